@@ -0,0 +1,374 @@
+#include "ArtifactDetector.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace ArtifactDetection {
+
+// Rate the blink detector works at; blinks carry almost nothing above 10 Hz
+static const double kBlinkRate = 64.0;
+
+QString typeName(ArtifactType type) {
+    switch (type) {
+    case ArtifactAmplitude: return "Amplitude";
+    case ArtifactClipping:  return "Clipping";
+    case ArtifactFlatline:  return "Flatline";
+    case ArtifactPop:       return "Pop";
+    case ArtifactMuscle:    return "Muscle";
+    case ArtifactBlink:     return "Blink";
+    default:                return "Unknown";
+    }
+}
+
+int ChannelArtifacts::count(ArtifactType type) const {
+    int n = 0;
+    for (const ArtifactInterval &interval : intervals) {
+        if (interval.type == type) ++n;
+    }
+    return n;
+}
+
+namespace {
+
+// Keeps the output compact: an interval that touches the previous one of the
+// same type extends it instead of being appended
+class IntervalCollector {
+public:
+    explicit IntervalCollector(qint64 gap) : m_gap(gap) { m_last.fill(-1); }
+
+    void add(qint64 start, qint64 end, ArtifactType type) {
+        int &last = m_last[type];
+        if (last >= 0 && start <= m_intervals[last].endSample + m_gap) {
+            m_intervals[last].endSample = std::max(m_intervals[last].endSample, end);
+            return;
+        }
+        last = m_intervals.size();
+        m_intervals.append({start, end, type});
+    }
+
+    QVector<ArtifactInterval> take() {
+        std::sort(m_intervals.begin(), m_intervals.end(),
+                  [](const ArtifactInterval &a, const ArtifactInterval &b) {
+                      return a.startSample != b.startSample ? a.startSample < b.startSample
+                                                            : a.type < b.type;
+                  });
+        return m_intervals;
+    }
+
+private:
+    qint64 m_gap;
+    std::array<int, ArtifactTypeCount> m_last;
+    QVector<ArtifactInterval> m_intervals;
+};
+
+// Transposed direct form II high-pass section
+struct Biquad {
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+    double z1 = 0.0, z2 = 0.0;
+
+    static Biquad highPass(double cutoff, double samplingRate, double q) {
+        double w0 = 2.0 * M_PI * cutoff / samplingRate;
+        double alpha = std::sin(w0) / (2.0 * q);
+        double cosw = std::cos(w0);
+        double a0 = 1.0 + alpha;
+        Biquad s;
+        s.b0 = (1.0 + cosw) / 2.0 / a0;
+        s.b1 = -(1.0 + cosw) / a0;
+        s.b2 = s.b0;
+        s.a1 = -2.0 * cosw / a0;
+        s.a2 = (1.0 - alpha) / a0;
+        return s;
+    }
+
+    inline double process(double x) {
+        double y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        return y;
+    }
+};
+
+bool isBlinkChannel(const QString &label, const QStringList &names) {
+    for (const QString &name : names) {
+        if (label.contains(name, Qt::CaseInsensitive)) return true;
+    }
+    return false;
+}
+
+// Normalized correlation of the decimated signal with a Hann-shaped bump
+void detectBlinks(const QVector<double> &y, int decimation, double rate,
+                  const DetectorParams &params, IntervalCollector &collector) {
+    int length = std::max(3, static_cast<int>(std::lround(params.blinkDuration * rate)));
+    int count = y.size();
+    if (count < length) return;
+
+    // Zero-mean, unit-norm template, so the dot product over the window's
+    // own norm is the Pearson correlation
+    QVector<double> shape(length);
+    double shapeMean = 0.0;
+    for (int j = 0; j < length; ++j) {
+        shape[j] = 0.5 * (1.0 - std::cos(2.0 * M_PI * (j + 0.5) / length));
+        shapeMean += shape[j];
+    }
+    shapeMean /= length;
+    double shapeNorm = 0.0;
+    for (int j = 0; j < length; ++j) {
+        shape[j] -= shapeMean;
+        shapeNorm += shape[j] * shape[j];
+    }
+    shapeNorm = std::sqrt(shapeNorm);
+    for (int j = 0; j < length; ++j) shape[j] /= shapeNorm;
+
+    const double *x = y.constData();
+    double shift = x[0];
+    double sum = 0.0;
+    double sumSquares = 0.0;
+    for (int j = 0; j < length; ++j) {
+        double v = x[j] - shift;
+        sum += v;
+        sumSquares += v * v;
+    }
+
+    for (int k = 0; k + length <= count; ++k) {
+        if (k > 0) {
+            double leaving = x[k - 1] - shift;
+            double entering = x[k + length - 1] - shift;
+            sum += entering - leaving;
+            sumSquares += entering * entering - leaving * leaving;
+        }
+
+        double variance = sumSquares - sum * sum / length;
+        if (variance <= 0.0) continue;
+
+        double amplitude = x[k + length / 2] - 0.5 * (x[k] + x[k + length - 1]);
+        if (amplitude < params.blinkMinAmplitude) continue;
+
+        double dot = 0.0;
+        for (int j = 0; j < length; ++j) dot += x[k + j] * shape[j];
+        if (dot / std::sqrt(variance) >= params.blinkCorrelation) {
+            collector.add(static_cast<qint64>(k) * decimation,
+                          static_cast<qint64>(k + length) * decimation, ArtifactBlink);
+        }
+    }
+}
+
+ChannelArtifacts screenChannel(const EEGChannel &channel, int channelIndex,
+                               const DetectorParams &params) {
+    ChannelArtifacts result;
+    result.channel = channelIndex;
+    result.samplingRate = channel.samplingRate;
+
+    const double fs = channel.samplingRate;
+    const double *x = channel.data.constData();
+    const qint64 n = channel.data.size();
+    if (n < 2 || fs <= 0) return result;
+
+    IntervalCollector collector(static_cast<qint64>(params.mergeGapSeconds * fs));
+    const int window = std::max(2, static_cast<int>(std::lround(params.windowSeconds * fs)));
+    const int flatWindow = std::max(2, static_cast<int>(std::lround(params.flatlineSeconds * fs)));
+
+    // Windows holding non-finite samples take the slow, per-sample path
+    const ValidityMask &mask = channel.validity;
+    bool checkMask = mask.size() != n || !mask.allValid();
+    double firstValid = 0.0;
+    double observedMin = 0.0;
+    double observedMax = 0.0;
+    bool anyValid = false;
+    for (qint64 i = 0; i < n; ++i) {
+        if (!std::isfinite(x[i])) continue;
+        if (!anyValid) firstValid = observedMin = observedMax = x[i];
+        anyValid = true;
+        observedMin = std::min(observedMin, x[i]);
+        observedMax = std::max(observedMax, x[i]);
+    }
+    if (!anyValid) return result;
+
+    // Clipping limits; a physical range the data does not fit in is not the
+    // real one, so the observed extremes stand in for the rails
+    double railLow = channel.physicalMin;
+    double railHigh = channel.physicalMax;
+    if (railHigh <= railLow || observedMin < railLow || observedMax > railHigh) {
+        railLow = observedMin;
+        railHigh = observedMax;
+    }
+    double range = railHigh - railLow;
+    bool clipping = params.detectClipping && range > 0.0;
+    double clipHigh = railHigh - params.clippingTolerance * range;
+    double clipLow = railLow + params.clippingTolerance * range;
+    qint64 clipRunStart = -1;
+
+    // 4th-order Butterworth high-pass for muscle power, as two sections
+    bool muscle = params.detectMuscle && params.muscleCutoff < 0.45 * fs;
+    Biquad hp1 = Biquad::highPass(params.muscleCutoff, fs, 0.5412);
+    Biquad hp2 = Biquad::highPass(params.muscleCutoff, fs, 1.3066);
+    double muscleLimit = params.muscleRmsThreshold * params.muscleRmsThreshold;
+
+    // Flatline windows run on their own length
+    double flatShift = firstValid;
+    double flatSum = 0.0;
+    double flatSquares = 0.0;
+    int flatCount = 0;
+    qint64 flatStart = 0;
+
+    // Blink detector input, block-averaged down to about kBlinkRate
+    bool blinks = params.detectBlinks && isBlinkChannel(channel.label, params.blinkChannels);
+    int decimation = std::max(1, static_cast<int>(fs / kBlinkRate));
+    QVector<double> decimated;
+    double heldValue = firstValid;
+    double decimationSum = 0.0;
+    int decimationCount = 0;
+    if (blinks) decimated.reserve(static_cast<int>(n / decimation) + 1);
+
+    // Last valid sample, carried across windows and gaps for the pop test
+    double prev = firstValid;
+
+    for (qint64 start = 0; start < n; start += window) {
+        const int len = static_cast<int>(std::min<qint64>(window, n - start));
+        const double *w = x + start;
+        bool windowValid = !checkMask || mask.rangeValid(start, len);
+
+        if (params.detectAmplitude) {
+            double lo = std::numeric_limits<double>::infinity();
+            double hi = -std::numeric_limits<double>::infinity();
+            for (int i = 0; i < len; ++i) {
+                if (!windowValid && !std::isfinite(w[i])) continue;
+                lo = std::min(lo, w[i]);
+                hi = std::max(hi, w[i]);
+            }
+            if (hi > lo && hi - lo > params.amplitudeThreshold) {
+                collector.add(start, start + len, ArtifactAmplitude);
+            }
+        }
+
+        if (params.detectPops) {
+            for (int i = 0; i < len; ++i) {
+                if (std::abs(w[i] - prev) > params.popThreshold) {
+                    qint64 at = start + i;
+                    collector.add(std::max<qint64>(0, at - 1), std::min(n, at + 1), ArtifactPop);
+                }
+                if (windowValid || std::isfinite(w[i])) prev = w[i];
+            }
+        }
+
+        if (clipping) {
+            for (int i = 0; i < len; ++i) {
+                bool atLimit = w[i] >= clipHigh || w[i] <= clipLow;
+                if (atLimit && clipRunStart < 0) {
+                    clipRunStart = start + i;
+                } else if (!atLimit && clipRunStart >= 0) {
+                    if (start + i - clipRunStart >= params.clippingMinSamples) {
+                        collector.add(clipRunStart, start + i, ArtifactClipping);
+                    }
+                    clipRunStart = -1;
+                }
+            }
+        }
+
+        if (muscle) {
+            // Invalid samples never reach the filters, whose state would stay NaN
+            double power = 0.0;
+            int used = 0;
+            for (int i = 0; i < len; ++i) {
+                if (!windowValid && !std::isfinite(w[i])) continue;
+                double y = hp2.process(hp1.process(w[i]));
+                power += y * y;
+                ++used;
+            }
+            // Skip the first window, the filter is still settling
+            if (start > 0 && used > 0 && power / used > muscleLimit) {
+                collector.add(start, start + len, ArtifactMuscle);
+            }
+        }
+
+        if (params.detectFlatline) {
+            for (int i = 0; i < len; ++i) {
+                if (!windowValid && !std::isfinite(w[i])) continue;
+                double v = w[i] - flatShift;
+                flatSum += v;
+                flatSquares += v * v;
+                if (++flatCount == flatWindow) {
+                    double variance = (flatSquares - flatSum * flatSum / flatCount) / flatCount;
+                    if (variance < params.flatlineVariance) {
+                        collector.add(flatStart, start + i + 1, ArtifactFlatline);
+                    }
+                    // Skipped samples leave gaps, so positions come from the index
+                    flatStart = start + i + 1;
+                    flatShift = w[i];
+                    flatSum = flatSquares = 0.0;
+                    flatCount = 0;
+                }
+            }
+        }
+
+        if (blinks) {
+            // Gaps hold the last valid value so the sliding sums stay finite
+            for (int i = 0; i < len; ++i) {
+                if (windowValid || std::isfinite(w[i])) heldValue = w[i];
+                decimationSum += heldValue;
+                if (++decimationCount == decimation) {
+                    decimated.append(decimationSum / decimation);
+                    decimationSum = 0.0;
+                    decimationCount = 0;
+                }
+            }
+        }
+    }
+
+    // Close runs still open at the end of the recording
+    if (clipping && clipRunStart >= 0 && n - clipRunStart >= params.clippingMinSamples) {
+        collector.add(clipRunStart, n, ArtifactClipping);
+    }
+    if (params.detectFlatline && flatCount >= flatWindow / 2) {
+        double variance = (flatSquares - flatSum * flatSum / flatCount) / flatCount;
+        if (variance < params.flatlineVariance) {
+            collector.add(flatStart, n, ArtifactFlatline);
+        }
+    }
+
+    if (blinks) {
+        detectBlinks(decimated, decimation, fs / decimation, params, collector);
+    }
+
+    result.intervals = collector.take();
+    return result;
+}
+
+}
+
+QVector<ChannelArtifacts> detect(const EEGData &data, const QVector<int> &channels,
+                                 const DetectorParams &params) {
+    QVector<ChannelArtifacts> results;
+    QVector<const EEGChannel*> sources;
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Artifact detection: Invalid channel index" << ch;
+            return results;
+        }
+        sources.append(&data.channel(ch));
+    }
+
+    results.resize(channels.size());
+    ChannelArtifacts *out = results.data();
+    Parallel::parallelFor(0, channels.size(), [&](int c) {
+        out[c] = screenChannel(*sources[c], channels[c], params);
+    });
+    return results;
+}
+
+IntervalSet toIntervalSet(const QVector<ChannelArtifacts> &artifacts, double padSeconds) {
+    IntervalSet result;
+    for (const ChannelArtifacts &channel : artifacts) {
+        if (channel.samplingRate <= 0) continue;
+        IntervalSet marked;
+        for (int i = 0; i < channel.intervals.size(); ++i) {
+            marked.add(std::max(0.0, channel.startTime(i) - padSeconds), channel.endTime(i) + padSeconds);
+        }
+        result = result.united(marked);
+    }
+    return result;
+}
+
+}
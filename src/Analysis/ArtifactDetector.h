@@ -0,0 +1,78 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include "../DataModels/EEGData.h"
+#include "../DataModels/IntervalSet.h"
+
+namespace ArtifactDetection {
+
+enum ArtifactType {
+    ArtifactAmplitude,   // peak-to-peak above threshold
+    ArtifactClipping,    // samples stuck at the physical range limits
+    ArtifactFlatline,    // variance too low, disconnected electrode
+    ArtifactPop,         // sudden sample-to-sample step
+    ArtifactMuscle,      // high-frequency (EMG) power
+    ArtifactBlink,       // blink-shaped deflection on frontal channels
+    ArtifactTypeCount
+};
+
+QString typeName(ArtifactType type);
+
+// Thresholds are in the channel's physical unit, normally uV
+struct DetectorParams {
+    double windowSeconds = 0.5;            // evaluation window for amplitude and muscle
+
+    bool detectAmplitude = true;
+    double amplitudeThreshold = 150.0;     // peak-to-peak
+
+    bool detectClipping = true;
+    double clippingTolerance = 0.001;      // fraction of the physical range
+    int clippingMinSamples = 3;            // consecutive samples at a limit
+
+    bool detectFlatline = true;
+    double flatlineSeconds = 1.0;
+    double flatlineVariance = 0.01;
+
+    bool detectPops = true;
+    double popThreshold = 80.0;            // |x[i] - x[i-1]|
+
+    bool detectMuscle = true;
+    double muscleCutoff = 30.0;            // Hz
+    double muscleRmsThreshold = 10.0;      // RMS above the cutoff
+
+    bool detectBlinks = true;
+    QStringList blinkChannels = {"Fp1", "Fp2", "AF7", "AF8", "AF3", "AF4"};
+    double blinkDuration = 0.3;            // template length in seconds
+    double blinkCorrelation = 0.8;         // minimum template correlation
+    double blinkMinAmplitude = 50.0;
+
+    double mergeGapSeconds = 0.1;          // joins same-type intervals closer than this
+};
+
+// [startSample, endSample)
+struct ArtifactInterval {
+    qint64 startSample;
+    qint64 endSample;
+    ArtifactType type;
+};
+
+struct ChannelArtifacts {
+    int channel = -1;
+    double samplingRate = 0.0;
+    QVector<ArtifactInterval> intervals;   // sorted by start
+
+    int count(ArtifactType type) const;
+    double startTime(int i) const { return intervals[i].startSample / samplingRate; }
+    double endTime(int i) const { return intervals[i].endSample / samplingRate; }
+};
+
+// One pass over each channel's samples evaluating every enabled detector,
+// channels screened in parallel
+QVector<ChannelArtifacts> detect(const EEGData &data, const QVector<int> &channels,
+                                 const DetectorParams &params = DetectorParams());
+
+// Union of every channel's intervals in seconds, each widened by padSeconds
+IntervalSet toIntervalSet(const QVector<ChannelArtifacts> &artifacts, double padSeconds = 0.0);
+
+}
@@ -0,0 +1,287 @@
+#include "BadChannels.h"
+#include "RobustStats.h"
+#include "Correlation.h"
+#include "SphericalSpline.h"
+#include "../Utils/Parallel.h"
+#include "../Utils/SignalProcessor.h"
+#include <iir/Butterworth.h>
+#include <QDebug>
+#include <QStringList>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+namespace BadChannels {
+
+QString reasonText(int reasons) {
+    QStringList names;
+    if (reasons & BadByNaN)         names << "NaN";
+    if (reasons & BadByFlat)        names << "Flat";
+    if (reasons & BadByDeviation)   names << "Deviation";
+    if (reasons & BadByNoise)       names << "HF noise";
+    if (reasons & BadByCorrelation) names << "Correlation";
+    if (reasons & BadByRansac)      names << "RANSAC";
+    return names.isEmpty() ? QString("Good") : names.join(", ");
+}
+
+namespace {
+
+// (value - median) / (1.4826 MAD) over the used entries, 0 for the rest
+QVector<double> robustZ(const QVector<double> &values, const QVector<bool> &used) {
+    QVector<double> pool;
+    for (int i = 0; i < values.size(); ++i) {
+        if (used[i]) pool.append(values[i]);
+    }
+
+    QVector<double> z(values.size(), 0.0);
+    if (pool.size() < 3) return z;
+    double center = RobustStats::median(pool.constData(), pool.size());
+    double scale = RobustStats::kMadToStdDev * RobustStats::mad(pool.constData(), pool.size());
+    if (scale <= 0.0) return z;
+
+    for (int i = 0; i < values.size(); ++i) {
+        if (used[i]) z[i] = (values[i] - center) / scale;
+    }
+    return z;
+}
+
+// Zero-phase (forward-backward) low-pass with the invalid samples bridged;
+// a copy when the cutoff is at or above Nyquist. The high band is taken as
+// x - low, so any phase delay here would leak low frequencies into it. Each
+// pass runs on the signal offset by its starting sample, which keeps the
+// filter from ringing on the step up from its zero state.
+QVector<double> lowPass(const EEGChannel &channel, double cutoff) {
+    QVector<double> low = channel.data;
+    SignalProcessor::bridgeInvalid(low.data(), low.size(), channel.validity);
+    if (cutoff >= channel.samplingRate / 2 || low.isEmpty()) return low;
+
+    Iir::Butterworth::LowPass<4> filter;
+    filter.setup(channel.samplingRate, cutoff);
+    double offset = low.first();
+    for (double &sample : low) sample = filter.filter(sample - offset) + offset;
+
+    filter.reset();
+    offset = low.last();
+    for (int s = low.size() - 1; s >= 0; --s) low[s] = filter.filter(low[s] - offset) + offset;
+    return low;
+}
+
+// Windows where every listed channel is valid
+QVector<int> cleanWindows(const EEGData &data, const QVector<int> &channels, int window, int numWindows) {
+    QVector<int> windows;
+    for (int w = 0; w < numWindows; ++w) {
+        bool clean = true;
+        for (int ch : channels) {
+            const ValidityMask &mask = data.channel(ch).validity;
+            if (mask.size() == data.channel(ch).data.size() && !mask.rangeValid(w * qint64(window), window)) {
+                clean = false;
+                break;
+            }
+        }
+        if (clean) windows.append(w);
+    }
+    return windows;
+}
+
+}
+
+QVector<ChannelReport> detect(const EEGData &data, const QVector<int> &channels, const DetectorParams &params) {
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Bad channels: Invalid channel index" << ch;
+            return QVector<ChannelReport>();
+        }
+    }
+    if (channels.isEmpty()) return QVector<ChannelReport>();
+
+    double rate = data.channel(channels[0]).samplingRate;
+    QVector<int> screened;
+    for (int ch : channels) {
+        if (data.channel(ch).samplingRate == rate) screened.append(ch);
+        else qWarning() << "Bad channels: Skipping" << data.channel(ch).label << "at a different sampling rate";
+    }
+
+    int numChannels = screened.size();
+    QVector<ChannelReport> reports(numChannels);
+    QVector<RobustStats::ChannelStats> stats = RobustStats::channelStats(data, screened);
+
+    // NaN and flat channels carry no information for the relative tests
+    QVector<bool> usable(numChannels, true);
+    int numSamples = INT_MAX;
+    for (int i = 0; i < numChannels; ++i) {
+        const EEGChannel &channel = data.channel(screened[i]);
+        reports[i].channel = screened[i];
+        qint64 n = channel.data.size();
+        if (n == 0 || n - stats[i].count > params.maxInvalidFraction * n) {
+            reports[i].reasons |= BadByNaN;
+        } else if (stats[i].mad < params.flatThreshold && stats[i].stdDev < params.flatThreshold) {
+            reports[i].reasons |= BadByFlat;
+        }
+        usable[i] = reports[i].reasons == 0;
+        numSamples = std::min(numSamples, channel.data.size());
+    }
+
+    // ================== DEVIATION AND NOISE ==================
+
+    QVector<double> spreads(numChannels);
+    for (int i = 0; i < numChannels; ++i) spreads[i] = stats[i].robustStdDev();
+
+    QVector<QVector<double>> low(numChannels);
+    QVector<double> noise(numChannels, 0.0);
+    bool testNoise = params.noiseCutoff < rate / 2;
+    Parallel::parallelFor(0, numChannels, [&](int i) {
+        if (!usable[i]) return;
+        const EEGChannel &channel = data.channel(screened[i]);
+        low[i] = lowPass(channel, params.noiseCutoff);
+        if (!testNoise) return;
+
+        QVector<double> high(channel.data.size());
+        for (int s = 0; s < high.size(); ++s) high[s] = channel.data[s] - low[i][s];
+        double lowMad = RobustStats::mad(low[i].constData(), low[i].size(), channel.validity);
+        double highMad = RobustStats::mad(high.constData(), high.size(), channel.validity);
+        noise[i] = lowMad > 0.0 ? highMad / lowMad : 0.0;
+    });
+
+    QVector<double> deviationZ = robustZ(spreads, usable);
+    QVector<double> noiseZ = robustZ(noise, usable);
+    for (int i = 0; i < numChannels; ++i) {
+        reports[i].deviationZ = deviationZ[i];
+        reports[i].noiseZ = noiseZ[i];
+        if (std::abs(deviationZ[i]) > params.deviationThreshold) reports[i].reasons |= BadByDeviation;
+        if (testNoise && noiseZ[i] > params.noiseThreshold) reports[i].reasons |= BadByNoise;
+    }
+
+    QVector<int> candidates;     // rows into screened
+    for (int i = 0; i < numChannels; ++i) {
+        if (usable[i]) candidates.append(i);
+    }
+    QVector<int> candidateChannels;
+    for (int i : candidates) candidateChannels.append(screened[i]);
+
+    // ================== CORRELATION ==================
+
+    int window = static_cast<int>(params.correlationWindow * rate);
+    if (candidates.size() >= 2 && window > 1 && numSamples >= window) {
+        QVector<int> windows = cleanWindows(data, candidateChannels, window, numSamples / window);
+        QVector<QVector<char>> uncorrelated(windows.size());
+
+        Parallel::parallelFor(0, windows.size(), [&](int k) {
+            qint64 start = windows[k] * qint64(window);
+            EEGMatrix block(candidates.size(), window);
+            for (int r = 0; r < candidates.size(); ++r) {
+                block.row(r) = Eigen::Map<const Eigen::RowVectorXd>(low[candidates[r]].constData() + start, window);
+            }
+            Eigen::MatrixXd corr = Correlation::correlationMatrix(block).cwiseAbs();
+            corr.diagonal().setZero();
+
+            uncorrelated[k].resize(candidates.size());
+            for (int r = 0; r < candidates.size(); ++r) {
+                uncorrelated[k][r] = corr.row(r).maxCoeff() < params.correlationThreshold;
+            }
+        });
+
+        for (int r = 0; r < candidates.size() && !windows.isEmpty(); ++r) {
+            int count = 0;
+            for (const QVector<char> &flags : uncorrelated) count += flags[r];
+            ChannelReport &report = reports[candidates[r]];
+            report.uncorrelatedFraction = static_cast<double>(count) / windows.size();
+            if (report.uncorrelatedFraction > params.correlationFraction) report.reasons |= BadByCorrelation;
+        }
+    }
+
+    // ================== RANSAC ==================
+
+    const ElectrodeLayout &layout = data.electrodeLayout();
+    QVector<int> targets;        // rows into screened, positioned candidates
+    std::vector<Eigen::Vector3d> targetPositions;
+    QVector<int> good;           // indices into targets, not flagged so far
+    for (int i : candidates) {
+        const QString &label = data.channel(screened[i]).label;
+        if (!layout.contains(label)) continue;
+        if (reports[i].reasons == 0) good.append(targets.size());
+        targets.append(i);
+        targetPositions.push_back(layout.position(label));
+    }
+
+    int subsetSize = static_cast<int>(std::ceil(params.ransacSubset * good.size()));
+    window = static_cast<int>(params.ransacWindow * rate);
+    if (params.ransac && subsetSize >= 4 && params.ransacSamples > 0 && window > 1 && numSamples >= window) {
+        // Subsets and their spline weights, predicting every target
+        std::mt19937 random(params.seed);
+        QVector<QVector<int>> subsets(params.ransacSamples);
+        std::vector<Eigen::MatrixXd> weights(params.ransacSamples);
+        for (int d = 0; d < params.ransacSamples; ++d) {
+            QVector<int> pool = good;
+            std::shuffle(pool.begin(), pool.end(), random);
+            subsets[d] = pool.mid(0, subsetSize);
+        }
+        Parallel::parallelFor(0, params.ransacSamples, [&](int d) {
+            std::vector<Eigen::Vector3d> sources;
+            for (int t : subsets[d]) sources.push_back(targetPositions[t]);
+            weights[d] = SphericalSpline::interpolationMatrix(sources, targetPositions);
+        });
+
+        QVector<int> targetChannels;
+        for (int t : targets) targetChannels.append(screened[t]);
+        QVector<int> windows = cleanWindows(data, targetChannels, window, numSamples / window);
+        QVector<QVector<char>> unpredictable(windows.size());
+
+        // Per target the median of the predictions from subsets without it
+        Parallel::parallelFor(0, windows.size(), [&](int k) {
+            qint64 start = windows[k] * qint64(window);
+            EEGMatrix block(targets.size(), window);
+            for (int r = 0; r < targets.size(); ++r) {
+                block.row(r) = Eigen::Map<const Eigen::RowVectorXd>(low[targets[r]].constData() + start, window);
+            }
+
+            EEGMatrix predictions(params.ransacSamples, window);
+            std::vector<double> column(params.ransacSamples);
+            Eigen::RowVectorXd median(window);
+            unpredictable[k].resize(targets.size());
+            for (int t = 0; t < targets.size(); ++t) {
+                int used = 0;
+                for (int d = 0; d < params.ransacSamples; ++d) {
+                    if (subsets[d].contains(t)) continue;
+                    auto p = predictions.row(used++);
+                    p.setZero();
+                    for (int j = 0; j < subsets[d].size(); ++j) p += weights[d](t, j) * block.row(subsets[d][j]);
+                }
+                if (used == 0) continue;
+
+                for (int s = 0; s < window; ++s) {
+                    for (int d = 0; d < used; ++d) column[d] = predictions(d, s);
+                    std::nth_element(column.begin(), column.begin() + used / 2, column.begin() + used);
+                    median[s] = column[used / 2];
+                }
+
+                EEGMatrix pair(2, window);
+                pair.row(0) = block.row(t);
+                pair.row(1) = median;
+                unpredictable[k][t] = Correlation::correlationMatrix(pair)(0, 1) < params.ransacCorrelation;
+            }
+        });
+
+        for (int t = 0; t < targets.size() && !windows.isEmpty(); ++t) {
+            int count = 0;
+            for (const QVector<char> &flags : unpredictable) count += flags[t];
+            ChannelReport &report = reports[targets[t]];
+            report.unpredictableFraction = static_cast<double>(count) / windows.size();
+            if (report.unpredictableFraction > params.ransacFraction) report.reasons |= BadByRansac;
+        }
+    } else if (params.ransac && !targets.isEmpty()) {
+        qWarning() << "Bad channels: Too few positioned good channels for RANSAC";
+    }
+
+    return reports;
+}
+
+QVector<int> badChannels(const QVector<ChannelReport> &reports) {
+    QVector<int> bad;
+    for (const ChannelReport &report : reports) {
+        if (report.isBad()) bad.append(report.channel);
+    }
+    return bad;
+}
+
+}
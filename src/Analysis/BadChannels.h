@@ -0,0 +1,61 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include "../DataModels/EEGData.h"
+
+namespace BadChannels {
+
+// Bit flags, a channel can be bad for several reasons
+enum BadReason {
+    BadByNaN         = 1 << 0,   // mostly non-finite samples
+    BadByFlat        = 1 << 1,   // no spread at all
+    BadByDeviation   = 1 << 2,   // robust amplitude far from the other channels
+    BadByNoise       = 1 << 3,   // high-frequency noise far above the other channels
+    BadByCorrelation = 1 << 4,   // unlike every other channel in too many windows
+    BadByRansac      = 1 << 5    // not predictable from random subsets of the others
+};
+
+QString reasonText(int reasons);
+
+// Modeled on the PREP pipeline (Bigdely-Shamlo et al. 2015)
+struct DetectorParams {
+    double maxInvalidFraction = 0.5;
+    double flatThreshold = 1e-6;            // MAD and SD below this, physical unit
+
+    double deviationThreshold = 5.0;        // robust z of the robust SD
+    double noiseCutoff = 50.0;              // Hz, low/high band split
+    double noiseThreshold = 5.0;            // robust z of the high/low band MAD ratio
+
+    double correlationWindow = 1.0;         // seconds
+    double correlationThreshold = 0.4;      // largest |r| with any other channel
+    double correlationFraction = 0.01;      // bad above this fraction of windows
+
+    bool ransac = true;                     // needs electrode positions
+    int ransacSamples = 50;                 // random subsets
+    double ransacSubset = 0.25;             // fraction of the good channels per subset
+    double ransacWindow = 5.0;              // seconds
+    double ransacCorrelation = 0.75;        // predicted vs actual
+    double ransacFraction = 0.4;            // bad above this fraction of windows
+    unsigned int seed = 435656;             // subsets are reproducible
+};
+
+struct ChannelReport {
+    int channel = -1;
+    int reasons = 0;
+    double deviationZ = 0.0;
+    double noiseZ = 0.0;
+    double uncorrelatedFraction = 0.0;      // of the correlation windows
+    double unpredictableFraction = 0.0;     // of the RANSAC windows
+
+    bool isBad() const { return reasons != 0; }
+};
+
+// Channels sharing the first channel's sampling rate are screened; per
+// channel statistics run channels in parallel, correlation and RANSAC
+// windows in parallel
+QVector<ChannelReport> detect(const EEGData &data, const QVector<int> &channels,
+                              const DetectorParams &params = DetectorParams());
+
+QVector<int> badChannels(const QVector<ChannelReport> &reports);
+
+}
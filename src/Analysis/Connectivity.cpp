@@ -0,0 +1,210 @@
+#include "Connectivity.h"
+#include "../DataModels/EEGData.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <fftw3.h>
+#include <cmath>
+#include <algorithm>
+
+namespace Connectivity {
+
+int CrossSpectra::binForFrequency(double hz) const {
+    if (frequencies.isEmpty()) return -1;
+    auto it = std::lower_bound(frequencies.begin(), frequencies.end(), hz);
+    if (it == frequencies.end()) return frequencies.size() - 1;
+    int index = it - frequencies.begin();
+    if (index > 0 && hz - frequencies[index - 1] < *it - hz) --index;
+    return index;
+}
+
+CrossSpectra computeCrossSpectra(const EEGData &data, const QVector<int> &channels,
+                                 const CSDParams &params) {
+    CrossSpectra result;
+    if (channels.isEmpty()) {
+        qWarning() << "CSD: No channels selected";
+        return result;
+    }
+
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "CSD: Invalid channel index" << ch;
+            return result;
+        }
+    }
+
+    int segmentLength = params.segmentLength;
+    double samplingRate = data.channel(channels[0]).samplingRate;
+    int numSamples = data.channel(channels[0]).sampleCount();
+
+    for (int ch : channels) {
+        if (data.channel(ch).samplingRate != samplingRate) {
+            qWarning() << "CSD: Channels must share one sampling rate";
+            return result;
+        }
+        numSamples = std::min(numSamples, data.channel(ch).sampleCount());
+    }
+
+    if (segmentLength < 8 || numSamples < segmentLength || samplingRate <= 0) {
+        qWarning() << "CSD: Not enough data for segment length" << segmentLength;
+        return result;
+    }
+
+    int hop = std::max(1, static_cast<int>(segmentLength * (1.0 - params.overlap)));
+    int numSegments = (numSamples - segmentLength) / hop + 1;
+    int numChannels = channels.size();
+
+    // Frequency bins to keep
+    double binWidth = samplingRate / segmentLength;
+    double maxFrequency = params.maxFrequency > 0 ? params.maxFrequency : samplingRate / 2.0;
+    int firstBin = std::max(0, static_cast<int>(std::ceil(params.minFrequency / binWidth)));
+    int lastBin = std::min(segmentLength / 2, static_cast<int>(std::floor(maxFrequency / binWidth)));
+    if (lastBin < firstBin) {
+        qWarning() << "CSD: Empty frequency range";
+        return result;
+    }
+    int numBins = lastBin - firstBin + 1;
+
+    // Hann window
+    QVector<double> window(segmentLength);
+    double windowPower = 0.0;
+    for (int i = 0; i < segmentLength; ++i) {
+        window[i] = 0.5 * (1.0 - std::cos(2.0 * M_PI * i / (segmentLength - 1)));
+        windowPower += window[i] * window[i];
+    }
+
+    // Plan once on this thread; workers execute it on their own buffers
+    double *planIn = fftw_alloc_real(segmentLength);
+    fftw_complex *planOut = fftw_alloc_complex(segmentLength / 2 + 1);
+    fftw_plan plan = fftw_plan_dft_r2c_1d(segmentLength, planIn, planOut, FFTW_ESTIMATE);
+
+    QVector<const double*> channelData(numChannels);
+    for (int c = 0; c < numChannels; ++c) {
+        channelData[c] = data.channel(channels[c]).data.constData();
+    }
+
+    int batchSize = std::max(1, std::min(params.segmentBatch, numSegments));
+    QVector<Eigen::MatrixXcd> spectra(numBins);
+    for (int b = 0; b < numBins; ++b) {
+        spectra[b].resize(numChannels, batchSize);
+    }
+
+    result.csd.resize(numBins);
+    if (params.computePLV) result.phase.resize(numBins);
+    for (int b = 0; b < numBins; ++b) {
+        result.csd[b] = Eigen::MatrixXcd::Zero(numChannels, numChannels);
+        if (params.computePLV) result.phase[b] = Eigen::MatrixXcd::Zero(numChannels, numChannels);
+    }
+
+    // Raw pointers so worker threads never touch QVector's shared-data bookkeeping
+    Eigen::MatrixXcd *binSpectra = spectra.data();
+    Eigen::MatrixXcd *csd = result.csd.data();
+    Eigen::MatrixXcd *phase = params.computePLV ? result.phase.data() : nullptr;
+
+    for (int batchStart = 0; batchStart < numSegments; batchStart += batchSize) {
+        int batchCount = std::min(batchSize, numSegments - batchStart);
+
+        // Windowed FFT of every segment in the batch, one channel per task
+        Parallel::parallelFor(0, numChannels, [&](int c) {
+            double *in = fftw_alloc_real(segmentLength);
+            fftw_complex *out = fftw_alloc_complex(segmentLength / 2 + 1);
+            const double *x = channelData[c];
+
+            for (int s = 0; s < batchCount; ++s) {
+                const double *segment = x + static_cast<qint64>(batchStart + s) * hop;
+                double segmentMean = 0.0;
+                for (int i = 0; i < segmentLength; ++i) segmentMean += segment[i];
+                segmentMean /= segmentLength;
+                for (int i = 0; i < segmentLength; ++i) {
+                    in[i] = (segment[i] - segmentMean) * window[i];
+                }
+
+                fftw_execute_dft_r2c(plan, in, out);
+
+                for (int b = 0; b < numBins; ++b) {
+                    binSpectra[b](c, s) = std::complex<double>(out[firstBin + b][0], out[firstBin + b][1]);
+                }
+            }
+
+            fftw_free(in);
+            fftw_free(out);
+        });
+
+        // Accumulate every channel pair of each bin as one product
+        Parallel::parallelFor(0, numBins, [&](int b) {
+            auto X = binSpectra[b].leftCols(batchCount);
+            csd[b].noalias() += X * X.adjoint();
+
+            if (params.computePLV) {
+                Eigen::MatrixXcd unit = X;
+                for (Eigen::Index i = 0; i < unit.size(); ++i) {
+                    double magnitude = std::abs(unit(i));
+                    unit(i) = magnitude > 0.0 ? unit(i) / magnitude : std::complex<double>(0.0, 0.0);
+                }
+                phase[b].noalias() += unit * unit.adjoint();
+            }
+        });
+    }
+
+    fftw_destroy_plan(plan);
+    fftw_free(planIn);
+    fftw_free(planOut);
+
+    // One-sided density scaling
+    for (int b = 0; b < numBins; ++b) {
+        int bin = firstBin + b;
+        bool isEdge = (bin == 0) || (segmentLength % 2 == 0 && bin == segmentLength / 2);
+        double scale = (isEdge ? 1.0 : 2.0) / (numSegments * windowPower * samplingRate);
+        result.csd[b] *= scale;
+        if (params.computePLV) result.phase[b] /= static_cast<double>(numSegments);
+        result.frequencies.append(bin * binWidth);
+    }
+
+    result.channels = channels;
+    result.samplingRate = samplingRate;
+    result.segmentCount = numSegments;
+    return result;
+}
+
+Eigen::MatrixXd connectivity(const CrossSpectra &spectra, Measure measure, int bin) {
+    if (bin < 0 || bin >= spectra.binCount()) return Eigen::MatrixXd();
+
+    if (measure == MeasurePLV) {
+        if (spectra.phase.isEmpty()) {
+            qWarning() << "PLV was not computed for these spectra";
+            return Eigen::MatrixXd();
+        }
+        return spectra.phase[bin].cwiseAbs();
+    }
+
+    const Eigen::MatrixXcd &S = spectra.csd[bin];
+    Eigen::ArrayXd power = S.diagonal().real().array();
+    Eigen::ArrayXd invNorm = (power > 0.0).select(power.rsqrt(), 0.0);
+    Eigen::MatrixXd norm = (invNorm.matrix() * invNorm.matrix().transpose());
+
+    if (measure == MeasureImaginaryCoherence) {
+        return S.imag().cwiseProduct(norm);
+    }
+    return S.cwiseAbs2().cwiseProduct(norm.cwiseAbs2());
+}
+
+Eigen::MatrixXd bandConnectivity(const CrossSpectra &spectra, Measure measure,
+                                 double lowHz, double highHz) {
+    Eigen::MatrixXd sum;
+    int count = 0;
+    for (int b = 0; b < spectra.binCount(); ++b) {
+        double f = spectra.frequencies[b];
+        if (f < lowHz || f > highHz) continue;
+        Eigen::MatrixXd m = connectivity(spectra, measure, b);
+        if (m.size() == 0) return m;
+        if (count == 0) sum = m;
+        else sum += m;
+        ++count;
+    }
+    if (count == 0) {
+        qWarning() << "No frequency bins in band" << lowHz << "-" << highHz << "Hz";
+        return Eigen::MatrixXd();
+    }
+    return sum / count;
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+
+class EEGData;
+
+namespace Connectivity {
+
+enum Measure {
+    MeasureCoherence,           // magnitude-squared coherence
+    MeasureImaginaryCoherence,  // Im(S_ij) / sqrt(S_ii * S_jj)
+    MeasurePLV                  // phase locking value across segments
+};
+
+struct CSDParams {
+    int segmentLength = 512;      // samples per FFT segment
+    double overlap = 0.5;         // fraction shared with the next segment
+    double minFrequency = 0.0;    // Hz
+    double maxFrequency = -1.0;   // Hz, <= 0 means Nyquist
+    int segmentBatch = 128;       // segments transformed per pass, bounds memory
+    bool computePLV = true;
+};
+
+// Welch-averaged cross-spectral density matrices, one per frequency bin.
+struct CrossSpectra {
+    QVector<int> channels;               // EEGData channel index of each row
+    QVector<double> frequencies;         // Hz, one per bin
+    QVector<Eigen::MatrixXcd> csd;       // channels x channels, per bin
+    QVector<Eigen::MatrixXcd> phase;     // mean unit-phasor products, per bin (PLV)
+    double samplingRate = 0.0;
+    int segmentCount = 0;
+
+    bool isEmpty() const { return csd.isEmpty(); }
+    int binCount() const { return csd.size(); }
+    int binForFrequency(double hz) const;
+};
+
+// Transforms every channel's segments once, then forms each bin's full matrix
+// as a single complex product. Channels must share one sampling rate.
+CrossSpectra computeCrossSpectra(const EEGData &data, const QVector<int> &channels,
+                                 const CSDParams &params = CSDParams());
+
+Eigen::MatrixXd connectivity(const CrossSpectra &spectra, Measure measure, int bin);
+Eigen::MatrixXd bandConnectivity(const CrossSpectra &spectra, Measure measure,
+                                 double lowHz, double highHz);
+
+inline Eigen::MatrixXd coherence(const CrossSpectra &spectra, int bin) {
+    return connectivity(spectra, MeasureCoherence, bin);
+}
+
+inline Eigen::MatrixXd imaginaryCoherence(const CrossSpectra &spectra, int bin) {
+    return connectivity(spectra, MeasureImaginaryCoherence, bin);
+}
+
+inline Eigen::MatrixXd phaseLockingValue(const CrossSpectra &spectra, int bin) {
+    return connectivity(spectra, MeasurePLV, bin);
+}
+
+}
@@ -0,0 +1,214 @@
+#include "Correlation.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <climits>
+
+namespace Correlation {
+
+// Samples per streamed block
+static const int kBlockSamples = 16384;
+
+// Exact recomputation interval for the sliding window, bounds rounding drift
+static const int kRefreshSteps = 512;
+
+void CovarianceAccumulator::reset(const Eigen::VectorXd &offset) {
+    m_offset = offset;
+    m_sum = Eigen::VectorXd::Zero(offset.size());
+    m_cross = Eigen::MatrixXd::Zero(offset.size(), offset.size());
+    m_count = 0.0;
+}
+
+void CovarianceAccumulator::add(const EEGMatrix &block, double weight) {
+    if (block.cols() == 0) return;
+    EEGMatrix shifted = block.colwise() - m_offset;
+    m_sum += weight * shifted.rowwise().sum();
+    m_cross.selfadjointView<Eigen::Lower>().rankUpdate(shifted, weight);
+    m_count += weight * block.cols();
+}
+
+void CovarianceAccumulator::merge(const CovarianceAccumulator &other) {
+    if (other.m_count == 0.0) return;
+    if (m_count == 0.0 && m_sum.size() == 0) {
+        *this = other;
+        return;
+    }
+    // Bring the other sums onto this accumulator's offset
+    Eigen::VectorXd delta = other.m_offset - m_offset;
+    Eigen::MatrixXd cross = other.m_cross.selfadjointView<Eigen::Lower>();
+    cross += other.m_sum * delta.transpose() + delta * other.m_sum.transpose()
+           + other.m_count * delta * delta.transpose();
+    m_cross.triangularView<Eigen::Lower>() += cross;
+    m_sum += other.m_sum + other.m_count * delta;
+    m_count += other.m_count;
+}
+
+Eigen::VectorXd CovarianceAccumulator::mean() const {
+    if (m_count <= 0.0) return m_offset;
+    return m_offset + m_sum / m_count;
+}
+
+Eigen::MatrixXd CovarianceAccumulator::covariance() const {
+    if (m_count <= 0.0) return Eigen::MatrixXd::Zero(m_offset.size(), m_offset.size());
+    Eigen::VectorXd shiftedMean = m_sum / m_count;
+    Eigen::MatrixXd cov = m_cross.selfadjointView<Eigen::Lower>();
+    cov /= m_count;
+    cov -= shiftedMean * shiftedMean.transpose();
+    return cov;
+}
+
+Eigen::MatrixXd CovarianceAccumulator::correlation() const {
+    Eigen::MatrixXd cov = covariance();
+    Eigen::ArrayXd variance = cov.diagonal().array();
+    Eigen::VectorXd invStd = (variance > 0.0).select(variance.rsqrt(), 0.0).matrix();
+    Eigen::MatrixXd corr = invStd.asDiagonal() * cov * invStd.asDiagonal();
+    corr.diagonal() = (variance > 0.0).select(Eigen::ArrayXd::Ones(variance.size()), 0.0);
+    return corr;
+}
+
+Eigen::MatrixXd correlationMatrix(const EEGMatrix &block) {
+    if (block.rows() == 0 || block.cols() < 2) return Eigen::MatrixXd();
+
+    // Center and scale each channel to unit norm once
+    EEGMatrix z = block.colwise() - block.rowwise().mean();
+    Eigen::VectorXd norms = z.rowwise().norm();
+    for (Eigen::Index r = 0; r < z.rows(); ++r) {
+        if (norms[r] > 0.0) z.row(r) /= norms[r];
+    }
+
+    Eigen::MatrixXd corr = Eigen::MatrixXd::Zero(z.rows(), z.rows());
+    corr.selfadjointView<Eigen::Lower>().rankUpdate(z);
+    return corr.selfadjointView<Eigen::Lower>();
+}
+
+// Clamps the requested range to what every channel has; -1 on invalid channels
+static int availableSamples(const EEGData &data, const QVector<int> &channels,
+                            int startSample, int numSamples) {
+    int available = INT_MAX;
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Correlation: Invalid channel index" << ch;
+            return -1;
+        }
+        available = std::min(available, data.channel(ch).sampleCount() - startSample);
+    }
+    if (numSamples < 0 || numSamples > available) numSamples = available;
+    return numSamples;
+}
+
+CovarianceAccumulator accumulateCovariance(const EEGData &data, const QVector<int> &channels,
+                                           int startSample, int numSamples) {
+    if (channels.isEmpty() || startSample < 0) return CovarianceAccumulator();
+    numSamples = availableSamples(data, channels, startSample, numSamples);
+    if (numSamples <= 0) return CovarianceAccumulator();
+
+    // Shift by an early-data mean so long sums stay well conditioned
+    int headSamples = std::min(numSamples, kBlockSamples);
+    Eigen::VectorXd offset = data.toMatrix(channels, startSample, headSamples).rowwise().mean();
+
+    int parts = std::max(1, std::min(Parallel::threadCount(), numSamples / kBlockSamples));
+    QVector<CovarianceAccumulator> partials(parts);
+    CovarianceAccumulator *partial = partials.data();
+
+    Parallel::parallelFor(0, parts, [&](int p) {
+        qint64 begin = static_cast<qint64>(numSamples) * p / parts;
+        qint64 end = static_cast<qint64>(numSamples) * (p + 1) / parts;
+        partial[p].reset(offset);
+        for (qint64 s = begin; s < end; s += kBlockSamples) {
+            int count = static_cast<int>(std::min<qint64>(kBlockSamples, end - s));
+            partial[p].add(data.toMatrix(channels, startSample + static_cast<int>(s), count));
+        }
+    });
+
+    for (int p = 1; p < parts; ++p) partials[0].merge(partials[p]);
+    return partials[0];
+}
+
+Eigen::MatrixXd correlationMatrix(const EEGData &data, const QVector<int> &channels,
+                                  int startSample, int numSamples) {
+    if (channels.isEmpty()) return Eigen::MatrixXd();
+
+    numSamples = availableSamples(data, channels, startSample, numSamples);
+    if (numSamples < 2) {
+        if (numSamples >= 0) qWarning() << "Correlation: Not enough samples";
+        return Eigen::MatrixXd();
+    }
+
+    if (numSamples <= kBlockSamples) {
+        return correlationMatrix(data.toMatrix(channels, startSample, numSamples));
+    }
+    return accumulateCovariance(data, channels, startSample, numSamples).correlation();
+}
+
+SlidingCorrelation::SlidingCorrelation(const EEGData &data, const QVector<int> &channels,
+                                       int windowSamples, int hopSamples,
+                                       int startSample, int numSamples)
+    : m_data(data),
+      m_channels(channels),
+      m_window(windowSamples),
+      m_hop(std::max(1, hopSamples)),
+      m_start(std::max(0, startSample)),
+      m_end(0),
+      m_stepsSinceRefresh(0),
+      m_samplingRate(0.0),
+      m_started(false) {
+
+    if (channels.isEmpty()) return;
+
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Sliding correlation: Invalid channel index" << ch;
+            return;
+        }
+    }
+
+    int available = INT_MAX;
+    m_samplingRate = data.channel(channels[0]).samplingRate;
+    for (int ch : channels) {
+        if (data.channel(ch).samplingRate != m_samplingRate) {
+            qWarning() << "Sliding correlation: Channels must share one sampling rate";
+            return;
+        }
+        available = std::min(available, data.channel(ch).sampleCount());
+    }
+    m_end = numSamples < 0 ? available : std::min<qint64>(available, qint64(m_start) + numSamples);
+}
+
+const EEGMatrix &SlidingCorrelation::block(int start, int count) {
+    m_block = m_data.toMatrix(m_channels, start, count);
+    return m_block;
+}
+
+void SlidingCorrelation::recompute() {
+    const EEGMatrix &window = block(m_start, m_window);
+    m_accumulator.reset(window.rowwise().mean());
+    m_accumulator.add(window);
+    m_stepsSinceRefresh = 0;
+}
+
+bool SlidingCorrelation::next() {
+    if (!isValid()) return false;
+
+    if (!m_started) {
+        m_started = true;
+        recompute();
+        return true;
+    }
+
+    if (m_start + m_hop + m_window > m_end) return false;
+
+    if (m_hop >= m_window || ++m_stepsSinceRefresh >= kRefreshSteps) {
+        m_start += m_hop;
+        recompute();
+        return true;
+    }
+
+    // Add the entering samples, then remove the leaving ones
+    m_accumulator.add(block(m_start + m_window, m_hop), 1.0);
+    m_accumulator.add(block(m_start, m_hop), -1.0);
+    m_start += m_hop;
+    return true;
+}
+
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "../DataModels/EEGData.h"
+
+namespace Correlation {
+
+// Running channel sums and cross-products. Samples are shifted by a fixed
+// per-channel offset before accumulation so signals riding on a large DC level
+// do not lose precision when the mean is taken back out.
+class CovarianceAccumulator {
+public:
+    CovarianceAccumulator() = default;
+    explicit CovarianceAccumulator(const Eigen::VectorXd &offset) { reset(offset); }
+
+    void reset(const Eigen::VectorXd &offset);
+
+    // weight = -1 removes a block that was previously added
+    void add(const EEGMatrix &block, double weight = 1.0);
+    void merge(const CovarianceAccumulator &other);
+
+    int channelCount() const { return m_offset.size(); }
+    double count() const { return m_count; }
+    Eigen::VectorXd mean() const;
+    Eigen::MatrixXd covariance() const;
+    Eigen::MatrixXd correlation() const;
+
+private:
+    Eigen::VectorXd m_offset;
+    Eigen::VectorXd m_sum;
+    Eigen::MatrixXd m_cross;   // lower triangle only
+    double m_count = 0.0;
+};
+
+// Streams [startSample, startSample + numSamples) block-wise in parallel, so a
+// whole recording never has to sit in one matrix. numSamples < 0 means to the end.
+// Returns an empty accumulator if the channels are invalid.
+CovarianceAccumulator accumulateCovariance(const EEGData &data, const QVector<int> &channels,
+                                           int startSample = 0, int numSamples = -1);
+
+// Centers and normalizes the block once; all pairs come from one product.
+Eigen::MatrixXd correlationMatrix(const EEGMatrix &block);
+
+// Correlation over [startSample, startSample + numSamples), streamed for long ranges
+Eigen::MatrixXd correlationMatrix(const EEGData &data, const QVector<int> &channels,
+                                  int startSample = 0, int numSamples = -1);
+
+// Correlation over a window that slides by hopSamples through
+// [startSample, startSample + numSamples), numSamples < 0 meaning to the end.
+// Each step adds the entering samples and removes the leaving ones,
+// O(C^2 * hop) instead of O(C^2 * window).
+class SlidingCorrelation {
+public:
+    SlidingCorrelation(const EEGData &data, const QVector<int> &channels,
+                       int windowSamples, int hopSamples,
+                       int startSample = 0, int numSamples = -1);
+
+    bool isValid() const { return m_end - m_start >= m_window && m_window > 1; }
+    bool next();
+    int windowStart() const { return m_start; }
+    double windowStartTime() const { return m_samplingRate > 0 ? m_start / m_samplingRate : 0.0; }
+    Eigen::MatrixXd matrix() const { return m_accumulator.correlation(); }
+
+private:
+    const EEGMatrix &block(int start, int count);
+    void recompute();
+
+    const EEGData &m_data;
+    QVector<int> m_channels;
+    int m_window;
+    int m_hop;
+    int m_start;
+    int m_end;             // exclusive
+    int m_stepsSinceRefresh;
+    double m_samplingRate;
+    bool m_started;
+    EEGMatrix m_block;
+    CovarianceAccumulator m_accumulator;
+};
+
+}
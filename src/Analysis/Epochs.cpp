@@ -0,0 +1,197 @@
+#include "Epochs.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <climits>
+
+namespace Epochs {
+
+EpochSet::EpochSet(const EEGData &data, const QVector<int> &channels,
+                   const QVector<double> &eventTimes, const EpochParams &params) {
+    if (channels.isEmpty() || eventTimes.isEmpty()) return;
+    if (params.tmax <= params.tmin) {
+        qWarning() << "Epochs: tmax must be after tmin";
+        return;
+    }
+
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Epochs: Invalid channel index" << ch;
+            return;
+        }
+    }
+
+    qint64 numSamples = LLONG_MAX;
+    m_samplingRate = data.channel(channels[0]).samplingRate;
+    for (int ch : channels) {
+        if (data.channel(ch).samplingRate != m_samplingRate) {
+            qWarning() << "Epochs: Channels must share one sampling rate";
+            return;
+        }
+        numSamples = std::min<qint64>(numSamples, data.channel(ch).sampleCount());
+    }
+    if (m_samplingRate <= 0) return;
+
+    const double fs = m_samplingRate;
+    const qint64 offset = std::llround(params.tmin * fs);
+    m_tmin = offset / fs;
+    m_length = static_cast<int>(std::llround((params.tmax - params.tmin) * fs)) + 1;
+
+    // Keep events whose whole window is inside the recording and clean
+    QVector<qint64> starts;
+    QVector<double> times;
+    for (double t : eventTimes) {
+        qint64 start = std::llround(t * fs) + offset;
+        if (start < 0 || start + m_length > numSamples) continue;
+        if (params.dropRejectedSegments
+            && data.rejectedIntervals().overlaps(start / fs, (start + m_length) / fs)) continue;
+        starts.append(start);
+        times.append(t);
+    }
+
+    int numChannels = channels.size();
+    int numEpochs = starts.size();
+    QVector<const double*> channelData(numChannels);
+    for (int c = 0; c < numChannels; ++c) channelData[c] = data.channel(channels[c]).data.constData();
+
+    // Baseline window inside the epoch
+    int baseFirst = 0;
+    int baseLast = 0;
+    if (params.baselineCorrection) {
+        baseFirst = std::max(0, static_cast<int>(std::llround((params.baselineStart - m_tmin) * fs)));
+        baseLast = std::min(m_length, static_cast<int>(std::llround((params.baselineEnd - m_tmin) * fs)) + 1);
+        if (baseLast <= baseFirst) {
+            qWarning() << "Epochs: Baseline window is outside the epoch, skipping correction";
+            baseLast = baseFirst;
+        }
+    }
+
+    // Per channel: baselines and peak-to-peak of every epoch
+    Eigen::MatrixXd baselines = Eigen::MatrixXd::Zero(numChannels, numEpochs);
+    Eigen::MatrixXd peakToPeak(numChannels, numEpochs);
+    bool checkAmplitude = params.rejectPeakToPeak > 0 || params.rejectFlat > 0;
+    const qint64 *epochStarts = starts.constData();
+    Parallel::parallelFor(0, numChannels, [&](int c) {
+        const double *x = channelData[c];
+        for (int e = 0; e < numEpochs; ++e) {
+            const double *epoch = x + epochStarts[e];
+            if (baseLast > baseFirst) {
+                double sum = 0.0;
+                for (int i = baseFirst; i < baseLast; ++i) sum += epoch[i];
+                baselines(c, e) = sum / (baseLast - baseFirst);
+            }
+            if (checkAmplitude) {
+                double lo = epoch[0];
+                double hi = epoch[0];
+                for (int i = 1; i < m_length; ++i) {
+                    lo = std::min(lo, epoch[i]);
+                    hi = std::max(hi, epoch[i]);
+                }
+                peakToPeak(c, e) = hi - lo;
+            }
+        }
+    });
+
+    m_channels = channels;
+    m_data = channelData;
+    QVector<int> kept;
+    for (int e = 0; e < numEpochs; ++e) {
+        if (checkAmplitude) {
+            if (params.rejectPeakToPeak > 0 && peakToPeak.col(e).maxCoeff() > params.rejectPeakToPeak) continue;
+            if (params.rejectFlat > 0 && peakToPeak.col(e).minCoeff() < params.rejectFlat) continue;
+        }
+        kept.append(e);
+    }
+
+    m_dropped = eventTimes.size() - kept.size();
+    m_baselines.resize(numChannels, kept.size());
+    for (int k = 0; k < kept.size(); ++k) {
+        m_starts.append(starts[kept[k]]);
+        m_eventTimes.append(times[kept[k]]);
+        m_baselines.col(k) = baselines.col(kept[k]);
+    }
+}
+
+QVector<double> EpochSet::times() const {
+    QVector<double> result(m_length);
+    for (int i = 0; i < m_length; ++i) result[i] = m_tmin + i / m_samplingRate;
+    return result;
+}
+
+EEGMatrix ERP::standardError() const {
+    if (count < 1) return EEGMatrix();
+    return (variance / count).cwiseSqrt();
+}
+
+ERP average(const EpochSet &epochs) {
+    ERP result;
+    if (epochs.isEmpty()) {
+        qWarning() << "ERP: No epochs to average";
+        return result;
+    }
+
+    int numChannels = epochs.channelCount();
+    int length = epochs.epochLength();
+    int numEpochs = epochs.epochCount();
+    result.mean = EEGMatrix::Zero(numChannels, length);
+    result.variance = EEGMatrix::Zero(numChannels, length);
+
+    // Welford over epochs, one channel row per task. Rows of the row-major
+    // result are contiguous, so each update is a straight vector loop.
+    Parallel::parallelFor(0, numChannels, [&](int c) {
+        double *mean = result.mean.row(c).data();
+        double *m2 = result.variance.row(c).data();
+        for (int e = 0; e < numEpochs; ++e) {
+            const double *x = epochs.epoch(c, e);
+            double base = epochs.baseline(c, e);
+            double weight = 1.0 / (e + 1);
+            for (int i = 0; i < length; ++i) {
+                double value = x[i] - base;
+                double delta = value - mean[i];
+                mean[i] += delta * weight;
+                m2[i] += delta * (value - mean[i]);
+            }
+        }
+    });
+
+    if (numEpochs > 1) result.variance /= (numEpochs - 1);
+    else result.variance.setZero();
+
+    result.channels = epochs.channels();
+    result.times = epochs.times();
+    result.count = numEpochs;
+    return result;
+}
+
+ERP grandAverage(const QVector<ERP> &averages) {
+    ERP result;
+    if (averages.isEmpty()) return result;
+
+    const ERP &first = averages.first();
+    for (const ERP &erp : averages) {
+        if (erp.channels != first.channels || erp.times.size() != first.times.size()) {
+            qWarning() << "Grand average: Averages do not share channels and times";
+            return result;
+        }
+    }
+
+    result.mean = EEGMatrix::Zero(first.mean.rows(), first.mean.cols());
+    result.variance = EEGMatrix::Zero(first.mean.rows(), first.mean.cols());
+    int n = 0;
+    for (const ERP &erp : averages) {
+        ++n;
+        EEGMatrix delta = erp.mean - result.mean;
+        result.mean += delta / n;
+        result.variance += delta.cwiseProduct(erp.mean - result.mean);
+    }
+    if (n > 1) result.variance /= (n - 1);
+    else result.variance.setZero();
+
+    result.channels = first.channels;
+    result.times = first.times;
+    result.count = n;
+    return result;
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "../DataModels/EEGData.h"
+
+namespace Epochs {
+
+// Times are in seconds relative to the event; thresholds in the channel unit
+struct EpochParams {
+    double tmin = -0.2;
+    double tmax = 0.8;
+    bool baselineCorrection = true;
+    double baselineStart = -0.2;
+    double baselineEnd = 0.0;
+    double rejectPeakToPeak = -1.0;     // drop epochs above this on any channel, <= 0 disables
+    double rejectFlat = -1.0;           // drop epochs below this on any channel, <= 0 disables
+    bool dropRejectedSegments = true;   // drop epochs overlapping the data's rejected intervals
+};
+
+// Epochs as views into channel storage: one pointer per channel plus one
+// start offset per epoch. Nothing is copied, so the set is only valid while
+// the underlying channels are left unmodified.
+class EpochSet {
+public:
+    EpochSet(const EEGData &data, const QVector<int> &channels,
+             const QVector<double> &eventTimes, const EpochParams &params = EpochParams());
+    // Epochs around every event of one type in the data's event store
+    EpochSet(const EEGData &data, const QVector<int> &channels,
+             const QString &eventType, const EpochParams &params = EpochParams())
+        : EpochSet(data, channels, data.events().onsets(eventType), params) {}
+
+    bool isEmpty() const { return m_starts.isEmpty(); }
+    int epochCount() const { return m_starts.size(); }
+    int channelCount() const { return m_channels.size(); }
+    int epochLength() const { return m_length; }
+    int droppedCount() const { return m_dropped; }
+
+    const QVector<int> &channels() const { return m_channels; }
+    double samplingRate() const { return m_samplingRate; }
+    double eventTime(int epoch) const { return m_eventTimes[epoch]; }
+    QVector<double> times() const;
+
+    // epochLength() samples of one channel for one epoch
+    const double *epoch(int channel, int epoch) const { return m_data[channel] + m_starts[epoch]; }
+    // Value subtracted from the epoch, 0 when baseline correction is off
+    double baseline(int channel, int epoch) const { return m_baselines(channel, epoch); }
+
+private:
+    QVector<int> m_channels;
+    QVector<const double*> m_data;
+    QVector<qint64> m_starts;
+    QVector<double> m_eventTimes;
+    Eigen::MatrixXd m_baselines;        // channels x epochs
+    double m_samplingRate = 0.0;
+    double m_tmin = 0.0;
+    int m_length = 0;
+    int m_dropped = 0;
+};
+
+struct ERP {
+    QVector<int> channels;
+    QVector<double> times;
+    EEGMatrix mean;                     // channels x samples
+    EEGMatrix variance;                 // across epochs (or averages), unbiased
+    int count = 0;
+
+    bool isEmpty() const { return mean.size() == 0; }
+    EEGMatrix standardError() const;
+};
+
+// Baseline-corrected mean and variance over all epochs, Welford-accumulated
+// per channel with channels in parallel
+ERP average(const EpochSet &epochs);
+
+// Unweighted mean over per-subject averages, which must share channels and times
+ERP grandAverage(const QVector<ERP> &averages);
+
+}
@@ -0,0 +1,285 @@
+#include "ICA.h"
+#include "PCA.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <Eigen/Eigenvalues>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <climits>
+
+namespace ICA {
+
+// Evaluates g(u) and g'(u) for the chosen contrast function
+static void applyNonlinearity(const Eigen::MatrixXd &u, Nonlinearity nonlinearity,
+                              Eigen::ArrayXXd &g, Eigen::ArrayXXd &dg) {
+    switch (nonlinearity) {
+    case NonlinearityExp: {
+        Eigen::ArrayXXd u2 = u.array().square();
+        Eigen::ArrayXXd e = (-0.5 * u2).exp();
+        g = u.array() * e;
+        dg = (1.0 - u2) * e;
+        break;
+    }
+    case NonlinearityCube:
+        g = u.array().cube();
+        dg = 3.0 * u.array().square();
+        break;
+    case NonlinearityLogCosh:
+    default:
+        g = u.array().tanh();
+        dg = 1.0 - g.square();
+        break;
+    }
+}
+
+// W <- (W W^T)^(-1/2) W
+static Eigen::MatrixXd symmetricDecorrelation(const Eigen::MatrixXd &W) {
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(W * W.transpose());
+    Eigen::VectorXd invSqrt = solver.eigenvalues().cwiseMax(1e-12).cwiseSqrt().cwiseInverse();
+    return solver.eigenvectors() * invSqrt.asDiagonal() * solver.eigenvectors().transpose() * W;
+}
+
+// Column ranges handed to worker threads
+static QVector<QPair<int, int>> columnPartitions(int columns) {
+    int parts = std::max(1, std::min(Parallel::threadCount(), columns / 1024));
+    QVector<QPair<int, int>> ranges;
+    for (int p = 0; p < parts; ++p) {
+        int begin = static_cast<int>(static_cast<qint64>(columns) * p / parts);
+        int end = static_cast<int>(static_cast<qint64>(columns) * (p + 1) / parts);
+        ranges.append(qMakePair(begin, end - begin));
+    }
+    return ranges;
+}
+
+static Eigen::MatrixXd fitSymmetric(const Eigen::MatrixXd &Z, const ICAParams &params,
+                                    std::mt19937 &rng, int &iterations, bool &converged) {
+    int k = Z.rows();
+    double numSamples = static_cast<double>(Z.cols());
+    QVector<QPair<int, int>> ranges = columnPartitions(Z.cols());
+    int parts = ranges.size();
+
+    std::normal_distribution<double> normal(0.0, 1.0);
+    Eigen::MatrixXd W(k, k);
+    for (Eigen::Index i = 0; i < W.size(); ++i) W(i) = normal(rng);
+    W = symmetricDecorrelation(W);
+
+    QVector<Eigen::MatrixXd> gzParts(parts);
+    QVector<Eigen::VectorXd> dgParts(parts);
+    Eigen::MatrixXd *gz = gzParts.data();
+    Eigen::VectorXd *dgSum = dgParts.data();
+
+    converged = false;
+    for (iterations = 1; iterations <= params.maxIterations; ++iterations) {
+        // Y = W Z, then E{g(Y) Z^T} and E{g'(Y)}, split over sample blocks
+        Parallel::parallelFor(0, parts, [&](int p) {
+            auto Zb = Z.middleCols(ranges[p].first, ranges[p].second);
+            Eigen::MatrixXd Y = W * Zb;
+            Eigen::ArrayXXd g, dg;
+            applyNonlinearity(Y, params.nonlinearity, g, dg);
+            gz[p].noalias() = g.matrix() * Zb.transpose();
+            dgSum[p] = dg.rowwise().sum();
+        });
+
+        Eigen::MatrixXd gzTotal = gzParts[0];
+        Eigen::VectorXd dgTotal = dgParts[0];
+        for (int p = 1; p < parts; ++p) {
+            gzTotal += gzParts[p];
+            dgTotal += dgParts[p];
+        }
+
+        Eigen::MatrixXd Wnew = gzTotal / numSamples - (dgTotal / numSamples).asDiagonal() * W;
+        Wnew = symmetricDecorrelation(Wnew);
+
+        double change = ((Wnew * W.transpose()).diagonal().cwiseAbs().array() - 1.0).abs().maxCoeff();
+        W = Wnew;
+        if (change < params.tolerance) {
+            converged = true;
+            break;
+        }
+    }
+    iterations = std::min(iterations, params.maxIterations);
+    return W;
+}
+
+static Eigen::MatrixXd fitDeflation(const Eigen::MatrixXd &Z, const ICAParams &params,
+                                    std::mt19937 &rng, int &iterations, bool &converged) {
+    int k = Z.rows();
+    double numSamples = static_cast<double>(Z.cols());
+    QVector<QPair<int, int>> ranges = columnPartitions(Z.cols());
+    int parts = ranges.size();
+
+    std::normal_distribution<double> normal(0.0, 1.0);
+    Eigen::MatrixXd W = Eigen::MatrixXd::Zero(k, k);
+
+    QVector<Eigen::VectorXd> zgParts(parts);
+    QVector<double> dgParts(parts);
+    Eigen::VectorXd *zg = zgParts.data();
+    double *dgSum = dgParts.data();
+
+    converged = true;
+    iterations = 0;
+    for (int c = 0; c < k; ++c) {
+        Eigen::VectorXd w(k);
+        for (int i = 0; i < k; ++i) w[i] = normal(rng);
+        w -= W.topRows(c).transpose() * (W.topRows(c) * w);
+        w.normalize();
+
+        bool componentConverged = false;
+        int it = 1;
+        for (; it <= params.maxIterations; ++it) {
+            Parallel::parallelFor(0, parts, [&](int p) {
+                auto Zb = Z.middleCols(ranges[p].first, ranges[p].second);
+                Eigen::MatrixXd y = w.transpose() * Zb;
+                Eigen::ArrayXXd g, dg;
+                applyNonlinearity(y, params.nonlinearity, g, dg);
+                zg[p].noalias() = Zb * g.matrix().transpose();
+                dgSum[p] = dg.sum();
+            });
+
+            Eigen::VectorXd zgTotal = zgParts[0];
+            double dgTotal = dgParts[0];
+            for (int p = 1; p < parts; ++p) {
+                zgTotal += zgParts[p];
+                dgTotal += dgParts[p];
+            }
+
+            Eigen::VectorXd wNew = zgTotal / numSamples - (dgTotal / numSamples) * w;
+            wNew -= W.topRows(c).transpose() * (W.topRows(c) * wNew);
+            wNew.normalize();
+
+            double change = std::abs(std::abs(wNew.dot(w)) - 1.0);
+            w = wNew;
+            if (change < params.tolerance) {
+                componentConverged = true;
+                break;
+            }
+        }
+
+        W.row(c) = w.transpose();
+        iterations = std::max(iterations, std::min(it, params.maxIterations));
+        converged = converged && componentConverged;
+    }
+    return W;
+}
+
+ICAModel fit(const EEGData &data, const QVector<int> &channels, const ICAParams &params) {
+    ICAModel model;
+    if (channels.size() < 2) {
+        qWarning() << "ICA: Need at least 2 channels";
+        return model;
+    }
+
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "ICA: Invalid channel index" << ch;
+            return model;
+        }
+    }
+
+    int numSamples = INT_MAX;
+    double samplingRate = data.channel(channels[0]).samplingRate;
+    for (int ch : channels) {
+        if (data.channel(ch).samplingRate != samplingRate) {
+            qWarning() << "ICA: Channels must share one sampling rate";
+            return model;
+        }
+        numSamples = std::min(numSamples, data.channel(ch).sampleCount());
+    }
+
+    int numChannels = channels.size();
+    int step = std::max(1, params.decimation);
+    int fitSamples = (numSamples + step - 1) / step;
+    if (fitSamples < 10 * numChannels) {
+        qWarning() << "ICA: Not enough samples for" << numChannels << "channels";
+        return model;
+    }
+
+    // Contiguous channels x samples fitting matrix, every step-th sample
+    EEGMatrix X(numChannels, fitSamples);
+    Parallel::parallelFor(0, numChannels, [&](int c) {
+        const double *src = data.channel(channels[c]).data.constData();
+        double *dst = X.row(c).data();
+        for (int s = 0; s < fitSamples; ++s) dst[s] = src[static_cast<qint64>(s) * step];
+    });
+
+    model.channels = channels;
+    model.mean = X.rowwise().mean();
+    X.colwise() -= model.mean;
+
+    // Covariance, accumulated over sample blocks in parallel
+    QVector<QPair<int, int>> ranges = columnPartitions(fitSamples);
+    QVector<Eigen::MatrixXd> covParts(ranges.size());
+    Eigen::MatrixXd *covPart = covParts.data();
+    Parallel::parallelFor(0, ranges.size(), [&](int p) {
+        covPart[p] = Eigen::MatrixXd::Zero(numChannels, numChannels);
+        covPart[p].selfadjointView<Eigen::Lower>().rankUpdate(X.middleCols(ranges[p].first, ranges[p].second));
+    });
+    Eigen::MatrixXd cov = Eigen::MatrixXd::Zero(numChannels, numChannels);
+    for (const Eigen::MatrixXd &part : covParts) cov += part;
+    cov = Eigen::MatrixXd(cov.selfadjointView<Eigen::Lower>()) / fitSamples;
+
+    // PCA whitening onto the leading components
+    PCA::PCAModel pca = PCA::fromCovariance(cov, model.mean, params.numComponents);
+    int k = pca.componentCount();
+    if (k < numChannels && params.numComponents <= 0) {
+        qDebug() << "ICA: Data rank is" << k << "- reducing component count";
+    }
+
+    Eigen::VectorXd sqrtValues = pca.variances.cwiseSqrt();
+    model.whitening = sqrtValues.cwiseInverse().asDiagonal() * pca.components.transpose();
+    model.dewhitening = pca.components * sqrtValues.asDiagonal();
+
+    Eigen::MatrixXd Z(k, fitSamples);
+    Parallel::parallelFor(0, ranges.size(), [&](int p) {
+        Z.middleCols(ranges[p].first, ranges[p].second).noalias() =
+            model.whitening * X.middleCols(ranges[p].first, ranges[p].second);
+    });
+    X.resize(0, 0);
+
+    std::mt19937 rng(params.seed);
+    Eigen::MatrixXd W = params.algorithm == AlgorithmDeflation
+        ? fitDeflation(Z, params, rng, model.iterations, model.converged)
+        : fitSymmetric(Z, params, rng, model.iterations, model.converged);
+
+    if (!model.converged) {
+        qWarning() << "ICA did not converge after" << model.iterations << "iterations";
+    }
+
+    model.unmixing = W * model.whitening;
+    model.mixing = model.dewhitening * W.transpose();
+    return model;
+}
+
+EEGMatrix sources(const ICAModel &model, const EEGData &data, int startSample, int numSamples) {
+    if (model.isEmpty()) return EEGMatrix();
+    EEGMatrix block = data.toMatrix(model.channels, startSample, numSamples);
+    if (block.size() == 0) return EEGMatrix();
+    block.colwise() -= model.mean;
+    return model.unmixing * block;
+}
+
+Eigen::VectorXd topography(const ICAModel &model, int component) {
+    if (component < 0 || component >= model.componentCount()) return Eigen::VectorXd();
+    return model.mixing.col(component);
+}
+
+void removeComponents(const ICAModel &model, EEGData &data, const QVector<int> &components) {
+    if (model.isEmpty() || components.isEmpty()) return;
+
+    // x - A_r S_r = (I - A_r W_r) x + A_r W_r mean
+    int numChannels = model.channels.size();
+    Eigen::MatrixXd removed = Eigen::MatrixXd::Zero(numChannels, numChannels);
+    for (int c : components) {
+        if (c < 0 || c >= model.componentCount()) {
+            qWarning() << "ICA: Invalid component index" << c;
+            return;
+        }
+        removed.noalias() += model.mixing.col(c) * model.unmixing.row(c);
+    }
+
+    Eigen::MatrixXd transform = Eigen::MatrixXd::Identity(numChannels, numChannels) - removed;
+    data.applyChannelTransform(model.channels, transform, removed * model.mean);
+}
+
+}
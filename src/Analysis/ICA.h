@@ -0,0 +1,55 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "../DataModels/EEGData.h"
+
+namespace ICA {
+
+enum Algorithm {
+    AlgorithmSymmetric,   // all components updated together, then decorrelated
+    AlgorithmDeflation    // one component at a time, Gram-Schmidt against earlier ones
+};
+
+enum Nonlinearity {
+    NonlinearityLogCosh,
+    NonlinearityExp,
+    NonlinearityCube
+};
+
+struct ICAParams {
+    int numComponents = -1;        // <= 0 keeps one per channel
+    Algorithm algorithm = AlgorithmSymmetric;
+    Nonlinearity nonlinearity = NonlinearityLogCosh;
+    int maxIterations = 200;
+    double tolerance = 1e-4;
+    int decimation = 1;            // fit on every n-th sample
+    unsigned int seed = 42;
+};
+
+// sources = unmixing * (x - mean), x = mixing * sources + mean
+struct ICAModel {
+    QVector<int> channels;
+    Eigen::VectorXd mean;
+    Eigen::MatrixXd whitening;     // components x channels
+    Eigen::MatrixXd dewhitening;   // channels x components
+    Eigen::MatrixXd unmixing;      // components x channels
+    Eigen::MatrixXd mixing;        // channels x components, columns are topographies
+    int iterations = 0;
+    bool converged = false;
+
+    bool isEmpty() const { return unmixing.size() == 0; }
+    int componentCount() const { return unmixing.rows(); }
+};
+
+ICAModel fit(const EEGData &data, const QVector<int> &channels, const ICAParams &params = ICAParams());
+
+// Component time courses over [startSample, startSample + numSamples)
+EEGMatrix sources(const ICAModel &model, const EEGData &data, int startSample, int numSamples);
+
+// Scalp map of one component, one weight per model channel
+Eigen::VectorXd topography(const ICAModel &model, int component);
+
+// Back-projects the data with the given components removed, in place
+void removeComponents(const ICAModel &model, EEGData &data, const QVector<int> &components);
+
+}
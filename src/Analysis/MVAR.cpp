@@ -0,0 +1,284 @@
+#include "MVAR.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <algorithm>
+
+namespace MVAR {
+
+namespace {
+
+// Sums over the stacked vectors z_t = [x_t; x_{t-1}; ...; x_{t-p}] of some samples
+struct Gram {
+    Eigen::MatrixXd products;            // lower triangle of sum z z^T
+    Eigen::VectorXd sums;
+    qint64 count = 0;
+
+    Gram &operator+=(const Gram &other) {
+        products += other.products;
+        sums += other.sums;
+        count += other.count;
+        return *this;
+    }
+};
+
+// Common sample count, 0 on invalid channels or mixed sampling rates
+qint64 commonSampleCount(const EEGData &data, const QVector<int> &channels) {
+    if (channels.isEmpty()) return 0;
+    qint64 numSamples = std::numeric_limits<qint64>::max();
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "MVAR: Invalid channel index" << ch;
+            return 0;
+        }
+        if (data.channel(ch).samplingRate != data.channel(channels[0]).samplingRate) {
+            qWarning() << "MVAR: Channels must share one sampling rate";
+            return 0;
+        }
+        numSamples = std::min<qint64>(numSamples, data.channel(ch).data.size());
+    }
+    return numSamples;
+}
+
+// Gram sums over targets t in [start, end). Targets need t >= p and every
+// sample of z_t finite; the others become zero columns and are not counted.
+Gram stepGram(const QVector<const double*> &rows, qint64 start, qint64 end, int order) {
+    int numChannels = rows.size();
+    int dims = numChannels * (order + 1);
+    Gram gram;
+    gram.products = Eigen::MatrixXd::Zero(dims, dims);
+    gram.sums = Eigen::VectorXd::Zero(dims);
+
+    start = std::max<qint64>(start, order);
+    qint64 length = end - start;
+    if (length <= 0) return gram;
+
+    // Finite run length ending at each sample, from p samples before the step
+    qint64 lo = start - order;
+    std::vector<int> run(end - lo);
+    for (qint64 t = lo; t < end; ++t) {
+        bool finite = true;
+        for (int c = 0; c < numChannels && finite; ++c) finite = std::isfinite(rows[c][t]);
+        run[t - lo] = finite ? (t > lo ? run[t - lo - 1] : 0) + 1 : 0;
+    }
+
+    // Row k * channels + c is channel c delayed by k
+    Eigen::MatrixXd Z(dims, length);
+    for (int k = 0; k <= order; ++k) {
+        for (int c = 0; c < numChannels; ++c) {
+            Z.row(k * numChannels + c) = Eigen::Map<const Eigen::RowVectorXd>(rows[c] + start - k, length);
+        }
+    }
+    for (qint64 i = 0; i < length; ++i) {
+        if (run[start + i - lo] > order) ++gram.count;
+        else Z.col(i).setZero();
+    }
+
+    gram.products.selfadjointView<Eigen::Lower>().rankUpdate(Z);
+    gram.sums = Z.rowwise().sum();
+    return gram;
+}
+
+// Least squares from the Gram sums: with S the covariance of z, A = S_0L S_LL^-1.
+// Dropping channel j's lags J raises the residual variance of channel i by
+// a_iJ (P_JJ)^-1 a_iJ^T with P = S_LL^-1, which gives every conditional
+// Granger causality without refitting.
+MVARModel fitGram(const Gram &gram, int numChannels, int order, double regularization) {
+    MVARModel model;
+    int lags = numChannels * order;
+    if (gram.count <= lags + 1) return model;
+
+    double n = static_cast<double>(gram.count);
+    Eigen::MatrixXd S = gram.products.selfadjointView<Eigen::Lower>();
+    Eigen::VectorXd mean = gram.sums / n;
+    S /= n;
+    S.noalias() -= mean * mean.transpose();
+
+    Eigen::MatrixXd laggedCovariance = S.bottomRightCorner(lags, lags);
+    if (regularization > 0.0) {
+        laggedCovariance.diagonal().array() += regularization * laggedCovariance.diagonal().mean();
+    }
+    Eigen::LDLT<Eigen::MatrixXd> ldlt(laggedCovariance);
+    if (ldlt.info() != Eigen::Success || !ldlt.isPositive()) return model;
+    Eigen::MatrixXd P = ldlt.solve(Eigen::MatrixXd::Identity(lags, lags));
+
+    Eigen::MatrixXd cross = S.block(0, numChannels, numChannels, lags);
+    model.coefficients = cross * P;
+    Eigen::MatrixXd noise = S.topLeftCorner(numChannels, numChannels) - model.coefficients * cross.transpose();
+    model.noiseCovariance = 0.5 * (noise + noise.transpose());
+    model.sampleCount = gram.count;
+
+    model.granger = Eigen::MatrixXd::Zero(numChannels, numChannels);
+    Eigen::MatrixXd coefficientsJ(numChannels, order);
+    Eigen::MatrixXd PJJ(order, order);
+    for (int j = 0; j < numChannels; ++j) {
+        for (int a = 0; a < order; ++a) {
+            coefficientsJ.col(a) = model.coefficients.col(a * numChannels + j);
+            for (int b = 0; b < order; ++b) PJJ(a, b) = P(a * numChannels + j, b * numChannels + j);
+        }
+        Eigen::MatrixXd weighted = PJJ.ldlt().solve(coefficientsJ.transpose());      // order x channels
+        Eigen::VectorXd increase = (coefficientsJ.transpose().array() * weighted.array()).colwise().sum();
+        for (int i = 0; i < numChannels; ++i) {
+            double variance = model.noiseCovariance(i, i);
+            model.granger(i, j) = i == j ? 0.0
+                : variance > 0.0 ? std::log((variance + std::max(0.0, increase[i])) / variance)
+                : std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+    return model;
+}
+
+}
+
+void spectralMeasures(const MVARModel &model, const QVector<double> &frequencies, double samplingRate,
+                      QVector<Eigen::MatrixXd> *pdc, QVector<Eigen::MatrixXd> *dtf, int frequencyBatch) {
+    int numFrequencies = frequencies.size();
+    if (pdc) pdc->resize(numFrequencies);
+    if (dtf) dtf->resize(numFrequencies);
+    if (model.isEmpty() || numFrequencies == 0 || samplingRate <= 0.0) return;
+
+    int numChannels = model.channelCount();
+    int order = model.order();
+    using Complex = std::complex<double>;
+
+    // Column k is vec(A_{k+1}), so one product gives every vec(sum_k A_k e^{-i w k})
+    Eigen::MatrixXcd stacked = Eigen::Map<const Eigen::MatrixXd>(model.coefficients.data(),
+                                                                  numChannels * numChannels, order).cast<Complex>();
+    int batch = std::max(1, frequencyBatch);
+    Eigen::MatrixXcd phasors(order, batch);
+    Eigen::MatrixXcd sums;
+    Eigen::MatrixXcd Af(numChannels, numChannels);
+    Eigen::MatrixXd power(numChannels, numChannels);
+
+    for (int first = 0; first < numFrequencies; first += batch) {
+        int count = std::min(batch, numFrequencies - first);
+        for (int f = 0; f < count; ++f) {
+            double w = 2.0 * M_PI * frequencies[first + f] / samplingRate;
+            for (int k = 0; k < order; ++k) phasors(k, f) = std::polar(1.0, -w * (k + 1));
+        }
+        sums.noalias() = stacked * phasors.leftCols(count);
+
+        for (int f = 0; f < count; ++f) {
+            // A(f) = I - sum_k A_k e^{-i w k}
+            Af = -Eigen::Map<const Eigen::MatrixXcd>(sums.col(f).data(), numChannels, numChannels);
+            Af.diagonal().array() += 1.0;
+
+            if (pdc) {
+                power = Af.cwiseAbs2();
+                Eigen::RowVectorXd columns = power.colwise().sum();
+                (*pdc)[first + f] = power.array().rowwise() / columns.array().max(1e-300);
+            }
+            if (dtf) {
+                power = Af.partialPivLu().inverse().cwiseAbs2();
+                Eigen::VectorXd rowSums = power.rowwise().sum();
+                (*dtf)[first + f] = power.array().colwise() / rowSums.array().max(1e-300);
+            }
+        }
+    }
+}
+
+DirectedConnectivity directedConnectivity(const EEGData &data, const QVector<int> &channels,
+                                          const MVARParams &params) {
+    DirectedConnectivity result;
+    qint64 total = commonSampleCount(data, channels);
+    if (total == 0) return result;
+    if (params.order < 1 || params.window <= 0.0 || params.step <= 0.0) {
+        qWarning() << "MVAR: Invalid order, window or step";
+        return result;
+    }
+
+    int numChannels = channels.size();
+    int order = params.order;
+    double rate = data.channel(channels[0]).samplingRate;
+    qint64 stepLength = std::max<qint64>(1, std::llround(params.step * rate));
+    int stepsPerWindow = std::max(1, static_cast<int>(std::lround(params.window / params.step)));
+    qint64 first = std::max<qint64>(0, std::llround(params.startTime * rate));
+    qint64 end = params.duration < 0.0 ? total : std::min(total, first + std::llround(params.duration * rate));
+    qint64 numSteps = end > first ? (end - first) / stepLength : 0;
+    int numWindows = static_cast<int>(std::max<qint64>(0, numSteps - stepsPerWindow + 1));
+    if (numWindows == 0) {
+        qWarning() << "MVAR: Range is shorter than one window";
+        return result;
+    }
+
+    for (double f : params.frequencies) {
+        if (f >= 0.0 && f <= rate / 2) result.frequencies.append(f);
+        else qWarning() << "MVAR: Skipping" << f << "Hz, outside [0, Nyquist]";
+    }
+
+    result.channels = channels;
+    result.samplingRate = rate;
+    result.window = stepsPerWindow * stepLength / rate;
+    result.order = order;
+    result.windowStarts.resize(numWindows);
+    for (int w = 0; w < numWindows; ++w) result.windowStarts[w] = (first + w * stepLength) / rate;
+    result.granger.resize(numWindows);
+    result.pdc.resize(numWindows);
+    result.dtf.resize(numWindows);
+
+    // Raw pointers so worker threads never touch QVector's shared-data bookkeeping
+    QVector<const double*> rows;
+    for (int ch : channels) rows.append(data.channel(ch).data.constData());
+    Eigen::MatrixXd *granger = result.granger.data();
+    Eigen::MatrixXd *pdc = result.pdc.data();
+    Eigen::MatrixXd *dtf = result.dtf.data();
+    const QVector<double> &frequencies = result.frequencies;
+    const Eigen::MatrixXd invalid = Eigen::MatrixXd::Constant(numChannels, numChannels,
+                                                              std::numeric_limits<double>::quiet_NaN());
+
+    // A task slides over windowsPerTask windows with a ring of its step blocks
+    int group = std::max(1, params.windowsPerTask);
+    int numTasks = (numWindows + group - 1) / group;
+    Parallel::parallelFor(0, numTasks, [&](int task) {
+        int firstWindow = task * group;
+        int lastWindow = std::min(numWindows, firstWindow + group);
+        std::vector<Gram> ring(stepsPerWindow);
+
+        for (int s = firstWindow; s < lastWindow + stepsPerWindow - 1; ++s) {
+            qint64 stepStart = first + s * stepLength;
+            ring[s % stepsPerWindow] = stepGram(rows, stepStart, stepStart + stepLength, order);
+            int w = s - stepsPerWindow + 1;
+            if (w < firstWindow) continue;
+
+            Gram window = ring[0];
+            for (int k = 1; k < stepsPerWindow; ++k) window += ring[k];
+            MVARModel model = fitGram(window, numChannels, order, params.regularization);
+            if (model.isEmpty()) {
+                granger[w] = pdc[w] = dtf[w] = invalid;
+                continue;
+            }
+
+            granger[w] = model.granger;
+            QVector<Eigen::MatrixXd> pdcSpectrum, dtfSpectrum;
+            spectralMeasures(model, frequencies, rate, &pdcSpectrum, &dtfSpectrum, params.frequencyBatch);
+            pdc[w] = Eigen::MatrixXd::Zero(numChannels, numChannels);
+            dtf[w] = Eigen::MatrixXd::Zero(numChannels, numChannels);
+            for (int f = 0; f < frequencies.size(); ++f) {
+                pdc[w] += pdcSpectrum[f];
+                dtf[w] += dtfSpectrum[f];
+            }
+            if (!frequencies.isEmpty()) {
+                pdc[w] /= frequencies.size();
+                dtf[w] /= frequencies.size();
+            }
+        }
+    });
+    return result;
+}
+
+MVARModel fit(const EEGData &data, const QVector<int> &channels, qint64 startSample, qint64 numSamples,
+              int order, double regularization) {
+    qint64 total = commonSampleCount(data, channels);
+    if (total == 0 || order < 1) return MVARModel();
+    startSample = std::max<qint64>(0, startSample);
+    qint64 end = std::min(total, startSample + numSamples);
+    if (end <= startSample) return MVARModel();
+
+    QVector<const double*> rows;
+    for (int ch : channels) rows.append(data.channel(ch).data.constData());
+    return fitGram(stepGram(rows, startSample, end, order), channels.size(), order, regularization);
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "TimeFrequency.h"
+#include "../DataModels/EEGData.h"
+
+namespace MVAR {
+
+struct MVARParams {
+    int order = 5;                       // lags p
+    double window = 10.0;                // seconds, rounded to a whole number of steps
+    double step = 5.0;                   // seconds between window starts
+    double startTime = 0.0;              // seconds
+    double duration = -1.0;              // seconds, < 0 means to the end
+    QVector<double> frequencies = TimeFrequency::frequencyRange(1.0, 40.0, 1.0);
+    double regularization = 0.0;         // ridge on the lag covariance, relative to its mean diagonal
+    int frequencyBatch = 16;             // transfer functions per batched product
+    int windowsPerTask = 8;              // consecutive windows sharing their step blocks
+};
+
+// x_t = sum_k A_k x_{t-k} + e_t, fitted by least squares on one window
+struct MVARModel {
+    Eigen::MatrixXd coefficients;        // channels x (channels * order), [A_1 ... A_p]
+    Eigen::MatrixXd noiseCovariance;     // channels x channels
+    Eigen::MatrixXd granger;             // channels x channels, (i, j) is j -> i, conditional on the rest
+    qint64 sampleCount = 0;
+
+    bool isEmpty() const { return coefficients.size() == 0; }
+    int channelCount() const { return coefficients.rows(); }
+    int order() const { return coefficients.rows() > 0 ? coefficients.cols() / coefficients.rows() : 0; }
+};
+
+// Squared PDC and DTF of one model at each frequency, (i, j) is j -> i. PDC
+// columns and DTF rows sum to one. The transfer functions of frequencyBatch
+// frequencies come out of one complex product of the stacked coefficients
+// with their phasors, then each is inverted for DTF.
+void spectralMeasures(const MVARModel &model, const QVector<double> &frequencies, double samplingRate,
+                      QVector<Eigen::MatrixXd> *pdc, QVector<Eigen::MatrixXd> *dtf, int frequencyBatch = 16);
+
+// Per sliding window: conditional Granger causality and the PDC and DTF
+// averaged over the requested frequencies. Windows that could not be fitted
+// hold NaN.
+struct DirectedConnectivity {
+    QVector<int> channels;
+    QVector<double> frequencies;
+    QVector<double> windowStarts;        // seconds
+    double samplingRate = 0.0;
+    double window = 0.0;                 // seconds, after rounding to steps
+    int order = 0;
+    QVector<Eigen::MatrixXd> granger;
+    QVector<Eigen::MatrixXd> pdc;
+    QVector<Eigen::MatrixXd> dtf;
+
+    bool isEmpty() const { return granger.isEmpty(); }
+    int windowCount() const { return granger.size(); }
+};
+
+// Each step's Gram matrix of the stacked vectors [x_t; x_{t-1}; ...; x_{t-p}]
+// is computed once and windows sum those of their steps, so overlapping
+// windows share the expensive part; the solve only sees a (channels * (p + 1))
+// square matrix. Granger causality for every pair comes from the inverse lag
+// covariance without refitting reduced models. Samples whose stacked vector
+// touches a non-finite value are left out, and the first p lags of a window
+// reach back before its start. Groups of windows run in parallel.
+DirectedConnectivity directedConnectivity(const EEGData &data, const QVector<int> &channels,
+                                          const MVARParams &params = MVARParams());
+
+// One model over [startSample, startSample + numSamples)
+MVARModel fit(const EEGData &data, const QVector<int> &channels, qint64 startSample, qint64 numSamples,
+              int order, double regularization = 0.0);
+
+}
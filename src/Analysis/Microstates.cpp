@@ -0,0 +1,312 @@
+#include "Microstates.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <Eigen/Eigenvalues>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <climits>
+#include <algorithm>
+
+namespace Microstates {
+
+// Samples per parallel block
+static const qint64 kBlockSamples = 65536;
+
+// Samples every channel has, 0 on invalid channels or mixed sampling rates
+static int commonSampleCount(const EEGData &data, const QVector<int> &channels) {
+    if (channels.isEmpty()) return 0;
+    int numSamples = INT_MAX;
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Microstates: Invalid channel index" << ch;
+            return 0;
+        }
+        if (data.channel(ch).samplingRate != data.channel(channels[0]).samplingRate) {
+            qWarning() << "Microstates: Channels must share one sampling rate";
+            return 0;
+        }
+        numSamples = std::min(numSamples, data.channel(ch).sampleCount());
+    }
+    return numSamples;
+}
+
+QVector<double> globalFieldPower(const EEGData &data, const QVector<int> &channels) {
+    int numSamples = commonSampleCount(data, channels);
+    QVector<double> gfp(numSamples);
+    if (numSamples == 0) return gfp;
+
+    int numChannels = channels.size();
+    QVector<const double*> rows;
+    for (int ch : channels) rows.append(data.channel(ch).data.constData());
+    double *out = gfp.data();
+
+    // Non-finite samples carry through the sums into NaN
+    Parallel::parallelForBlocks(numSamples, kBlockSamples, [&](qint64 start, qint64 count) {
+        Eigen::ArrayXd sum = Eigen::ArrayXd::Zero(count);
+        Eigen::ArrayXd sumSq = Eigen::ArrayXd::Zero(count);
+        for (int c = 0; c < numChannels; ++c) {
+            Eigen::Map<const Eigen::ArrayXd> x(rows[c] + start, count);
+            sum += x;
+            sumSq += x.square();
+        }
+        Eigen::ArrayXd mean = sum / numChannels;
+        Eigen::Map<Eigen::ArrayXd>(out + start, count) = (sumSq / numChannels - mean.square()).max(0.0).sqrt();
+    });
+    return gfp;
+}
+
+QVector<qint64> gfpPeaks(const QVector<double> &gfp) {
+    QVector<qint64> peaks;
+    for (qint64 t = 1; t + 1 < gfp.size(); ++t) {
+        if (gfp[t] > gfp[t - 1] && gfp[t] >= gfp[t + 1]) peaks.append(t);
+    }
+    return peaks;
+}
+
+namespace {
+
+struct Clustering {
+    Eigen::MatrixXd maps;
+    double residual = std::numeric_limits<double>::infinity();
+    int iterations = 0;
+};
+
+// Index and squared projection of the best map for every column of products
+void assign(const Eigen::MatrixXd &products, QVector<int> &labels, Eigen::VectorXd &explained) {
+    for (Eigen::Index t = 0; t < products.cols(); ++t) {
+        Eigen::Index best;
+        explained[t] = products.col(t).cwiseAbs2().maxCoeff(&best);
+        labels[t] = static_cast<int>(best);
+    }
+}
+
+Clustering cluster(const Eigen::MatrixXd &X, double totalSquares, int numStates,
+                   const MicrostateParams &params, unsigned int seed) {
+    int numChannels = X.rows();
+    int numPeaks = X.cols();
+
+    // Start from distinct random peaks
+    std::mt19937 rng(seed);
+    std::vector<int> order(numPeaks);
+    for (int i = 0; i < numPeaks; ++i) order[i] = i;
+    std::shuffle(order.begin(), order.end(), rng);
+
+    Clustering result;
+    Eigen::MatrixXd maps(numChannels, numStates);
+    for (int k = 0; k < numStates; ++k) maps.col(k) = X.col(order[k]).normalized();
+
+    QVector<int> labels(numPeaks);
+    Eigen::VectorXd explained(numPeaks);
+    double previous = std::numeric_limits<double>::infinity();
+    for (int iteration = 1; iteration <= params.maxIterations; ++iteration) {
+        assign(maps.transpose() * X, labels, explained);
+        double residual = totalSquares - explained.sum();
+        result.iterations = iteration;
+        if (std::abs(previous - residual) <= params.tolerance * std::abs(residual)) break;
+        previous = residual;
+
+        // Leading eigenvector of each cluster's scatter; empty clusters keep their map
+        for (int k = 0; k < numStates; ++k) {
+            QVector<int> members;
+            for (int t = 0; t < numPeaks; ++t) {
+                if (labels[t] == k) members.append(t);
+            }
+            if (members.isEmpty()) continue;
+            Eigen::MatrixXd Xk(numChannels, members.size());
+            for (int i = 0; i < members.size(); ++i) Xk.col(i) = X.col(members[i]);
+            Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(Xk * Xk.transpose());
+            maps.col(k) = solver.eigenvectors().col(numChannels - 1);
+        }
+    }
+
+    assign(maps.transpose() * X, labels, explained);
+    result.maps = maps;
+    result.residual = totalSquares - explained.sum();
+    return result;
+}
+
+}
+
+MicrostateModel fit(const EEGData &data, const QVector<int> &channels, const MicrostateParams &params) {
+    MicrostateModel model;
+    int numSamples = commonSampleCount(data, channels);
+    int numChannels = channels.size();
+    if (numSamples == 0) return model;
+    if (params.numStates < 1 || params.numStates > numChannels) {
+        qWarning() << "Microstates: Number of states must be in [1," << numChannels << "]";
+        return model;
+    }
+
+    QVector<qint64> peaks = gfpPeaks(globalFieldPower(data, channels));
+    if (params.maxPeaks > 0 && peaks.size() > params.maxPeaks) {
+        QVector<qint64> thinned(params.maxPeaks);
+        for (int i = 0; i < params.maxPeaks; ++i) {
+            thinned[i] = peaks[static_cast<int>(static_cast<qint64>(i) * peaks.size() / params.maxPeaks)];
+        }
+        peaks = thinned;
+    }
+    if (peaks.size() < params.numStates) {
+        qWarning() << "Microstates: Only" << peaks.size() << "GFP peaks for" << params.numStates << "states";
+        return model;
+    }
+
+    // Average-referenced topographies at the peaks, one per column
+    int numPeaks = peaks.size();
+    Eigen::MatrixXd X(numChannels, numPeaks);
+    for (int c = 0; c < numChannels; ++c) {
+        const double *samples = data.channel(channels[c]).data.constData();
+        for (int p = 0; p < numPeaks; ++p) X(c, p) = samples[peaks[p]];
+    }
+    X.rowwise() -= X.colwise().mean();
+    double totalSquares = X.squaredNorm();
+
+    int restarts = std::max(1, params.restarts);
+    QVector<Clustering> runs(restarts);
+    Clustering *results = runs.data();
+    Parallel::parallelFor(0, restarts, [&](int r) {
+        results[r] = cluster(X, totalSquares, params.numStates, params, params.seed + r);
+    });
+    const Clustering &best = *std::min_element(runs.begin(), runs.end(),
+        [](const Clustering &a, const Clustering &b) { return a.residual < b.residual; });
+
+    // Order the maps by the variance they explain
+    QVector<int> labels(numPeaks);
+    Eigen::VectorXd explained(numPeaks);
+    assign(best.maps.transpose() * X, labels, explained);
+    Eigen::VectorXd perState = Eigen::VectorXd::Zero(params.numStates);
+    for (int t = 0; t < numPeaks; ++t) perState[labels[t]] += explained[t];
+    std::vector<int> order(params.numStates);
+    for (int k = 0; k < params.numStates; ++k) order[k] = k;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return perState[a] > perState[b]; });
+
+    model.channels = channels;
+    model.samplingRate = data.channel(channels[0]).samplingRate;
+    model.maps.resize(numChannels, params.numStates);
+    for (int k = 0; k < params.numStates; ++k) model.maps.col(k) = best.maps.col(order[k]);
+    model.gev = totalSquares > 0.0 ? 1.0 - best.residual / totalSquares : 0.0;
+    model.peakCount = numPeaks;
+    model.iterations = best.iterations;
+    return model;
+}
+
+namespace {
+
+struct BlockSums {
+    Eigen::VectorXd explained;     // per state, squared projections
+    Eigen::VectorXd gfp;           // per state
+    Eigen::VectorXd samples;       // per state
+    double squares = 0.0;          // all labelled samples
+};
+
+// Splits labelled runs shorter than minLength between their neighbours,
+// the first half to the left one and the rest to the right one
+void splitShortSegments(QVector<qint8> &labels, qint64 minLength) {
+    qint64 n = labels.size();
+    qint64 start = 0;
+    while (start < n) {
+        qint64 end = start + 1;
+        while (end < n && labels[end] == labels[start]) ++end;
+        qint8 left = start > 0 ? labels[start - 1] : -1;
+        qint8 right = end < n ? labels[end] : -1;
+        if (labels[start] >= 0 && end - start < minLength && (left >= 0 || right >= 0)) {
+            qint64 middle = left < 0 ? start : right < 0 ? end : start + (end - start) / 2;
+            for (qint64 t = start; t < middle; ++t) labels[t] = left;
+            for (qint64 t = middle; t < end; ++t) labels[t] = right;
+        }
+        start = end;
+    }
+}
+
+}
+
+Segmentation backfit(const MicrostateModel &model, const EEGData &data, const MicrostateParams &params) {
+    Segmentation result;
+    if (model.isEmpty()) return result;
+    int numSamples = commonSampleCount(data, model.channels);
+    if (numSamples == 0) return result;
+
+    int numStates = model.stateCount();
+    double rate = data.channel(model.channels[0]).samplingRate;
+    double channelScale = 1.0 / std::sqrt(static_cast<double>(model.channels.size()));
+    result.samplingRate = rate;
+    result.labels.resize(numSamples);
+    qint8 *labels = result.labels.data();
+
+    int numBlocks = static_cast<int>((numSamples + kBlockSamples - 1) / kBlockSamples);
+    QVector<BlockSums> partial(numBlocks);
+    BlockSums *sums = partial.data();
+    Parallel::parallelFor(0, numBlocks, [&](int b) {
+        qint64 start = b * kBlockSamples;
+        int count = static_cast<int>(std::min<qint64>(kBlockSamples, numSamples - start));
+        EEGMatrix block = data.toMatrix(model.channels, static_cast<int>(start), count);
+        block.rowwise() -= block.colwise().mean();
+        Eigen::MatrixXd products = model.maps.transpose() * block;
+        Eigen::RowVectorXd squares = block.colwise().squaredNorm();
+
+        BlockSums &s = sums[b];
+        s.explained = Eigen::VectorXd::Zero(numStates);
+        s.gfp = Eigen::VectorXd::Zero(numStates);
+        s.samples = Eigen::VectorXd::Zero(numStates);
+        for (int t = 0; t < count; ++t) {
+            Eigen::Index best;
+            double value = products.col(t).cwiseAbs2().maxCoeff(&best);
+            if (!std::isfinite(value) || !std::isfinite(squares[t])) {
+                labels[start + t] = -1;
+                continue;
+            }
+            labels[start + t] = static_cast<qint8>(best);
+            s.explained[best] += value;
+            s.gfp[best] += std::sqrt(squares[t]) * channelScale;
+            s.samples[best] += 1.0;
+            s.squares += squares[t];
+        }
+    });
+
+    BlockSums total{Eigen::VectorXd::Zero(numStates), Eigen::VectorXd::Zero(numStates),
+                    Eigen::VectorXd::Zero(numStates), 0.0};
+    for (const BlockSums &s : partial) {
+        total.explained += s.explained;
+        total.gfp += s.gfp;
+        total.samples += s.samples;
+        total.squares += s.squares;
+    }
+
+    qint64 minLength = static_cast<qint64>(std::llround(params.minSegmentDuration * rate));
+    if (minLength > 1) splitShortSegments(result.labels, minLength);
+
+    // Segments and transitions between directly adjacent ones
+    QVector<qint64> stateSamples(numStates, 0);
+    QVector<qint64> segments(numStates, 0);
+    result.transitions = Eigen::MatrixXd::Zero(numStates, numStates);
+    qint64 labelled = 0;
+    for (qint64 t = 0; t < numSamples; ++t) {
+        int label = labels[t];
+        if (label < 0) continue;
+        ++labelled;
+        ++stateSamples[label];
+        if (t == 0 || labels[t - 1] != label) {
+            ++segments[label];
+            if (t > 0 && labels[t - 1] >= 0) result.transitions(labels[t - 1], label) += 1.0;
+        }
+    }
+    for (int k = 0; k < numStates; ++k) {
+        double outgoing = result.transitions.row(k).sum();
+        if (outgoing > 0.0) result.transitions.row(k) /= outgoing;
+    }
+
+    double labelledSeconds = labelled / rate;
+    result.gev = total.squares > 0.0 ? total.explained.sum() / total.squares : 0.0;
+    result.states.resize(numStates);
+    for (int k = 0; k < numStates; ++k) {
+        StateStatistics &state = result.states[k];
+        state.coverage = labelled > 0 ? static_cast<double>(stateSamples[k]) / labelled : 0.0;
+        state.meanDuration = segments[k] > 0 ? stateSamples[k] / rate / segments[k] : 0.0;
+        state.occurrence = labelledSeconds > 0.0 ? segments[k] / labelledSeconds : 0.0;
+        state.gev = total.squares > 0.0 ? total.explained[k] / total.squares : 0.0;
+        state.meanGfp = total.samples[k] > 0.0 ? total.gfp[k] / total.samples[k] : 0.0;
+    }
+    return result;
+}
+
+}
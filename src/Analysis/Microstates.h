@@ -0,0 +1,70 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "../DataModels/EEGData.h"
+
+namespace Microstates {
+
+struct MicrostateParams {
+    int numStates = 4;
+    int restarts = 50;             // k-means runs from random peaks, best GEV kept
+    int maxIterations = 500;
+    double tolerance = 1e-6;       // relative change of the residual variance
+    int maxPeaks = 10000;          // evenly thinned GFP peaks to cluster, <= 0 keeps all
+    double minSegmentDuration = 0.0; // back-fit segments shorter than this (s) are split between neighbours
+    unsigned int seed = 7;
+};
+
+// Maps are unit-norm, average-referenced and polarity-free, ordered by GEV
+struct MicrostateModel {
+    QVector<int> channels;
+    Eigen::MatrixXd maps;          // channels x states
+    double samplingRate = 0.0;
+    double gev = 0.0;              // global explained variance over the clustered peaks
+    int peakCount = 0;
+    int iterations = 0;            // of the winning restart
+
+    bool isEmpty() const { return maps.size() == 0; }
+    int stateCount() const { return maps.cols(); }
+};
+
+struct StateStatistics {
+    double coverage = 0.0;         // fraction of labelled time
+    double meanDuration = 0.0;     // seconds per segment
+    double occurrence = 0.0;       // segments per second of labelled time
+    double gev = 0.0;              // share of the total variance this state explains
+    double meanGfp = 0.0;
+};
+
+struct Segmentation {
+    QVector<qint8> labels;         // per sample, -1 where a channel is not finite
+    double samplingRate = 0.0;
+    double gev = 0.0;              // over every labelled sample
+    QVector<StateStatistics> states;
+    Eigen::MatrixXd transitions;   // states x states, row-normalized segment transition probabilities
+
+    bool isEmpty() const { return labels.isEmpty(); }
+};
+
+// Spatial standard deviation of the average-referenced channels per sample,
+// NaN where any channel is not finite. One blocked pass adds each channel's
+// contiguous samples into running sums.
+QVector<double> globalFieldPower(const EEGData &data, const QVector<int> &channels);
+
+// Local maxima of the GFP
+QVector<qint64> gfpPeaks(const QVector<double> &gfp);
+
+// Modified k-means (Pascual-Marqui et al. 1995) on the topographies at GFP
+// peaks. Restarts run in parallel; each iteration assigns every peak through
+// one maps^T * X product and refits each map as the leading eigenvector of
+// its cluster's scatter matrix.
+MicrostateModel fit(const EEGData &data, const QVector<int> &channels,
+                    const MicrostateParams &params = MicrostateParams());
+
+// Labels every sample with its best-correlated map, polarity ignored, in
+// parallel blocks. GEV and mean GFP come from this assignment; durations,
+// coverage and transitions from the labels after short segments are split.
+Segmentation backfit(const MicrostateModel &model, const EEGData &data,
+                     const MicrostateParams &params = MicrostateParams());
+
+}
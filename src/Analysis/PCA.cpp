@@ -0,0 +1,204 @@
+#include "PCA.h"
+#include "Correlation.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <Eigen/Eigenvalues>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <climits>
+
+namespace PCA {
+
+// Samples per streamed block
+static const int kBlockSamples = 16384;
+
+Eigen::VectorXd PCAModel::explainedVarianceRatio() const {
+    if (totalVariance <= 0.0) return Eigen::VectorXd::Zero(variances.size());
+    return variances / totalVariance;
+}
+
+PCAModel fromCovariance(const Eigen::MatrixXd &covariance, const Eigen::VectorXd &mean,
+                        int numComponents) {
+    PCAModel model;
+    int numChannels = covariance.rows();
+    if (numChannels == 0 || covariance.cols() != numChannels) return model;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(covariance);
+    Eigen::VectorXd eigenvalues = solver.eigenvalues().reverse();
+    Eigen::MatrixXd eigenvectors = solver.eigenvectors().rowwise().reverse();
+
+    int k = numComponents > 0 ? std::min(numComponents, numChannels) : numChannels;
+    double rankFloor = std::max(eigenvalues[0], 0.0) * 1e-10;
+    while (k > 1 && eigenvalues[k - 1] <= rankFloor) --k;
+
+    model.mean = mean;
+    model.components = eigenvectors.leftCols(k);
+    model.variances = eigenvalues.head(k).cwiseMax(0.0);
+    model.totalVariance = covariance.trace();
+    return model;
+}
+
+// Samples every channel has, 0 on invalid channels
+static int commonSampleCount(const EEGData &data, const QVector<int> &channels) {
+    int numSamples = INT_MAX;
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "PCA: Invalid channel index" << ch;
+            return 0;
+        }
+        numSamples = std::min(numSamples, data.channel(ch).sampleCount());
+    }
+    return numSamples;
+}
+
+// One streamed pass computing C Q, where C is the channel covariance. Also
+// returns the mean and trace, which come almost for free from the same blocks.
+static Eigen::MatrixXd covarianceProduct(const EEGData &data, const QVector<int> &channels,
+                                         int numSamples, const Eigen::VectorXd &offset,
+                                         const Eigen::MatrixXd &Q,
+                                         Eigen::VectorXd &mean, double &totalVariance) {
+    int numChannels = channels.size();
+    int parts = std::max(1, std::min(Parallel::threadCount(), numSamples / kBlockSamples));
+    QVector<Eigen::MatrixXd> productParts(parts);
+    QVector<Eigen::VectorXd> sumParts(parts);
+    QVector<Eigen::VectorXd> squareParts(parts);
+    Eigen::MatrixXd *product = productParts.data();
+    Eigen::VectorXd *sum = sumParts.data();
+    Eigen::VectorXd *squares = squareParts.data();
+
+    Parallel::parallelFor(0, parts, [&](int p) {
+        qint64 begin = static_cast<qint64>(numSamples) * p / parts;
+        qint64 end = static_cast<qint64>(numSamples) * (p + 1) / parts;
+        product[p] = Eigen::MatrixXd::Zero(numChannels, Q.cols());
+        sum[p] = Eigen::VectorXd::Zero(numChannels);
+        squares[p] = Eigen::VectorXd::Zero(numChannels);
+
+        for (qint64 s = begin; s < end; s += kBlockSamples) {
+            int count = static_cast<int>(std::min<qint64>(kBlockSamples, end - s));
+            EEGMatrix block = data.toMatrix(channels, static_cast<int>(s), count);
+            block.colwise() -= offset;
+            // Y (Y^T Q) keeps the intermediate at count x l instead of C x C
+            Eigen::MatrixXd projected = block.transpose() * Q;
+            product[p].noalias() += block * projected;
+            sum[p] += block.rowwise().sum();
+            squares[p] += block.rowwise().squaredNorm();
+        }
+    });
+
+    for (int p = 1; p < parts; ++p) {
+        productParts[0] += productParts[p];
+        sumParts[0] += sumParts[p];
+        squareParts[0] += squareParts[p];
+    }
+
+    // Take the mean back out: sum (y - m)(y - m)^T = sum y y^T - N m m^T
+    Eigen::VectorXd shiftedMean = sumParts[0] / numSamples;
+    mean = offset + shiftedMean;
+    totalVariance = (squareParts[0] / numSamples - shiftedMean.cwiseAbs2()).sum();
+    return productParts[0] / numSamples - shiftedMean * (shiftedMean.transpose() * Q);
+}
+
+static Eigen::MatrixXd orthonormalBasis(const Eigen::MatrixXd &Y) {
+    Eigen::HouseholderQR<Eigen::MatrixXd> qr(Y);
+    return qr.householderQ() * Eigen::MatrixXd::Identity(Y.rows(), Y.cols());
+}
+
+// Randomized subspace iteration on the covariance: the data is only ever
+// touched through C Q products, powerIterations + 2 streamed passes in total
+static PCAModel fitRandomized(const EEGData &data, const QVector<int> &channels,
+                              int numSamples, const PCAParams &params) {
+    int numChannels = channels.size();
+    int k = params.numComponents;
+    int width = std::min(numChannels, k + std::max(0, params.oversampling));
+
+    Eigen::VectorXd offset = data.toMatrix(channels, 0, std::min(numSamples, kBlockSamples))
+                                 .rowwise().mean();
+
+    std::mt19937 rng(params.seed);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    Eigen::MatrixXd Q(numChannels, width);
+    for (Eigen::Index i = 0; i < Q.size(); ++i) Q(i) = normal(rng);
+
+    Eigen::VectorXd mean;
+    double totalVariance = 0.0;
+    for (int pass = 0; pass <= std::max(0, params.powerIterations); ++pass) {
+        Q = orthonormalBasis(covarianceProduct(data, channels, numSamples, offset, Q, mean, totalVariance));
+    }
+
+    // Rayleigh-Ritz on the captured subspace
+    Eigen::MatrixXd CQ = covarianceProduct(data, channels, numSamples, offset, Q, mean, totalVariance);
+    Eigen::MatrixXd B = Q.transpose() * CQ;
+    B = 0.5 * (B + B.transpose());
+
+    PCAModel reduced = fromCovariance(B, Eigen::VectorXd(), k);
+    PCAModel model;
+    model.channels = channels;
+    model.mean = mean;
+    model.components = Q * reduced.components;
+    model.variances = reduced.variances;
+    model.totalVariance = totalVariance;
+    return model;
+}
+
+PCAModel fit(const EEGData &data, const QVector<int> &channels, const PCAParams &params) {
+    if (channels.isEmpty()) {
+        qWarning() << "PCA: No channels selected";
+        return PCAModel();
+    }
+
+    int numSamples = commonSampleCount(data, channels);
+    if (numSamples < 2) {
+        qWarning() << "PCA: Not enough samples";
+        return PCAModel();
+    }
+
+    // The range finder only pays off when far fewer components than channels are wanted
+    bool randomized = params.method == MethodRandomized && params.numComponents > 0
+                      && params.numComponents + params.oversampling < channels.size();
+    if (params.method == MethodRandomized && !randomized) {
+        qDebug() << "PCA: Falling back to the covariance method for" << params.numComponents
+                 << "of" << channels.size() << "components";
+    }
+    if (randomized) {
+        return fitRandomized(data, channels, numSamples, params);
+    }
+
+    Correlation::CovarianceAccumulator accumulator = Correlation::accumulateCovariance(data, channels);
+    PCAModel model = fromCovariance(accumulator.covariance(), accumulator.mean(), params.numComponents);
+    model.channels = channels;
+    return model;
+}
+
+EEGMatrix project(const PCAModel &model, const EEGData &data, int startSample, int numSamples) {
+    if (model.isEmpty()) return EEGMatrix();
+    EEGMatrix block = data.toMatrix(model.channels, startSample, numSamples);
+    if (block.size() == 0) return EEGMatrix();
+    block.colwise() -= model.mean;
+    return model.components.transpose() * block;
+}
+
+Eigen::MatrixXd projector(const PCAModel &model, const QVector<int> &components) {
+    int numChannels = model.components.rows();
+    Eigen::MatrixXd P = Eigen::MatrixXd::Identity(numChannels, numChannels);
+    for (int c : components) {
+        if (c < 0 || c >= model.componentCount()) {
+            qWarning() << "PCA: Invalid component index" << c;
+            return Eigen::MatrixXd();
+        }
+        P.noalias() -= model.components.col(c) * model.components.col(c).transpose();
+    }
+    return P;
+}
+
+void removeComponents(const PCAModel &model, EEGData &data, const QVector<int> &components) {
+    if (model.isEmpty() || components.isEmpty()) return;
+
+    // P (x - mean) + mean = P x + (I - P) mean
+    Eigen::MatrixXd P = projector(model, components);
+    if (P.size() == 0) return;
+    Eigen::VectorXd offset = model.mean - P * model.mean;
+    data.applyChannelTransform(model.channels, P, offset);
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "../DataModels/EEGData.h"
+
+namespace PCA {
+
+enum Method {
+    MethodCovariance,   // streamed covariance, exact eigendecomposition
+    MethodRandomized    // streamed randomized range finder, only the leading components
+};
+
+struct PCAParams {
+    int numComponents = -1;        // <= 0 keeps one per channel (covariance method only)
+    Method method = MethodCovariance;
+    int oversampling = 10;         // extra random directions for the range finder
+    int powerIterations = 2;       // sharpens the spectrum when it decays slowly
+    unsigned int seed = 7;
+};
+
+// scores = components^T * (x - mean), x ~ components * scores + mean
+struct PCAModel {
+    QVector<int> channels;
+    Eigen::VectorXd mean;
+    Eigen::MatrixXd components;    // channels x components, orthonormal columns
+    Eigen::VectorXd variances;     // per component, descending
+    double totalVariance = 0.0;    // trace of the channel covariance
+
+    bool isEmpty() const { return components.size() == 0; }
+    int componentCount() const { return components.cols(); }
+    Eigen::VectorXd explainedVarianceRatio() const;
+};
+
+// Leading components of a covariance matrix; rank-deficient directions are dropped
+PCAModel fromCovariance(const Eigen::MatrixXd &covariance, const Eigen::VectorXd &mean,
+                        int numComponents = -1);
+
+PCAModel fit(const EEGData &data, const QVector<int> &channels, const PCAParams &params = PCAParams());
+
+// Component scores over [startSample, startSample + numSamples)
+EEGMatrix project(const PCAModel &model, const EEGData &data, int startSample, int numSamples);
+
+// I - U_r U_r^T for the given components, the signal-space projection operator
+Eigen::MatrixXd projector(const PCAModel &model, const QVector<int> &components);
+
+// Projects the given components out of the data, in place
+void removeComponents(const PCAModel &model, EEGData &data, const QVector<int> &components);
+
+}
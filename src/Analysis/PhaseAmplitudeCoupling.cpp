@@ -0,0 +1,173 @@
+#include "PhaseAmplitudeCoupling.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+
+namespace PAC {
+
+namespace {
+
+struct Job {
+    int row;                    // into the channel list
+    qint64 start;               // block core, samples
+    qint64 count;
+};
+
+// Per phase frequency: summed amplitudes (amplitude frequencies x bins) and samples per bin
+struct BinSums {
+    std::vector<Eigen::MatrixXd> amplitude;
+    Eigen::MatrixXd counts;     // phase frequencies x bins
+};
+
+QVector<double> belowNyquist(const QVector<double> &frequencies, double rate, const char *what) {
+    QVector<double> kept;
+    for (double f : frequencies) {
+        if (f > 0.0 && f < rate / 2) kept.append(f);
+        else qWarning() << "PAC: Skipping" << what << "frequency" << f << "Hz";
+    }
+    return kept;
+}
+
+}
+
+QVector<Comodulogram> comodulogram(const EEGData &data, const QVector<int> &channels, const PACParams &params) {
+    QVector<Comodulogram> results;
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "PAC: Invalid channel index" << ch;
+            return results;
+        }
+    }
+    if (channels.isEmpty()) return results;
+    if (params.bins < 2 || params.bins > 255) {
+        qWarning() << "PAC: Bins must be in [2, 255]";
+        return results;
+    }
+
+    double rate = data.channel(channels[0]).samplingRate;
+    QVector<int> used;
+    for (int ch : channels) {
+        if (data.channel(ch).samplingRate == rate) used.append(ch);
+        else qWarning() << "PAC: Skipping" << data.channel(ch).label << "at a different sampling rate";
+    }
+
+    QVector<double> phaseFrequencies = belowNyquist(params.phaseFrequencies, rate, "phase");
+    QVector<double> amplitudeFrequencies = belowNyquist(params.amplitudeFrequencies, rate, "amplitude");
+    if (phaseFrequencies.isEmpty() || amplitudeFrequencies.isEmpty()) return results;
+    int numPhase = phaseFrequencies.size();
+    int numAmplitude = amplitudeFrequencies.size();
+    int bins = params.bins;
+
+    double amplitudeWidth = params.amplitudeWidth > 0.0
+        ? params.amplitudeWidth : *std::max_element(phaseFrequencies.begin(), phaseFrequencies.end());
+    QVector<double> phaseWidths(numPhase, params.phaseWidth);
+    QVector<double> amplitudeWidths(numAmplitude, amplitudeWidth);
+
+    // One block length for every task, so both banks are planned once
+    qint64 first = std::max<qint64>(0, std::llround(params.startTime * rate));
+    qint64 block = std::max<qint64>(16, std::llround(params.blockSeconds * rate));
+    qint64 pad = std::max<qint64>(0, std::llround(params.padSeconds * rate));
+    QVector<Job> jobs;
+    for (int row = 0; row < used.size(); ++row) {
+        qint64 total = data.channel(used[row]).data.size();
+        qint64 end = params.duration < 0.0 ? total : std::min(total, first + std::llround(params.duration * rate));
+        for (qint64 start = first; start < end; start += block) {
+            jobs.append({row, start, std::min(block, end - start)});
+        }
+    }
+    if (jobs.isEmpty()) return results;
+
+    qint64 length = block + 2 * pad;
+    TimeFrequency::FilterBank phaseBank(length, rate, phaseFrequencies, phaseWidths);
+    TimeFrequency::FilterBank amplitudeBank(length, rate, amplitudeFrequencies, amplitudeWidths);
+
+    QVector<BinSums> partial(jobs.size());
+    BinSums *sums = partial.data();
+    Parallel::parallelFor(0, jobs.size(), [&](int j) {
+        const Job &job = jobs[j];
+        const EEGChannel &channel = data.channel(used[job.row]);
+        const double *samples = channel.data.constData();
+        qint64 total = channel.data.size();
+
+        // The block with its padding, demeaned over the finite samples;
+        // non-finite samples and the part past either end of the data are zero
+        qint64 lo = job.start - pad;
+        Eigen::VectorXd x = Eigen::VectorXd::Zero(length);
+        std::vector<char> valid(length, 0);
+        double sum = 0.0;
+        qint64 count = 0;
+        for (qint64 i = 0; i < length; ++i) {
+            qint64 s = lo + i;
+            if (s < 0 || s >= total || !std::isfinite(samples[s])) continue;
+            x[i] = samples[s];
+            valid[i] = 1;
+            sum += x[i];
+            ++count;
+        }
+        BinSums &out = sums[j];
+        out.amplitude.assign(numPhase, Eigen::MatrixXd::Zero(numAmplitude, bins));
+        out.counts = Eigen::MatrixXd::Zero(numPhase, bins);
+        if (count == 0) return;
+        double mean = sum / count;
+        for (qint64 i = 0; i < length; ++i) {
+            if (valid[i]) x[i] -= mean;
+        }
+
+        Eigen::MatrixXcd phase, amplitude;
+        phaseBank.transform(x.data(), phase);
+        amplitudeBank.transform(x.data(), amplitude);
+        Eigen::MatrixXd envelope = amplitude.cwiseAbs();     // column per sample
+
+        // Phase in [-pi, pi] to a bin index, all frequencies at once
+        Eigen::Array<unsigned char, Eigen::Dynamic, Eigen::Dynamic> binIndex =
+            ((phase.array().arg() + M_PI) * (bins / (2.0 * M_PI))).floor().min(bins - 1.0).cast<unsigned char>();
+
+        qint64 coreFirst = pad;
+        qint64 coreEnd = pad + job.count;
+        for (int p = 0; p < numPhase; ++p) {
+            Eigen::MatrixXd &binned = out.amplitude[p];
+            for (qint64 t = coreFirst; t < coreEnd; ++t) {
+                if (!valid[t]) continue;
+                int b = binIndex(p, t);
+                binned.col(b) += envelope.col(t);
+                out.counts(p, b) += 1.0;
+            }
+        }
+    });
+
+    // Merge blocks per channel, then the modulation index of every pair
+    const double logBins = std::log(static_cast<double>(bins));
+    for (int row = 0; row < used.size(); ++row) {
+        std::vector<Eigen::MatrixXd> amplitude(numPhase, Eigen::MatrixXd::Zero(numAmplitude, bins));
+        Eigen::MatrixXd counts = Eigen::MatrixXd::Zero(numPhase, bins);
+        for (int j = 0; j < jobs.size(); ++j) {
+            if (jobs[j].row != row) continue;
+            for (int p = 0; p < numPhase; ++p) amplitude[p] += partial[j].amplitude[p];
+            counts += partial[j].counts;
+        }
+
+        Comodulogram result;
+        result.channel = used[row];
+        result.phaseFrequencies = phaseFrequencies;
+        result.amplitudeFrequencies = amplitudeFrequencies;
+        result.modulationIndex = Eigen::MatrixXd::Zero(numAmplitude, numPhase);
+        result.sampleCount = static_cast<qint64>(counts.row(0).sum());
+
+        for (int p = 0; p < numPhase; ++p) {
+            if ((counts.row(p).array() == 0.0).any()) continue;
+            Eigen::ArrayXXd meanAmplitude = amplitude[p].array().rowwise() / counts.row(p).array();
+            Eigen::ArrayXd totals = meanAmplitude.rowwise().sum();
+            for (int a = 0; a < numAmplitude; ++a) {
+                if (totals[a] <= 0.0) continue;
+                Eigen::ArrayXd distribution = meanAmplitude.row(a).transpose() / totals[a];
+                double entropy = -(distribution * distribution.max(1e-300).log()).sum();
+                result.modulationIndex(a, p) = (logBins - entropy) / logBins;
+            }
+        }
+        results.append(result);
+    }
+    return results;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include "TimeFrequency.h"
+#include "../DataModels/EEGData.h"
+
+namespace PAC {
+
+struct PACParams {
+    QVector<double> phaseFrequencies = TimeFrequency::frequencyRange(2.0, 12.0, 1.0);
+    QVector<double> amplitudeFrequencies = TimeFrequency::frequencyRange(20.0, 100.0, 5.0);
+    double phaseWidth = 1.0;             // Gaussian SD of the phase filters, Hz
+    double amplitudeWidth = -1.0;        // Hz; <= 0 uses the highest phase frequency, so the sidebands pass
+    int bins = 18;                       // phase bins, at most 255
+
+    double startTime = 0.0;              // seconds
+    double duration = -1.0;              // seconds, < 0 means to the end
+    double blockSeconds = 30.0;          // parallel tasks, bounds memory
+    double padSeconds = 2.0;             // filtered on either side of a block, then dropped
+};
+
+// Modulation index (Tort et al. 2010): KL divergence of the phase-binned mean
+// amplitude from uniform, normalized by log(bins)
+struct Comodulogram {
+    int channel = -1;
+    QVector<double> phaseFrequencies;
+    QVector<double> amplitudeFrequencies;
+    Eigen::MatrixXd modulationIndex;     // amplitude frequencies x phase frequencies
+    qint64 sampleCount = 0;
+
+    bool isEmpty() const { return modulationIndex.size() == 0; }
+};
+
+// Both filter banks run once per block. Phase becomes a bin index per
+// sample, then one pass over time per phase frequency adds each sample's
+// whole amplitude column to its bin's column, so every amplitude frequency
+// is binned at once. Tasks are (channel, block); non-finite samples are left
+// out. Channels must share the first channel's sampling rate.
+QVector<Comodulogram> comodulogram(const EEGData &data, const QVector<int> &channels,
+                                   const PACParams &params = PACParams());
+
+}
@@ -0,0 +1,317 @@
+#include "RobustStats.h"
+#include "../Utils/Parallel.h"
+#include "../Utils/SignalProcessor.h"
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+namespace RobustStats {
+
+// ================== QUANTILE SKETCH ==================
+
+QuantileSketch::QuantileSketch(int k) : m_k(std::max(8, k)) {}
+
+// Levels shrink geometrically below the top one, which holds k items
+void QuantileSketch::addLevel() {
+    m_levels.emplace_back();
+    int levels = static_cast<int>(m_levels.size());
+    m_capacities.resize(levels);
+    m_budget = 0;
+    for (int h = 0; h < levels; ++h) {
+        m_capacities[h] = std::max(2, static_cast<int>(std::ceil(m_k * std::pow(2.0 / 3.0, levels - 1 - h))));
+        m_budget += m_capacities[h];
+    }
+}
+
+void QuantileSketch::insert(double value) {
+    if (std::isfinite(value)) append(value);
+}
+
+void QuantileSketch::append(double value) {
+    if (m_levels.empty()) addLevel();
+    m_levels[0].push_back(value);
+    ++m_count;
+    ++m_retained;
+    if (m_retained >= m_budget) compress();
+}
+
+void QuantileSketch::insert(const double *x, qint64 n, const ValidityMask &mask) {
+    // Without a matching mask every sample is tested, with one only dirty chunks
+    bool checked = mask.size() != n;
+    for (qint64 start = 0; start < n; start += ValidityMask::ChunkSize) {
+        qint64 end = std::min(n, start + ValidityMask::ChunkSize);
+        if (checked || !mask.chunkValid(start / ValidityMask::ChunkSize)) {
+            for (qint64 i = start; i < end; ++i) insert(x[i]);
+        } else {
+            for (qint64 i = start; i < end; ++i) append(x[i]);
+        }
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch &other) {
+    if (other.isEmpty()) return;
+    while (m_levels.size() < other.m_levels.size()) addLevel();
+    for (size_t h = 0; h < other.m_levels.size(); ++h) {
+        m_levels[h].insert(m_levels[h].end(), other.m_levels[h].begin(), other.m_levels[h].end());
+    }
+    m_count += other.m_count;
+    m_retained += other.m_retained;
+    compress();
+}
+
+// Once the sketch holds its budget, sorts the lowest full level and promotes
+// every other item, starting at a random one of the first two, with twice the weight
+void QuantileSketch::compress() {
+    for (;;) {
+        if (m_retained < m_budget) return;
+
+        int level = -1;
+        for (size_t h = 0; h < m_levels.size(); ++h) {
+            if (static_cast<int>(m_levels[h].size()) >= m_capacities[h]) {
+                level = static_cast<int>(h);
+                break;
+            }
+        }
+        if (level < 0) return;
+
+        if (level + 1 == static_cast<int>(m_levels.size())) addLevel();
+        std::vector<double> &items = m_levels[level];
+        std::vector<double> &next = m_levels[level + 1];
+        std::sort(items.begin(), items.end());
+
+        size_t pairs = items.size() / 2;
+        m_random ^= m_random << 13;
+        m_random ^= m_random >> 7;
+        m_random ^= m_random << 17;
+        size_t offset = m_random & 1;
+        for (size_t i = 0; i < pairs; ++i) next.push_back(items[2 * i + offset]);
+
+        bool odd = items.size() % 2 != 0;
+        double leftover = items.back();
+        items.clear();
+        if (odd) items.push_back(leftover);
+        m_retained -= static_cast<int>(pairs);
+    }
+}
+
+QVector<double> QuantileSketch::quantiles(const QVector<double> &qs) const {
+    QVector<double> result(qs.size(), 0.0);
+    if (isEmpty()) return result;
+
+    std::vector<std::pair<double, double>> weighted;
+    weighted.reserve(m_retained);
+    for (size_t h = 0; h < m_levels.size(); ++h) {
+        double weight = std::ldexp(1.0, static_cast<int>(h));
+        for (double value : m_levels[h]) weighted.emplace_back(value, weight);
+    }
+    std::sort(weighted.begin(), weighted.end());
+
+    std::vector<double> cumulative(weighted.size());
+    double total = 0.0;
+    for (size_t i = 0; i < weighted.size(); ++i) {
+        total += weighted[i].second;
+        cumulative[i] = total;
+    }
+
+    for (int i = 0; i < qs.size(); ++i) {
+        double target = qBound(0.0, qs[i], 1.0) * total;
+        size_t j = std::lower_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin();
+        result[i] = weighted[std::min(j, weighted.size() - 1)].first;
+    }
+    return result;
+}
+
+double QuantileSketch::quantile(double q) const {
+    return quantiles({q})[0];
+}
+
+// ================== EXACT SELECTION ==================
+
+namespace {
+
+// Valid samples in one buffer: clean chunks are copied whole, dirty chunks
+// compacted without a branch per sample
+std::vector<double> validCopy(const double *x, qint64 n, const ValidityMask &mask) {
+    bool masked = mask.size() == n && !mask.allValid();
+    if (!masked) return std::vector<double>(x, x + n);
+
+    // One slot of slack, each invalid sample is written and then overwritten
+    std::vector<double> out(n - mask.invalidCount() + 1);
+
+    std::vector<double> valid(ValidityMask::ChunkSize);
+    size_t k = 0;
+    for (qint64 start = 0; start < n; start += ValidityMask::ChunkSize) {
+        qint64 count = std::min(ValidityMask::ChunkSize, n - start);
+        if (mask.chunkValid(start / ValidityMask::ChunkSize)) {
+            std::copy(x + start, x + start + count, out.begin() + k);
+            k += count;
+            continue;
+        }
+        mask.weights(start, count, valid.data());
+        for (qint64 i = 0; i < count; ++i) {
+            out[k] = x[start + i];
+            k += valid[i] > 0.0;
+        }
+    }
+    out.pop_back();
+    return out;
+}
+
+// Linear interpolation between order statistics (Hyndman & Fan type 7).
+// Each selection works on the part above the previous one, so ascending
+// quantiles cost one partial pass each.
+QVector<double> selectQuantiles(std::vector<double> &values, const QVector<double> &qs) {
+    QVector<double> result(qs.size(), 0.0);
+    if (values.empty()) return result;
+
+    QVector<int> order(qs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return qs[a] < qs[b]; });
+
+    size_t m = values.size();
+    auto from = values.begin();
+    for (int i : order) {
+        double position = qBound(0.0, qs[i], 1.0) * (m - 1);
+        size_t lo = static_cast<size_t>(std::floor(position));
+        auto nth = values.begin() + lo;
+        if (nth >= from) std::nth_element(from, nth, values.end());
+        from = nth;
+
+        double value = *nth;
+        double frac = position - lo;
+        if (frac > 0.0 && lo + 1 < m) {
+            double above = *std::min_element(nth + 1, values.end());
+            value += frac * (above - value);
+        }
+        result[i] = value;
+    }
+    return result;
+}
+
+// Excess kurtosis about a known mean and variance
+double kurtosis(const double *x, qint64 n, const ValidityMask &mask, const SignalProcessor::Moments &m) {
+    if (m.count < 4 || m.variance <= 0.0) return 0.0;
+
+    bool masked = mask.size() == n && !mask.allValid();
+    Eigen::ArrayXd valid(masked ? ValidityMask::ChunkSize : 0);
+    double sum = 0.0;
+    for (qint64 start = 0; start < n; start += ValidityMask::ChunkSize) {
+        qint64 count = std::min(ValidityMask::ChunkSize, n - start);
+        Eigen::Map<const Eigen::ArrayXd> values(x + start, count);
+        if (!masked || mask.chunkValid(start / ValidityMask::ChunkSize)) {
+            sum += (values - m.mean).square().square().sum();
+        } else {
+            mask.weights(start, count, valid.data());
+            sum += (valid.head(count) > 0.0).select(values - m.mean, 0.0).square().square().sum();
+        }
+    }
+    return sum / m.count / (m.variance * m.variance) - 3.0;
+}
+
+}
+
+QVector<double> quantiles(const double *x, qint64 n, const QVector<double> &qs, const ValidityMask &mask) {
+    std::vector<double> values = validCopy(x, n, mask);
+    return selectQuantiles(values, qs);
+}
+
+double median(const double *x, qint64 n, const ValidityMask &mask) {
+    return quantiles(x, n, {0.5}, mask)[0];
+}
+
+double mad(const double *x, qint64 n, const ValidityMask &mask) {
+    std::vector<double> values = validCopy(x, n, mask);
+    if (values.empty()) return 0.0;
+    double center = selectQuantiles(values, {0.5})[0];
+    for (double &v : values) v = std::abs(v - center);
+    return selectQuantiles(values, {0.5})[0];
+}
+
+// ================== CHANNEL STATISTICS ==================
+
+double ChannelStats::iqr(const StatsParams &params) const {
+    int q1 = params.percentiles.indexOf(25);
+    int q3 = params.percentiles.indexOf(75);
+    // A symmetric distribution has its quartiles one MAD either side of the median
+    if (q1 < 0 || q3 < 0 || q3 >= percentiles.size()) return 2.0 * mad;
+    return percentiles[q3] - percentiles[q1];
+}
+
+QVector<ChannelStats> channelStats(const EEGData &data, const QVector<int> &channels, const StatsParams &params) {
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Robust stats: Invalid channel index" << ch;
+            return QVector<ChannelStats>();
+        }
+    }
+
+    QVector<double> qs;
+    qs.append(0.5);
+    for (double p : params.percentiles) qs.append(p / 100.0);
+
+    QVector<ChannelStats> results(channels.size());
+    Parallel::parallelFor(0, channels.size(), [&](int i) {
+        const EEGChannel &channel = data.channel(channels[i]);
+        const double *x = channel.data.constData();
+        qint64 n = channel.data.size();
+
+        ChannelStats &stats = results[i];
+        stats.channel = channels[i];
+        SignalProcessor::Moments m = SignalProcessor::moments(x, n, channel.validity);
+        stats.count = m.count;
+        stats.mean = m.mean;
+        stats.stdDev = std::sqrt(m.variance);
+        stats.min = m.min;
+        stats.max = m.max;
+        stats.kurtosis = kurtosis(x, n, channel.validity, m);
+        stats.percentiles = QVector<double>(params.percentiles.size(), 0.0);
+        if (m.count == 0) return;
+
+        QVector<double> values;
+        if (params.exact) {
+            std::vector<double> samples = validCopy(x, n, channel.validity);
+            values = selectQuantiles(samples, qs);
+            for (double &v : samples) v = std::abs(v - values[0]);
+            stats.mad = selectQuantiles(samples, {0.5})[0];
+        } else {
+            QuantileSketch sketch(params.sketchK);
+            sketch.insert(x, n, channel.validity);
+            values = sketch.quantiles(qs);
+
+            // Second pass for the deviations, non-finite samples drop out on insert
+            QuantileSketch deviations(params.sketchK);
+            for (qint64 s = 0; s < n; ++s) deviations.insert(std::abs(x[s] - values[0]));
+            stats.mad = deviations.quantile(0.5);
+        }
+        stats.median = values[0];
+        stats.percentiles = values.mid(1);
+    });
+    return results;
+}
+
+QVector<int> deviantChannels(const QVector<ChannelStats> &stats, double threshold) {
+    QVector<int> deviant;
+    QVector<double> spreads;
+    for (const ChannelStats &s : stats) {
+        if (s.count > 0 && s.mad > 0.0) spreads.append(std::log(s.robustStdDev()));
+    }
+
+    double center = 0.0;
+    double scale = 0.0;
+    if (spreads.size() >= 3) {
+        center = median(spreads.constData(), spreads.size());
+        scale = kMadToStdDev * mad(spreads.constData(), spreads.size());
+    }
+
+    for (const ChannelStats &s : stats) {
+        if (s.count == 0 || s.mad <= 0.0) {
+            deviant.append(s.channel);
+        } else if (scale > 0.0 && std::abs(std::log(s.robustStdDev()) - center) / scale > threshold) {
+            deviant.append(s.channel);
+        }
+    }
+    return deviant;
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <QVector>
+#include <vector>
+#include "../DataModels/EEGData.h"
+#include "../DataModels/ValidityMask.h"
+
+namespace RobustStats {
+
+// Scale from MAD to the standard deviation of a normal distribution
+const double kMadToStdDev = 1.4826;
+
+// Mergeable quantile sketch (KLL, Karnin, Lang & Liberty 2016). Memory stays
+// around 3k values whatever the stream length; rank error is roughly 1.7/k.
+// Sketches of separate pages or blocks merge into one for the whole stream.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(int k = 200);
+
+    void insert(double value);
+    // Valid samples of x[0, n) (mask ignored when it does not match n)
+    void insert(const double *x, qint64 n, const ValidityMask &mask = ValidityMask());
+    void merge(const QuantileSketch &other);
+
+    qint64 count() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+    // q in [0, 1]; 0 when empty
+    double quantile(double q) const;
+    QVector<double> quantiles(const QVector<double> &qs) const;
+
+private:
+    void addLevel();
+    void append(double value);
+    void compress();
+
+    int m_k;
+    qint64 m_count = 0;
+    int m_retained = 0;
+    int m_budget = 0;           // total capacity of the levels
+    std::vector<std::vector<double>> m_levels;   // level h items weigh 2^h
+    std::vector<int> m_capacities;
+    quint64 m_random = 0x9e3779b97f4a7c15ULL;    // xorshift state for the compaction coin
+};
+
+// Exact quantiles of the valid samples by selection (nth_element over a
+// chunked copy), O(n) per call. qs in [0, 1], any order.
+QVector<double> quantiles(const double *x, qint64 n, const QVector<double> &qs,
+                          const ValidityMask &mask = ValidityMask());
+double median(const double *x, qint64 n, const ValidityMask &mask = ValidityMask());
+// Median absolute deviation from the median, unscaled
+double mad(const double *x, qint64 n, const ValidityMask &mask = ValidityMask());
+
+struct StatsParams {
+    QVector<double> percentiles = {1, 5, 25, 75, 95, 99};
+    bool exact = true;          // false: streaming sketches, bounded memory
+    int sketchK = 200;
+};
+
+struct ChannelStats {
+    int channel = -1;
+    qint64 count = 0;           // valid samples
+    double mean = 0.0;
+    double stdDev = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double median = 0.0;
+    double mad = 0.0;           // unscaled
+    double kurtosis = 0.0;      // excess, 0 for a normal distribution
+    QVector<double> percentiles;    // matching StatsParams::percentiles
+
+    double robustStdDev() const { return kMadToStdDev * mad; }
+    double iqr(const StatsParams &params) const;
+};
+
+// Channels in parallel
+QVector<ChannelStats> channelStats(const EEGData &data, const QVector<int> &channels,
+                                   const StatsParams &params = StatsParams());
+
+// Channels whose robust spread is an outlier among the others: robust z of
+// log(robustStdDev) beyond threshold, or no spread at all
+QVector<int> deviantChannels(const QVector<ChannelStats> &stats, double threshold = 5.0);
+
+}
@@ -0,0 +1,273 @@
+#include "SeizureDetector.h"
+#include "RobustStats.h"
+#include "../Utils/Parallel.h"
+#include <iir/Butterworth.h>
+#include <QDebug>
+#include <QSet>
+#include <Eigen/Dense>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace SeizureDetection {
+
+namespace {
+
+// Columns of the per step sums
+enum Column {
+    ColValid,          // valid samples
+    ColPairs,          // valid (n-1, n) pairs
+    ColTriples,        // valid (n-1, n, n+1) triples
+    ColLineLength,
+    ColEnergy,
+    ColSum,
+    ColSumSq,
+    ColFirstBand
+};
+
+using StepRows = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+FeatureSeries channelFeatures(const EEGChannel &channel, int channelIndex, const FeatureParams &params) {
+    FeatureSeries series;
+    series.channel = channelIndex;
+
+    double rate = channel.samplingRate;
+    qint64 total = channel.data.size();
+    qint64 stepLength = std::max<qint64>(1, std::llround(params.step * rate));
+    int stepsPerWindow = std::max(1, static_cast<int>(std::lround(params.window / params.step)));
+    qint64 steps = total / stepLength;
+    series.step = stepLength / rate;
+    series.window = stepsPerWindow * series.step;
+
+    int numBands = params.bands.size();
+    series.bandRatios.resize(numBands);
+    qint64 numWindows = std::max<qint64>(0, steps - stepsPerWindow + 1);
+    if (numWindows == 0) return series;
+
+    series.lineLength.resize(numWindows);
+    series.energy.resize(numWindows);
+    series.rms.resize(numWindows);
+    for (QVector<float> &ratios : series.bandRatios) ratios.resize(numWindows);
+
+    // iir1 band-pass filters take the centre frequency and the width
+    std::vector<Iir::Butterworth::BandPass<2>> filters(numBands);
+    QVector<bool> bandUsable(numBands);
+    for (int b = 0; b < numBands; ++b) {
+        const Band &band = params.bands[b];
+        bandUsable[b] = band.low > 0.0 && band.high > band.low && band.high < rate / 2;
+        if (bandUsable[b]) filters[b].setup(rate, (band.low + band.high) / 2, band.high - band.low);
+    }
+
+    const double *x = channel.data.constData();
+    bool checkMask = channel.validity.size() == total && !channel.validity.allValid();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+
+    // Ring of the last stepsPerWindow steps plus the running window total
+    int columns = ColFirstBand + numBands;
+    StepRows ring = StepRows::Zero(stepsPerWindow, columns);
+    Eigen::RowVectorXd window = Eigen::RowVectorXd::Zero(columns);
+
+    Eigen::ArrayXd held(stepLength + 2), weight(stepLength + 2);
+    double lastValid = 0.0;
+
+    for (qint64 step = 0; step < steps; ++step) {
+        // One sample either side for the differences and the Teager energy
+        qint64 start = step * stepLength;
+        qint64 lo = std::max<qint64>(0, start - 1);
+        qint64 hi = std::min(total, start + stepLength + 1);
+        qint64 n = hi - lo;
+        qint64 offset = start - lo;
+
+        // Gaps hold the last valid value for the filters and weigh zero in every sum
+        const double *y = x + lo;
+        weight.head(n).setOnes();
+        if (checkMask && !channel.validity.rangeValid(lo, n)) {
+            channel.validity.weights(lo, n, weight.data());
+            for (qint64 k = 0; k < n; ++k) {
+                if (weight[k] > 0.0) lastValid = y[k];
+                held[k] = lastValid;
+            }
+            y = held.data();
+        }
+
+        Eigen::Map<const Eigen::ArrayXd> Y(y, n);
+        auto W = weight.head(n);
+        auto row = ring.row(step % stepsPerWindow);
+        if (step >= stepsPerWindow) window -= row;
+
+        auto Ys = Y.segment(offset, stepLength);
+        auto Ws = W.segment(offset, stepLength);
+        row[ColValid] = Ws.sum();
+        row[ColSum] = (Ws * Ys).sum();
+        row[ColSumSq] = (Ws * Ys.square()).sum();
+
+        qint64 m = offset + stepLength - 1;              // pairs ending inside the step
+        Eigen::ArrayXd pairWeight = W.segment(1, m) * W.segment(0, m);
+        row[ColPairs] = pairWeight.sum();
+        row[ColLineLength] = (pairWeight * (Y.segment(1, m) - Y.segment(0, m)).abs()).sum();
+
+        qint64 t = std::min(offset + stepLength, n - 1) - 1; // triples centred inside the step
+        if (t > 0) {
+            Eigen::ArrayXd tripleWeight = W.segment(0, t) * W.segment(1, t) * W.segment(2, t);
+            row[ColTriples] = tripleWeight.sum();
+            row[ColEnergy] = (tripleWeight * (Y.segment(1, t).square() - Y.segment(0, t) * Y.segment(2, t))).sum();
+        } else {
+            row[ColTriples] = 0.0;
+            row[ColEnergy] = 0.0;
+        }
+
+        for (int b = 0; b < numBands; ++b) {
+            double power = 0.0;
+            if (bandUsable[b]) {
+                for (qint64 k = offset; k < offset + stepLength; ++k) {
+                    double filtered = filters[b].filter(y[k]);
+                    power += W[k] * filtered * filtered;
+                }
+            }
+            row[ColFirstBand + b] = power;
+        }
+        window += row;
+
+        if (step + 1 < stepsPerWindow) continue;
+        qint64 w = step + 1 - stepsPerWindow;
+
+        // Re-add the ring once per window length so rounding cannot build up
+        if (w % stepsPerWindow == stepsPerWindow - 1) window = ring.colwise().sum();
+
+        double valid = window[ColValid];
+        if (valid < (1.0 - params.maxInvalidFraction) * stepsPerWindow * stepLength || valid < 2) {
+            series.lineLength[w] = series.energy[w] = series.rms[w] = nan;
+            for (QVector<float> &ratios : series.bandRatios) ratios[w] = nan;
+            continue;
+        }
+
+        double mean = window[ColSum] / valid;
+        double variance = std::max(0.0, window[ColSumSq] / valid - mean * mean);
+        series.lineLength[w] = window[ColPairs] > 0 ? window[ColLineLength] / window[ColPairs] : nan;
+        series.energy[w] = window[ColTriples] > 0 ? window[ColEnergy] / window[ColTriples] : nan;
+        series.rms[w] = std::sqrt(variance);
+        for (int b = 0; b < numBands; ++b) {
+            series.bandRatios[b][w] = bandUsable[b] && variance > 0.0
+                ? window[ColFirstBand + b] / valid / variance : nan;
+        }
+    }
+    return series;
+}
+
+// Median of the finite values of a float series
+double seriesMedian(const QVector<float> &values) {
+    QVector<double> finite;
+    finite.reserve(values.size());
+    for (float v : values) {
+        if (std::isfinite(v)) finite.append(v);
+    }
+    return finite.isEmpty() ? 0.0 : RobustStats::median(finite.constData(), finite.size());
+}
+
+}
+
+QVector<FeatureSeries> extractFeatures(const EEGData &data, const QVector<int> &channels, const FeatureParams &params) {
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Seizure detection: Invalid channel index" << ch;
+            return QVector<FeatureSeries>();
+        }
+    }
+    if (params.window <= 0.0 || params.step <= 0.0 || params.step > params.window) {
+        qWarning() << "Seizure detection: Invalid window" << params.window << "or step" << params.step;
+        return QVector<FeatureSeries>();
+    }
+    for (const Band &band : params.bands) {
+        if (band.low <= 0.0 || band.high <= band.low) {
+            qWarning() << "Seizure detection: Invalid band" << band.name;
+        }
+    }
+
+    QVector<FeatureSeries> features(channels.size());
+    Parallel::parallelFor(0, channels.size(), [&](int i) {
+        features[i] = channelFeatures(data.channel(channels[i]), channels[i], params);
+    });
+    return features;
+}
+
+QVector<EEGEvent> detect(const QVector<FeatureSeries> &features, const DetectionParams &params) {
+    QVector<EEGEvent> events;
+    if (features.isEmpty()) return events;
+
+    // Channels stepping differently cannot share windows
+    double step = features[0].step;
+    double windowLength = features[0].window;
+    QVector<const FeatureSeries*> used;
+    int numWindows = INT_MAX;
+    for (const FeatureSeries &series : features) {
+        if (std::abs(series.step - step) > 1e-9 || std::abs(series.window - windowLength) > 1e-9) {
+            qWarning() << "Seizure detection: Skipping channel" << series.channel << "with a different window";
+            continue;
+        }
+        used.append(&series);
+        numWindows = std::min(numWindows, series.windowCount());
+    }
+    if (used.isEmpty() || numWindows == 0) return events;
+
+    // Flagged channels per window, each against its own baseline
+    QVector<QVector<char>> flagged(used.size());
+    Parallel::parallelFor(0, used.size(), [&](int i) {
+        const FeatureSeries &series = *used[i];
+        double lineThreshold = params.lineLengthFactor * seriesMedian(series.lineLength);
+        double energyThreshold = params.energyFactor * seriesMedian(series.energy);
+        flagged[i].resize(numWindows);
+        for (int w = 0; w < numWindows; ++w) {
+            flagged[i][w] = series.lineLength[w] > lineThreshold && series.energy[w] > energyThreshold;
+        }
+    });
+
+    int needed = std::max(1, std::min(params.minChannels, static_cast<int>(used.size())));
+    QVector<char> seizure(numWindows);
+    for (int w = 0; w < numWindows; ++w) {
+        int count = 0;
+        for (const QVector<char> &flags : flagged) count += flags[w];
+        seizure[w] = count >= needed;
+    }
+
+    // Runs of seizure windows, joined across short gaps
+    double runStart = -1.0;
+    double runEnd = -1.0;
+    QSet<int> runChannels;
+    auto finishRun = [&]() {
+        if (runStart < 0.0 || runEnd - runStart < params.minDuration) return;
+        EEGEvent event;
+        event.onset = runStart;
+        event.duration = runEnd - runStart;
+        event.type = params.eventType;
+        event.channel = runChannels.size() == 1 ? *runChannels.begin() : -1;
+        events.append(event);
+    };
+
+    for (int w = 0; w < numWindows; ++w) {
+        if (!seizure[w]) continue;
+        double start = w * step;
+        if (runStart >= 0.0 && start - runEnd > params.mergeGap) {
+            finishRun();
+            runStart = -1.0;
+        }
+        if (runStart < 0.0) {
+            runStart = start;
+            runChannels.clear();
+        }
+        runEnd = start + windowLength;
+        for (int i = 0; i < used.size(); ++i) {
+            if (flagged[i][w]) runChannels.insert(used[i]->channel);
+        }
+    }
+    finishRun();
+    return events;
+}
+
+int detectInto(EEGData &data, const QVector<int> &channels,
+               const FeatureParams &featureParams, const DetectionParams &detectionParams) {
+    QVector<EEGEvent> events = detect(extractFeatures(data, channels, featureParams), detectionParams);
+    data.addEvents(events);
+    return events.size();
+}
+
+}
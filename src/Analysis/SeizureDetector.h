@@ -0,0 +1,61 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include "../DataModels/EEGData.h"
+
+namespace SeizureDetection {
+
+struct Band {
+    QString name;
+    double low;                            // Hz
+    double high;                           // Hz
+};
+
+// Sliding windows advance by whole steps; window / step steps per window
+struct FeatureParams {
+    double window = 2.0;                   // seconds
+    double step = 0.5;                     // seconds
+    QVector<Band> bands = {{"Delta-Theta", 1.0, 8.0}, {"Alpha-Beta", 8.0, 30.0}};
+    double maxInvalidFraction = 0.5;       // windows above this are NaN
+};
+
+// One value per window, float to keep day-long series small. Features are
+// per valid sample, so windows touching a gap stay comparable.
+struct FeatureSeries {
+    int channel = -1;
+    double window = 0.0;                   // seconds
+    double step = 0.0;                     // seconds
+    QVector<float> lineLength;             // mean |x[n] - x[n-1]|
+    QVector<float> energy;                 // mean Teager energy x[n]^2 - x[n-1] x[n+1]
+    QVector<float> rms;                    // about the window mean
+    QVector<QVector<float>> bandRatios;    // band power / window variance, per band
+
+    int windowCount() const { return lineLength.size(); }
+    double windowStart(int w) const { return w * step; }
+};
+
+struct DetectionParams {
+    double lineLengthFactor = 3.0;         // over the channel's median line length
+    double energyFactor = 6.0;             // over the channel's median energy
+    int minChannels = 2;                   // flagged together, fewer if fewer are given
+    double minDuration = 10.0;             // seconds
+    double mergeGap = 5.0;                 // seconds between runs joined into one
+    QString eventType = "Seizure";
+};
+
+// Per step sums updated as the window slides, so each step costs the same
+// however long the window is; channels run in parallel
+QVector<FeatureSeries> extractFeatures(const EEGData &data, const QVector<int> &channels,
+                                       const FeatureParams &params = FeatureParams());
+
+// Windows where enough channels exceed their own baseline on both line length
+// and energy, merged into events; single-channel events carry the channel
+QVector<EEGEvent> detect(const QVector<FeatureSeries> &features,
+                         const DetectionParams &params = DetectionParams());
+
+// extractFeatures + detect + one batch insert into the event store; returns the count
+int detectInto(EEGData &data, const QVector<int> &channels,
+               const FeatureParams &featureParams = FeatureParams(),
+               const DetectionParams &detectionParams = DetectionParams());
+
+}
@@ -0,0 +1,126 @@
+#include "SphericalSpline.h"
+#include <QDebug>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+
+namespace SphericalSpline {
+
+double splineKernel(double cosAngle, const SplineParams &params) {
+    double x = std::clamp(cosAngle, -1.0, 1.0);
+    double previous = 1.0;   // P0
+    double current = x;      // P1
+    double sum = 0.0;
+    for (int n = 1; n <= params.legendreTerms; ++n) {
+        double nn = static_cast<double>(n) * (n + 1);
+        sum += (2.0 * n + 1.0) / std::pow(nn, params.order) * current;
+        double next = ((2.0 * n + 1.0) * x * current - n * previous) / (n + 1);
+        previous = current;
+        current = next;
+    }
+    return sum / (4.0 * M_PI);
+}
+
+static Eigen::MatrixXd kernelMatrix(const std::vector<Eigen::Vector3d> &rows,
+                                    const std::vector<Eigen::Vector3d> &cols, const SplineParams &params) {
+    Eigen::MatrixXd g(rows.size(), cols.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        for (size_t j = 0; j < cols.size(); ++j) {
+            g(i, j) = splineKernel(rows[i].dot(cols[j]), params);
+        }
+    }
+    return g;
+}
+
+static Eigen::MatrixXd computeMatrix(const std::vector<Eigen::Vector3d> &sources,
+                                     const std::vector<Eigen::Vector3d> &targets, const SplineParams &params) {
+    int k = static_cast<int>(sources.size());
+
+    // [G 1; 1' 0] [c; c0] = [v; 0], so the weights are [G_ts 1] times the
+    // first k columns of the inverse
+    Eigen::MatrixXd system = Eigen::MatrixXd::Zero(k + 1, k + 1);
+    system.topLeftCorner(k, k) = kernelMatrix(sources, sources, params);
+    system.topLeftCorner(k, k).diagonal().array() += params.regularization;
+    system.block(0, k, k, 1).setOnes();
+    system.block(k, 0, 1, k).setOnes();
+
+    Eigen::MatrixXd rhs = Eigen::MatrixXd::Zero(k + 1, k);
+    rhs.topRows(k).setIdentity();
+    Eigen::MatrixXd coefficients = system.fullPivLu().solve(rhs);
+
+    Eigen::MatrixXd evaluation(targets.size(), k + 1);
+    evaluation.leftCols(k) = kernelMatrix(targets, sources, params);
+    evaluation.col(k).setOnes();
+    return evaluation * coefficients;
+}
+
+Eigen::MatrixXd interpolationMatrix(const std::vector<Eigen::Vector3d> &sources,
+                                    const std::vector<Eigen::Vector3d> &targets, const SplineParams &params) {
+    if (sources.empty() || targets.empty()) return Eigen::MatrixXd();
+
+    // Key on the exact geometry, so a changed layout never hits a stale entry
+    std::vector<double> key;
+    key.reserve(3 * (sources.size() + targets.size()) + 5);
+    key.push_back(static_cast<double>(sources.size()));
+    for (const auto &p : sources) key.insert(key.end(), {p.x(), p.y(), p.z()});
+    key.push_back(static_cast<double>(targets.size()));
+    for (const auto &p : targets) key.insert(key.end(), {p.x(), p.y(), p.z()});
+    key.insert(key.end(), {static_cast<double>(params.order), static_cast<double>(params.legendreTerms),
+                           params.regularization});
+
+    static std::map<std::vector<double>, std::shared_ptr<const Eigen::MatrixXd>> cache;
+    static std::mutex cacheMutex;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = cache.find(key);
+        if (it != cache.end()) return *it->second;
+    }
+
+    auto matrix = std::make_shared<const Eigen::MatrixXd>(computeMatrix(sources, targets, params));
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    // Bad sets vary little within a session, a small cache is plenty
+    if (cache.size() >= 32) cache.clear();
+    cache[key] = matrix;
+    return *matrix;
+}
+
+bool interpolateChannels(EEGData &data, const QVector<int> &badChannels, const SplineParams &params) {
+    if (badChannels.isEmpty()) return false;
+
+    const ElectrodeLayout &layout = data.electrodeLayout();
+    std::vector<Eigen::Vector3d> targets;
+    for (int ch : badChannels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Spherical spline: Invalid channel index" << ch;
+            return false;
+        }
+        if (!layout.contains(data.channel(ch).label)) {
+            qWarning() << "Spherical spline: No position for" << data.channel(ch).label;
+            return false;
+        }
+        targets.push_back(layout.position(data.channel(ch).label));
+    }
+
+    double samplingRate = data.channel(badChannels[0]).samplingRate;
+    QVector<int> sources;
+    std::vector<Eigen::Vector3d> sourcePositions;
+    for (int ch = 0; ch < data.channelCount(); ++ch) {
+        const EEGChannel &channel = data.channel(ch);
+        if (badChannels.contains(ch) || channel.samplingRate != samplingRate) continue;
+        if (!layout.contains(channel.label)) continue;
+        sources.append(ch);
+        sourcePositions.push_back(layout.position(channel.label));
+    }
+    if (sources.size() < 4) {
+        qWarning() << "Spherical spline: Need at least 4 good positioned channels, have" << sources.size();
+        return false;
+    }
+
+    Eigen::MatrixXd weights = interpolationMatrix(sourcePositions, targets, params);
+    data.mapChannels(sources, badChannels, weights);
+    return true;
+}
+
+}
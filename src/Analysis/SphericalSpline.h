@@ -0,0 +1,31 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include <vector>
+#include "../DataModels/EEGData.h"
+
+namespace SphericalSpline {
+
+// Perrin et al. (1989) spherical splines
+struct SplineParams {
+    int order = 4;                  // m, stiffness of the spline
+    int legendreTerms = 50;
+    double regularization = 1e-5;   // added to the diagonal of G
+};
+
+// g(cos angle) = 1/(4 pi) sum (2n+1) / (n(n+1))^m P_n(cos angle)
+double splineKernel(double cosAngle, const SplineParams &params = SplineParams());
+
+// targets x sources weights estimating the targets from the sources. Cached
+// per (source positions, target positions, params), so repeated repairs of
+// the same bad set only pay for the product.
+Eigen::MatrixXd interpolationMatrix(const std::vector<Eigen::Vector3d> &sources,
+                                    const std::vector<Eigen::Vector3d> &targets,
+                                    const SplineParams &params = SplineParams());
+
+// Replaces the bad channels with splines through every other positioned
+// channel of the same sampling rate, as one blocked matrix product
+bool interpolateChannels(EEGData &data, const QVector<int> &badChannels,
+                         const SplineParams &params = SplineParams());
+
+}
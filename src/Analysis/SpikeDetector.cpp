@@ -0,0 +1,198 @@
+#include "SpikeDetector.h"
+#include "RobustStats.h"
+#include "../Utils/Parallel.h"
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace SpikeDetection {
+
+namespace {
+
+struct Job {
+    int row;            // into the channel list
+    qint64 start;
+    qint64 count;
+};
+
+// Median of a scratch buffer, non-finite entries left out
+double finiteMedian(const double *x, qint64 n, bool clean) {
+    if (clean) return RobustStats::median(x, n);
+    return RobustStats::median(x, n, ValidityMask::scan(x, n));
+}
+
+// Peak, troughs and shape around a candidate; false when the shape does not qualify
+bool measure(const double *x, qint64 total, qint64 candidate, double rate, const SpikeParams &params, Spike &spike) {
+    qint64 half = std::max<qint64>(1, static_cast<qint64>(params.maxDuration * rate / 2));
+    qint64 reach = std::max<qint64>(1, static_cast<qint64>(params.spikeMaxDuration * rate / 2));
+
+    // Polarity from whichever extreme near the candidate stands further from the local mean
+    qint64 lo = std::max<qint64>(0, candidate - reach);
+    qint64 hi = std::min(total - 1, candidate + reach);
+    Eigen::Map<const Eigen::ArrayXd> near(x + lo, hi - lo + 1);
+    qint64 contextLo = std::max<qint64>(0, candidate - half);
+    qint64 contextHi = std::min(total - 1, candidate + half);
+    double mean = Eigen::Map<const Eigen::ArrayXd>(x + contextLo, contextHi - contextLo + 1).mean();
+    Eigen::Index top, bottom;
+    double maxValue = near.maxCoeff(&top);
+    double minValue = near.minCoeff(&bottom);
+    int polarity = maxValue - mean >= mean - minValue ? 1 : -1;
+    qint64 peak = lo + (polarity > 0 ? top : bottom);
+
+    // Troughs: the lowest point (in the peak's polarity) on either side within reach
+    qint64 left0 = std::max<qint64>(0, peak - half);
+    qint64 right1 = std::min(total - 1, peak + half);
+    if (peak - left0 < 1 || right1 - peak < 1) return false;
+    Eigen::Index leftIndex, rightIndex;
+    double sign = polarity;
+    (sign * Eigen::Map<const Eigen::ArrayXd>(x + left0, peak - left0)).minCoeff(&leftIndex);
+    (sign * Eigen::Map<const Eigen::ArrayXd>(x + peak + 1, right1 - peak)).minCoeff(&rightIndex);
+    qint64 left = left0 + leftIndex;
+    qint64 right = peak + 1 + rightIndex;
+
+    double duration = (right - left) / rate;
+    double rise = sign * (x[peak] - x[left]);
+    double fall = sign * (x[peak] - x[right]);
+    double amplitude = (rise + fall) / 2;
+    double slope = std::min(rise / ((peak - left) * 1000.0 / rate), fall / ((right - peak) * 1000.0 / rate));
+    if (!(duration >= params.minDuration && duration <= params.maxDuration)) return false;
+    if (!(amplitude >= params.minAmplitude && slope >= params.minSlope)) return false;
+
+    // After-going slow wave: a return in the spike's polarity after the trailing trough
+    qint64 slowEnd = std::min(total - 1, right + static_cast<qint64>(params.slowWaveWindow * rate));
+    bool slowWave = false;
+    if (slowEnd > right) {
+        double slowPeak = (sign * Eigen::Map<const Eigen::ArrayXd>(x + right + 1, slowEnd - right)).maxCoeff();
+        slowWave = slowPeak - sign * x[right] >= params.slowWaveRatio * amplitude;
+    }
+    if (params.requireSlowWave && !slowWave) return false;
+
+    spike.peak = peak;
+    spike.start = left;
+    spike.end = right;
+    spike.polarity = polarity;
+    spike.amplitude = amplitude;
+    spike.slope = slope;
+    spike.slowWave = slowWave;
+    return true;
+}
+
+// Candidate search over one chunk. Teager energy x[n]^2 - x[n-1] x[n+1] and
+// the central difference come from whole-chunk array expressions, the
+// threshold test yields a byte mask, and memchr jumps between hits, so the
+// per-sample work is branch-free.
+QVector<Spike> scanChunk(const EEGChannel &channel, int channelIndex, qint64 start, qint64 count,
+                         const SpikeParams &params) {
+    QVector<Spike> spikes;
+    const double *x = channel.data.constData();
+    qint64 total = channel.data.size();
+    qint64 a = std::max<qint64>(start, 1);
+    qint64 b = std::min(start + count, total - 1);
+    qint64 m = b - a;
+    if (m < 3) return spikes;
+
+    Eigen::Map<const Eigen::ArrayXd> previous(x + a - 1, m), current(x + a, m), next(x + a + 1, m);
+    Eigen::ArrayXd teager = current.square() - previous * next;
+    Eigen::ArrayXd slope = (next - previous).abs();
+
+    bool clean = channel.validity.size() != total || channel.validity.rangeValid(a - 1, m + 2);
+    double teagerThreshold = params.teagerFactor * finiteMedian(teager.data(), m, clean);
+    double slopeThreshold = params.slopeFactor * finiteMedian(slope.data(), m, clean);
+    if (!(teagerThreshold > 0.0) || !(slopeThreshold > 0.0)) return spikes;
+
+    Eigen::Array<unsigned char, Eigen::Dynamic, 1> hits =
+        ((teager > teagerThreshold) && (slope > slopeThreshold)).cast<unsigned char>();
+    const unsigned char *begin = hits.data();
+    const unsigned char *end = begin + m;
+
+    // Each run of hits is one candidate, centred on its Teager maximum
+    qint64 lastEnd = -1;
+    for (const unsigned char *hit = begin; hit < end; ) {
+        hit = static_cast<const unsigned char*>(std::memchr(hit, 1, end - hit));
+        if (!hit) break;
+        const unsigned char *runEnd = hit;
+        while (runEnd < end && *runEnd) ++runEnd;
+
+        Eigen::Index offset;
+        teager.segment(hit - begin, runEnd - hit).maxCoeff(&offset);
+        qint64 candidate = a + (hit - begin) + offset;
+        hit = runEnd;
+
+        // Candidates inside the last accepted spike add nothing
+        if (candidate <= lastEnd) continue;
+        Spike spike;
+        spike.channel = channelIndex;
+        if (measure(x, total, candidate, channel.samplingRate, params, spike)) {
+            spikes.append(spike);
+            lastEnd = spike.end;
+        }
+    }
+    return spikes;
+}
+
+}
+
+QVector<Spike> detect(const EEGData &data, const QVector<int> &channels, const SpikeParams &params) {
+    for (int ch : channels) {
+        if (ch < 0 || ch >= data.channelCount()) {
+            qWarning() << "Spike detection: Invalid channel index" << ch;
+            return QVector<Spike>();
+        }
+    }
+
+    // Chunks of every channel form one job list, so a few long channels still spread out
+    QVector<Job> jobs;
+    for (int row = 0; row < channels.size(); ++row) {
+        const EEGChannel &channel = data.channel(channels[row]);
+        qint64 chunk = std::max<qint64>(1024, static_cast<qint64>(params.chunkSeconds * channel.samplingRate));
+        for (qint64 start = 0; start < channel.data.size(); start += chunk) {
+            jobs.append({row, start, std::min(chunk, channel.data.size() - start)});
+        }
+    }
+
+    QVector<QVector<Spike>> found(jobs.size());
+    Parallel::parallelFor(0, jobs.size(), [&](int j) {
+        const Job &job = jobs[j];
+        found[j] = scanChunk(data.channel(channels[job.row]), channels[job.row], job.start, job.count, params);
+    });
+
+    // Jobs are in channel then time order; keep the strongest spike within the refractory span
+    QVector<Spike> spikes;
+    for (int j = 0; j < jobs.size(); ++j) {
+        double rate = data.channel(channels[jobs[j].row]).samplingRate;
+        qint64 refractory = static_cast<qint64>(params.refractory * rate);
+        for (const Spike &spike : found[j]) {
+            if (!spikes.isEmpty() && spikes.last().channel == spike.channel
+                && spike.peak - spikes.last().peak < refractory) {
+                if (spike.amplitude > spikes.last().amplitude) spikes.last() = spike;
+                continue;
+            }
+            spikes.append(spike);
+        }
+    }
+    return spikes;
+}
+
+QVector<EEGEvent> toEvents(const EEGData &data, const QVector<Spike> &spikes, const SpikeParams &params) {
+    QVector<EEGEvent> events;
+    events.reserve(spikes.size());
+    for (const Spike &spike : spikes) {
+        double rate = data.channel(spike.channel).samplingRate;
+        EEGEvent event;
+        event.onset = spike.start / rate;
+        event.duration = (spike.end - spike.start) / rate;
+        event.type = event.duration <= params.spikeMaxDuration ? params.spikeType : params.sharpWaveType;
+        event.channel = spike.channel;
+        events.append(event);
+    }
+    return events;
+}
+
+int detectInto(EEGData &data, const QVector<int> &channels, const SpikeParams &params) {
+    QVector<EEGEvent> events = toEvents(data, detect(data, channels, params), params);
+    data.addEvents(events);
+    return events.size();
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include "../DataModels/EEGData.h"
+
+namespace SpikeDetection {
+
+// Amplitudes in the channel's physical unit, normally uV
+struct SpikeParams {
+    double chunkSeconds = 60.0;            // thresholds adapt per chunk
+
+    // Candidate search: Teager energy and first difference both above a
+    // multiple of their chunk median
+    double teagerFactor = 20.0;
+    double slopeFactor = 5.0;
+
+    // Morphology, checked on candidates only
+    double minDuration = 0.020;            // seconds, trough to trough
+    double spikeMaxDuration = 0.070;       // longer is a sharp wave
+    double maxDuration = 0.200;
+    double minAmplitude = 40.0;            // peak above the mean of its troughs
+    double minSlope = 1.0;                 // uV/ms, on both flanks
+    double slowWaveWindow = 0.300;         // seconds after the spike
+    double slowWaveRatio = 0.3;            // slow wave amplitude / spike amplitude
+    bool requireSlowWave = false;
+
+    double refractory = 0.100;             // seconds, the strongest spike in range wins
+
+    QString spikeType = "Spike";
+    QString sharpWaveType = "Sharp Wave";
+};
+
+struct Spike {
+    int channel = -1;
+    qint64 peak = 0;                       // sample
+    qint64 start = 0;                      // leading trough
+    qint64 end = 0;                        // trailing trough
+    int polarity = 1;                      // +1 positive peak, -1 negative
+    double amplitude = 0.0;
+    double slope = 0.0;                    // uV/ms, the shallower flank
+    bool slowWave = false;
+};
+
+// Channels and chunks in parallel; spikes sorted by channel then peak
+QVector<Spike> detect(const EEGData &data, const QVector<int> &channels,
+                      const SpikeParams &params = SpikeParams());
+
+// Events spanning each spike's troughs, typed as spike or sharp wave
+QVector<EEGEvent> toEvents(const EEGData &data, const QVector<Spike> &spikes,
+                           const SpikeParams &params = SpikeParams());
+
+// detect + toEvents + one batch insert into the event store; returns the count
+int detectInto(EEGData &data, const QVector<int> &channels, const SpikeParams &params = SpikeParams());
+
+}
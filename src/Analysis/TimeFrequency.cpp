@@ -0,0 +1,209 @@
+#include "TimeFrequency.h"
+#include "../Utils/Parallel.h"
+#include "../Utils/SignalProcessor.h"
+#include <QDebug>
+#include <cmath>
+#include <complex>
+#include <algorithm>
+
+namespace TimeFrequency {
+
+QVector<double> frequencyRange(double low, double high, double step) {
+    QVector<double> frequencies;
+    if (step <= 0.0) return frequencies;
+    for (int i = 0; low + i * step <= high + 1e-9; ++i) frequencies.append(low + i * step);
+    return frequencies;
+}
+
+QVector<double> morletWidths(const QVector<double> &frequencies, double cycles) {
+    QVector<double> widths(frequencies.size());
+    for (int i = 0; i < frequencies.size(); ++i) widths[i] = frequencies[i] / cycles;
+    return widths;
+}
+
+FilterBank::FilterBank(qint64 length, double samplingRate, const QVector<double> &frequencies,
+                       const QVector<double> &widths)
+    : m_length(length), m_size(0), m_frequencies(frequencies) {
+    if (length < 2 || samplingRate <= 0 || frequencies.isEmpty() || widths.size() != frequencies.size()) {
+        qWarning() << "Filter bank: Invalid length, rate or frequencies";
+        m_frequencies.clear();
+        return;
+    }
+
+    // Kernel length in time is about 1 / (2 pi width); pad three of the longest
+    double narrowest = *std::min_element(widths.begin(), widths.end());
+    qint64 pad = narrowest > 0.0 ? static_cast<qint64>(std::ceil(3.0 * samplingRate / (2.0 * M_PI * narrowest))) : length;
+    m_size = SignalProcessor::fftSize(length + std::min(pad, 4 * length));
+    int numBins = m_size / 2 + 1;
+    int numFrequencies = frequencies.size();
+
+    // Twice the positive frequencies, none of the negative ones: the analytic signal
+    m_kernels.resize(numBins, numFrequencies);
+    for (int f = 0; f < numFrequencies; ++f) {
+        for (int k = 0; k < numBins; ++k) {
+            double hz = k * samplingRate / m_size;
+            double z = (hz - frequencies[f]) / widths[f];
+            bool edge = k == 0 || (m_size % 2 == 0 && k == numBins - 1);
+            m_kernels(k, f) = (edge ? 1.0 : 2.0) * std::exp(-0.5 * z * z);
+        }
+    }
+
+    // Plans on this thread; transform() executes them on its own buffers
+    double *real = fftw_alloc_real(m_size);
+    fftw_complex *spectrum = fftw_alloc_complex(static_cast<size_t>(m_size) * numFrequencies);
+    fftw_complex *analytic = fftw_alloc_complex(static_cast<size_t>(m_size) * numFrequencies);
+    m_forward = fftw_plan_dft_r2c_1d(m_size, real, spectrum, FFTW_ESTIMATE);
+    int dims[] = {m_size};
+    m_inverse = fftw_plan_many_dft(1, dims, numFrequencies, spectrum, nullptr, 1, m_size,
+                                   analytic, nullptr, 1, m_size, FFTW_BACKWARD, FFTW_ESTIMATE);
+    fftw_free(real);
+    fftw_free(spectrum);
+    fftw_free(analytic);
+}
+
+FilterBank::~FilterBank() {
+    if (m_forward) fftw_destroy_plan(m_forward);
+    if (m_inverse) fftw_destroy_plan(m_inverse);
+}
+
+void FilterBank::transform(const double *x, Eigen::MatrixXcd &out) const {
+    int numFrequencies = m_frequencies.size();
+    out.resize(numFrequencies, m_length);
+    if (numFrequencies == 0) return;
+
+    int numBins = m_size / 2 + 1;
+    double *real = fftw_alloc_real(m_size);
+    fftw_complex *spectrum = fftw_alloc_complex(static_cast<size_t>(m_size) * numFrequencies);
+    fftw_complex *analytic = fftw_alloc_complex(static_cast<size_t>(m_size) * numFrequencies);
+
+    std::copy(x, x + m_length, real);
+    std::fill(real + m_length, real + m_size, 0.0);
+    fftw_execute_dft_r2c(m_forward, real, spectrum);
+
+    // Row f of the batch: the spectrum times kernel f, negative frequencies
+    // zero. The forward output sits in row 0, so it is copied out first.
+    using ComplexArray = Eigen::Map<Eigen::ArrayXcd>;
+    Eigen::ArrayXcd input = ComplexArray(reinterpret_cast<std::complex<double>*>(spectrum), numBins);
+    for (int f = 0; f < numFrequencies; ++f) {
+        ComplexArray row(reinterpret_cast<std::complex<double>*>(spectrum + static_cast<qint64>(f) * m_size), m_size);
+        row.head(numBins) = input * m_kernels.col(f).array();
+        row.tail(m_size - numBins).setZero();
+    }
+    fftw_execute_dft(m_inverse, spectrum, analytic);
+
+    Eigen::Map<Eigen::MatrixXcd> rows(reinterpret_cast<std::complex<double>*>(analytic), m_size, numFrequencies);
+    out = rows.topRows(m_length).transpose() / static_cast<double>(m_size);
+
+    fftw_free(real);
+    fftw_free(spectrum);
+    fftw_free(analytic);
+}
+
+// ================== ERSP ==================
+
+namespace {
+
+struct Sums {
+    Eigen::MatrixXd power;
+    Eigen::MatrixXcd phase;
+    int count = 0;
+};
+
+}
+
+ERSP ersp(const Epochs::EpochSet &epochs, const ERSPParams &params) {
+    ERSP result;
+    if (epochs.isEmpty()) return result;
+
+    double rate = epochs.samplingRate();
+    QVector<double> frequencies;
+    for (double f : params.frequencies) {
+        if (f > 0.0 && f < rate / 2) frequencies.append(f);
+        else qWarning() << "ERSP: Skipping" << f << "Hz, outside (0, Nyquist)";
+    }
+    if (frequencies.isEmpty() || params.cycles <= 0.0) return result;
+
+    int numFrequencies = frequencies.size();
+    int length = epochs.epochLength();
+    int numChannels = epochs.channelCount();
+    int numEpochs = epochs.epochCount();
+    FilterBank bank(length, rate, frequencies, morletWidths(frequencies, params.cycles));
+
+    int block = std::max(1, params.epochBlock);
+    int blocksPerChannel = (numEpochs + block - 1) / block;
+    QVector<Sums> partial(numChannels * blocksPerChannel);
+    Sums *sums = partial.data();
+
+    Parallel::parallelFor(0, partial.size(), [&](int task) {
+        int c = task / blocksPerChannel;
+        int first = (task % blocksPerChannel) * block;
+        int last = std::min(numEpochs, first + block);
+
+        Sums &s = sums[task];
+        s.power = Eigen::MatrixXd::Zero(numFrequencies, length);
+        s.phase = Eigen::MatrixXcd::Zero(numFrequencies, length);
+        Eigen::VectorXd x(length);
+        Eigen::MatrixXcd z;
+        for (int e = first; e < last; ++e) {
+            // Demeaned over the finite samples, the rest count as zero
+            const double *epoch = epochs.epoch(c, e);
+            double sum = 0.0;
+            int valid = 0;
+            for (int i = 0; i < length; ++i) {
+                if (std::isfinite(epoch[i])) {
+                    sum += epoch[i];
+                    ++valid;
+                }
+            }
+            if (valid == 0) continue;
+            double mean = sum / valid;
+            for (int i = 0; i < length; ++i) x[i] = std::isfinite(epoch[i]) ? epoch[i] - mean : 0.0;
+
+            bank.transform(x.data(), z);
+            Eigen::ArrayXXd magnitude = z.array().abs();
+            s.power.array() += magnitude.square();
+            s.phase.array() += z.array() / magnitude.max(1e-300).cast<std::complex<double>>();
+            ++s.count;
+        }
+    });
+
+    result.channels = epochs.channels();
+    result.frequencies = frequencies;
+    result.times = epochs.times();
+
+    // Baseline columns; without any, power stays absolute in dB
+    QVector<int> baseline;
+    for (int t = 0; t < length; ++t) {
+        if (result.times[t] >= params.baselineStart && result.times[t] < params.baselineEnd) baseline.append(t);
+    }
+    if (baseline.isEmpty()) qWarning() << "ERSP: Baseline window is outside the epoch, reporting absolute power";
+
+    for (int c = 0; c < numChannels; ++c) {
+        Sums total;
+        total.power = Eigen::MatrixXd::Zero(numFrequencies, length);
+        total.phase = Eigen::MatrixXcd::Zero(numFrequencies, length);
+        for (int b = 0; b < blocksPerChannel; ++b) {
+            const Sums &s = partial[c * blocksPerChannel + b];
+            total.power += s.power;
+            total.phase += s.phase;
+            total.count += s.count;
+        }
+        if (total.count == 0) total.count = 1;
+
+        Eigen::MatrixXd power = total.power / total.count;
+        if (!baseline.isEmpty()) {
+            Eigen::VectorXd reference = Eigen::VectorXd::Zero(numFrequencies);
+            for (int t : baseline) reference += power.col(t);
+            reference /= baseline.size();
+            for (int f = 0; f < numFrequencies; ++f) {
+                if (reference[f] > 0.0) power.row(f) /= reference[f];
+            }
+        }
+        result.power.append(10.0 * power.array().max(1e-300).log10().matrix());
+        result.itc.append(total.phase.cwiseAbs() / total.count);
+        result.count = total.count;
+    }
+    return result;
+}
+
+}
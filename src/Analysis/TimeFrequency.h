@@ -0,0 +1,73 @@
+#pragma once
+#include <QVector>
+#include <Eigen/Dense>
+#include <fftw3.h>
+#include "Epochs.h"
+
+namespace TimeFrequency {
+
+// Frequencies from low to high (inclusive) in steps
+QVector<double> frequencyRange(double low, double high, double step);
+
+// Gaussian standard deviations in Hz of Morlet wavelets with the given number of cycles
+QVector<double> morletWidths(const QVector<double> &frequencies, double cycles);
+
+// Analytic band-pass signals of fixed-length inputs for a set of centre
+// frequencies. Each kernel is a Gaussian in frequency (a Morlet wavelet for
+// width = frequency / cycles) over positive frequencies only, so its inverse
+// transform is already the analytic signal: one forward FFT per input, then
+// every frequency through one batched inverse. Inputs are zero-padded past
+// three kernel lengths so the circular transform does not wrap. The plans are
+// made once; transform() may run on several threads at a time.
+class FilterBank {
+public:
+    FilterBank(qint64 length, double samplingRate, const QVector<double> &frequencies,
+               const QVector<double> &widths);
+    ~FilterBank();
+    FilterBank(const FilterBank &) = delete;
+    FilterBank &operator=(const FilterBank &) = delete;
+
+    qint64 length() const { return m_length; }
+    int frequencyCount() const { return m_frequencies.size(); }
+    const QVector<double> &frequencies() const { return m_frequencies; }
+
+    // out becomes frequencies x length. x holds length() finite samples.
+    void transform(const double *x, Eigen::MatrixXcd &out) const;
+
+private:
+    qint64 m_length;
+    int m_size;                          // FFT length
+    QVector<double> m_frequencies;
+    Eigen::MatrixXd m_kernels;           // positive-frequency bins x frequencies
+    fftw_plan m_forward = nullptr;
+    fftw_plan m_inverse = nullptr;       // all frequencies at once
+};
+
+// ================== ERSP ==================
+
+struct ERSPParams {
+    QVector<double> frequencies = frequencyRange(4.0, 40.0, 1.0);
+    double cycles = 5.0;                 // Morlet cycles at every frequency
+    double baselineStart = -0.2;         // seconds relative to the event
+    double baselineEnd = 0.0;
+    int epochBlock = 16;                 // epochs per parallel task
+};
+
+// Event-related spectral perturbation: trial-averaged power relative to the
+// pre-event baseline, and inter-trial phase coherence, per channel
+struct ERSP {
+    QVector<int> channels;
+    QVector<double> frequencies;
+    QVector<double> times;
+    QVector<Eigen::MatrixXd> power;      // per channel, frequencies x times, dB over baseline
+    QVector<Eigen::MatrixXd> itc;        // per channel, frequencies x times, 0..1
+    int count = 0;
+
+    bool isEmpty() const { return power.isEmpty(); }
+};
+
+// Epochs stream through the filter bank and only running sums are kept.
+// Tasks are (channel, block of epochs), merged per channel at the end.
+ERSP ersp(const Epochs::EpochSet &epochs, const ERSPParams &params = ERSPParams());
+
+}
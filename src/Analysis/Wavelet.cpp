@@ -0,0 +1,312 @@
+#include "Wavelet.h"
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+namespace Wavelet {
+
+// Orthonormal decomposition low-pass filters; the high-pass is the
+// quadrature mirror g[i] = (-1)^i h[L-1-i]
+static const double kDb4[] = {
+    -0.010597401784997278, 0.032883011666982945, 0.030841381835986965, -0.18703481171888114,
+    -0.02798376941698385, 0.6308807679295904, 0.7148465705525415, 0.23037781330885523
+};
+static const double kSym4[] = {
+    -0.07576571478927333, -0.02963552764599851, 0.49761866763201545, 0.8037387518059161,
+    0.29785779560527736, -0.09921954357684722, -0.012603967262037833, 0.0322231006040427
+};
+static const double kCoif1[] = {
+    -0.01565572813546454, -0.0727326195128539, 0.38486484686420286,
+    0.8525720202122554, 0.3378976624578092, -0.0727326195128539
+};
+
+QString waveletName(WaveletType type) {
+    switch (type) {
+    case WaveletHaar: return "Haar";
+    case WaveletDb2: return "Daubechies 2";
+    case WaveletDb4: return "Daubechies 4";
+    case WaveletSym4: return "Symlet 4";
+    case WaveletCoif1: return "Coiflet 1";
+    default: return "Unknown";
+    }
+}
+
+int filterLength(WaveletType type) {
+    switch (type) {
+    case WaveletHaar: return 2;
+    case WaveletDb2: return 4;
+    case WaveletDb4: return 8;
+    case WaveletSym4: return 8;
+    case WaveletCoif1: return 6;
+    default: return 2;
+    }
+}
+
+static const double *lowPass(WaveletType type) {
+    switch (type) {
+    case WaveletDb4: return kDb4;
+    case WaveletSym4: return kSym4;
+    case WaveletCoif1: return kCoif1;
+    default: return nullptr;
+    }
+}
+
+int maxLevels(qint64 n, WaveletType type) {
+    int length = filterLength(type);
+    int levels = 0;
+    while ((n >> (levels + 1)) >= length) ++levels;
+    return levels;
+}
+
+// ================== ONE LEVEL ==================
+
+// Evens to x[0, h), odds to x[h, n)
+static void split(double *x, qint64 n, double *scratch) {
+    qint64 h = n / 2;
+    for (qint64 k = 0; k < h; ++k) scratch[k] = x[2 * k + 1];
+    for (qint64 k = 0; k < h; ++k) x[k] = x[2 * k];
+    std::copy(scratch, scratch + h, x + h);
+}
+
+static void merge(double *x, qint64 n, double *scratch) {
+    qint64 h = n / 2;
+    std::copy(x + h, x + n, scratch);
+    for (qint64 k = h - 1; k >= 0; --k) x[2 * k] = x[k];
+    for (qint64 k = 0; k < h; ++k) x[2 * k + 1] = scratch[k];
+}
+
+static void haarForward(double *s, double *d, qint64 h) {
+    for (qint64 k = 0; k < h; ++k) {
+        d[k] -= s[k];
+        s[k] += d[k] * 0.5;
+        s[k] *= M_SQRT2;
+        d[k] *= M_SQRT1_2;
+    }
+}
+
+static void haarInverse(double *s, double *d, qint64 h) {
+    for (qint64 k = 0; k < h; ++k) {
+        d[k] *= M_SQRT2;
+        s[k] *= M_SQRT1_2;
+        s[k] -= d[k] * 0.5;
+        d[k] += s[k];
+    }
+}
+
+// Daubechies-Sweldens factorization of db2 into two lifting steps and a
+// scaling, with periodic wrap at the ends
+static const double kSqrt3 = std::sqrt(3.0);
+
+static void db2Forward(double *s, double *d, qint64 h) {
+    for (qint64 k = 0; k < h; ++k) d[k] -= kSqrt3 * s[k];
+    for (qint64 k = 0; k < h; ++k) {
+        double next = d[k + 1 < h ? k + 1 : 0];
+        s[k] += (kSqrt3 / 4.0) * d[k] + ((kSqrt3 - 2.0) / 4.0) * next;
+    }
+    for (qint64 k = 0; k < h; ++k) d[k] += s[k > 0 ? k - 1 : h - 1];
+    const double scaleS = (kSqrt3 + 1.0) / M_SQRT2;
+    const double scaleD = (kSqrt3 - 1.0) / M_SQRT2;
+    for (qint64 k = 0; k < h; ++k) {
+        s[k] *= scaleS;
+        d[k] *= scaleD;
+    }
+}
+
+static void db2Inverse(double *s, double *d, qint64 h) {
+    const double scaleS = (kSqrt3 + 1.0) / M_SQRT2;
+    const double scaleD = (kSqrt3 - 1.0) / M_SQRT2;
+    for (qint64 k = 0; k < h; ++k) {
+        s[k] /= scaleS;
+        d[k] /= scaleD;
+    }
+    for (qint64 k = 0; k < h; ++k) d[k] -= s[k > 0 ? k - 1 : h - 1];
+    for (qint64 k = 0; k < h; ++k) {
+        double next = d[k + 1 < h ? k + 1 : 0];
+        s[k] -= (kSqrt3 / 4.0) * d[k] + ((kSqrt3 - 2.0) / 4.0) * next;
+    }
+    for (qint64 k = 0; k < h; ++k) d[k] += kSqrt3 * s[k];
+}
+
+// Periodized filter bank for db4, sym4 and coif1. These have lifting
+// factorizations too, but only Haar and db2 are factored here, so the
+// longer filters work out of place through scratch.
+static void filterForward(double *x, qint64 n, const double *lo, int length, double *scratch) {
+    std::copy(x, x + n, scratch);
+    qint64 h = n / 2;
+    for (qint64 k = 0; k < h; ++k) {
+        double a = 0.0;
+        double d = 0.0;
+        for (int i = 0; i < length; ++i) {
+            double v = scratch[(2 * k + i) % n];
+            a += lo[i] * v;
+            d += ((i & 1) ? -lo[length - 1 - i] : lo[length - 1 - i]) * v;
+        }
+        x[k] = a;
+        x[h + k] = d;
+    }
+}
+
+static void filterInverse(double *x, qint64 n, const double *lo, int length, double *scratch) {
+    std::fill(scratch, scratch + n, 0.0);
+    qint64 h = n / 2;
+    for (qint64 k = 0; k < h; ++k) {
+        double a = x[k];
+        double d = x[h + k];
+        for (int i = 0; i < length; ++i) {
+            double hi = (i & 1) ? -lo[length - 1 - i] : lo[length - 1 - i];
+            scratch[(2 * k + i) % n] += lo[i] * a + hi * d;
+        }
+    }
+    std::copy(scratch, scratch + n, x);
+}
+
+void forward(double *x, qint64 n, int levels, WaveletType type, double *scratch) {
+    for (int level = 0; level < levels; ++level) {
+        qint64 m = n >> level;
+        if (type == WaveletHaar || type == WaveletDb2) {
+            split(x, m, scratch);
+            if (type == WaveletHaar) haarForward(x, x + m / 2, m / 2);
+            else db2Forward(x, x + m / 2, m / 2);
+        } else {
+            filterForward(x, m, lowPass(type), filterLength(type), scratch);
+        }
+    }
+}
+
+void inverse(double *x, qint64 n, int levels, WaveletType type, double *scratch) {
+    for (int level = levels - 1; level >= 0; --level) {
+        qint64 m = n >> level;
+        if (type == WaveletHaar || type == WaveletDb2) {
+            if (type == WaveletHaar) haarInverse(x, x + m / 2, m / 2);
+            else db2Inverse(x, x + m / 2, m / 2);
+            merge(x, m, scratch);
+        } else {
+            filterInverse(x, m, lowPass(type), filterLength(type), scratch);
+        }
+    }
+}
+
+// ================== THRESHOLDS ==================
+
+static double median(std::vector<double> values) {
+    if (values.empty()) return 0.0;
+    auto mid = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), mid, values.end());
+    return *mid;
+}
+
+// Noise level from the finest details, robust to the sparse signal part
+static double noiseSigma(const double *d, qint64 n) {
+    std::vector<double> magnitudes(d, d + n);
+    for (double &v : magnitudes) v = std::abs(v);
+    return median(std::move(magnitudes)) / 0.6745;
+}
+
+static double sureThreshold(const double *d, qint64 n, double sigma) {
+    double universal = std::sqrt(2.0 * std::log(static_cast<double>(n)));
+    std::vector<double> squares(n);
+    double energy = 0.0;
+    for (qint64 i = 0; i < n; ++i) {
+        double v = d[i] / sigma;
+        squares[i] = v * v;
+        energy += squares[i];
+    }
+
+    // Sparse levels are better served by the universal threshold
+    double eta = (energy - n) / n;
+    double critical = std::pow(std::log2(static_cast<double>(n)), 1.5) / std::sqrt(static_cast<double>(n));
+    if (eta < critical) return universal * sigma;
+
+    std::sort(squares.begin(), squares.end());
+    double best = squares.back();
+    double bestRisk = INFINITY;
+    double cumulative = 0.0;
+    for (qint64 k = 0; k < n; ++k) {
+        cumulative += squares[k];
+        double risk = n - 2.0 * (k + 1) + cumulative + (n - k - 1) * squares[k];
+        if (risk < bestRisk) {
+            bestRisk = risk;
+            best = squares[k];
+        }
+    }
+    return std::min(std::sqrt(best), universal) * sigma;
+}
+
+static double bayesThreshold(const double *d, qint64 n, double sigma) {
+    double power = 0.0;
+    for (qint64 i = 0; i < n; ++i) power += d[i] * d[i];
+    power /= n;
+    double signalVariance = power - sigma * sigma;
+    if (signalVariance <= 0.0) {
+        // Pure noise: remove the level
+        double largest = 0.0;
+        for (qint64 i = 0; i < n; ++i) largest = std::max(largest, std::abs(d[i]));
+        return largest;
+    }
+    return sigma * sigma / std::sqrt(signalVariance);
+}
+
+static void applyThreshold(double *d, qint64 n, double threshold, bool soft) {
+    for (qint64 i = 0; i < n; ++i) {
+        double magnitude = std::abs(d[i]);
+        if (magnitude <= threshold) d[i] = 0.0;
+        else if (soft) d[i] = std::copysign(magnitude - threshold, d[i]);
+    }
+}
+
+// ================== DENOISING ==================
+
+static qint64 mirrorIndex(qint64 i, qint64 n) {
+    qint64 period = 2 * n;
+    i %= period;
+    if (i < 0) i += period;
+    return i < n ? i : period - 1 - i;
+}
+
+void denoise(QVector<double> &data, const DenoiseParams &params) {
+    qint64 n = data.size();
+    if (n < 2 * filterLength(params.wavelet)) return;
+
+    // Margins of one coarsest-level filter support on each side, rounded up
+    // so the total length splits evenly at every level
+    int levels = std::min(params.levels, maxLevels(n, params.wavelet));
+    if (levels < 1) return;
+    qint64 block = qint64(1) << levels;
+    qint64 margin = std::min<qint64>(n, qint64(filterLength(params.wavelet)) << levels);
+    qint64 total = (n + 2 * margin + block - 1) / block * block;
+    qint64 left = (total - n) / 2;
+
+    std::vector<double> buffer(total);
+    std::vector<double> scratch(total);
+    const double *x = data.constData();
+    for (qint64 i = 0; i < total; ++i) buffer[i] = x[mirrorIndex(i - left, n)];
+
+    forward(buffer.data(), total, levels, params.wavelet, scratch.data());
+
+    // Details of level j (1 = finest) sit at [total >> j, total >> (j - 1))
+    const double *finest = buffer.data() + total / 2;
+    double sigma = noiseSigma(finest, total / 2);
+    if (sigma > 0.0) {
+        double universal = sigma * std::sqrt(2.0 * std::log(static_cast<double>(total)));
+        for (int level = 1; level <= levels; ++level) {
+            double *d = buffer.data() + (total >> level);
+            qint64 count = total >> level;
+            double threshold = universal;
+            if (params.rule == ThresholdSURE) threshold = sureThreshold(d, count, sigma);
+            else if (params.rule == ThresholdBayes) threshold = bayesThreshold(d, count, sigma);
+            applyThreshold(d, count, threshold, params.softThreshold);
+        }
+    }
+
+    inverse(buffer.data(), total, levels, params.wavelet, scratch.data());
+    std::copy(buffer.begin() + left, buffer.begin() + left + n, data.begin());
+}
+
+void denoise(EEGData &data, const QVector<int> &channels, const DenoiseParams &params) {
+    data.transformChannels(channels, [&params](QVector<double> &samples, double) {
+        denoise(samples, params);
+    });
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include "../DataModels/EEGData.h"
+
+namespace Wavelet {
+
+enum WaveletType {
+    WaveletHaar,         // lifting
+    WaveletDb2,          // lifting
+    WaveletDb4,          // filter bank
+    WaveletSym4,         // filter bank
+    WaveletCoif1,        // filter bank
+    WaveletTypeCount
+};
+
+QString waveletName(WaveletType type);
+int filterLength(WaveletType type);
+
+enum ThresholdRule {
+    ThresholdUniversal,  // sigma * sqrt(2 ln n), one threshold for all levels
+    ThresholdSURE,       // per-level minimum of Stein's unbiased risk, hybrid with universal
+    ThresholdBayes       // per-level BayesShrink, sigma^2 / signal sigma
+};
+
+struct DenoiseParams {
+    WaveletType wavelet = WaveletSym4;
+    int levels = 6;                // upper bound, lowered for short signals
+    ThresholdRule rule = ThresholdBayes;
+    bool softThreshold = true;
+};
+
+// Deepest decomposition that keeps every level at least one filter long
+int maxLevels(qint64 n, WaveletType type);
+
+// Periodic orthonormal DWT in place: x becomes [aL | dL | ... | d1]. n must be
+// divisible by 2^levels and scratch must hold n doubles. Haar and db2 run as
+// lifting steps; db4, sym4 and coif1 use a filter bank that copies each
+// level into scratch.
+void forward(double *x, qint64 n, int levels, WaveletType type, double *scratch);
+void inverse(double *x, qint64 n, int levels, WaveletType type, double *scratch);
+
+// Thresholds the detail coefficients; the signal is mirror-extended so the
+// periodic transform sees no jump at either edge
+void denoise(QVector<double> &data, const DenoiseParams &params = DenoiseParams());
+
+// Whole channels, in parallel
+void denoise(EEGData &data, const QVector<int> &channels, const DenoiseParams &params = DenoiseParams());
+
+}
@@ -1,11 +1,14 @@
 #include "EEGData.h"
 #include "../FileHandlers/EEGFileHandler.h"
 #include "../Utils/SignalProcessor.h"
+#include "../Utils/Parallel.h"
 #include <QDebug>
 #include <cmath>
 #include <algorithm>
 #include <numeric>
 #include <QtGlobal>
+#include <climits>
+#include <limits>
 
 EEGData::EEGData(QObject *parent) : QObject(parent) {
     m_startDateTime = QDateTime::currentDateTime();
@@ -27,20 +30,30 @@ bool EEGData::saveToFile(const QString &filePath) {
 }
 
 void EEGData::clear() {
+    clearDisplayMontage();
     m_channels.clear();
     m_patientInfo.clear();
     m_recordingInfo.clear();
     m_startDateTime = QDateTime::currentDateTime();
+    m_rejected.clear();
+    emit eventsAboutToBeReset();
+    m_events.clear();
+    emit eventsReset();
     emit dataChanged();
+    emit eventsChanged();
 }
 
 void EEGData::addChannel(const EEGChannel &channel) {
+    clearDisplayMontage();
     m_channels.append(channel);
+    EEGChannel &added = m_channels.last();
+    if (added.validity.size() != added.data.size()) added.validity = ValidityMask::scan(added.data);
     emit channelAdded(m_channels.size() - 1);
 }
 
 void EEGData::removeChannel(int index) {
     if (index >= 0 && index < m_channels.size()) {
+        clearDisplayMontage();
         m_channels.removeAt(index);
         emit channelRemoved(index);
     }
@@ -70,7 +83,7 @@ void EEGData::normalizeChannel(int channelIndex) {
     if (channelIndex < 0 || channelIndex >= m_channels.size()) return;
     
     EEGChannel &channel = m_channels[channelIndex];
-    SignalProcessor::normalize(channel.data);
+    SignalProcessor::normalize(channel.data, channel.validity);
     
     // Update physical range
     channel.physicalMin = 0.0;
@@ -109,22 +122,474 @@ void EEGData::removeDC(int channelIndex) {
     if (channelIndex < 0 || channelIndex >= m_channels.size()) return;
     
     EEGChannel &channel = m_channels[channelIndex];
-    SignalProcessor::removeDC(channel.data);
     
-    // Update mean
-    double mean = SignalProcessor::mean(channel.data);
+    // Shift the physical range by the mean being removed
+    double mean = SignalProcessor::mean(channel.data, channel.validity);
+    SignalProcessor::removeDC(channel.data, channel.validity);
     channel.physicalMin -= mean;
     channel.physicalMax -= mean;
     
     emit dataChanged();
 }
 
+void EEGData::refreshValidity(const QVector<int> &channelIndices) {
+    QVector<EEGChannel*> targets;
+    for (int index : channelIndices) {
+        if (index >= 0 && index < m_channels.size()) targets.append(&m_channels[index]);
+    }
+    Parallel::parallelFor(0, targets.size(), [&](int i) {
+        targets[i]->validity = ValidityMask::scan(targets[i]->data);
+    });
+    emit dataChanged();
+}
+
+QVector<int> EEGData::badChannels() const {
+    QVector<int> bad;
+    for (int i = 0; i < m_channels.size(); ++i) {
+        if (m_channels[i].bad) bad.append(i);
+    }
+    return bad;
+}
+
+void EEGData::setBadChannels(const QVector<int> &channelIndices) {
+    for (int index : channelIndices) {
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "Bad channels: Invalid channel index" << index;
+            return;
+        }
+    }
+    for (EEGChannel &ch : m_channels) ch.bad = false;
+    for (int index : channelIndices) m_channels[index].bad = true;
+    emit badChannelsChanged();
+}
+
+void EEGData::setRejectedIntervals(const IntervalSet &intervals) {
+    m_rejected = intervals;
+    emit rejectedIntervalsChanged();
+}
+
+void EEGData::rejectInterval(double startTime, double endTime) {
+    m_rejected.add(startTime, endTime);
+    emit rejectedIntervalsChanged();
+}
+
+void EEGData::clearRejectedIntervals() {
+    m_rejected.clear();
+    emit rejectedIntervalsChanged();
+}
+
+CleanView EEGData::cleanView(int channelIndex) const {
+    if (channelIndex < 0 || channelIndex >= m_channels.size()) {
+        qWarning() << "Clean view: Invalid channel index" << channelIndex;
+        static const QVector<double> empty;
+        return CleanView(empty, 1.0, m_rejected);
+    }
+    const EEGChannel &channel = m_channels[channelIndex];
+    return CleanView(channel.data, channel.samplingRate, m_rejected);
+}
+
+void EEGData::addEvent(const EEGEvent &event) {
+    int row = m_events.insertionIndex(event.onset);
+    emit eventAboutToBeAdded(row);
+    m_events.add(event);
+    emit eventAdded(row);
+    emit eventsChanged();
+}
+
+void EEGData::addEvents(const QVector<EEGEvent> &events) {
+    if (events.isEmpty()) return;
+    emit eventsAboutToBeReset();
+    m_events.add(events);
+    emit eventsReset();
+    emit eventsChanged();
+}
+
+void EEGData::removeEvent(int index) {
+    if (index < 0 || index >= m_events.size()) return;
+    emit eventAboutToBeRemoved(index);
+    m_events.remove(index);
+    emit eventRemoved(index);
+    emit eventsChanged();
+}
+
+void EEGData::clearEvents() {
+    emit eventsAboutToBeReset();
+    m_events.clear();
+    emit eventsReset();
+    emit eventsChanged();
+}
+
+void EEGData::resample(double newRate) {
+    if (newRate <= 0) {
+        qWarning() << "Resample: Invalid target rate" << newRate;
+        return;
+    }
+
+    QVector<QVector<double>> results(m_channels.size());
+    QVector<ValidityMask> masks(m_channels.size());
+    const EEGChannel *channels = m_channels.constData();
+    Parallel::parallelFor(0, m_channels.size(), [&](int i) {
+        const EEGChannel &ch = channels[i];
+        if (ch.samplingRate == newRate) return;
+        if (ch.validity.size() != ch.data.size() || ch.validity.allValid()) {
+            results[i] = SignalProcessor::resample(ch.data, ch.samplingRate, newRate);
+            masks[i] = ValidityMask::scan(results[i]);
+            return;
+        }
+
+        // Resample across bridged gaps, then mark the gaps at the new rate
+        QVector<double> bridged = ch.data;
+        SignalProcessor::bridgeInvalid(bridged.data(), bridged.size(), ch.validity);
+        results[i] = SignalProcessor::resample(bridged, ch.samplingRate, newRate);
+        double ratio = newRate / ch.samplingRate;
+        qint64 length = results[i].size();
+        ch.validity.forEachInvalidRun([&](qint64 start, qint64 count) {
+            qint64 first = qBound<qint64>(0, static_cast<qint64>(std::floor(start * ratio)), length);
+            qint64 last = qBound<qint64>(0, static_cast<qint64>(std::ceil((start + count) * ratio)), length);
+            std::fill(results[i].begin() + first, results[i].begin() + last,
+                      std::numeric_limits<double>::quiet_NaN());
+        });
+        masks[i] = ValidityMask::scan(results[i]);
+    });
+
+    bool changed = false;
+    for (int i = 0; i < m_channels.size(); ++i) {
+        if (m_channels[i].samplingRate == newRate || results[i].isEmpty()) continue;
+        m_channels[i].data.swap(results[i]);
+        m_channels[i].validity = masks[i];
+        m_channels[i].samplingRate = newRate;
+        changed = true;
+    }
+    if (changed) emit dataChanged();
+}
+
+void EEGData::removeBaseline(const QVector<int> &channelIndices, const SignalProcessor::BaselineParams &params) {
+    if (params.mode == SignalProcessor::BaselineMean) {
+        // Shift each physical range by the mean removed from its channel
+        for (int index : channelIndices) {
+            if (index < 0 || index >= m_channels.size()) continue;
+            double mean = SignalProcessor::mean(m_channels[index].data, m_channels[index].validity);
+            m_channels[index].physicalMin -= mean;
+            m_channels[index].physicalMax -= mean;
+        }
+    }
+    transformChannels(channelIndices, [&params](QVector<double> &samples, double samplingRate) {
+        SignalProcessor::removeBaseline(samples, samplingRate, params);
+    });
+}
+
+void EEGData::transformChannels(const QVector<int> &channelIndices,
+                                const std::function<void(QVector<double>&, double)> &fn) {
+    QVector<EEGChannel*> targets;
+    for (int index : channelIndices) {
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "Transform: Invalid channel index" << index;
+            return;
+        }
+        targets.append(&m_channels[index]);
+    }
+    if (targets.isEmpty()) return;
+
+    // Invalid samples are bridged for fn and restored after it
+    Parallel::parallelFor(0, targets.size(), [&](int i) {
+        EEGChannel *ch = targets[i];
+        SignalProcessor::filterMasked(ch->data, ch->validity, [&](QVector<double> &samples) {
+            fn(samples, ch->samplingRate);
+        });
+        if (ch->validity.size() != ch->data.size()) ch->validity = ValidityMask::scan(ch->data);
+    });
+    emit dataChanged();
+}
+
+void EEGData::interpolateRejected(const QVector<int> &channelIndices) {
+    if (m_rejected.isEmpty()) return;
+
+    // Detach every channel here, before workers write through raw pointers
+    QVector<double*> samples;
+    QVector<qint64> lengths;
+    QVector<double> rates;
+    for (int index : channelIndices) {
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "Interpolate: Invalid channel index" << index;
+            return;
+        }
+        EEGChannel &ch = m_channels[index];
+        samples.append(ch.data.data());
+        lengths.append(ch.data.size());
+        rates.append(ch.samplingRate);
+    }
+
+    const IntervalSet &rejected = m_rejected;
+    Parallel::parallelFor(0, samples.size(), [&](int i) {
+        interpolateIntervals(samples[i], lengths[i], rates[i], rejected);
+    });
+    refreshValidity(channelIndices);
+}
+
+void EEGData::mapChannels(const QVector<int> &sources, const QVector<int> &targets, const Eigen::MatrixXd &weights) {
+    int numSources = sources.size();
+    int numTargets = targets.size();
+    if (numSources == 0 || numTargets == 0 || weights.rows() != numTargets || weights.cols() != numSources) {
+        qWarning() << "Channel map: Weights do not match channel counts";
+        return;
+    }
+
+    // Detach targets first, before taking read pointers that could share storage
+    int numSamples = INT_MAX;
+    QVector<double*> outputs(numTargets);
+    for (int i = 0; i < numTargets; ++i) {
+        int index = targets[i];
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "Channel map: Invalid channel index" << index;
+            return;
+        }
+        outputs[i] = m_channels[index].data.data();
+        numSamples = qMin(numSamples, m_channels[index].data.size());
+    }
+    QVector<const double*> inputs(numSources);
+    for (int i = 0; i < numSources; ++i) {
+        int index = sources[i];
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "Channel map: Invalid channel index" << index;
+            return;
+        }
+        inputs[i] = m_channels[index].data.constData();
+        numSamples = qMin(numSamples, m_channels[index].data.size());
+    }
+
+    const qint64 blockSamples = 4096;
+    Parallel::parallelForBlocks(numSamples, blockSamples, [&](qint64 start, qint64 count) {
+        EEGMatrix block(numSources, count);
+        for (int i = 0; i < numSources; ++i) {
+            block.row(i) = Eigen::Map<const Eigen::RowVectorXd>(inputs[i] + start, count);
+        }
+
+        EEGMatrix result = weights * block;
+
+        for (int i = 0; i < numTargets; ++i) {
+            Eigen::Map<Eigen::RowVectorXd>(outputs[i] + start, count) = result.row(i);
+        }
+    });
+
+    refreshValidity(targets);
+}
+
+QVector<QString> EEGData::channelLabels() const {
+    QVector<QString> labels;
+    labels.reserve(m_channels.size());
+    for (const EEGChannel &ch : m_channels) labels.append(ch.label);
+    return labels;
+}
+
+bool EEGData::applyMontage(const Montage &montage) {
+    if (montage.isEmpty() || montage.inputCount() != m_channels.size()) {
+        qWarning() << "Montage: Does not match the loaded channels";
+        return false;
+    }
+
+    int numSamples = INT_MAX;
+    double rate = m_channels[0].samplingRate;
+    QVector<const double*> inputs(m_channels.size());
+    QVector<const ValidityMask*> masks(m_channels.size());
+    for (int i = 0; i < m_channels.size(); ++i) {
+        const EEGChannel &ch = m_channels[i];
+        if (ch.samplingRate != rate) {
+            qWarning() << "Montage: Channels must share one sampling rate, resample first";
+            return false;
+        }
+        inputs[i] = ch.data.constData();
+        masks[i] = ch.validity.size() == ch.data.size() ? &ch.validity : nullptr;
+        numSamples = qMin(numSamples, ch.data.size());
+    }
+
+    QVector<EEGChannel> outputs(montage.outputCount());
+    QVector<double*> outputData(outputs.size());
+    for (int i = 0; i < outputs.size(); ++i) {
+        EEGChannel &ch = outputs[i];
+        ch.label = montage.outputLabels()[i];
+        ch.samplingRate = rate;
+        QVector<int> sources = montage.inputsOf(i);
+        if (!sources.isEmpty()) ch.unit = m_channels[sources[0]].unit;
+        ch.data.resize(numSamples);
+        outputData[i] = ch.data.data();
+    }
+
+    montage.apply(inputs, numSamples, outputData, QVector<int>(), masks);
+
+    // Physical range of the result, so saving keeps full resolution
+    Parallel::parallelFor(0, outputs.size(), [&](int i) {
+        outputs[i].validity = ValidityMask::scan(outputs[i].data);
+        SignalProcessor::Moments m = SignalProcessor::moments(outputs[i].data, outputs[i].validity);
+        if (m.count > 0 && m.max > m.min) {
+            outputs[i].physicalMin = m.min;
+            outputs[i].physicalMax = m.max;
+        }
+    });
+
+    clearDisplayMontage();
+    m_channels = outputs;
+    emit dataChanged();
+    emit channelCountChanged(m_channels.size());
+    return true;
+}
+
+bool EEGData::setDisplayMontage(const Montage &montage) {
+    if (montage.isEmpty() || montage.inputCount() != m_channels.size()) {
+        qWarning() << "Montage: Does not match the loaded channels";
+        return false;
+    }
+    for (const EEGChannel &ch : m_channels) {
+        if (ch.samplingRate != m_channels[0].samplingRate) {
+            qWarning() << "Montage: Channels must share one sampling rate, resample first";
+            return false;
+        }
+    }
+    m_displayMontage = montage;
+    emit displayMontageChanged();
+    return true;
+}
+
+void EEGData::clearDisplayMontage() {
+    if (m_displayMontage.isEmpty()) return;
+    m_displayMontage = Montage();
+    emit displayMontageChanged();
+}
+
+int EEGData::displayChannelCount() const {
+    return hasDisplayMontage() ? m_displayMontage.outputCount() : m_channels.size();
+}
+
+QString EEGData::displayChannelLabel(int row) const {
+    if (row < 0 || row >= displayChannelCount()) return QString();
+    return hasDisplayMontage() ? m_displayMontage.outputLabels()[row] : m_channels[row].label;
+}
+
+double EEGData::displaySamplingRate(int row) const {
+    if (row < 0 || row >= displayChannelCount()) return 0.0;
+    return hasDisplayMontage() ? m_channels[0].samplingRate : m_channels[row].samplingRate;
+}
+
+int EEGData::displaySampleCount(int row) const {
+    if (row < 0 || row >= displayChannelCount()) return 0;
+    if (!hasDisplayMontage()) return m_channels[row].data.size();
+
+    int numSamples = INT_MAX;
+    for (const EEGChannel &ch : m_channels) numSamples = qMin(numSamples, ch.data.size());
+    return numSamples;
+}
+
+QVector<QVector<double>> EEGData::displayWindow(const QVector<int> &rows, double startTime, double endTime,
+                                                QVector<int> &firstSamples) const {
+    QVector<QVector<double>> windows(rows.size());
+    firstSamples = QVector<int>(rows.size(), 0);
+    int numRows = displayChannelCount();
+
+    auto sampleRange = [&](double rate, int available, int &first, int &last) {
+        first = qMax(0, static_cast<int>(startTime * rate));
+        last = qMin(available - 1, static_cast<int>(endTime * rate));
+    };
+
+    if (!hasDisplayMontage()) {
+        for (int i = 0; i < rows.size(); ++i) {
+            if (rows[i] < 0 || rows[i] >= numRows) continue;
+            const EEGChannel &ch = m_channels[rows[i]];
+            int first, last;
+            sampleRange(ch.samplingRate, ch.data.size(), first, last);
+            if (last < first) continue;
+            windows[i] = ch.data.mid(first, last - first + 1);
+            firstSamples[i] = first;
+        }
+        return windows;
+    }
+
+    // One montage pass over the window for every requested output
+    int first, last;
+    sampleRange(m_channels[0].samplingRate, displaySampleCount(0), first, last);
+    if (last < first) return windows;
+    int count = last - first + 1;
+
+    QVector<int> outputRows;
+    QVector<double*> outputs;
+    for (int i = 0; i < rows.size(); ++i) {
+        if (rows[i] < 0 || rows[i] >= numRows) continue;
+        windows[i].resize(count);
+        firstSamples[i] = first;
+        outputRows.append(rows[i]);
+        outputs.append(windows[i].data());
+    }
+    if (outputRows.isEmpty()) return windows;
+
+    QVector<const double*> inputs(m_channels.size());
+    QVector<const ValidityMask*> masks(m_channels.size());
+    for (int i = 0; i < m_channels.size(); ++i) {
+        const EEGChannel &ch = m_channels[i];
+        inputs[i] = ch.data.constData() + first;
+        masks[i] = ch.validity.size() == ch.data.size() ? &ch.validity : nullptr;
+    }
+    m_displayMontage.apply(inputs, count, outputs, outputRows, masks, first);
+    return windows;
+}
+
+void EEGData::applyChannelTransform(const QVector<int> &channelIndices, const Eigen::MatrixXd &transform,
+                                    const Eigen::VectorXd &offset) {
+    int n = channelIndices.size();
+    if (n == 0 || transform.rows() != n || transform.cols() != n) {
+        qWarning() << "Channel transform: Matrix does not match channel count";
+        return;
+    }
+    bool hasOffset = offset.size() == n;
+
+    // Detach every channel here, before workers write through raw pointers
+    int numSamples = INT_MAX;
+    QVector<double*> rows(n);
+    QVector<const ValidityMask*> masks(n);
+    for (int i = 0; i < n; ++i) {
+        int index = channelIndices[i];
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "Channel transform: Invalid channel index" << index;
+            return;
+        }
+        const EEGChannel &ch = m_channels[index];
+        numSamples = qMin(numSamples, ch.data.size());
+        masks[i] = ch.validity.size() == ch.data.size() ? &ch.validity : nullptr;
+        rows[i] = m_channels[index].data.data();
+    }
+
+    // Blocks are one mask chunk, so clean blocks skip the mask entirely. In a
+    // dirty block invalid samples enter the mix as zero and stay invalid in
+    // their own channel, instead of spreading to every channel.
+    const qint64 blockSamples = ValidityMask::ChunkSize;
+    Parallel::parallelForBlocks(numSamples, blockSamples, [&](qint64 start, qint64 count) {
+        EEGMatrix block(n, count);
+        EEGMatrix valid;
+        for (int i = 0; i < n; ++i) {
+            block.row(i) = Eigen::Map<const Eigen::RowVectorXd>(rows[i] + start, count);
+            if (!masks[i] || masks[i]->rangeValid(start, count)) continue;
+            if (valid.size() == 0) valid = EEGMatrix::Ones(n, count);
+            masks[i]->weights(start, count, valid.row(i).data());
+        }
+        if (valid.size() > 0) block = (valid.array() > 0.0).select(block, 0.0);
+
+        EEGMatrix result = transform * block;
+        if (hasOffset) result.colwise() += offset;
+        if (valid.size() > 0) {
+            result = (valid.array() > 0.0).select(result, std::numeric_limits<double>::quiet_NaN());
+        }
+
+        for (int i = 0; i < n; ++i) {
+            Eigen::Map<Eigen::RowVectorXd>(rows[i] + start, count) = result.row(i);
+        }
+    });
+
+    emit dataChanged();
+}
+
 QVector<double> EEGData::channelMeans() const {
     QVector<double> means;
     means.reserve(m_channels.size());
     
     for (const auto &channel : m_channels) {
-        means.append(SignalProcessor::mean(channel.data));
+        means.append(SignalProcessor::mean(channel.data, channel.validity));
     }
     
     return means;
@@ -135,7 +600,7 @@ QVector<double> EEGData::channelStdDevs() const {
     stddevs.reserve(m_channels.size());
     
     for (const auto &channel : m_channels) {
-        stddevs.append(SignalProcessor::standardDeviation(channel.data));
+        stddevs.append(SignalProcessor::standardDeviation(channel.data, channel.validity));
     }
     
     return stddevs;
@@ -148,12 +613,66 @@ QVector<double> EEGData::getTimeSeries(int channelIndex, double startTime, doubl
     return SignalProcessor::extractTimeWindow(channel.data, channel.samplingRate, startTime, duration);
 }
 
+EEGMatrix EEGData::toMatrix(const QVector<int> &channelIndices, int startSample, int numSamples) const {
+    if (channelIndices.isEmpty() || startSample < 0 || numSamples <= 0) return EEGMatrix();
+
+    EEGMatrix block(channelIndices.size(), numSamples);
+    for (int row = 0; row < channelIndices.size(); ++row) {
+        int index = channelIndices[row];
+        if (index < 0 || index >= m_channels.size()) {
+            qWarning() << "toMatrix: Invalid channel index" << index;
+            return EEGMatrix();
+        }
+
+        const QVector<double> &samples = m_channels[index].data;
+        int available = qBound(0, samples.size() - startSample, numSamples);
+        if (available > 0) {
+            std::copy(samples.constData() + startSample,
+                      samples.constData() + startSample + available, block.row(row).data());
+        }
+        if (available < numSamples) {
+            block.row(row).tail(numSamples - available).setZero();
+        }
+    }
+    return block;
+}
 
 void EEGData::applyNotchFilter(int channelIndex, double notchFreq) {
     if (channelIndex < 0 || channelIndex >= m_channels.size()) return;
     
     EEGChannel &channel = m_channels[channelIndex];
-    SignalProcessor::notchFilter(channel.data, channel.samplingRate, notchFreq);
+    SignalProcessor::filterMasked(channel.data, channel.validity, [&](QVector<double> &samples) {
+        SignalProcessor::notchFilter(samples, channel.samplingRate, notchFreq);
+    });
     
     emit dataChanged();
+}
+
+void EEGData::applyLineCanceller(const QVector<int> &channelIndices,
+                                 const SignalProcessor::LineCancellerParams &params, int referenceChannel) {
+    // A copy, the reference may be one of the channels being cleaned
+    QVector<double> reference;
+    if (referenceChannel >= 0) {
+        if (referenceChannel >= m_channels.size()) {
+            qWarning() << "Line canceller: Invalid reference channel" << referenceChannel;
+            return;
+        }
+        const EEGChannel &ref = m_channels[referenceChannel];
+        for (int index : channelIndices) {
+            if (index < 0 || index >= m_channels.size()) continue;
+            const EEGChannel &ch = m_channels[index];
+            if (ch.samplingRate != ref.samplingRate || ch.data.size() != ref.data.size()) {
+                qWarning() << "Line canceller: Reference" << ref.label << "does not match" << ch.label;
+                return;
+            }
+        }
+        reference = ref.data;
+        SignalProcessor::bridgeInvalid(reference.data(), reference.size(), ref.validity);
+    }
+
+    const double *referenceData = reference.isEmpty() ? nullptr : reference.constData();
+    transformChannels(channelIndices, [&](QVector<double> &samples, double samplingRate) {
+        SignalProcessor::LineNoiseCanceller canceller(samplingRate, params);
+        canceller.process(samples.data(), samples.size(), referenceData);
+    });
 }
\ No newline at end of file
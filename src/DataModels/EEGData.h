@@ -3,7 +3,13 @@
 #include <QVector>
 #include <QString>
 #include <QDateTime>
+#include <functional>
 #include "../Utils/SignalProcessor.h"
+#include "IntervalSet.h"
+#include "ValidityMask.h"
+#include "EventStore.h"
+#include "ElectrodeLayout.h"
+#include "Montage.h"
 
 struct EEGChannel {
     QString label;
@@ -14,6 +20,10 @@ struct EEGChannel {
     double digitalMax = 32767.0;
     double samplingRate = 250.0; // Hz
     QVector<double> data;
+    // Non-finite samples of data, scanned by EEGData on add and after its own
+    // edits; refresh it with EEGData::refreshValidity after writing data directly
+    ValidityMask validity;
+    bool bad = false;   // marked for hiding or interpolation
 
     double duration() const {
         return data.size() / samplingRate;
@@ -24,6 +34,9 @@ struct EEGChannel {
     }
 };
 
+// Channels x samples, row-major so each channel's samples stay contiguous
+using EEGMatrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
 class EEGData : public QObject {
     Q_OBJECT
 
@@ -41,19 +54,12 @@ public:
         newData->m_patientInfo = this->m_patientInfo;
         newData->m_recordingInfo = this->m_recordingInfo;
         newData->m_startDateTime = this->m_startDateTime;
+        newData->m_rejected = this->m_rejected;
+        newData->m_events = this->m_events;
+        newData->m_layout = this->m_layout;
         
-        // Deep copy channels
-        for (const EEGChannel &ch : m_channels) {
-            EEGChannel newChannel;
-            newChannel.label = ch.label;
-            newChannel.samplingRate = ch.samplingRate;
-            newChannel.physicalMin = ch.physicalMin;
-            newChannel.physicalMax = ch.physicalMax;
-            newChannel.digitalMin = ch.digitalMin;
-            newChannel.digitalMax = ch.digitalMax;
-            newChannel.data = ch.data;  // QVector copies its data
-            newData->m_channels.append(newChannel);
-        }
+        // Whole channels, so data, mask, range, unit and bad mark all travel together
+        newData->m_channels = m_channels;
         
         return newData;
     }
@@ -62,24 +68,25 @@ public:
     void copyFrom(const EEGData *other) {
         if (!other) return;
         
+        // Same channels (e.g. a filtered copy) keep the display montage
+        Montage displayMontage = m_displayMontage;
+        QVector<QString> labels = channelLabels();
+
         clear();
         m_patientInfo = other->m_patientInfo;
         m_recordingInfo = other->m_recordingInfo;
         m_startDateTime = other->m_startDateTime;
+        m_rejected = other->m_rejected;
+        emit eventsAboutToBeReset();
+        m_events = other->m_events;
+        emit eventsReset();
+        m_layout = other->m_layout;
         
-        for (const EEGChannel &ch : other->m_channels) {
-            EEGChannel newChannel;
-            newChannel.label = ch.label;
-            newChannel.samplingRate = ch.samplingRate;
-            newChannel.physicalMin = ch.physicalMin;
-            newChannel.physicalMax = ch.physicalMax;
-            newChannel.digitalMin = ch.digitalMin;
-            newChannel.digitalMax = ch.digitalMax;
-            newChannel.data = ch.data;
-            m_channels.append(newChannel);
-        }
+        m_channels = other->m_channels;
+        if (!displayMontage.isEmpty() && channelLabels() == labels) setDisplayMontage(displayMontage);
         
         emit dataChanged();
+        emit eventsChanged();
     }
 
     // Data manipulation
@@ -90,12 +97,55 @@ public:
     void applyOffset(int channelIndex, double offset);
     void applyFilter(int channelIndex, double lowCut, double highCut) {
         if (channelIndex < 0 || channelIndex >= m_channels.size()) return;
-        SignalProcessor::bandpassFilter(m_channels[channelIndex].data, 
-                                        m_channels[channelIndex].samplingRate, 
-                                        lowCut, highCut);
+        EEGChannel &channel = m_channels[channelIndex];
+        SignalProcessor::filterMasked(channel.data, channel.validity, [&](QVector<double> &samples) {
+            SignalProcessor::bandpassFilter(samples, channel.samplingRate, lowCut, highCut);
+        });
         emit dataChanged();
     }
     void removeDC(int channelIndex);
+    // Rescans the validity masks, after channel data was written directly
+    void refreshValidity(const QVector<int> &channelIndices);
+
+    // Channels marked bad, e.g. by BadChannels::detect; setting replaces the marks
+    QVector<int> badChannels() const;
+    void setBadChannels(const QVector<int> &channelIndices);
+    // Slow drift removal, channels in parallel
+    void removeBaseline(const QVector<int> &channelIndices, const SignalProcessor::BaselineParams &params);
+    // Brings every channel to newRate with the polyphase resampler, channels in parallel
+    void resample(double newRate);
+
+    // targets <- weights * sources, block-wise over samples. Targets may
+    // overlap sources, each block is read before it is written.
+    void mapChannels(const QVector<int> &sources, const QVector<int> &targets, const Eigen::MatrixXd &weights);
+
+    // Runs fn(samples, samplingRate) on each listed channel, channels in parallel
+    void transformChannels(const QVector<int> &channelIndices,
+                           const std::function<void(QVector<double>&, double)> &fn);
+
+    // x <- transform * x + offset over the listed channels, applied block-wise
+    void applyChannelTransform(const QVector<int> &channelIndices, const Eigen::MatrixXd &transform,
+                               const Eigen::VectorXd &offset = Eigen::VectorXd());
+
+    // Rejected segments, in seconds from the start of the recording
+    const IntervalSet& rejectedIntervals() const { return m_rejected; }
+    void setRejectedIntervals(const IntervalSet &intervals);
+    void rejectInterval(double startTime, double endTime);
+    void clearRejectedIntervals();
+    CleanView cleanView(int channelIndex) const;
+    // Bridges the rejected segments of each channel with a straight line, in place
+    void interpolateRejected(const QVector<int> &channelIndices);
+
+    // Electrode positions, matched to channels by label
+    const ElectrodeLayout& electrodeLayout() const { return m_layout; }
+    void setElectrodeLayout(const ElectrodeLayout &layout) { m_layout = layout; }
+
+    // Events and annotations
+    const EventStore& events() const { return m_events; }
+    void addEvent(const EEGEvent &event);
+    void addEvents(const QVector<EEGEvent> &events);
+    void removeEvent(int index);
+    void clearEvents();
 
     // Data access
     const QVector<EEGChannel>& channels() const { return m_channels; }
@@ -112,6 +162,7 @@ public:
     QVector<double> channelMeans() const;
     QVector<double> channelStdDevs() const;
     QVector<double> getTimeSeries(int channelIndex, double startTime, double duration) const;
+    EEGMatrix toMatrix(const QVector<int> &channelIndices, int startSample, int numSamples) const;
 
     QString fileName() const { return m_fileName; }
     void setFileName(const QString &name) { m_fileName = name; }
@@ -126,41 +177,54 @@ public:
     QDateTime startDateTime() const { return m_startDateTime; }
     void setStartDateTime(const QDateTime &dt) { m_startDateTime = dt; }
 
-    void applyMontage(SignalProcessor::MontageType montage) {
-        // Collect all channel data
-        QVector<QVector<double>> allData;
-        QVector<QString> labels;
-        QVector<double> samplingRates;
-
-        for (const auto &ch : m_channels) {
-            allData.append(ch.data);
-            labels.append(ch.label);
-            samplingRates.append(ch.samplingRate);
-        }
-
-        
-        // Apply montage
-        SignalProcessor::applyMontage(allData, labels, montage);
-        
-        // Update channels
-        m_channels.clear();
-        for (int i = 0; i < allData.size(); ++i) {
-            EEGChannel ch;
-            ch.data = allData[i];
-            ch.label = labels[i];
-            ch.samplingRate = samplingRates[i % samplingRates.size()]; 
-            m_channels.append(ch);
-        }
-        emit dataChanged();
-        emit channelCountChanged(m_channels.size());
-    }
+    QVector<QString> channelLabels() const;
+    // Replaces the channels with the montage outputs; the montage must be
+    // built from channelLabels(). Inputs need a common sampling rate.
+    bool applyMontage(const Montage &montage);
+
+    // Display montage: evaluated over the requested window only when drawing,
+    // the channels stay as recorded. Same requirements as applyMontage. It is
+    // dropped whenever the channel set changes.
+    bool setDisplayMontage(const Montage &montage);
+    void clearDisplayMontage();
+    bool hasDisplayMontage() const { return !m_displayMontage.isEmpty(); }
+    const Montage& displayMontage() const { return m_displayMontage; }
+
+    // Rows as displayed: montage outputs with a display montage, the
+    // channels themselves without one
+    int displayChannelCount() const;
+    QString displayChannelLabel(int row) const;
+    double displaySamplingRate(int row) const;
+    int displaySampleCount(int row) const;
+    // Samples of each row within [startTime, endTime], clipped to the data;
+    // firstSamples receives the index of each row's first sample. Invalid
+    // rows come back empty.
+    QVector<QVector<double>> displayWindow(const QVector<int> &rows, double startTime, double endTime,
+                                           QVector<int> &firstSamples) const;
 
     void applyNotchFilter(int channelIndex, double notchFreq);
+    // Adaptive canceller per channel, in parallel. referenceChannel < 0 uses
+    // synthesized sinusoids, otherwise that channel's line pickup.
+    void applyLineCanceller(const QVector<int> &channelIndices,
+                            const SignalProcessor::LineCancellerParams &params,
+                            int referenceChannel = -1);
 signals:
     void dataChanged();
     void channelAdded(int index);
     void channelRemoved(int index);
     void channelCountChanged(int newCount);
+    void rejectedIntervalsChanged();
+    // Any event change. Views that track rows use the finer signals below:
+    // single events report their row, bulk changes a reset.
+    void eventsChanged();
+    void eventAboutToBeAdded(int row);
+    void eventAdded(int row);
+    void eventAboutToBeRemoved(int row);
+    void eventRemoved(int row);
+    void eventsAboutToBeReset();
+    void eventsReset();
+    void displayMontageChanged();
+    void badChannelsChanged();
 
 private:
     QVector<EEGChannel> m_channels;
@@ -168,4 +232,8 @@ private:
     QString m_recordingInfo;
     QDateTime m_startDateTime;
     QString m_fileName;
+    IntervalSet m_rejected;
+    EventStore m_events;
+    ElectrodeLayout m_layout = ElectrodeLayout::standard1010();
+    Montage m_displayMontage;
 };
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "ElectrodeLayout.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QRegularExpression>
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+
+static Eigen::Vector3d fromPolar(double polarDegrees, double azimuthDegrees) {
+    // Azimuth counted from the nasion towards the left ear
+    double theta = polarDegrees * M_PI / 180.0;
+    double phi = azimuthDegrees * M_PI / 180.0;
+    return Eigen::Vector3d(-std::sin(theta) * std::sin(phi), std::sin(theta) * std::cos(phi), std::cos(theta));
+}
+
+static Eigen::Vector3d slerp(const Eigen::Vector3d &a, const Eigen::Vector3d &b, double t) {
+    double angle = std::acos(std::clamp(a.dot(b), -1.0, 1.0));
+    if (angle < 1e-12) return a;
+    return (std::sin((1.0 - t) * angle) * a + std::sin(t * angle) * b) / std::sin(angle);
+}
+
+ElectrodeLayout ElectrodeLayout::standard1010() {
+    ElectrodeLayout layout;
+    layout.m_name = "Standard 10-10";
+
+    auto mirrored = [](const Eigen::Vector3d &p) { return Eigen::Vector3d(-p.x(), p.y(), p.z()); };
+
+    // Rows from front to back: left equator electrode, the inner electrodes
+    // of the left half (outermost first) and the midline electrode. Right
+    // hemisphere labels carry the next even number.
+    struct Row {
+        const char *equator;
+        const char *equatorRight;
+        QStringList inner;
+        QStringList innerRight;
+        const char *midline;
+        double equatorAzimuth;     // degrees from the nasion
+        double midlinePolar;       // signed, negative behind Cz
+    };
+    const QVector<Row> rows = {
+        {"Fp1", "Fp2", {}, {}, "Fpz", 18.0, 90.0},
+        {"AF7", "AF8", {"AF5", "AF3", "AF1"}, {"AF6", "AF4", "AF2"}, "AFz", 36.0, 67.5},
+        {"F7", "F8", {"F5", "F3", "F1"}, {"F6", "F4", "F2"}, "Fz", 54.0, 45.0},
+        {"FT7", "FT8", {"FC5", "FC3", "FC1"}, {"FC6", "FC4", "FC2"}, "FCz", 72.0, 22.5},
+        {"T7", "T8", {"C5", "C3", "C1"}, {"C6", "C4", "C2"}, "Cz", 90.0, 0.0},
+        {"TP7", "TP8", {"CP5", "CP3", "CP1"}, {"CP6", "CP4", "CP2"}, "CPz", 108.0, -22.5},
+        {"P7", "P8", {"P5", "P3", "P1"}, {"P6", "P4", "P2"}, "Pz", 126.0, -45.0},
+        {"PO7", "PO8", {"PO5", "PO3", "PO1"}, {"PO6", "PO4", "PO2"}, "POz", 144.0, -67.5},
+        {"O1", "O2", {}, {}, "Oz", 162.0, -90.0},
+    };
+
+    for (const Row &row : rows) {
+        Eigen::Vector3d left = fromPolar(90.0, row.equatorAzimuth);
+        Eigen::Vector3d mid = row.midlinePolar >= 0 ? fromPolar(row.midlinePolar, 0.0)
+                                                    : fromPolar(-row.midlinePolar, 180.0);
+        layout.setPosition(row.equator, left);
+        layout.setPosition(row.equatorRight, mirrored(left));
+        layout.setPosition(row.midline, mid);
+        for (int i = 0; i < row.inner.size(); ++i) {
+            Eigen::Vector3d p = slerp(left, mid, (i + 1.0) / (row.inner.size() + 1));
+            layout.setPosition(row.inner[i], p);
+            layout.setPosition(row.innerRight[i], mirrored(p));
+        }
+    }
+
+    // Below the equator: temporal, inion row and mastoids
+    layout.setPosition("T9", fromPolar(112.5, 90.0));
+    layout.setPosition("T10", mirrored(fromPolar(112.5, 90.0)));
+    layout.setPosition("Iz", fromPolar(112.5, 180.0));
+    layout.setPosition("I1", fromPolar(112.5, 162.0));
+    layout.setPosition("I2", mirrored(fromPolar(112.5, 162.0)));
+    layout.setPosition("M1", fromPolar(120.0, 108.0));
+    layout.setPosition("M2", mirrored(fromPolar(120.0, 108.0)));
+    layout.setPosition("A1", fromPolar(120.0, 90.0));
+    layout.setPosition("A2", mirrored(fromPolar(120.0, 90.0)));
+    return layout;
+}
+
+QString ElectrodeLayout::baseLabel(const QString &label) {
+    QString result = label.trimmed();
+    if (result.startsWith("EEG ", Qt::CaseInsensitive)) result = result.mid(4).trimmed();
+
+    // Reference suffixes from EDF exports and our own montages, e.g.
+    // "Fp1-REF", "C3-A2" or "Cz-LAP"
+    static const QStringList references = {"REF", "LE", "RE", "AVG", "CAR", "LAP", "REST",
+                                           "A1", "A2", "M1", "M2"};
+    int dash = result.lastIndexOf('-');
+    if (dash > 0 && references.contains(result.mid(dash + 1).toUpper())) result = result.left(dash);
+    return result;
+}
+
+QString ElectrodeLayout::normalizedLabel(const QString &label) {
+    QString result = baseLabel(label).toUpper();
+
+    // 10-20 names that moved in 10-10
+    if (result == "T3") return "T7";
+    if (result == "T4") return "T8";
+    if (result == "T5") return "P7";
+    if (result == "T6") return "P8";
+    return result;
+}
+
+void ElectrodeLayout::setPosition(const QString &label, const Eigen::Vector3d &position) {
+    QString key = normalizedLabel(label);
+    double norm = position.norm();
+    Eigen::Vector3d unit = norm > 0 ? Eigen::Vector3d(position / norm) : Eigen::Vector3d(0, 0, 1);
+
+    auto it = m_index.constFind(key);
+    if (it != m_index.constEnd()) {
+        m_positions[it.value()] = unit;
+        return;
+    }
+    m_index.insert(key, m_labels.size());
+    m_labels.append(label);
+    m_positions.append(unit);
+}
+
+int ElectrodeLayout::indexOf(const QString &label) const {
+    return m_index.value(normalizedLabel(label), -1);
+}
+
+Eigen::Vector3d ElectrodeLayout::position(const QString &label) const {
+    int index = indexOf(label);
+    return index >= 0 ? m_positions[index] : Eigen::Vector3d::Zero();
+}
+
+QVector<int> ElectrodeLayout::neighbours(int index, double maxAngle) const {
+    QVector<QPair<double, int>> candidates;
+    const Eigen::Vector3d &center = m_positions[index];
+    for (int i = 0; i < m_positions.size(); ++i) {
+        if (i == index) continue;
+        double angle = std::acos(std::clamp(center.dot(m_positions[i]), -1.0, 1.0));
+        if (angle <= maxAngle) candidates.append({angle, i});
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    QVector<int> result;
+    for (const auto &candidate : candidates) result.append(candidate.second);
+    return result;
+}
+
+bool ElectrodeLayout::loadFromFile(const QString &filePath) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open electrode file:" << filePath;
+        return false;
+    }
+
+    QVector<QString> labels;
+    QVector<QVector<double>> values;
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        QStringList tokens = line.split(QRegularExpression("[\\s,;]+"), Qt::SkipEmptyParts);
+        QString label;
+        QVector<double> numbers;
+        bool valid = true;
+        for (const QString &token : tokens) {
+            bool ok;
+            double value = token.toDouble(&ok);
+            if (ok) {
+                numbers.append(value);
+            } else if (label.isEmpty()) {
+                label = token;
+            } else {
+                valid = false;  // header or comment line
+            }
+        }
+        if (numbers.size() == 4) numbers.removeFirst();   // leading index
+        if (!valid || label.isEmpty() || (numbers.size() != 2 && numbers.size() != 3)) continue;
+        labels.append(label);
+        values.append(numbers);
+    }
+    file.close();
+
+    if (labels.isEmpty()) {
+        qWarning() << "No electrode positions in" << filePath;
+        return false;
+    }
+
+    // Cartesian input comes in head coordinates, so fit a sphere and work
+    // relative to its center: |p|^2 = 2 c.p + (r^2 - |c|^2)
+    Eigen::Vector3d center = Eigen::Vector3d::Zero();
+    int cartesian = 0;
+    for (const auto &v : values) cartesian += (v.size() == 3);
+    if (cartesian >= 4) {
+        Eigen::MatrixXd A(cartesian, 4);
+        Eigen::VectorXd b(cartesian);
+        int row = 0;
+        for (const auto &v : values) {
+            if (v.size() != 3) continue;
+            Eigen::Vector3d p(v[0], v[1], v[2]);
+            A.row(row) << 2.0 * p.x(), 2.0 * p.y(), 2.0 * p.z(), 1.0;
+            b[row] = p.squaredNorm();
+            ++row;
+        }
+        Eigen::Vector4d solution = A.colPivHouseholderQr().solve(b);
+        center = solution.head<3>();
+        if (!center.allFinite()) center.setZero();
+    }
+
+    ElectrodeLayout layout;
+    layout.m_name = QFileInfo(filePath).completeBaseName();
+    for (int i = 0; i < labels.size(); ++i) {
+        const QVector<double> &v = values[i];
+        if (v.size() == 3) {
+            layout.setPosition(labels[i], Eigen::Vector3d(v[0], v[1], v[2]) - center);
+        } else {
+            // BESA: signed polar angle from Cz, azimuth from the right ear
+            double theta = v[0] * M_PI / 180.0;
+            double phi = v[1] * M_PI / 180.0;
+            layout.setPosition(labels[i], Eigen::Vector3d(std::sin(theta) * std::cos(phi),
+                                                          std::sin(theta) * std::sin(phi),
+                                                          std::cos(theta)));
+        }
+    }
+
+    *this = layout;
+    qDebug() << "Loaded" << size() << "electrode positions from" << filePath;
+    return true;
+}
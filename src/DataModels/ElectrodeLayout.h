@@ -0,0 +1,51 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <Eigen/Dense>
+
+// Electrode positions on the unit sphere, looked up by channel label.
+// x points right, y to the nasion, z up through Cz.
+class ElectrodeLayout {
+public:
+    ElectrodeLayout() = default;
+
+    // Idealized spherical 10-10 positions: 10% steps are 18 degrees around
+    // the equator and 22.5 degrees along the midline, inner electrodes are
+    // spaced evenly on the arc between the equator and the midline. Old
+    // 10-20 names (T3, T4, T5, T6) resolve to their 10-10 equivalents.
+    static ElectrodeLayout standard1010();
+
+    // One electrode per line, whitespace or comma separated:
+    //   label x y z          cartesian, any unit; a sphere is fitted and removed
+    //   label theta phi      BESA spherical degrees
+    // An EEGLAB-style leading index and a label in the last column also work.
+    bool loadFromFile(const QString &filePath);
+
+    void setPosition(const QString &label, const Eigen::Vector3d &position);
+    bool contains(const QString &label) const { return indexOf(label) >= 0; }
+    Eigen::Vector3d position(const QString &label) const;
+
+    int size() const { return m_labels.size(); }
+    bool isEmpty() const { return m_labels.isEmpty(); }
+    const QVector<QString> &labels() const { return m_labels; }
+    QString name() const { return m_name; }
+
+    // Neighbours of an electrode within maxAngle radians, nearest first
+    QVector<int> neighbours(int index, double maxAngle) const;
+    const Eigen::Vector3d &positionAt(int index) const { return m_positions[index]; }
+    int indexOf(const QString &label) const;
+
+    // Label without an "EEG " prefix or a reference suffix, case kept
+    static QString baseLabel(const QString &label);
+    // Upper-case base label with 10-20 names mapped to 10-10, the lookup key
+    static QString normalizedLabel(const QString &label);
+
+private:
+
+    QString m_name;
+    QVector<QString> m_labels;
+    QVector<Eigen::Vector3d> m_positions;
+    QHash<QString, int> m_index;   // by normalized label
+};
@@ -0,0 +1,177 @@
+#include "EventStore.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+static bool overlapsWindow(const EEGEvent &event, double start, double end) {
+    return event.onset < end && (event.end() > start || event.onset >= start);
+}
+
+EventStore::EventStore(const EventStore &other) {
+    *this = other;
+}
+
+EventStore &EventStore::operator=(const EventStore &other) {
+    if (this == &other) return *this;
+    m_events = other.m_events;
+    m_indexStale = true;
+    return *this;
+}
+
+int EventStore::insertionIndex(double onset) const {
+    auto it = std::upper_bound(m_events.begin(), m_events.end(), onset,
+                               [](double t, const EEGEvent &e) { return t < e.onset; });
+    return static_cast<int>(it - m_events.begin());
+}
+
+int EventStore::add(const EEGEvent &event) {
+    int row = insertionIndex(event.onset);
+    m_events.insert(row, event);
+    m_indexStale = true;
+    return row;
+}
+
+void EventStore::add(const QVector<EEGEvent> &events) {
+    if (events.isEmpty()) return;
+    m_events += events;
+    std::stable_sort(m_events.begin(), m_events.end(),
+                     [](const EEGEvent &a, const EEGEvent &b) { return a.onset < b.onset; });
+    m_indexStale = true;
+}
+
+void EventStore::remove(int index) {
+    if (index < 0 || index >= m_events.size()) return;
+    m_events.remove(index);
+    m_indexStale = true;
+}
+
+void EventStore::clear() {
+    m_events.clear();
+    m_indexStale = true;
+}
+
+void EventStore::ensureIndex() const {
+    std::lock_guard<std::mutex> lock(m_indexMutex);
+    if (!m_indexStale) return;
+    rebuildIndex();
+    m_indexStale = false;
+}
+
+void EventStore::rebuildIndex() const {
+    m_maxEnd.resize(m_events.size());
+    buildMaxEnd(0, m_events.size());
+
+    m_byType.clear();
+    m_maxDuration.clear();
+    for (int i = 0; i < m_events.size(); ++i) {
+        const EEGEvent &event = m_events[i];
+        m_byType[event.type].append(i);
+        double &longest = m_maxDuration[event.type];
+        longest = std::max(longest, event.duration);
+    }
+}
+
+double EventStore::buildMaxEnd(int lo, int hi) const {
+    if (lo >= hi) return -std::numeric_limits<double>::infinity();
+    int mid = lo + (hi - lo) / 2;
+    double maxEnd = std::max(m_events[mid].end(), m_events[mid].onset);
+    maxEnd = std::max(maxEnd, buildMaxEnd(lo, mid));
+    maxEnd = std::max(maxEnd, buildMaxEnd(mid + 1, hi));
+    m_maxEnd[mid] = maxEnd;
+    return maxEnd;
+}
+
+void EventStore::collect(int lo, int hi, double start, double end, QVector<int> &out) const {
+    if (lo >= hi) return;
+    int mid = lo + (hi - lo) / 2;
+
+    // Nothing in this subtree reaches the window
+    if (m_maxEnd[mid] < start) return;
+
+    collect(lo, mid, start, end, out);
+
+    // Everything from here on starts after the window
+    if (m_events[mid].onset >= end) return;
+    if (overlapsWindow(m_events[mid], start, end)) out.append(mid);
+
+    collect(mid + 1, hi, start, end, out);
+}
+
+QVector<int> EventStore::inWindow(double start, double end) const {
+    ensureIndex();
+    QVector<int> result;
+    collect(0, m_events.size(), start, end, result);
+    return result;
+}
+
+QVector<int> EventStore::inWindow(double start, double end, const QString &type) const {
+    ensureIndex();
+    QVector<int> result;
+    auto typeIt = m_byType.constFind(type);
+    if (typeIt == m_byType.constEnd()) return result;
+    const QVector<int> &indices = typeIt.value();
+
+    // No event of this type is longer than maxDuration, so only onsets in
+    // [start - maxDuration, end) can overlap
+    double earliest = start - m_maxDuration.value(type);
+    auto it = std::lower_bound(indices.begin(), indices.end(), earliest,
+                               [this](int i, double t) { return m_events[i].onset < t; });
+    for (; it != indices.end() && m_events[*it].onset < end; ++it) {
+        if (overlapsWindow(m_events[*it], start, end)) result.append(*it);
+    }
+    return result;
+}
+
+int EventStore::nearest(double time, const QString &type) const {
+    auto closest = [&](auto begin, auto end, auto onsetOf) -> int {
+        auto it = std::lower_bound(begin, end, time,
+                                   [&](const auto &item, double t) { return onsetOf(item) < t; });
+        int best = -1;
+        double bestDistance = std::numeric_limits<double>::infinity();
+        if (it != end) {
+            best = static_cast<int>(it - begin);
+            bestDistance = std::abs(onsetOf(*it) - time);
+        }
+        if (it != begin && std::abs(onsetOf(*(it - 1)) - time) <= bestDistance) {
+            best = static_cast<int>(it - begin) - 1;
+        }
+        return best;
+    };
+
+    if (type.isEmpty()) {
+        return closest(m_events.begin(), m_events.end(),
+                       [](const EEGEvent &e) { return e.onset; });
+    }
+
+    ensureIndex();
+    auto typeIt = m_byType.constFind(type);
+    if (typeIt == m_byType.constEnd()) return -1;
+    const QVector<int> &indices = typeIt.value();
+    int position = closest(indices.begin(), indices.end(),
+                           [this](int i) { return m_events[i].onset; });
+    return position < 0 ? -1 : indices[position];
+}
+
+QVector<int> EventStore::ofType(const QString &type) const {
+    ensureIndex();
+    return m_byType.value(type);
+}
+
+QStringList EventStore::types() const {
+    ensureIndex();
+    QStringList result = m_byType.keys();
+    result.sort();
+    return result;
+}
+
+QVector<double> EventStore::onsets(const QString &type) const {
+    QVector<double> result;
+    if (type.isEmpty()) {
+        result.reserve(m_events.size());
+        for (const EEGEvent &event : m_events) result.append(event.onset);
+        return result;
+    }
+    ensureIndex();
+    for (int i : m_byType.value(type)) result.append(m_events[i].onset);
+    return result;
+}
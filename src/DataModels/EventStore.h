@@ -0,0 +1,68 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <mutex>
+
+struct EEGEvent {
+    double onset = 0.0;      // seconds from the start of the recording
+    double duration = 0.0;   // 0 for point events
+    QString type;
+    int channel = -1;        // -1 applies to all channels
+
+    double end() const { return onset + duration; }
+};
+
+// Events sorted by onset with an implicit interval tree on top: the sorted
+// array is read as a balanced BST (node = middle of its range) and each node
+// keeps the latest end time in its subtree. Window queries prune on that
+// bound, so they cost O(log n + k). Mutations only mark the index stale; the
+// next query rebuilds it in O(n). Queries may run concurrently, but not
+// alongside a mutation.
+class EventStore {
+public:
+    EventStore() = default;
+    EventStore(const EventStore &other);
+    EventStore &operator=(const EventStore &other);
+
+    // Returns the row the event lands in
+    int add(const EEGEvent &event);
+    void add(const QVector<EEGEvent> &events);
+    void remove(int index);
+    void clear();
+
+    int size() const { return m_events.size(); }
+    bool isEmpty() const { return m_events.isEmpty(); }
+    const EEGEvent &at(int index) const { return m_events[index]; }
+    const QVector<EEGEvent> &events() const { return m_events; }
+    // Row a new event with this onset would take, after equal onsets
+    int insertionIndex(double onset) const;
+
+    // Indices, in onset order, of events overlapping [start, end). A point
+    // event overlaps when its onset is inside the window.
+    QVector<int> inWindow(double start, double end) const;
+    QVector<int> inWindow(double start, double end, const QString &type) const;
+    QVector<int> ofType(const QString &type) const;
+
+    // Event whose onset is closest to time, -1 if there is none
+    int nearest(double time, const QString &type = QString()) const;
+
+    QStringList types() const;
+    QVector<double> onsets(const QString &type = QString()) const;
+
+private:
+    void ensureIndex() const;
+    void rebuildIndex() const;
+    double buildMaxEnd(int lo, int hi) const;
+    void collect(int lo, int hi, double start, double end, QVector<int> &out) const;
+
+    QVector<EEGEvent> m_events;
+
+    // Derived from m_events on demand
+    mutable std::mutex m_indexMutex;
+    mutable bool m_indexStale = false;
+    mutable QVector<double> m_maxEnd;                  // per implicit tree node
+    mutable QHash<QString, QVector<int>> m_byType;     // sorted indices per type
+    mutable QHash<QString, double> m_maxDuration;      // per type, bounds type window queries
+};
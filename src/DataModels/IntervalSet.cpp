@@ -0,0 +1,159 @@
+#include "IntervalSet.h"
+#include <algorithm>
+#include <cmath>
+
+void IntervalSet::add(double start, double end) {
+    if (!(end > start)) return;
+
+    // First interval that ends at or after start, first that starts after end
+    auto first = std::lower_bound(m_intervals.begin(), m_intervals.end(), start,
+                                  [](const TimeInterval &iv, double t) { return iv.end < t; });
+    auto last = std::upper_bound(first, m_intervals.end(), end,
+                                 [](double t, const TimeInterval &iv) { return t < iv.start; });
+
+    if (first == last) {
+        m_intervals.insert(first, {start, end});
+        return;
+    }
+
+    // Collapse [first, last) into one interval
+    first->start = std::min(first->start, start);
+    first->end = std::max((last - 1)->end, end);
+    m_intervals.erase(first + 1, last);
+}
+
+IntervalSet IntervalSet::united(const IntervalSet &other) const {
+    IntervalSet result;
+    result.m_intervals.reserve(m_intervals.size() + other.m_intervals.size());
+
+    int i = 0;
+    int j = 0;
+    while (i < m_intervals.size() || j < other.m_intervals.size()) {
+        const TimeInterval &next = (j >= other.m_intervals.size()
+                                    || (i < m_intervals.size() && m_intervals[i].start <= other.m_intervals[j].start))
+            ? m_intervals[i++] : other.m_intervals[j++];
+
+        if (!result.m_intervals.isEmpty() && next.start <= result.m_intervals.last().end) {
+            result.m_intervals.last().end = std::max(result.m_intervals.last().end, next.end);
+        } else {
+            result.m_intervals.append(next);
+        }
+    }
+    return result;
+}
+
+IntervalSet IntervalSet::intersected(const IntervalSet &other) const {
+    IntervalSet result;
+    int i = 0;
+    int j = 0;
+    while (i < m_intervals.size() && j < other.m_intervals.size()) {
+        double start = std::max(m_intervals[i].start, other.m_intervals[j].start);
+        double end = std::min(m_intervals[i].end, other.m_intervals[j].end);
+        if (start < end) result.m_intervals.append({start, end});
+
+        // Advance whichever finishes first
+        if (m_intervals[i].end < other.m_intervals[j].end) ++i;
+        else ++j;
+    }
+    return result;
+}
+
+IntervalSet IntervalSet::complement(double start, double end) const {
+    IntervalSet result;
+    double cursor = start;
+    for (const TimeInterval &iv : m_intervals) {
+        if (iv.end <= cursor) continue;
+        if (iv.start >= end) break;
+        if (iv.start > cursor) result.m_intervals.append({cursor, iv.start});
+        cursor = iv.end;
+    }
+    if (cursor < end) result.m_intervals.append({cursor, end});
+    return result;
+}
+
+bool IntervalSet::contains(double time) const {
+    auto it = std::upper_bound(m_intervals.begin(), m_intervals.end(), time,
+                               [](double t, const TimeInterval &iv) { return t < iv.start; });
+    return it != m_intervals.begin() && time < (it - 1)->end;
+}
+
+bool IntervalSet::overlaps(double start, double end) const {
+    auto it = std::lower_bound(m_intervals.begin(), m_intervals.end(), start,
+                               [](const TimeInterval &iv, double t) { return iv.end <= t; });
+    return it != m_intervals.end() && it->start < end;
+}
+
+double IntervalSet::totalDuration() const {
+    double total = 0.0;
+    for (const TimeInterval &iv : m_intervals) total += iv.duration();
+    return total;
+}
+
+QVector<QPair<qint64, qint64>> IntervalSet::sampleRanges(double samplingRate, qint64 numSamples) const {
+    QVector<QPair<qint64, qint64>> ranges;
+    if (samplingRate <= 0) return ranges;
+
+    for (const TimeInterval &iv : m_intervals) {
+        qint64 first = std::max<qint64>(0, static_cast<qint64>(std::floor(iv.start * samplingRate)));
+        qint64 last = std::min<qint64>(numSamples, static_cast<qint64>(std::ceil(iv.end * samplingRate)));
+        if (first >= last) continue;
+
+        // Rounding outwards can make neighbours touch
+        if (!ranges.isEmpty() && first <= ranges.last().second) {
+            ranges.last().second = std::max(ranges.last().second, last);
+        } else {
+            ranges.append(qMakePair(first, last));
+        }
+    }
+    return ranges;
+}
+
+CleanView::CleanView(const QVector<double> &samples, double samplingRate, const IntervalSet &rejected)
+    : m_data(samples.constData()),
+      m_samplingRate(samplingRate),
+      m_sampleCount(0) {
+
+    qint64 cursor = 0;
+    for (const auto &range : rejected.sampleRanges(samplingRate, samples.size())) {
+        if (range.first > cursor) m_segments.append(qMakePair(cursor, range.first));
+        cursor = range.second;
+    }
+    if (cursor < samples.size()) m_segments.append(qMakePair(cursor, static_cast<qint64>(samples.size())));
+
+    for (const auto &segment : m_segments) m_sampleCount += segment.second - segment.first;
+}
+
+qint64 CleanView::longestSegment() const {
+    qint64 longest = 0;
+    for (const auto &segment : m_segments) longest = std::max(longest, segment.second - segment.first);
+    return longest;
+}
+
+QVector<double> CleanView::toVector() const {
+    QVector<double> result;
+    result.reserve(static_cast<int>(m_sampleCount));
+    for (int i = 0; i < segmentCount(); ++i) {
+        const double *segment = segmentData(i);
+        for (qint64 s = 0; s < segmentLength(i); ++s) result.append(segment[s]);
+    }
+    return result;
+}
+
+void interpolateIntervals(double *x, qint64 n, double samplingRate, const IntervalSet &intervals) {
+    if (n == 0 || intervals.isEmpty()) return;
+
+    for (const auto &range : intervals.sampleRanges(samplingRate, n)) {
+        qint64 first = range.first;
+        qint64 last = range.second;
+
+        // Hold the clean neighbour flat when the gap touches either end
+        double left = first > 0 ? x[first - 1] : (last < n ? x[last] : 0.0);
+        double right = last < n ? x[last] : left;
+
+        double span = static_cast<double>(last - first + 1);
+        for (qint64 s = first; s < last; ++s) {
+            double t = (s - first + 1) / span;
+            x[s] = left + t * (right - left);
+        }
+    }
+}
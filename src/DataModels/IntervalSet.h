@@ -0,0 +1,75 @@
+#pragma once
+#include <QVector>
+#include <QPair>
+
+// [start, end) in seconds
+struct TimeInterval {
+    double start;
+    double end;
+
+    double duration() const { return end - start; }
+};
+
+// Sorted, disjoint time intervals. Touching or overlapping intervals are
+// merged on insertion, so lookups are a binary search and set operations a
+// single linear merge.
+class IntervalSet {
+public:
+    IntervalSet() = default;
+
+    void add(double start, double end);
+    void clear() { m_intervals.clear(); }
+
+    IntervalSet united(const IntervalSet &other) const;
+    IntervalSet intersected(const IntervalSet &other) const;
+    // The gaps between intervals within [start, end)
+    IntervalSet complement(double start, double end) const;
+
+    bool contains(double time) const;
+    bool overlaps(double start, double end) const;
+
+    int size() const { return m_intervals.size(); }
+    bool isEmpty() const { return m_intervals.isEmpty(); }
+    const TimeInterval &at(int i) const { return m_intervals[i]; }
+    const QVector<TimeInterval> &intervals() const { return m_intervals; }
+    double totalDuration() const;
+
+    // [startSample, endSample) runs covering the intervals, clipped to [0, numSamples)
+    QVector<QPair<qint64, qint64>> sampleRanges(double samplingRate, qint64 numSamples) const;
+
+private:
+    QVector<TimeInterval> m_intervals;
+};
+
+// Read-only view of one channel with rejected intervals skipped. Segments
+// point straight into the channel's storage, so the view is only valid while
+// that channel is left unmodified.
+class CleanView {
+public:
+    CleanView(const QVector<double> &samples, double samplingRate, const IntervalSet &rejected);
+
+    int segmentCount() const { return m_segments.size(); }
+    const double *segmentData(int i) const { return m_data + m_segments[i].first; }
+    qint64 segmentStart(int i) const { return m_segments[i].first; }
+    qint64 segmentLength(int i) const { return m_segments[i].second - m_segments[i].first; }
+
+    qint64 sampleCount() const { return m_sampleCount; }
+    double samplingRate() const { return m_samplingRate; }
+    qint64 longestSegment() const;
+
+    // Contiguous copy of the clean samples, for callers that need one buffer
+    QVector<double> toVector() const;
+
+private:
+    const double *m_data;
+    double m_samplingRate;
+    qint64 m_sampleCount;
+    QVector<QPair<qint64, qint64>> m_segments;
+};
+
+// Replaces the samples inside the intervals with a straight line between the
+// clean samples on either side, in place
+void interpolateIntervals(double *samples, qint64 n, double samplingRate, const IntervalSet &intervals);
+inline void interpolateIntervals(QVector<double> &samples, double samplingRate, const IntervalSet &intervals) {
+    interpolateIntervals(samples.data(), samples.size(), samplingRate, intervals);
+}
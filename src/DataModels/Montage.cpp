@@ -0,0 +1,466 @@
+#include "Montage.h"
+#include "../Utils/Parallel.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QHash>
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+// Longitudinal and transverse chains in the definition format
+static const char *kDoubleBanana =
+    "Fp1-F7 = Fp1 - F7\n F7-T7 = F7 - T7\n T7-P7 = T7 - P7\n P7-O1 = P7 - O1\n"
+    "Fp1-F3 = Fp1 - F3\n F3-C3 = F3 - C3\n C3-P3 = C3 - P3\n P3-O1 = P3 - O1\n"
+    "Fz-Cz = Fz - Cz\n Cz-Pz = Cz - Pz\n"
+    "Fp2-F4 = Fp2 - F4\n F4-C4 = F4 - C4\n C4-P4 = C4 - P4\n P4-O2 = P4 - O2\n"
+    "Fp2-F8 = Fp2 - F8\n F8-T8 = F8 - T8\n T8-P8 = T8 - P8\n P8-O2 = P8 - O2\n";
+
+static const char *kTransverse =
+    "Fp1-Fp2 = Fp1 - Fp2\n"
+    "F7-F3 = F7 - F3\n F3-Fz = F3 - Fz\n Fz-F4 = Fz - F4\n F4-F8 = F4 - F8\n"
+    "T7-C3 = T7 - C3\n C3-Cz = C3 - Cz\n Cz-C4 = Cz - C4\n C4-T8 = C4 - T8\n"
+    "P7-P3 = P7 - P3\n P3-Pz = P3 - Pz\n Pz-P4 = Pz - P4\n P4-P8 = P4 - P8\n"
+    "O1-O2 = O1 - O2\n";
+
+// Exact label first, then the layout's normalized form ("EEG T3-REF" is T7)
+class LabelIndex {
+public:
+    explicit LabelIndex(const QVector<QString> &labels) {
+        for (int i = labels.size() - 1; i >= 0; --i) {
+            m_exact.insert(labels[i].trimmed().toUpper(), i);
+            m_normalized.insert(ElectrodeLayout::normalizedLabel(labels[i]), i);
+        }
+    }
+    int find(const QString &label) const {
+        int index = m_exact.value(label.trimmed().toUpper(), -1);
+        return index >= 0 ? index : m_normalized.value(ElectrodeLayout::normalizedLabel(label), -1);
+    }
+
+private:
+    QHash<QString, int> m_exact;
+    QHash<QString, int> m_normalized;
+};
+
+Montage Montage::build(const QString &name, int inputCount, const QVector<QString> &outputLabels,
+                       const QVector<QVector<Term>> &rows) {
+    Montage montage;
+    montage.m_name = name;
+    montage.m_inputCount = inputCount;
+    montage.m_outputLabels = outputLabels;
+
+    std::vector<Eigen::Triplet<double>> triplets;
+    Eigen::VectorXd gains = Eigen::VectorXd::Zero(rows.size());
+    bool referenced = false;
+    for (int row = 0; row < rows.size(); ++row) {
+        for (const Term &term : rows[row]) {
+            if (term.input < 0) {
+                gains[row] += term.weight;
+                referenced = true;
+            } else {
+                triplets.emplace_back(row, term.input, term.weight);
+            }
+        }
+    }
+
+    // Duplicates are summed, so "Cz - 0.5 C3 - 0.5 C3" is one entry
+    montage.m_weights.resize(rows.size(), inputCount);
+    montage.m_weights.setFromTriplets(triplets.begin(), triplets.end());
+    montage.m_weights.prune(0.0);
+    montage.m_weights.makeCompressed();
+
+    if (referenced && inputCount > 0) {
+        montage.m_referenceWeights = Eigen::VectorXd::Constant(inputCount, 1.0 / inputCount);
+        montage.m_referenceGains = gains;
+    }
+    return montage;
+}
+
+// ================== BUILT-IN MONTAGES ==================
+
+Montage Montage::averageReference(const QVector<QString> &labels) {
+    QVector<QString> outputs;
+    QVector<QVector<Term>> rows;
+    for (int i = 0; i < labels.size(); ++i) {
+        outputs.append(ElectrodeLayout::baseLabel(labels[i]) + "-AVG");
+        rows.append({{i, 1.0}, {-1, -1.0}});
+    }
+    return build("Average Reference", labels.size(), outputs, rows);
+}
+
+QStringList Montage::bipolarTemplates() {
+    return {"Double Banana", "Transverse"};
+}
+
+Montage Montage::bipolar(const QVector<QString> &labels, const QString &templateName) {
+    const char *definition = templateName == "Transverse" ? kTransverse : kDoubleBanana;
+
+    // Not through fromDefinition: a partial cap is expected to miss some of
+    // the template without a warning per pair
+    LabelIndex index(labels);
+    QVector<QString> outputs;
+    QVector<QVector<Term>> rows;
+    for (const QString &line : QString(definition).split('\n', Qt::SkipEmptyParts)) {
+        QStringList sides = line.split('=');
+        QStringList pair = sides.value(1).split('-');
+        int first = index.find(pair.value(0).trimmed());
+        int second = index.find(pair.value(1).trimmed());
+        if (first < 0 || second < 0) continue;
+        outputs.append(sides[0].trimmed());
+        rows.append({{first, 1.0}, {second, -1.0}});
+    }
+    Montage montage = build("Bipolar " + templateName, labels.size(), outputs, rows);
+
+    if (montage.isEmpty() && labels.size() >= 2) {
+        qDebug() << "Bipolar Montage: No template pairs found, using consecutive channels";
+        outputs.clear();
+        rows.clear();
+        for (int i = 0; i + 1 < labels.size(); ++i) {
+            outputs.append(ElectrodeLayout::baseLabel(labels[i]) + "-" + ElectrodeLayout::baseLabel(labels[i + 1]));
+            rows.append({{i, 1.0}, {i + 1, -1.0}});
+        }
+        montage = build("Bipolar Consecutive", labels.size(), outputs, rows);
+    }
+    return montage;
+}
+
+// Input index and unit position of every channel the layout knows
+static void positionedChannels(const QVector<QString> &labels, const ElectrodeLayout &layout,
+                               QVector<int> &indices, QVector<Eigen::Vector3d> &positions) {
+    for (int i = 0; i < labels.size(); ++i) {
+        int electrode = layout.indexOf(labels[i]);
+        if (electrode < 0) continue;
+        indices.append(i);
+        positions.append(layout.positionAt(electrode));
+    }
+}
+
+Montage Montage::laplacian(const QVector<QString> &labels, const ElectrodeLayout &layout, int neighbours) {
+    QVector<int> indices;
+    QVector<Eigen::Vector3d> positions;
+    positionedChannels(labels, layout, indices, positions);
+
+    QVector<QVector<Term>> rows(labels.size());
+    for (int i = 0; i < labels.size(); ++i) rows[i].append({i, 1.0});
+
+    for (int a = 0; a < indices.size(); ++a) {
+        QVector<QPair<double, int>> candidates;
+        for (int b = 0; b < indices.size(); ++b) {
+            if (b == a) continue;
+            double angle = std::acos(std::clamp(positions[a].dot(positions[b]), -1.0, 1.0));
+            if (angle > 1e-6) candidates.append({angle, indices[b]});
+        }
+        if (candidates.isEmpty()) continue;
+        std::sort(candidates.begin(), candidates.end());
+
+        // Edge electrodes have fewer true neighbours; skip those much further
+        // away than the nearest one rather than reach across the head
+        double limit = 2.0 * candidates[0].first;
+        QVector<int> chosen;
+        for (const auto &candidate : candidates) {
+            if (chosen.size() >= neighbours || candidate.first > limit) break;
+            chosen.append(candidate.second);
+        }
+        for (int neighbour : chosen) rows[indices[a]].append({neighbour, -1.0 / chosen.size()});
+    }
+
+    QVector<QString> outputs;
+    for (const QString &label : labels) outputs.append(ElectrodeLayout::baseLabel(label) + "-LAP");
+    return build("Laplacian", labels.size(), outputs, rows);
+}
+
+Montage Montage::rest(const QVector<QString> &labels, const ElectrodeLayout &layout) {
+    QVector<int> indices;
+    QVector<Eigen::Vector3d> positions;
+    positionedChannels(labels, layout, indices, positions);
+    int m = indices.size();
+
+    QVector<QVector<Term>> rows(labels.size());
+    QVector<QString> outputs;
+    for (int i = 0; i < labels.size(); ++i) outputs.append(ElectrodeLayout::baseLabel(labels[i]) + "-REST");
+
+    if (m < 4) {
+        qWarning() << "REST: Need at least 4 positioned channels, have" << m;
+        return Montage();
+    }
+
+    // Equivalent sources: three orthogonal dipoles at each point of a
+    // Fibonacci lattice on a sphere inside the scalp, upper head only. Lead
+    // fields use the infinite homogeneous medium, p.(e - s) / |e - s|^3.
+    const int numPoints = 1200;
+    const double sourceRadius = 0.87;
+    std::vector<Eigen::Vector3d> sources;
+    const double golden = M_PI * (3.0 - std::sqrt(5.0));
+    for (int k = 0; k < numPoints; ++k) {
+        double z = 1.0 - 2.0 * (k + 0.5) / numPoints;
+        if (z < -0.4) continue;
+        double radius = std::sqrt(1.0 - z * z);
+        sources.emplace_back(sourceRadius * radius * std::cos(golden * k),
+                             sourceRadius * radius * std::sin(golden * k), sourceRadius * z);
+    }
+
+    Eigen::MatrixXd leadField(m, 3 * sources.size());
+    for (int i = 0; i < m; ++i) {
+        for (size_t k = 0; k < sources.size(); ++k) {
+            Eigen::Vector3d d = positions[i] - sources[k];
+            double r = d.norm();
+            leadField.block<1, 3>(i, 3 * k) = (d / (r * r * r)).transpose();
+        }
+    }
+
+    // V_inf = G s and the recorded data only fixes H V = H G s, with H the
+    // average-reference projector. The minimum-norm s gives
+    //   V_inf = G (HG)^+ H V = K H (H K H)^+ H V,  K = G G'
+    // The pseudo-inverse is truncated, so only the common offset is taken
+    // from it and H V passes through exactly.
+    Eigen::MatrixXd K = leadField * leadField.transpose();
+    Eigen::MatrixXd H = Eigen::MatrixXd::Identity(m, m) - Eigen::MatrixXd::Constant(m, m, 1.0 / m);
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(H * K * H);
+    Eigen::VectorXd values = solver.eigenvalues();
+    double tolerance = 1e-10 * values.cwiseAbs().maxCoeff();
+    Eigen::VectorXd inverse = values.unaryExpr([tolerance](double v) { return v > tolerance ? 1.0 / v : 0.0; });
+    Eigen::MatrixXd pseudoInverse = solver.eigenvectors() * inverse.asDiagonal() * solver.eigenvectors().transpose();
+    Eigen::RowVectorXd offset = (K * H * pseudoInverse * H).colwise().mean();
+    Eigen::MatrixXd transform = H;
+    transform.rowwise() += offset;
+
+    QVector<bool> positioned(labels.size(), false);
+    for (int a = 0; a < m; ++a) {
+        positioned[indices[a]] = true;
+        for (int b = 0; b < m; ++b) rows[indices[a]].append({indices[b], transform(a, b)});
+    }
+    for (int i = 0; i < labels.size(); ++i) {
+        if (!positioned[i]) rows[i].append({i, 1.0});
+    }
+    return build("REST", labels.size(), outputs, rows);
+}
+
+// ================== DEFINITIONS ==================
+
+// Sum of [sign] [number [*]] label terms; false on a syntax error or an
+// unknown label
+static bool parseExpression(const QString &text, const LabelIndex &index, QVector<QPair<int, double>> &terms,
+                            QString &error) {
+    int pos = 0;
+    int n = text.size();
+    auto skipSpaces = [&]() { while (pos < n && text[pos].isSpace()) ++pos; };
+
+    while (true) {
+        skipSpaces();
+        if (pos >= n) break;
+
+        double sign = 1.0;
+        if (text[pos] == '+' || text[pos] == '-') {
+            if (text[pos] == '-') sign = -1.0;
+            ++pos;
+            skipSpaces();
+        } else if (!terms.isEmpty()) {
+            error = "expected + or - at \"" + text.mid(pos) + "\"";
+            return false;
+        }
+
+        double coefficient = 1.0;
+        if (pos < n && (text[pos].isDigit() || text[pos] == '.')) {
+            int start = pos;
+            while (pos < n && (text[pos].isDigit() || text[pos] == '.')) ++pos;
+            if (pos < n && (text[pos] == 'e' || text[pos] == 'E')) {
+                int exponent = pos + 1;
+                if (exponent < n && (text[exponent] == '+' || text[exponent] == '-')) ++exponent;
+                if (exponent < n && text[exponent].isDigit()) {
+                    pos = exponent;
+                    while (pos < n && text[pos].isDigit()) ++pos;
+                }
+            }
+            bool ok;
+            coefficient = text.mid(start, pos - start).toDouble(&ok);
+            if (!ok) {
+                error = "bad number \"" + text.mid(start, pos - start) + "\"";
+                return false;
+            }
+            skipSpaces();
+            if (pos < n && text[pos] == '*') {
+                ++pos;
+                skipSpaces();
+            }
+        }
+
+        QString label;
+        if (pos < n && text[pos] == '"') {
+            int close = text.indexOf('"', pos + 1);
+            if (close < 0) {
+                error = "unterminated quote";
+                return false;
+            }
+            label = text.mid(pos + 1, close - pos - 1);
+            pos = close + 1;
+        } else {
+            int start = pos;
+            while (pos < n && (text[pos].isLetterOrNumber() || text[pos] == '_' || text[pos] == '\''
+                               || text[pos] == '.')) {
+                ++pos;
+            }
+            label = text.mid(start, pos - start);
+        }
+        if (label.isEmpty()) {
+            error = "expected a channel at \"" + text.mid(pos) + "\"";
+            return false;
+        }
+
+        QString upper = label.toUpper();
+        int input = (upper == "AVG" || upper == "CAR") ? -1 : index.find(label);
+        if (input < 0 && upper != "AVG" && upper != "CAR") {
+            error = "unknown channel " + label;
+            return false;
+        }
+        terms.append({input, sign * coefficient});
+    }
+
+    if (terms.isEmpty()) {
+        error = "empty expression";
+        return false;
+    }
+    return true;
+}
+
+Montage Montage::fromDefinition(const QString &text, const QVector<QString> &labels, const QString &name) {
+    LabelIndex index(labels);
+    QString montageName = name;
+    QVector<QString> outputs;
+    QVector<QVector<Term>> rows;
+
+    int lineNumber = 0;
+    for (QString line : text.split('\n')) {
+        ++lineNumber;
+        int comment = line.indexOf('#');
+        if (comment >= 0) line = line.left(comment);
+        line = line.trimmed();
+        if (line.isEmpty()) continue;
+
+        if (line.startsWith("name:", Qt::CaseInsensitive)) {
+            montageName = line.mid(5).trimmed();
+            continue;
+        }
+
+        QString output;
+        QString expression = line;
+        int equals = line.indexOf('=');
+        if (equals >= 0) {
+            output = line.left(equals).trimmed();
+            expression = line.mid(equals + 1);
+        } else {
+            output = QString(line).remove(' ').remove('"');
+        }
+
+        QVector<QPair<int, double>> terms;
+        QString error;
+        if (output.isEmpty() || !parseExpression(expression, index, terms, error)) {
+            qWarning() << "Montage: Line" << lineNumber << "skipped," << (output.isEmpty() ? "no output label" : error);
+            continue;
+        }
+
+        QVector<Term> row;
+        for (const auto &term : terms) row.append({term.first, term.second});
+        outputs.append(output);
+        rows.append(row);
+    }
+    return build(montageName, labels.size(), outputs, rows);
+}
+
+bool Montage::loadFromFile(const QString &filePath, const QVector<QString> &labels) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open montage file:" << filePath;
+        return false;
+    }
+    QTextStream stream(&file);
+    Montage montage = fromDefinition(stream.readAll(), labels, QFileInfo(filePath).completeBaseName());
+    file.close();
+
+    if (montage.isEmpty()) {
+        qWarning() << "No usable montage lines in" << filePath;
+        return false;
+    }
+    *this = montage;
+    return true;
+}
+
+// ================== APPLICATION ==================
+
+QVector<int> Montage::inputsOf(int output) const {
+    if (hasReference() && m_referenceGains[output] != 0.0) {
+        QVector<int> all(m_inputCount);
+        for (int i = 0; i < m_inputCount; ++i) all[i] = i;
+        return all;
+    }
+    QVector<int> inputs;
+    for (SparseMatrix::InnerIterator it(m_weights, output); it; ++it) inputs.append(it.col());
+    return inputs;
+}
+
+void Montage::apply(const QVector<const double*> &inputs, qint64 count, const QVector<double*> &outputs,
+                    const QVector<int> &outputRows, const QVector<const ValidityMask*> &masks,
+                    qint64 maskOffset) const {
+    QVector<int> rows = outputRows;
+    if (rows.isEmpty()) {
+        for (int i = 0; i < outputCount(); ++i) rows.append(i);
+    }
+    if (inputs.size() != m_inputCount || outputs.size() != rows.size()
+        || (!masks.isEmpty() && masks.size() != m_inputCount)) {
+        qWarning() << "Montage: Channel pointers do not match the montage";
+        return;
+    }
+
+    bool needsReference = false;
+    for (int row : rows) needsReference |= hasReference() && m_referenceGains[row] != 0.0;
+
+    // A reference summing to zero has no scale to restore, invalid inputs just drop out
+    double referenceTotal = hasReference() ? m_referenceWeights.sum() : 0.0;
+    bool rescaleReference = hasReference()
+        && std::abs(referenceTotal) > 1e-12 * m_referenceWeights.cwiseAbs().sum();
+
+    // Short blocks keep the reference and the output rows in cache while
+    // each weight streams one input row through a vectorized axpy
+    const qint64 blockSamples = 2048;
+    Parallel::parallelForBlocks(count, blockSamples, [&](qint64 start, qint64 n) {
+        Eigen::ArrayXd reference;
+        if (needsReference) {
+            reference = Eigen::ArrayXd::Zero(n);
+            bool clean = true;
+            for (int j = 0; j < masks.size() && clean; ++j) {
+                clean = !masks[j] || masks[j]->rangeValid(maskOffset + start, n);
+            }
+
+            if (clean) {
+                for (int j = 0; j < m_inputCount; ++j) {
+                    reference += m_referenceWeights[j] * Eigen::Map<const Eigen::ArrayXd>(inputs[j] + start, n);
+                }
+            } else {
+                Eigen::ArrayXd weightSum = Eigen::ArrayXd::Zero(n);
+                Eigen::ArrayXd valid(n);
+                for (int j = 0; j < m_inputCount; ++j) {
+                    Eigen::Map<const Eigen::ArrayXd> x(inputs[j] + start, n);
+                    if (!masks[j] || masks[j]->rangeValid(maskOffset + start, n)) {
+                        reference += m_referenceWeights[j] * x;
+                        weightSum += m_referenceWeights[j];
+                    } else {
+                        masks[j]->weights(maskOffset + start, n, valid.data());
+                        reference += m_referenceWeights[j] * (valid > 0.0).select(x, 0.0);
+                        weightSum += m_referenceWeights[j] * valid;
+                    }
+                }
+                if (rescaleReference) reference *= referenceTotal / weightSum;
+            }
+        }
+
+        for (int k = 0; k < rows.size(); ++k) {
+            int row = rows[k];
+            Eigen::Map<Eigen::ArrayXd> out(outputs[k] + start, n);
+            if (needsReference && m_referenceGains[row] != 0.0) out = m_referenceGains[row] * reference;
+            else out.setZero();
+            for (SparseMatrix::InnerIterator it(m_weights, row); it; ++it) {
+                out += it.value() * Eigen::Map<const Eigen::ArrayXd>(inputs[it.col()] + start, n);
+            }
+        }
+    });
+}
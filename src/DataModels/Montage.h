@@ -0,0 +1,87 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include "ElectrodeLayout.h"
+#include "ValidityMask.h"
+
+// A linear re-referencing of a fixed list of input channels:
+//   out = W x + g (r . x)
+// W is a sparse outputs x inputs matrix, the rank-one term carries a common
+// reference such as the channel average, which would otherwise fill W.
+class Montage {
+public:
+    using SparseMatrix = Eigen::SparseMatrix<double, Eigen::RowMajor>;
+
+    Montage() = default;
+
+    // Every input minus the mean of all inputs
+    static Montage averageReference(const QVector<QString> &labels);
+
+    // Chains from a built-in template (see bipolarTemplates), resolved against
+    // the labels. Pairs with a missing electrode are left out; labels matching
+    // no template pair fall back to consecutive differences.
+    static Montage bipolar(const QVector<QString> &labels, const QString &templateName = "Double Banana");
+    static QStringList bipolarTemplates();
+
+    // Hjorth surface Laplacian: each positioned channel minus the mean of its
+    // nearest positioned neighbours. Channels without a position pass through.
+    static Montage laplacian(const QVector<QString> &labels, const ElectrodeLayout &layout,
+                             int neighbours = 4);
+
+    // Reference electrode standardization technique (Yao 2001): re-reference
+    // to a point at infinity through an equivalent dipole layer. Channels
+    // without a position pass through.
+    static Montage rest(const QVector<QString> &labels, const ElectrodeLayout &layout);
+
+    // One output per line, '#' starts a comment:
+    //   Fp1-F7 = Fp1 - F7
+    //   Cz' = Cz - 0.25 C3 - 0.25 C4 - 0.25 Fz - 0.25 Pz
+    //   O1 - AVG
+    // Without '=' the expression is also the output label. AVG (or CAR) is the
+    // mean of all inputs; labels with operator characters go in double quotes.
+    // An optional "name: ..." line names the montage.
+    static Montage fromDefinition(const QString &text, const QVector<QString> &labels,
+                                  const QString &name = QString());
+    bool loadFromFile(const QString &filePath, const QVector<QString> &labels);
+
+    bool isEmpty() const { return m_outputLabels.isEmpty(); }
+    int outputCount() const { return m_outputLabels.size(); }
+    int inputCount() const { return m_inputCount; }
+    QString name() const { return m_name; }
+    const QVector<QString> &outputLabels() const { return m_outputLabels; }
+
+    const SparseMatrix &weights() const { return m_weights; }
+    bool hasReference() const { return m_referenceWeights.size() > 0; }
+
+    // Inputs that output row depends on, including the common reference
+    QVector<int> inputsOf(int output) const;
+
+    // outputs.size() rows of count samples from inputCount() input rows,
+    // in sample blocks with the blocks in parallel. outputRows selects which
+    // outputs to produce, empty for all of them in order.
+    // With masks (one per input, null for none, sample 0 of inputs at
+    // maskOffset) invalid samples drop out of the common reference, which is
+    // rescaled over the remaining inputs; direct terms stay non-finite.
+    void apply(const QVector<const double*> &inputs, qint64 count, const QVector<double*> &outputs,
+               const QVector<int> &outputRows = QVector<int>(),
+               const QVector<const ValidityMask*> &masks = QVector<const ValidityMask*>(),
+               qint64 maskOffset = 0) const;
+
+private:
+    struct Term {
+        int input;          // -1 for the common reference
+        double weight;
+    };
+    static Montage build(const QString &name, int inputCount, const QVector<QString> &outputLabels,
+                         const QVector<QVector<Term>> &rows);
+
+    QString m_name;
+    int m_inputCount = 0;
+    QVector<QString> m_outputLabels;
+    SparseMatrix m_weights;
+    Eigen::VectorXd m_referenceWeights;   // r, empty without a common reference
+    Eigen::VectorXd m_referenceGains;     // g
+};
@@ -0,0 +1,80 @@
+#include "ValidityMask.h"
+#include "../Utils/Parallel.h"
+#include <algorithm>
+
+ValidityMask ValidityMask::scan(const double *x, qint64 n) {
+    ValidityMask mask;
+    if (n <= 0) return mask;
+
+    int chunks = static_cast<int>((n + ChunkSize - 1) / ChunkSize);
+    mask.m_size = n;
+    mask.m_chunkInvalid = QVector<int>(chunks, 0);
+    mask.m_chunkBits = QVector<int>(chunks, -1);
+
+    // x - x is 0 for finite x and NaN for NaN and +-Inf, so the count needs no branch
+    int *counts = mask.m_chunkInvalid.data();
+    Parallel::parallelForBlocks(n, ChunkSize, [&](qint64 start, qint64 count) {
+        const double *chunk = x + start;
+        int invalid = 0;
+        for (qint64 i = 0; i < count; ++i) invalid += !(chunk[i] - chunk[i] == 0.0);
+        counts[start / ChunkSize] = invalid;
+    });
+
+    // Bitmaps only for the chunks that need one
+    const int wordsPerChunk = ChunkSize / 64;
+    for (int c = 0; c < chunks; ++c) {
+        if (counts[c] == 0) continue;
+        mask.m_invalid += counts[c];
+        mask.m_chunkBits[c] = mask.m_bits.size();
+        mask.m_bits.resize(mask.m_bits.size() + wordsPerChunk);
+    }
+    if (mask.m_invalid == 0) return mask;
+
+    quint64 *bits = mask.m_bits.data();
+    const int *offsets = mask.m_chunkBits.constData();
+    Parallel::parallelForBlocks(n, ChunkSize, [&](qint64 start, qint64 count) {
+        int offset = offsets[start / ChunkSize];
+        if (offset < 0) return;
+        for (qint64 i = 0; i < count; ++i) {
+            quint64 invalid = !(x[start + i] - x[start + i] == 0.0);
+            bits[offset + i / 64] |= invalid << (i % 64);
+        }
+    });
+    return mask;
+}
+
+bool ValidityMask::isValid(qint64 i) const {
+    if (i < 0 || i >= m_size) return false;
+    qint64 chunk = i / ChunkSize;
+    if (m_chunkInvalid[chunk] == 0) return true;
+    qint64 bit = i % ChunkSize;
+    return !((m_bits[m_chunkBits[chunk] + bit / 64] >> (bit % 64)) & 1);
+}
+
+bool ValidityMask::rangeValid(qint64 start, qint64 count) const {
+    if (count <= 0 || m_invalid == 0) return true;
+    qint64 first = std::max<qint64>(0, start) / ChunkSize;
+    qint64 last = std::min(m_size - 1, start + count - 1) / ChunkSize;
+    for (qint64 c = first; c <= last; ++c) {
+        if (m_chunkInvalid[c] != 0) return false;
+    }
+    return true;
+}
+
+void ValidityMask::weights(qint64 start, qint64 count, double *out) const {
+    for (qint64 i = 0; i < count; ) {
+        qint64 s = start + i;
+        qint64 chunk = s / ChunkSize;
+        qint64 length = std::min(count - i, (chunk + 1) * ChunkSize - s);
+        if (m_chunkInvalid[chunk] == 0) {
+            std::fill(out + i, out + i + length, 1.0);
+        } else {
+            const quint64 *words = m_bits.constData() + m_chunkBits[chunk];
+            qint64 bit = s - chunk * ChunkSize;
+            for (qint64 k = 0; k < length; ++k, ++bit) {
+                out[i + k] = static_cast<double>(!((words[bit / 64] >> (bit % 64)) & 1));
+            }
+        }
+        i += length;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <QVector>
+#include <QtGlobal>
+
+// Where a channel holds non-finite samples (NaN, +-Inf, e.g. gaps in the
+// recording). Samples are grouped in chunks; a chunk without invalid samples
+// is only a zero count, so kernels can run clean chunks with no per-sample
+// checks. Chunks with invalid samples also carry one bit per sample.
+class ValidityMask {
+public:
+    static constexpr qint64 ChunkSize = 4096;   // multiple of 64
+
+    ValidityMask() = default;
+
+    // Branch-free scan, chunks in parallel
+    static ValidityMask scan(const double *x, qint64 n);
+    static ValidityMask scan(const QVector<double> &x) { return scan(x.constData(), x.size()); }
+
+    qint64 size() const { return m_size; }
+    qint64 invalidCount() const { return m_invalid; }
+    bool allValid() const { return m_invalid == 0; }
+
+    qint64 chunkCount() const { return m_chunkInvalid.size(); }
+    bool chunkValid(qint64 chunk) const { return m_chunkInvalid[chunk] == 0; }
+    bool isValid(qint64 i) const;
+    // No invalid sample in [start, start + count); O(1) per chunk, so a
+    // chunk holding any invalid sample fails every range that touches it
+    bool rangeValid(qint64 start, qint64 count) const;
+
+    // 1.0 for each valid sample of [start, start + count), 0.0 for invalid ones
+    void weights(qint64 start, qint64 count, double *out) const;
+
+    // fn(start, length) for each run of invalid samples, in order
+    template <typename Fn>
+    void forEachInvalidRun(Fn &&fn) const;
+
+private:
+    qint64 m_size = 0;
+    qint64 m_invalid = 0;
+    QVector<int> m_chunkInvalid;    // invalid samples per chunk
+    QVector<int> m_chunkBits;       // first word of the chunk in m_bits, -1 when clean
+    QVector<quint64> m_bits;        // set bit = invalid sample
+};
+
+template <typename Fn>
+void ValidityMask::forEachInvalidRun(Fn &&fn) const {
+    if (allValid()) return;
+
+    qint64 runStart = -1;
+    qint64 runEnd = -1;
+    for (qint64 chunk = 0; chunk < chunkCount(); ++chunk) {
+        if (chunkValid(chunk)) continue;
+
+        const quint64 *words = m_bits.constData() + m_chunkBits[chunk];
+        for (int w = 0; w < ChunkSize / 64; ++w) {
+            quint64 word = words[w];
+            while (word) {
+                qint64 i = chunk * ChunkSize + w * 64 + __builtin_ctzll(word);
+                word &= word - 1;
+                if (i == runEnd) {
+                    ++runEnd;
+                    continue;
+                }
+                if (runStart >= 0) fn(runStart, runEnd - runStart);
+                runStart = i;
+                runEnd = i + 1;
+            }
+        }
+    }
+    if (runStart >= 0) fn(runStart, runEnd - runStart);
+}
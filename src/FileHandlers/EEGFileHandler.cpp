@@ -18,6 +18,7 @@ static bool loadEDF(const QString &filePath, EEGData &data);
 static bool loadCSV(const QString &filePath, EEGData &data);
 static bool saveEDF(const QString &filePath, const EEGData &data);
 static bool saveCSV(const QString &filePath, const EEGData &data);
+static void parseAnnotations(const QByteArray &bytes, QVector<EEGEvent> &events);
 
 bool loadFile(const QString &filePath, EEGData &data) {
     QString ext = QFileInfo(filePath).suffix().toLower();
@@ -104,38 +105,23 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
     QVector<double> digMin(numSignals);
     QVector<double> digMax(numSignals);
     
-    for (int i = 0; i < numSignals; ++i) {
-        char physMinStr[9] = {0};
-        char physMaxStr[9] = {0};
-        char digMinStr[9] = {0};
-        char digMaxStr[9] = {0};
-        
-        if (stream.readRawData(physMinStr, 8) != 8 ||
-            stream.readRawData(physMaxStr, 8) != 8 ||
-            stream.readRawData(digMinStr, 8) != 8 ||
-            stream.readRawData(digMaxStr, 8) != 8) {
-            qWarning() << "Failed to read min/max values for signal" << i;
-            file.close();
-            return false;
+    // Each field is stored for all signals before the next field starts
+    QVector<double> *fields[] = {&physMin, &physMax, &digMin, &digMax};
+    const double fallbacks[] = {-500.0, 500.0, -32768.0, 32767.0};
+    for (int f = 0; f < 4; ++f) {
+        for (int i = 0; i < numSignals; ++i) {
+            char valueStr[9] = {0};
+            if (stream.readRawData(valueStr, 8) != 8) {
+                qWarning() << "Failed to read min/max values for signal" << i;
+                file.close();
+                return false;
+            }
+            (*fields[f])[i] = QString::fromLatin1(valueStr, 8).trimmed().toDouble(&ok);
+            if (!ok) (*fields[f])[i] = fallbacks[f];
         }
-        
-        QString physMinQStr = QString::fromLatin1(physMinStr, 8).trimmed();
-        QString physMaxQStr = QString::fromLatin1(physMaxStr, 8).trimmed();
-        QString digMinQStr = QString::fromLatin1(digMinStr, 8).trimmed();
-        QString digMaxQStr = QString::fromLatin1(digMaxStr, 8).trimmed();
-        
-        physMin[i] = physMinQStr.toDouble(&ok);
-        if (!ok) physMin[i] = -500.0;
-        
-        physMax[i] = physMaxQStr.toDouble(&ok);
-        if (!ok) physMax[i] = 500.0;
-        
-        digMin[i] = digMinQStr.toDouble(&ok);
-        if (!ok) digMin[i] = -32768.0;
-        
-        digMax[i] = digMaxQStr.toDouble(&ok);
-        if (!ok) digMax[i] = 32767.0;
-        
+    }
+
+    for (int i = 0; i < numSignals; ++i) {
         // Debug check for corrupted values
         if (qAbs(physMax[i] - physMin[i]) < 0.1 || qAbs(digMax[i] - digMin[i]) < 0.1) {
             qWarning() << "WARNING: Corrupted calibration values for signal" << i << labels[i]
@@ -147,9 +133,6 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
     // Skip prefiltering (80 chars per signal)
     stream.skipRawData(80 * numSignals);
     
-    // Skip reserved (32 chars per signal)
-    stream.skipRawData(32 * numSignals);
-    
     // Read samples per data record
     for (int i = 0; i < numSignals; ++i) {
         char samplesStr[9] = {0};
@@ -162,10 +145,11 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
         if (!ok) samplesPerRecord[i] = 1;
     }
     
-    // Read duration of data record
-    char durationStr[9] = {0};
-    stream.readRawData(durationStr, 8);
-    double recordDuration = QString::fromLatin1(durationStr, 8).trimmed().toDouble(&ok);
+    // Skip reserved (32 chars per signal)
+    stream.skipRawData(32 * numSignals);
+    
+    // Duration of a data record lives in the main header
+    double recordDuration = QString::fromLatin1(header + 244, 8).trimmed().toDouble(&ok);
     if (!ok || recordDuration <= 0) {
         recordDuration = 1.0; // Default
     }
@@ -239,6 +223,20 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
     }
     
     
+    // EDF+ annotation signals carry their TALs as raw bytes in the 16-bit samples
+    QVector<EEGEvent> events;
+    for (int sig = 0; sig < numSignals; ++sig) {
+        if (!labels[sig].contains("EDF Annotations", Qt::CaseInsensitive)) continue;
+        
+        QByteArray bytes;
+        bytes.reserve(rawData[sig].size() * 2);
+        for (short sample : rawData[sig]) {
+            bytes.append(static_cast<char>(sample & 0xFF));
+            bytes.append(static_cast<char>((sample >> 8) & 0xFF));
+        }
+        parseAnnotations(bytes, events);
+    }
+    
     // Convert raw data to EEG channels
     int channelsToLoad = qMin(numSignals, 32); // Limit to 32 channels
     for (int sig = 0; sig < channelsToLoad; ++sig) {
@@ -316,6 +314,18 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
         for (int i = 0; i < numSamples; ++i) {
             channel.data[i] = rawData[sig][i] * scale + offset;
         }
+
+        // Ranges from the header when it calibrates the signal; otherwise the
+        // observed extremes are the best guess at the amplifier rails
+        channel.digitalMin = digMin[sig];
+        channel.digitalMax = digMax[sig];
+        if (qAbs(digMax[sig] - digMin[sig]) > 0.1 && qAbs(physMax[sig] - physMin[sig]) > 0.1) {
+            channel.physicalMin = std::min(physMin[sig], physMax[sig]);
+            channel.physicalMax = std::max(physMin[sig], physMax[sig]);
+        } else if (numSamples > 0) {
+            channel.physicalMin = *std::min_element(channel.data.begin(), channel.data.end());
+            channel.physicalMax = *std::max_element(channel.data.begin(), channel.data.end());
+        }
         
         data.addChannel(channel);
         
@@ -327,6 +337,10 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
         }
     }
     
+    if (!events.isEmpty()) {
+        data.addEvents(events);
+    }
+    
     // Set metadata
     data.setPatientInfo(patientID.trimmed());
     data.setRecordingInfo(recordingInfo.trimmed());
@@ -344,6 +358,60 @@ static bool loadEDF(const QString &filePath, EEGData &data) {
     return true;
 }
 
+// ================== EDF+ ANNOTATIONS ==================
+
+// Time-stamped annotation lists: "+onset[0x15 duration]0x14 text 0x14 ... 0x14 0x00".
+// The first TAL of every record only keeps time and carries no text, so it
+// yields no events. Unused bytes at the end of a record are zero.
+static void parseAnnotations(const QByteArray &bytes, QVector<EEGEvent> &events) {
+    const char *p = bytes.constData();
+    int n = bytes.size();
+    int pos = 0;
+    
+    while (pos < n) {
+        if (p[pos] == '\0') {
+            ++pos;
+            continue;
+        }
+        
+        int end = pos;
+        while (end < n && p[end] != '\0') ++end;
+        
+        // Fields are terminated by 0x14; the first one holds onset and duration
+        QVector<int> fieldEnds;
+        for (int i = pos; i < end; ++i) {
+            if (p[i] == 0x14) fieldEnds.append(i);
+        }
+        
+        if (!fieldEnds.isEmpty()) {
+            QString timing = QString::fromLatin1(p + pos, fieldEnds[0] - pos);
+            int separator = timing.indexOf(QChar(0x15));
+            
+            bool ok;
+            double onset = (separator < 0 ? timing : timing.left(separator)).toDouble(&ok);
+            double duration = separator < 0 ? 0.0 : timing.mid(separator + 1).toDouble();
+            
+            if (ok) {
+                for (int f = 1; f < fieldEnds.size(); ++f) {
+                    int start = fieldEnds[f - 1] + 1;
+                    QString text = QString::fromUtf8(p + start, fieldEnds[f] - start).trimmed();
+                    if (text.isEmpty()) continue;
+                    
+                    EEGEvent event;
+                    event.onset = onset;
+                    event.duration = duration;
+                    event.type = text;
+                    events.append(event);
+                }
+            } else {
+                qWarning() << "Skipping annotation with invalid onset:" << timing;
+            }
+        }
+        
+        pos = end + 1;
+    }
+}
+
 // ================== CSV LOADER ==================
 
 static bool loadCSV(const QString &filePath, EEGData &data) {
@@ -506,20 +574,23 @@ static bool saveCSV(const QString &filePath, const EEGData &data) {
         }
     }
     
-    // Write data
-    for (int sample = 0; sample < maxSamples; ++sample) {
-        double time = sample / samplingRate;  // Use actual sampling rate
-        stream << QString::number(time, 'f', 6);
-        
-        for (int ch = 0; ch < data.channelCount(); ++ch) {
-            stream << ",";
-            if (sample < data.channel(ch).data.size()) {
-                stream << QString::number(data.channel(ch).data[sample], 'f', 6);
-            } else {
-                stream << "0";
+    // Write data, leaving out rejected segments; the time column keeps the gaps visible
+    IntervalSet clean = data.rejectedIntervals().complement(0.0, maxSamples / samplingRate);
+    for (const auto &range : clean.sampleRanges(samplingRate, maxSamples)) {
+        for (qint64 sample = range.first; sample < range.second; ++sample) {
+            double time = sample / samplingRate;  // Use actual sampling rate
+            stream << QString::number(time, 'f', 6);
+            
+            for (int ch = 0; ch < data.channelCount(); ++ch) {
+                stream << ",";
+                if (sample < data.channel(ch).data.size()) {
+                    stream << QString::number(data.channel(ch).data[sample], 'f', 6);
+                } else {
+                    stream << "0";
+                }
             }
+            stream << "\n";
         }
-        stream << "\n";
     }
     
     file.close();   
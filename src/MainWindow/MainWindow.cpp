@@ -1,6 +1,17 @@
 #include "MainWindow.h"
 #include "../NotchPreviewDialog/NotchPreviewDialog.h"
 #include "qcustomplot.h"
+#include "../Analysis/Correlation.h"
+#include "../Analysis/ArtifactDetector.h"
+#include "../Analysis/SphericalSpline.h"
+#include "../Analysis/RobustStats.h"
+#include "../Analysis/BadChannels.h"
+#include "../Analysis/SpikeDetector.h"
+#include "../Analysis/SeizureDetector.h"
+#include "../Analysis/TimeFrequency.h"
+#include "../Analysis/PhaseAmplitudeCoupling.h"
+#include "../Analysis/Microstates.h"
+#include "../Analysis/MVAR.h"
 #include <QCoreApplication>
 #include <QFileDialog>
 #include <QMessageBox>
@@ -14,9 +25,11 @@
 #include <QTableWidget>
 #include <QDialog>
 #include <QDialogButtonBox>
+#include <QInputDialog>
 #include <QPlainTextEdit>
 #include <QDateTime>
 #include <QCloseEvent>
+#include <QSlider>
 #include <cmath>
 #include <numeric>
 #include <algorithm>
@@ -41,6 +54,7 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_eegData, &EEGData::dataChanged, this, &MainWindow::updateChannelList);
     connect(m_eegData, &EEGData::channelAdded, this, &MainWindow::updateChannelList);
     connect(m_eegData, &EEGData::channelRemoved, this, &MainWindow::updateChannelList);
+    connect(m_eegData, &EEGData::badChannelsChanged, this, &MainWindow::updateChannelList);
     connect(m_eegData, &EEGData::channelCountChanged, [this](int newCount) {
         // Update channel list
         updateChannelList();
@@ -56,6 +70,12 @@ MainWindow::MainWindow(QWidget *parent)
         m_channelSelectSpin->setRange(-1, newCount - 1);
     });
 
+    connect(m_eegData, &EEGData::displayMontageChanged, [this]() {
+        // Montage rows replace the channel rows in the chart and the list
+        m_chartView->selectAllChannels();
+        updateChannelList();
+    });
+
     connect(m_chartView, &EEGChartView::visibleChannelsChanged,
             this, &MainWindow::onVisibleChannelsChanged);
     
@@ -86,6 +106,10 @@ void MainWindow::createActions() {
     m_actSaveAs->setStatusTip("Save EEG data as...");
     connect(m_actSaveAs, &QAction::triggered, this, &MainWindow::onFileSaveAs);
 
+    m_actLoadPositions = new QAction("Load &Electrode Positions...", this);
+    m_actLoadPositions->setStatusTip("Load electrode positions used for interpolation and montages");
+    connect(m_actLoadPositions, &QAction::triggered, this, &MainWindow::onLoadElectrodePositions);
+
     m_actExit = new QAction("E&xit", this);
     m_actExit->setShortcut(QKeySequence::Quit);
     m_actExit->setStatusTip("Exit application");
@@ -162,6 +186,17 @@ void MainWindow::createActions() {
             m_processingDock->setVisible(checked);
         }
     });
+
+    m_actShowEvents = new QAction("Events Panel", this);
+    m_actShowEvents->setMenuRole(QAction::NoRole);
+    m_actShowEvents->setCheckable(true);
+    m_actShowEvents->setChecked(true);
+    m_actShowEvents->setStatusTip("Show/hide events panel");
+    connect(m_actShowEvents, &QAction::toggled, [this](bool checked) {
+        if (m_eventDock) {
+            m_eventDock->setVisible(checked);
+        }
+    });
 }
 
 void MainWindow::onVisibleChannelsChanged(const QVector<int> &channels) {
@@ -184,6 +219,8 @@ void MainWindow::createMenus() {
     fileMenu->addAction(m_actSave);
     fileMenu->addAction(m_actSaveAs);
     fileMenu->addSeparator();
+    fileMenu->addAction(m_actLoadPositions);
+    fileMenu->addSeparator();
     fileMenu->addAction(m_actExit);
     
     // View menu
@@ -197,6 +234,7 @@ void MainWindow::createMenus() {
     QMenu *panelsMenu = menuBar()->addMenu("&Panels");
     panelsMenu->addAction(m_actShowChannels);
     panelsMenu->addAction(m_actShowProcessing);
+    panelsMenu->addAction(m_actShowEvents);
     
     // Tools menu
     QMenu *toolsMenu = menuBar()->addMenu("&Tools");
@@ -225,6 +263,7 @@ void MainWindow::createToolBars() {
     m_panelToolBar = addToolBar("Panels");
     m_panelToolBar->addAction(m_actShowChannels);
     m_panelToolBar->addAction(m_actShowProcessing);
+    m_panelToolBar->addAction(m_actShowEvents);
     
     // Tools toolbar
     QToolBar *toolsToolBar = addToolBar("Tools");
@@ -246,6 +285,28 @@ void MainWindow::createDockWidgets() {
 
     m_channelDock->setWidget(m_channelList);
     addDockWidget(Qt::LeftDockWidgetArea, m_channelDock);
+
+    // Event list dock, double-click jumps the chart to the event
+    m_eventDock = new QDockWidget("Events", this);
+    m_eventDock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea | Qt::BottomDockWidgetArea);
+    m_eventDock->setFeatures(QDockWidget::DockWidgetMovable | QDockWidget::DockWidgetClosable);
+
+    m_eventModel = new EventTableModel(m_eegData, this);
+    m_eventTable = new QTableView();
+    m_eventTable->setModel(m_eventModel);
+    m_eventTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_eventTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_eventTable->verticalHeader()->setDefaultSectionSize(20);
+    m_eventTable->horizontalHeader()->setStretchLastSection(true);
+    connect(m_eventTable, &QTableView::doubleClicked, [this](const QModelIndex &index) {
+        double duration = m_chartView->currentDuration();
+        m_chartView->setTimeRange(m_eventModel->onset(index.row()) - duration / 2, duration);
+    });
+
+    m_eventDock->setWidget(m_eventTable);
+    addDockWidget(Qt::LeftDockWidgetArea, m_eventDock);
+    connect(m_eventDock, &QDockWidget::visibilityChanged,
+            m_actShowEvents, &QAction::setChecked);
     
     // Processing dock
     m_processingDock = new QDockWidget("Signal Processing", this);
@@ -359,6 +420,43 @@ void MainWindow::createDockWidgets() {
     
     gainLayout->addRow(gainButtons);
     procLayout->addWidget(gainGroup);
+
+    // Baseline drift
+    QGroupBox *baselineGroup = new QGroupBox("Baseline");
+    QFormLayout *baselineLayout = new QFormLayout(baselineGroup);
+
+    m_baselineModeCombo = new QComboBox();
+    m_baselineModeCombo->addItem("Global Mean", SignalProcessor::BaselineMean);
+    m_baselineModeCombo->addItem("Piecewise Polynomial", SignalProcessor::BaselinePolynomial);
+    m_baselineModeCombo->addItem("Running Median", SignalProcessor::BaselineMedian);
+    m_baselineModeCombo->setCurrentIndex(1);
+
+    m_baselineWindowSpin = new QDoubleSpinBox();
+    m_baselineWindowSpin->setRange(0.1, 600.0);
+    m_baselineWindowSpin->setValue(10.0);
+    m_baselineWindowSpin->setSuffix(" s");
+    m_baselineWindowSpin->setToolTip("Segment length for polynomial fits, window length for the median");
+
+    m_baselineOrderSpin = new QSpinBox();
+    m_baselineOrderSpin->setRange(0, 5);
+    m_baselineOrderSpin->setValue(1);
+
+    connect(m_baselineModeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int) {
+        int mode = m_baselineModeCombo->currentData().toInt();
+        m_baselineWindowSpin->setEnabled(mode != SignalProcessor::BaselineMean);
+        m_baselineOrderSpin->setEnabled(mode == SignalProcessor::BaselinePolynomial);
+        m_baselineWindowSpin->setValue(mode == SignalProcessor::BaselineMedian ? 2.0 : 10.0);
+    });
+
+    QPushButton *baselineButton = new QPushButton("Remove Baseline");
+    connect(baselineButton, &QPushButton::clicked, this, &MainWindow::onBaselineApply);
+
+    baselineLayout->addRow("Mode:", m_baselineModeCombo);
+    baselineLayout->addRow("Window:", m_baselineWindowSpin);
+    baselineLayout->addRow("Order:", m_baselineOrderSpin);
+    baselineLayout->addRow(baselineButton);
+
+    procLayout->addWidget(baselineGroup);
     
     // Notch filter
     QGroupBox *notchGroup = new QGroupBox("Notch Filter");
@@ -370,21 +468,110 @@ void MainWindow::createDockWidgets() {
     m_notchFreqCombo->addItem("60 Hz (North America)", 60);
     m_notchFreqCombo->setCurrentIndex(0);  // Default to 50 Hz
 
+    // Fixed notch, or an adaptive canceller that only removes the mains component
+    m_notchMethodCombo = new QComboBox();
+    m_notchMethodCombo->addItem("Notch (biquad)", -1);
+    m_notchMethodCombo->addItem("Adaptive (RLS)", SignalProcessor::LineCancellerRLS);
+    m_notchMethodCombo->addItem("Adaptive (LMS)", SignalProcessor::LineCancellerLMS);
+
+    m_notchReferenceCombo = new QComboBox();
+    m_notchReferenceCombo->addItem("Synthesized", -1);
+    m_notchReferenceCombo->setEnabled(false);
+    connect(m_notchMethodCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int) {
+        m_notchReferenceCombo->setEnabled(m_notchMethodCombo->currentData().toInt() >= 0);
+    });
+
     // Apply button
     QPushButton *notchButton = new QPushButton("Apply Notch Filter");
     connect(notchButton, &QPushButton::clicked, this, &MainWindow::onNotchFilterApply);
 
     notchLayout->addRow("Frequency:", m_notchFreqCombo);
+    notchLayout->addRow("Method:", m_notchMethodCombo);
+    notchLayout->addRow("Reference:", m_notchReferenceCombo);
     notchLayout->addRow(notchButton);
 
     procLayout->addWidget(notchGroup);
+
+    // Resampling
+    QGroupBox *resampleGroup = new QGroupBox("Resampling");
+    QFormLayout *resampleLayout = new QFormLayout(resampleGroup);
+
+    m_resampleRateSpin = new QDoubleSpinBox();
+    m_resampleRateSpin->setRange(1.0, 20000.0);
+    m_resampleRateSpin->setValue(256.0);
+    m_resampleRateSpin->setSuffix(" Hz");
+
+    QPushButton *resampleButton = new QPushButton("Resample All Channels");
+    connect(resampleButton, &QPushButton::clicked, this, &MainWindow::onResampleApply);
+
+    resampleLayout->addRow("Target rate:", m_resampleRateSpin);
+    resampleLayout->addRow(resampleButton);
+
+    procLayout->addWidget(resampleGroup);
+
+    // Wavelet denoising
+    QGroupBox *waveletGroup = new QGroupBox("Wavelet Denoising");
+    QFormLayout *waveletLayout = new QFormLayout(waveletGroup);
+
+    m_waveletCombo = new QComboBox();
+    for (int i = 0; i < Wavelet::WaveletTypeCount; ++i) {
+        m_waveletCombo->addItem(Wavelet::waveletName(static_cast<Wavelet::WaveletType>(i)), i);
+    }
+    m_waveletCombo->setCurrentIndex(Wavelet::WaveletSym4);
+
+    m_waveletRuleCombo = new QComboBox();
+    m_waveletRuleCombo->addItem("Universal", Wavelet::ThresholdUniversal);
+    m_waveletRuleCombo->addItem("SURE", Wavelet::ThresholdSURE);
+    m_waveletRuleCombo->addItem("BayesShrink", Wavelet::ThresholdBayes);
+    m_waveletRuleCombo->setCurrentIndex(2);
+
+    m_waveletLevelsSpin = new QSpinBox();
+    m_waveletLevelsSpin->setRange(1, 12);
+    m_waveletLevelsSpin->setValue(6);
+
+    QCheckBox *waveletPreviewCheck = new QCheckBox("Preview on display");
+    connect(waveletPreviewCheck, &QCheckBox::toggled, [this](bool checked) {
+        m_chartView->setWaveletPreview(checked, waveletParams());
+    });
+    auto refreshPreview = [this, waveletPreviewCheck]() {
+        if (waveletPreviewCheck->isChecked()) m_chartView->setWaveletPreview(true, waveletParams());
+    };
+    connect(m_waveletCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), refreshPreview);
+    connect(m_waveletRuleCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), refreshPreview);
+    connect(m_waveletLevelsSpin, QOverload<int>::of(&QSpinBox::valueChanged), refreshPreview);
+
+    QPushButton *waveletButton = new QPushButton("Denoise Channels");
+    connect(waveletButton, &QPushButton::clicked, [this, waveletPreviewCheck]() {
+        if (m_eegData->isEmpty()) {
+            QMessageBox::warning(this, "Error", "No data loaded");
+            return;
+        }
+        QVector<int> channels;
+        int channel = m_channelSelectSpin->value();
+        if (channel >= 0) {
+            channels.append(channel);
+        } else {
+            for (int i = 0; i < m_eegData->channelCount(); ++i) channels.append(i);
+        }
+        Wavelet::denoise(*m_eegData, channels, waveletParams());
+        waveletPreviewCheck->setChecked(false);
+    });
+
+    waveletLayout->addRow("Wavelet:", m_waveletCombo);
+    waveletLayout->addRow("Threshold:", m_waveletRuleCombo);
+    waveletLayout->addRow("Levels:", m_waveletLevelsSpin);
+    waveletLayout->addRow(waveletPreviewCheck);
+    waveletLayout->addRow(waveletButton);
+
+    procLayout->addWidget(waveletGroup);
     
     // Montage
     QGroupBox *montageGroup = new QGroupBox("Montage");
     QFormLayout *montageLayout = new QFormLayout(montageGroup);
     
     m_montageCombo = new QComboBox();
-    m_montageCombo->addItems({"Bipolar", "Average Reference", "Laplacian"});
+    m_montageCombo->addItems({"Bipolar (Double Banana)", "Bipolar (Transverse)", "Average Reference",
+                              "Laplacian", "REST", "From File..."});
     
     QPushButton *montageButton = new QPushButton("Apply Montage");
     connect(montageButton, &QPushButton::clicked, this, &MainWindow::onMontageApply);
@@ -510,6 +697,12 @@ void MainWindow::createDockWidgets() {
     QPushButton *powerSpectrumBtn = new QPushButton("Show Power Spectrum");
     QPushButton *bandPowerBtn = new QPushButton("Show Band Powers");
     QPushButton *spectrogramBtn = new QPushButton("Show Spectrogram");
+    QPushButton *comodulogramBtn = new QPushButton("Show Comodulogram");
+    comodulogramBtn->setToolTip("Phase-amplitude coupling (modulation index) over the whole recording");
+    QPushButton *erspBtn = new QPushButton("Show ERSP");
+    erspBtn->setToolTip("Event-related spectral perturbation and inter-trial coherence around one event type");
+    QPushButton *complexityBtn = new QPushButton("Show Complexity Trend");
+    complexityBtn->setToolTip("Sample, approximate and permutation entropy and Higuchi dimension in 30 s windows");
 
     freqLayout->addRow("Channel:", freqChannelCombo);
     freqLayout->addRow("FFT Window:", windowSizeCombo);
@@ -517,6 +710,9 @@ void MainWindow::createDockWidgets() {
     freqLayout->addRow(powerSpectrumBtn);
     freqLayout->addRow(bandPowerBtn);
     freqLayout->addRow(spectrogramBtn);
+    freqLayout->addRow(comodulogramBtn);
+    freqLayout->addRow(erspBtn);
+    freqLayout->addRow(complexityBtn);
 
     procLayout->addWidget(freqGroup);
 
@@ -537,6 +733,115 @@ void MainWindow::createDockWidgets() {
         showSpectrogram(channelIndex);
     });
 
+    connect(comodulogramBtn, &QPushButton::clicked, [this, freqChannelCombo]() {
+        showComodulogram(freqChannelCombo->currentData().toInt());
+    });
+
+    connect(erspBtn, &QPushButton::clicked, [this, freqChannelCombo]() {
+        showERSP(freqChannelCombo->currentData().toInt());
+    });
+
+    connect(complexityBtn, &QPushButton::clicked, [this, freqChannelCombo]() {
+        showComplexityTrend(freqChannelCombo->currentData().toInt());
+    });
+
+    // Connectivity Group
+    QGroupBox *connectivityGroup = new QGroupBox("Connectivity");
+    QFormLayout *connectivityLayout = new QFormLayout(connectivityGroup);
+
+    QPushButton *correlationBtn = new QPushButton("Show Correlation Matrix");
+    correlationBtn->setToolTip("Channel x channel correlation over the visible time range");
+    connect(correlationBtn, &QPushButton::clicked, this, &MainWindow::showCorrelationMatrix);
+    connectivityLayout->addRow(correlationBtn);
+
+    QPushButton *lagsBtn = new QPushButton("Show Channel Lags");
+    lagsBtn->setToolTip("Cross-correlation peak lag of every channel pair over the visible time range");
+    connect(lagsBtn, &QPushButton::clicked, this, &MainWindow::showChannelLags);
+    connectivityLayout->addRow(lagsBtn);
+
+    QPushButton *directedBtn = new QPushButton("Show Directed Connectivity");
+    directedBtn->setToolTip("MVAR Granger causality, PDC or DTF (1-40 Hz) over the visible time range");
+    connect(directedBtn, &QPushButton::clicked, this, &MainWindow::showDirectedConnectivity);
+    connectivityLayout->addRow(directedBtn);
+
+    procLayout->addWidget(connectivityGroup);
+
+    // Microstates Group
+    QGroupBox *microstateGroup = new QGroupBox("Microstates");
+    QFormLayout *microstateLayout = new QFormLayout(microstateGroup);
+
+    m_microstateCountSpin = new QSpinBox();
+    m_microstateCountSpin->setRange(2, 12);
+    m_microstateCountSpin->setValue(4);
+    microstateLayout->addRow("States:", m_microstateCountSpin);
+
+    QPushButton *microstateBtn = new QPushButton("Fit Microstates");
+    microstateBtn->setToolTip("Modified k-means on GFP peak topographies, back-fitted to the whole recording");
+    connect(microstateBtn, &QPushButton::clicked, this, &MainWindow::fitMicrostates);
+    microstateLayout->addRow(microstateBtn);
+
+    procLayout->addWidget(microstateGroup);
+
+    // Artifacts Group
+    QGroupBox *artifactGroup = new QGroupBox("Artifacts");
+    QFormLayout *artifactLayout = new QFormLayout(artifactGroup);
+
+    QPushButton *detectArtifactsBtn = new QPushButton("Detect Artifacts");
+    detectArtifactsBtn->setToolTip("Screen all channels for blinks, clipping, flatline, pops and muscle");
+    connect(detectArtifactsBtn, &QPushButton::clicked, this, &MainWindow::detectArtifacts);
+    artifactLayout->addRow(detectArtifactsBtn);
+
+    QPushButton *interpolateRejectedBtn = new QPushButton("Interpolate Rejected");
+    interpolateRejectedBtn->setToolTip("Bridge rejected segments with a straight line on every channel");
+    connect(interpolateRejectedBtn, &QPushButton::clicked, [this]() {
+        if (m_eegData->rejectedIntervals().isEmpty()) {
+            QMessageBox::information(this, "Artifacts", "No rejected segments");
+            return;
+        }
+        QVector<int> channels;
+        for (int i = 0; i < m_eegData->channelCount(); ++i) channels.append(i);
+        m_eegData->interpolateRejected(channels);
+        m_eegData->clearRejectedIntervals();
+    });
+    artifactLayout->addRow(interpolateRejectedBtn);
+
+    QPushButton *detectBadBtn = new QPushButton("Detect Bad Channels");
+    detectBadBtn->setToolTip("Flag flat, noisy, deviating and uncorrelated channels (PREP criteria)");
+    connect(detectBadBtn, &QPushButton::clicked, this, &MainWindow::detectBadChannels);
+    artifactLayout->addRow(detectBadBtn);
+
+    QPushButton *interpolateChannelsBtn = new QPushButton("Interpolate Bad Channels...");
+    interpolateChannelsBtn->setToolTip("Rebuild channels from their neighbours with spherical splines");
+    connect(interpolateChannelsBtn, &QPushButton::clicked, this, &MainWindow::interpolateBadChannels);
+    artifactLayout->addRow(interpolateChannelsBtn);
+
+    QPushButton *clearRejectedBtn = new QPushButton("Clear Rejected");
+    connect(clearRejectedBtn, &QPushButton::clicked, [this]() {
+        m_eegData->clearRejectedIntervals();
+    });
+    artifactLayout->addRow(clearRejectedBtn);
+
+    procLayout->addWidget(artifactGroup);
+
+    // Event Detection Group
+    QGroupBox *eventDetectionGroup = new QGroupBox("Event Detection");
+    QFormLayout *eventDetectionLayout = new QFormLayout(eventDetectionGroup);
+
+    QPushButton *detectSpikesBtn = new QPushButton("Detect Spikes");
+    detectSpikesBtn->setToolTip("Mark interictal spikes and sharp waves on every channel as events");
+    connect(detectSpikesBtn, &QPushButton::clicked, this, &MainWindow::detectSpikes);
+    eventDetectionLayout->addRow(detectSpikesBtn);
+
+    QPushButton *detectSeizuresBtn = new QPushButton("Detect Seizures");
+    detectSeizuresBtn->setToolTip("Mark stretches of high line length and energy on several channels");
+    connect(detectSeizuresBtn, &QPushButton::clicked, this, &MainWindow::detectSeizures);
+    eventDetectionLayout->addRow(detectSeizuresBtn);
+
+    m_seizureOnLoadCheck = new QCheckBox("Screen for seizures on load");
+    eventDetectionLayout->addRow(m_seizureOnLoadCheck);
+
+    procLayout->addWidget(eventDetectionGroup);
+
     procLayout->addStretch(); 
 
     // Set the processing widget as the scroll area's widget
@@ -622,6 +927,8 @@ void MainWindow::onFileOpen() {
                 freqChannelCombo->addItem(QString("%1: %2").arg(i).arg(channel.label), i);
             }
         }
+
+        if (m_seizureOnLoadCheck->isChecked()) detectSeizures();
         
         QMessageBox::information(this, "Success", 
                                 QString("Loaded %1 channels with %2 seconds of data")
@@ -764,6 +1071,47 @@ void MainWindow::onDCRemoveApply() {
     m_chartView->updateChart();
 }
 
+Wavelet::DenoiseParams MainWindow::waveletParams() const {
+    Wavelet::DenoiseParams params;
+    params.wavelet = static_cast<Wavelet::WaveletType>(m_waveletCombo->currentData().toInt());
+    params.rule = static_cast<Wavelet::ThresholdRule>(m_waveletRuleCombo->currentData().toInt());
+    params.levels = m_waveletLevelsSpin->value();
+    return params;
+}
+
+void MainWindow::onResampleApply() {
+    if (!m_eegData || m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    m_eegData->resample(m_resampleRateSpin->value());
+    m_chartView->setTimeRange(m_chartView->currentStartTime(), m_chartView->currentDuration());
+    updateStatusBar();
+}
+
+void MainWindow::onBaselineApply() {
+    if (!m_eegData || m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    SignalProcessor::BaselineParams params;
+    params.mode = static_cast<SignalProcessor::BaselineMode>(m_baselineModeCombo->currentData().toInt());
+    params.segmentSeconds = m_baselineWindowSpin->value();
+    params.medianWindowSeconds = m_baselineWindowSpin->value();
+    params.polynomialOrder = m_baselineOrderSpin->value();
+
+    QVector<int> channels;
+    int channel = m_channelSelectSpin->value();
+    if (channel >= 0) {
+        channels.append(channel);
+    } else {
+        for (int i = 0; i < m_eegData->channelCount(); ++i) channels.append(i);
+    }
+    m_eegData->removeBaseline(channels, params);
+}
+
 void MainWindow::onNotchFilterApply() {
     // Get selected frequency
     double notchFreq = m_notchFreqCombo->currentData().toDouble();
@@ -792,7 +1140,20 @@ void MainWindow::onNotchFilterApply() {
     }
     
     int channel = m_channelSelectSpin->value();
-    if (channel >= 0) {
+    int method = m_notchMethodCombo->currentData().toInt();
+    if (method >= 0) {
+        SignalProcessor::LineCancellerParams params;
+        params.lineFrequency = notchFreq;
+        params.method = static_cast<SignalProcessor::LineCancellerMethod>(method);
+        QVector<int> channels;
+        if (channel >= 0) {
+            channels.append(channel);
+        } else {
+            for (int i = 0; i < filteredData->channelCount(); ++i) channels.append(i);
+        }
+        filteredData->applyLineCanceller(channels, params, m_notchReferenceCombo->currentData().toInt());
+        m_progressBar->setValue(100);
+    } else if (channel >= 0) {
         filteredData->applyNotchFilter(channel, notchFreq);
     } else {
         for (int i = 0; i < filteredData->channelCount(); ++i) {
@@ -818,38 +1179,60 @@ void MainWindow::onNotchFilterApply() {
 }
 
 void MainWindow::onMontageApply() {
-    int montageIndex = m_montageCombo->currentIndex();
-    
-    switch (montageIndex) {
+    if (m_eegData->isEmpty()) return;
+
+    QVector<QString> labels = m_eegData->channelLabels();
+    const ElectrodeLayout &layout = m_eegData->electrodeLayout();
+    Montage montage;
+
+    switch (m_montageCombo->currentIndex()) {
     case 0:
-        m_eegData->applyMontage(SignalProcessor::MontageBipolar);
+        montage = Montage::bipolar(labels, "Double Banana");
         break;
     case 1:
-        m_eegData->applyMontage(SignalProcessor::MontageAverageReference);
+        montage = Montage::bipolar(labels, "Transverse");
         break;
     case 2:
-        m_eegData->applyMontage(SignalProcessor::MontageLaplacian);
+        montage = Montage::averageReference(labels);
+        break;
+    case 3:
+        montage = Montage::laplacian(labels, layout);
+        break;
+    case 4:
+        montage = Montage::rest(labels, layout);
+        break;
+    case 5: {
+        QString filePath = QFileDialog::getOpenFileName(
+            nullptr,
+            QString("Load Montage"),
+            QDir::homePath(),
+            "Montage Files (*.txt *.mtg);;All Files (*)",
+            nullptr,
+            QFileDialog::DontUseNativeDialog
+        );
+        if (filePath.isEmpty()) return;
+        if (!montage.loadFromFile(filePath, labels)) {
+            QMessageBox::warning(this, "Montage", "No usable montage definition in " + filePath);
+            return;
+        }
         break;
     }
-    
-    m_chartView->updateChart();
-    updateChannelList();
+    }
+
+    // Display only: the recorded channels stay untouched for analysis
+    if (!m_eegData->setDisplayMontage(montage)) {
+        QMessageBox::warning(this, "Montage", "Could not apply the montage to the loaded channels");
+        return;
+    }
+
+    statusBar()->showMessage(QString("Montage: %1").arg(montage.name()), 3000);
 }
 
 void MainWindow::onResetMontage() {
-    if (!m_currentFilePath.isEmpty()) {
-        m_eegData->loadFromFile(m_currentFilePath);
-
-        m_chartView->selectAllChannels();
+    if (!m_eegData->hasDisplayMontage()) return;
 
-        m_chartView->updateChart();
-        updateChannelList();
-        updateStatusBar();
-        
-        QMessageBox::information(this, "Reset", "Data restored to original");
-    } else {
-        QMessageBox::warning(this, "Error", "No original file to restore from");
-    }
+    m_eegData->clearDisplayMontage();
+    statusBar()->showMessage("Montage: As recorded", 3000);
 }
 
 
@@ -878,40 +1261,47 @@ void MainWindow::onShowStatistics() {
     
     QVBoxLayout *layout = new QVBoxLayout(&statsDialog);
     
-    // Add more columns for min/max
+    // Robust columns alongside the classical ones, outliers barely move them
     QTableWidget *table = new QTableWidget();
-    table->setColumnCount(10); 
+    table->setColumnCount(15);
     table->setHorizontalHeaderLabels({
         "Channel", "Label", "Samples", "Rate (Hz)", 
         "Mean (μV)", "StdDev (μV)", "Min (μV)", "Max (μV)",
-        "Peak-Peak", "Variance"
+        "Peak-Peak", "Variance",
+        "Median (μV)", "MAD (μV)", "P5 (μV)", "P95 (μV)", "Kurtosis"
     });
     
     int channelCount = m_eegData->channelCount();
     table->setRowCount(channelCount);
     
-    auto means = m_eegData->channelMeans();
-    auto stddevs = m_eegData->channelStdDevs();
+    QVector<int> channels;
+    for (int i = 0; i < channelCount; ++i) channels.append(i);
+    RobustStats::StatsParams params;
+    params.percentiles = {5, 95};
+    QVector<RobustStats::ChannelStats> stats = RobustStats::channelStats(*m_eegData, channels, params);
     
-    for (int i = 0; i < channelCount; ++i) {
+    for (int i = 0; i < stats.size(); ++i) {
         const EEGChannel &channel = m_eegData->channel(i);
+        const RobustStats::ChannelStats &s = stats[i];
         
-        auto minMax = std::minmax_element(channel.data.begin(), channel.data.end());
-        double minVal = *minMax.first;
-        double maxVal = *minMax.second;
-        double peakToPeak = maxVal - minVal;
-        double variance = stddevs[i] * stddevs[i];
+        double peakToPeak = s.max - s.min;
+        double variance = s.stdDev * s.stdDev;
         
         table->setItem(i, 0, new QTableWidgetItem(QString::number(i + 1)));
         table->setItem(i, 1, new QTableWidgetItem(channel.label));
         table->setItem(i, 2, new QTableWidgetItem(QString::number(channel.data.size())));
         table->setItem(i, 3, new QTableWidgetItem(QString::number(channel.samplingRate, 'f', 1)));
-        table->setItem(i, 4, new QTableWidgetItem(QString::number(means[i], 'f', 2)));
-        table->setItem(i, 5, new QTableWidgetItem(QString::number(stddevs[i], 'f', 2)));
-        table->setItem(i, 6, new QTableWidgetItem(QString::number(minVal, 'f', 2)));  // Min
-        table->setItem(i, 7, new QTableWidgetItem(QString::number(maxVal, 'f', 2)));  // Max
+        table->setItem(i, 4, new QTableWidgetItem(QString::number(s.mean, 'f', 2)));
+        table->setItem(i, 5, new QTableWidgetItem(QString::number(s.stdDev, 'f', 2)));
+        table->setItem(i, 6, new QTableWidgetItem(QString::number(s.min, 'f', 2)));  // Min
+        table->setItem(i, 7, new QTableWidgetItem(QString::number(s.max, 'f', 2)));  // Max
         table->setItem(i, 8, new QTableWidgetItem(QString::number(peakToPeak, 'f', 2)));  // Peak-Peak
         table->setItem(i, 9, new QTableWidgetItem(QString::number(variance, 'f', 2)));  // Variance
+        table->setItem(i, 10, new QTableWidgetItem(QString::number(s.median, 'f', 2)));
+        table->setItem(i, 11, new QTableWidgetItem(QString::number(s.mad, 'f', 2)));
+        table->setItem(i, 12, new QTableWidgetItem(QString::number(s.percentiles[0], 'f', 2)));
+        table->setItem(i, 13, new QTableWidgetItem(QString::number(s.percentiles[1], 'f', 2)));
+        table->setItem(i, 14, new QTableWidgetItem(QString::number(s.kurtosis, 'f', 2)));
     }
     
     table->resizeColumnsToContents();
@@ -944,13 +1334,14 @@ void MainWindow::updateChannelList() {
     m_channelList->clear();
     QVector<int> visibleChannels = m_chartView->getVisibleChannels();
     
-    for (int i = 0; i < m_eegData->channelCount(); ++i) {
-        const EEGChannel &channel = m_eegData->channel(i);
+    // Rows as drawn, so montage outputs when a display montage is set
+    for (int i = 0; i < m_eegData->displayChannelCount(); ++i) {
         QString itemText = QString("%1: %2 (%3 samples, %4 Hz)")
                           .arg(i + 1, 2)
-                          .arg(channel.label)
-                          .arg(channel.data.size())
-                          .arg(channel.samplingRate, 0, 'f', 1);
+                          .arg(m_eegData->displayChannelLabel(i))
+                          .arg(m_eegData->displaySampleCount(i))
+                          .arg(m_eegData->displaySamplingRate(i), 0, 'f', 1);
+        if (!m_eegData->hasDisplayMontage() && m_eegData->channel(i).bad) itemText += " [bad]";
         
         QListWidgetItem *item = new QListWidgetItem(itemText);
         item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
@@ -964,6 +1355,15 @@ void MainWindow::updateChannelList() {
     // Update channel selection spin box
     int channelCount = m_eegData->channelCount();
     m_channelSelectSpin->setRange(-1, qMax(0, channelCount - 1));
+
+    // Line canceller reference choices, keeping the current one when it still exists
+    int reference = m_notchReferenceCombo->currentData().toInt();
+    m_notchReferenceCombo->clear();
+    m_notchReferenceCombo->addItem("Synthesized", -1);
+    for (int i = 0; i < channelCount; ++i) {
+        m_notchReferenceCombo->addItem(QString("%1: %2").arg(i).arg(m_eegData->channel(i).label), i);
+    }
+    m_notchReferenceCombo->setCurrentIndex(qMax(0, m_notchReferenceCombo->findData(reference)));
 }
 
 void MainWindow::onFileExit() {
@@ -1024,20 +1424,20 @@ void MainWindow::showPowerSpectrum(int channelIndex, int windowSizeIndex) {
         // Single channel spectrum
         const EEGChannel &channel = m_eegData->channel(channelIndex);
         
-        // Take a window of data
-        int startSample = 0;
-        int endSample = std::min(windowSize, channel.data.size());
-        QVector<double> windowData(channel.data.begin() + startSample, 
-                                   channel.data.begin() + endSample);
-        
-        // Calculate spectrum
-        QVector<double> spectrum = SignalProcessor::powerSpectrum(windowData, channel.samplingRate);
+        // Welch average over the clean data, skipping rejected segments
+        CleanView view = m_eegData->cleanView(channelIndex);
+        int segmentLength = static_cast<int>(std::min<qint64>(windowSize, view.longestSegment()));
+        QVector<double> spectrum = SignalProcessor::welchPowerSpectrum(view, segmentLength);
+        if (spectrum.isEmpty()) {
+            QMessageBox::warning(this, "Error", "Not enough clean data for a spectrum");
+            return;
+        }
         
         // Create series
         QLineSeries *series = new QLineSeries();
         series->setName(channel.label);
         
-        double freqResolution = channel.samplingRate / (2.0 * spectrum.size());
+        double freqResolution = channel.samplingRate / segmentLength;
         for (int i = 0; i < spectrum.size(); ++i) {
             double freq = i * freqResolution;
             series->append(freq, spectrum[i]);
@@ -1051,25 +1451,30 @@ void MainWindow::showPowerSpectrum(int channelIndex, int windowSizeIndex) {
         axisX->setRange(0, channel.samplingRate / 2);
         
         QValueAxis *axisY = new QValueAxis();
-        axisY->setTitleText("Amplitude");
+        axisY->setTitleText("Power (μV²/Hz)");
         
         chart->addAxis(axisX, Qt::AlignBottom);
         chart->addAxis(axisY, Qt::AlignLeft);
         series->attachAxis(axisX);
         series->attachAxis(axisY);
     } else {
-        // Average spectrum across all channels
+        // Average spectrum across all channels, one segment length for all of them
         QVector<double> avgSpectrum;
+        qint64 longestClean = m_eegData->cleanView(0).longestSegment();
+        for (int ch = 1; ch < m_eegData->channelCount(); ++ch) {
+            longestClean = std::min(longestClean, m_eegData->cleanView(ch).longestSegment());
+        }
+        int segmentLength = static_cast<int>(std::min<qint64>(windowSize, longestClean));
         
         for (int ch = 0; ch < m_eegData->channelCount(); ++ch) {
             const EEGChannel &channel = m_eegData->channel(ch);
             
-            int startSample = 0;
-            int endSample = std::min(windowSize, channel.data.size());
-            QVector<double> windowData(channel.data.begin() + startSample, 
-                                       channel.data.begin() + endSample);
-            
-            QVector<double> spectrum = SignalProcessor::powerSpectrum(windowData, channel.samplingRate);
+            CleanView view = m_eegData->cleanView(ch);
+            QVector<double> spectrum = SignalProcessor::welchPowerSpectrum(view, segmentLength);
+            if (spectrum.isEmpty()) {
+                QMessageBox::warning(this, "Error", "Not enough clean data for a spectrum");
+                return;
+            }
             
             if (ch == 0) {
                 avgSpectrum = spectrum;
@@ -1090,7 +1495,7 @@ void MainWindow::showPowerSpectrum(int channelIndex, int windowSizeIndex) {
         series->setName("Average Spectrum");
         
         double samplingRate = m_eegData->channel(0).samplingRate;
-        double freqResolution = samplingRate / (2.0 * avgSpectrum.size());
+        double freqResolution = samplingRate / segmentLength;
         for (int i = 0; i < avgSpectrum.size(); ++i) {
             double freq = i * freqResolution;
             series->append(freq, avgSpectrum[i]);
@@ -1103,7 +1508,7 @@ void MainWindow::showPowerSpectrum(int channelIndex, int windowSizeIndex) {
         axisX->setRange(0, samplingRate / 2);
         
         QValueAxis *axisY = new QValueAxis();
-        axisY->setTitleText("Amplitude");
+        axisY->setTitleText("Power (μV²/Hz)");
         
         chart->addAxis(axisX, Qt::AlignBottom);
         chart->addAxis(axisY, Qt::AlignLeft);
@@ -1306,4 +1711,712 @@ void MainWindow::showSpectrogram(int channelIndex) {
     layout->addWidget(closeButton);
 
     specDialog->show();
-}
\ No newline at end of file
+}
+
+void MainWindow::showHeatmap(const QString &title, const Eigen::MatrixXd &values,
+                             double xMin, double xMax, double yMin, double yMax,
+                             const QString &xLabel, const QString &yLabel) {
+    QDialog *dialog = new QDialog(this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose, true);
+    dialog->setWindowTitle(title);
+    dialog->resize(900, 600);
+
+    QVBoxLayout *layout = new QVBoxLayout(dialog);
+    QCustomPlot *customPlot = new QCustomPlot(dialog);
+    layout->addWidget(customPlot);
+
+    // values is rows = y, columns = x
+    QCPColorMap *colorMap = new QCPColorMap(customPlot->xAxis, customPlot->yAxis);
+    colorMap->data()->setSize(values.cols(), values.rows());
+    colorMap->data()->setRange(QCPRange(xMin, xMax), QCPRange(yMin, yMax));
+    for (int x = 0; x < values.cols(); ++x) {
+        for (int y = 0; y < values.rows(); ++y) {
+            colorMap->data()->setCell(x, y, values(y, x));
+        }
+    }
+
+    QCPColorGradient gradient;
+    gradient.setColorStopAt(0.0, Qt::darkBlue);
+    gradient.setColorStopAt(0.25, Qt::blue);
+    gradient.setColorStopAt(0.5, Qt::green);
+    gradient.setColorStopAt(0.75, Qt::yellow);
+    gradient.setColorStopAt(1.0, Qt::darkRed);
+    colorMap->setGradient(gradient);
+    colorMap->rescaleDataRange();
+
+    QCPColorScale *colorScale = new QCPColorScale(customPlot);
+    customPlot->plotLayout()->addElement(0, 1, colorScale);
+    colorMap->setColorScale(colorScale);
+
+    customPlot->rescaleAxes();
+    customPlot->xAxis->setLabel(xLabel);
+    customPlot->yAxis->setLabel(yLabel);
+
+    QPushButton *closeButton = new QPushButton("Close", dialog);
+    connect(closeButton, &QPushButton::clicked, dialog, &QDialog::accept);
+    layout->addWidget(closeButton);
+
+    dialog->show();
+}
+
+void MainWindow::showComodulogram(int channelIndex) {
+    if (channelIndex < 0 || channelIndex >= m_eegData->channelCount()) {
+        QMessageBox::warning(this, "Error", "Please select a specific channel");
+        return;
+    }
+
+    QVector<PAC::Comodulogram> results = PAC::comodulogram(*m_eegData, {channelIndex});
+    if (results.isEmpty() || results.first().isEmpty()) {
+        QMessageBox::warning(this, "Error", "Not enough data for a comodulogram");
+        return;
+    }
+
+    const PAC::Comodulogram &result = results.first();
+    showHeatmap(QString("Comodulogram - Channel %1 (%2)").arg(channelIndex).arg(m_eegData->channel(channelIndex).label),
+                result.modulationIndex,
+                result.phaseFrequencies.first(), result.phaseFrequencies.last(),
+                result.amplitudeFrequencies.first(), result.amplitudeFrequencies.last(),
+                "Phase frequency (Hz)", "Amplitude frequency (Hz)");
+}
+
+void MainWindow::showERSP(int channelIndex) {
+    if (channelIndex < 0 || channelIndex >= m_eegData->channelCount()) {
+        QMessageBox::warning(this, "Error", "Please select a specific channel");
+        return;
+    }
+
+    QStringList types = m_eegData->events().types();
+    if (types.isEmpty()) {
+        QMessageBox::warning(this, "Error", "No events to time-lock to");
+        return;
+    }
+    bool ok = false;
+    QString type = QInputDialog::getItem(this, "ERSP", "Event type:", types, 0, false, &ok);
+    if (!ok) return;
+
+    Epochs::EpochParams epochParams;
+    epochParams.tmin = -0.5;
+    epochParams.tmax = 1.0;
+    Epochs::EpochSet epochs(*m_eegData, {channelIndex}, type, epochParams);
+    TimeFrequency::ERSP result = TimeFrequency::ersp(epochs);
+    if (result.isEmpty()) {
+        QMessageBox::warning(this, "Error", "No usable epochs for " + type);
+        return;
+    }
+
+    QString label = m_eegData->channel(channelIndex).label;
+    double tFirst = result.times.first();
+    double tLast = result.times.last();
+    double fFirst = result.frequencies.first();
+    double fLast = result.frequencies.last();
+    showHeatmap(QString("ERSP (dB) - %1, %2 epochs of %3").arg(label).arg(result.count).arg(type),
+                result.power.first(), tFirst, tLast, fFirst, fLast, "Time (s)", "Frequency (Hz)");
+    showHeatmap(QString("Inter-trial coherence - %1, %2 epochs of %3").arg(label).arg(result.count).arg(type),
+                result.itc.first(), tFirst, tLast, fFirst, fLast, "Time (s)", "Frequency (Hz)");
+}
+
+void MainWindow::showComplexityTrend(int channelIndex) {
+    if (channelIndex < 0 || channelIndex >= m_eegData->channelCount()) {
+        QMessageBox::warning(this, "Error", "Please select a specific channel");
+        return;
+    }
+
+    // 30 s windows every 15 s over the whole recording
+    const EEGChannel &channel = m_eegData->channel(channelIndex);
+    qint64 window = static_cast<qint64>(30.0 * channel.samplingRate);
+    qint64 step = window / 2;
+    QVector<QVector<SignalProcessor::Complexity>> trend = SignalProcessor::complexityTrend(
+        {channel.data.constData()}, channel.data.size(), window, step);
+    if (trend.isEmpty() || trend.first().isEmpty()) {
+        QMessageBox::warning(this, "Error", "Need at least 30 s of data for a complexity trend");
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle(QString("Complexity - Channel %1 (%2)").arg(channelIndex).arg(channel.label));
+    dialog.resize(900, 500);
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+
+    QChartView *chartView = new QChartView();
+    chartView->setRenderHint(QPainter::Antialiasing);
+    QChart *chart = new QChart();
+
+    QLineSeries *sampleSeries = new QLineSeries();
+    sampleSeries->setName("Sample entropy");
+    QLineSeries *approximateSeries = new QLineSeries();
+    approximateSeries->setName("Approximate entropy");
+    QLineSeries *permutationSeries = new QLineSeries();
+    permutationSeries->setName("Permutation entropy (normalized)");
+    QLineSeries *higuchiSeries = new QLineSeries();
+    higuchiSeries->setName("Higuchi dimension");
+
+    // Points at window centres; undefined values leave a gap in the trend
+    const QVector<SignalProcessor::Complexity> &values = trend.first();
+    for (int w = 0; w < values.size(); ++w) {
+        double time = (w * step + window / 2) / channel.samplingRate;
+        const SignalProcessor::Complexity &value = values[w];
+        if (std::isfinite(value.sampleEntropy)) sampleSeries->append(time, value.sampleEntropy);
+        if (std::isfinite(value.approximateEntropy)) approximateSeries->append(time, value.approximateEntropy);
+        if (std::isfinite(value.permutationEntropy)) permutationSeries->append(time, value.permutationEntropy);
+        if (std::isfinite(value.higuchiDimension)) higuchiSeries->append(time, value.higuchiDimension);
+    }
+
+    QValueAxis *axisX = new QValueAxis();
+    axisX->setTitleText("Time (s)");
+    axisX->setRange(0, channel.data.size() / channel.samplingRate);
+    QValueAxis *axisY = new QValueAxis();
+    axisY->setTitleText("Value");
+    chart->addAxis(axisX, Qt::AlignBottom);
+    chart->addAxis(axisY, Qt::AlignLeft);
+    for (QLineSeries *series : {sampleSeries, approximateSeries, permutationSeries, higuchiSeries}) {
+        chart->addSeries(series);
+        series->attachAxis(axisX);
+        series->attachAxis(axisY);
+    }
+    axisY->setMin(0.0);
+
+    chartView->setChart(chart);
+    layout->addWidget(chartView);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    dialog.exec();
+}
+
+void MainWindow::showCorrelationMatrix() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    // Channels sharing the first channel's sampling rate
+    double samplingRate = m_eegData->channel(0).samplingRate;
+    QVector<int> channels;
+    QStringList labels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        if (m_eegData->channel(i).samplingRate == samplingRate) {
+            channels.append(i);
+            labels.append(m_eegData->channel(i).label);
+        }
+    }
+
+    int startSample = static_cast<int>(m_chartView->currentStartTime() * samplingRate);
+    int numSamples = static_cast<int>(m_chartView->currentDuration() * samplingRate);
+
+    // Slider position 0 is the whole visible range, the rest are 1 s sliding windows
+    QVector<Eigen::MatrixXd> matrices;
+    QVector<double> windowTimes;
+    matrices.append(Correlation::correlationMatrix(*m_eegData, channels, startSample, numSamples));
+    windowTimes.append(m_chartView->currentStartTime());
+
+    if (matrices.first().size() == 0) {
+        QMessageBox::warning(this, "Error", "Not enough data for correlation");
+        return;
+    }
+
+    int windowSamples = static_cast<int>(samplingRate);
+    int hopSamples = qMax(windowSamples / 4, (numSamples - windowSamples) / 400);
+    hopSamples = qMax(1, hopSamples);
+    if (numSamples >= 2 * windowSamples) {
+        Correlation::SlidingCorrelation sliding(*m_eegData, channels, windowSamples, hopSamples,
+                                                startSample, numSamples);
+        while (sliding.next()) {
+            matrices.append(sliding.matrix());
+            windowTimes.append(sliding.windowStartTime());
+        }
+    }
+
+    QDialog *corrDialog = new QDialog(this);
+    corrDialog->setAttribute(Qt::WA_DeleteOnClose, true);
+    corrDialog->setWindowTitle("Channel Correlation");
+    corrDialog->resize(800, 750);
+
+    QVBoxLayout *layout = new QVBoxLayout(corrDialog);
+
+    QCustomPlot *customPlot = new QCustomPlot(corrDialog);
+    layout->addWidget(customPlot);
+
+    int n = channels.size();
+    QCPColorMap *colorMap = new QCPColorMap(customPlot->xAxis, customPlot->yAxis);
+    colorMap->data()->setSize(n, n);
+    colorMap->data()->setRange(QCPRange(0, n - 1), QCPRange(0, n - 1));
+
+    QCPColorScale *colorScale = new QCPColorScale(customPlot);
+    customPlot->plotLayout()->addElement(0, 1, colorScale);
+    colorMap->setColorScale(colorScale);
+    colorMap->setGradient(QCPColorGradient::gpPolar);
+    colorMap->setDataRange(QCPRange(-1.0, 1.0));
+
+    // Channel labels on both axes
+    QSharedPointer<QCPAxisTickerText> ticker(new QCPAxisTickerText);
+    for (int i = 0; i < n; ++i) {
+        ticker->addTick(i, labels[i]);
+    }
+    customPlot->xAxis->setTicker(ticker);
+    customPlot->yAxis->setTicker(ticker);
+    customPlot->xAxis->setTickLabelRotation(60);
+    customPlot->yAxis->setRangeReversed(true);
+
+    QLabel *windowLabel = new QLabel(corrDialog);
+    layout->addWidget(windowLabel);
+
+    auto showMatrix = [=](int index) {
+        const Eigen::MatrixXd &corr = matrices[index];
+        for (int x = 0; x < n; ++x) {
+            for (int y = 0; y < n; ++y) {
+                colorMap->data()->setCell(x, y, corr(x, y));
+            }
+        }
+        if (index == 0) {
+            windowLabel->setText(QString("Visible range: %1 - %2 s")
+                .arg(windowTimes[0], 0, 'f', 2)
+                .arg(windowTimes[0] + numSamples / samplingRate, 0, 'f', 2));
+        } else {
+            windowLabel->setText(QString("Window %1 of %2: %3 - %4 s")
+                .arg(index).arg(matrices.size() - 1)
+                .arg(windowTimes[index], 0, 'f', 2)
+                .arg(windowTimes[index] + windowSamples / samplingRate, 0, 'f', 2));
+        }
+        customPlot->replot();
+    };
+
+    if (matrices.size() > 1) {
+        QSlider *windowSlider = new QSlider(Qt::Horizontal, corrDialog);
+        windowSlider->setRange(0, matrices.size() - 1);
+        windowSlider->setToolTip("0 = whole visible range, then 1 s sliding windows");
+        connect(windowSlider, &QSlider::valueChanged, corrDialog, showMatrix);
+        layout->addWidget(windowSlider);
+    }
+
+    customPlot->rescaleAxes();
+    showMatrix(0);
+
+    QPushButton *closeButton = new QPushButton("Close", corrDialog);
+    connect(closeButton, &QPushButton::clicked, corrDialog, &QDialog::accept);
+    layout->addWidget(closeButton);
+
+    corrDialog->show();
+}
+
+void MainWindow::showChannelLags() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    // Channels sharing the first channel's sampling rate, over the visible range
+    double samplingRate = m_eegData->channel(0).samplingRate;
+    qint64 startSample = static_cast<qint64>(m_chartView->currentStartTime() * samplingRate);
+    qint64 numSamples = static_cast<qint64>(m_chartView->currentDuration() * samplingRate);
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        const EEGChannel &channel = m_eegData->channel(i);
+        if (channel.samplingRate == samplingRate) channels.append(i);
+    }
+    for (int ch : channels) {
+        numSamples = std::min(numSamples, m_eegData->channel(ch).data.size() - startSample);
+    }
+    if (channels.size() < 2 || numSamples < 2) {
+        QMessageBox::warning(this, "Error", "Not enough data for cross-correlation");
+        return;
+    }
+
+    QVector<const double*> traces;
+    for (int ch : channels) traces.append(m_eegData->channel(ch).data.constData() + startSample);
+    QVector<QPair<int, int>> pairs;
+    for (int i = 0; i < channels.size(); ++i) {
+        for (int j = i + 1; j < channels.size(); ++j) pairs.append(qMakePair(i, j));
+    }
+
+    const double maxLagSeconds = 0.2;
+    int maxLag = static_cast<int>(maxLagSeconds * samplingRate);
+    QVector<SignalProcessor::LagEstimate> lags =
+        SignalProcessor::crossCorrelationLags(traces, numSamples, pairs, maxLag);
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Channel Lags");
+    dialog.resize(600, 500);
+
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel(QString("Peak |r| within +/-%1 ms, positive when the second channel trails")
+                                     .arg(maxLagSeconds * 1000.0, 0, 'f', 0)));
+
+    QTableWidget *table = new QTableWidget();
+    table->setColumnCount(4);
+    table->setHorizontalHeaderLabels({"First", "Second", "Lag (ms)", "r"});
+    table->setRowCount(lags.size());
+    for (int row = 0; row < lags.size(); ++row) {
+        const SignalProcessor::LagEstimate &lag = lags[row];
+        table->setItem(row, 0, new QTableWidgetItem(m_eegData->channel(channels[lag.first]).label));
+        table->setItem(row, 1, new QTableWidgetItem(m_eegData->channel(channels[lag.second]).label));
+        QTableWidgetItem *lagItem = new QTableWidgetItem();
+        lagItem->setData(Qt::DisplayRole, std::round(lag.refinedLag * 1000.0 / samplingRate * 10.0) / 10.0);
+        table->setItem(row, 2, lagItem);
+        QTableWidgetItem *rItem = new QTableWidgetItem();
+        rItem->setData(Qt::DisplayRole, std::round(lag.correlation * 1000.0) / 1000.0);
+        table->setItem(row, 3, rItem);
+    }
+    table->setSortingEnabled(true);
+    table->resizeColumnsToContents();
+    layout->addWidget(table);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    dialog.exec();
+}
+
+void MainWindow::onLoadElectrodePositions() {
+    QString filePath = QFileDialog::getOpenFileName(
+        nullptr,
+        QString("Load Electrode Positions"),
+        QDir::homePath(),
+        "Electrode Files (*.txt *.sfp *.xyz *.elp *.csv);;All Files (*)",
+        nullptr,
+        QFileDialog::DontUseNativeDialog
+    );
+    if (filePath.isEmpty()) return;
+
+    ElectrodeLayout layout;
+    if (!layout.loadFromFile(filePath)) {
+        QMessageBox::warning(this, "Error", "Could not read electrode positions from " + filePath);
+        return;
+    }
+    m_eegData->setElectrodeLayout(layout);
+    statusBar()->showMessage(QString("Loaded %1 electrode positions").arg(layout.size()), 3000);
+}
+
+void MainWindow::interpolateBadChannels() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Interpolate Bad Channels");
+    dialog.resize(300, 500);
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel("Channels to rebuild:"));
+
+    // Channels whose robust spread stands out are checked up front
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) channels.append(i);
+    QVector<int> deviant = RobustStats::deviantChannels(RobustStats::channelStats(*m_eegData, channels));
+
+    // Only channels with a known position can be interpolated
+    const ElectrodeLayout &positions = m_eegData->electrodeLayout();
+    QListWidget *list = new QListWidget();
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        QListWidgetItem *item = new QListWidgetItem(m_eegData->channel(i).label);
+        item->setData(Qt::UserRole, i);
+        if (positions.contains(m_eegData->channel(i).label)) {
+            item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+            bool suspect = m_eegData->channel(i).bad || deviant.contains(i);
+            item->setCheckState(suspect ? Qt::Checked : Qt::Unchecked);
+        } else {
+            item->setFlags(item->flags() & ~Qt::ItemIsEnabled);
+        }
+        list->addItem(item);
+    }
+    layout->addWidget(list);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    if (dialog.exec() != QDialog::Accepted) return;
+
+    QVector<int> bad;
+    for (int i = 0; i < list->count(); ++i) {
+        if (list->item(i)->checkState() == Qt::Checked) bad.append(list->item(i)->data(Qt::UserRole).toInt());
+    }
+    if (bad.isEmpty()) return;
+
+    if (!SphericalSpline::interpolateChannels(*m_eegData, bad)) {
+        QMessageBox::warning(this, "Error", "Interpolation failed, see the log for details");
+        return;
+    }
+
+    // Rebuilt channels are no longer bad
+    QVector<int> marked = m_eegData->badChannels();
+    for (int ch : bad) marked.removeAll(ch);
+    m_eegData->setBadChannels(marked);
+}
+
+void MainWindow::hideBadChannels() {
+    // Under a display montage, rows built from a bad channel go as well
+    QVector<int> visible;
+    for (int row : m_chartView->getVisibleChannels()) {
+        bool bad = false;
+        if (!m_eegData->hasDisplayMontage()) {
+            bad = row < m_eegData->channelCount() && m_eegData->channel(row).bad;
+        } else if (row < m_eegData->displayChannelCount()) {
+            const Montage::SparseMatrix &weights = m_eegData->displayMontage().weights();
+            for (Montage::SparseMatrix::InnerIterator it(weights, row); it; ++it) {
+                bad |= m_eegData->channel(it.col()).bad;
+            }
+        }
+        if (!bad) visible.append(row);
+    }
+    m_chartView->setVisibleChannels(visible);
+}
+
+void MainWindow::detectBadChannels() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) channels.append(i);
+
+    QVector<BadChannels::ChannelReport> reports = BadChannels::detect(*m_eegData, channels);
+    QVector<int> bad = BadChannels::badChannels(reports);
+    m_eegData->setBadChannels(bad);
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Bad Channels");
+    dialog.resize(700, 500);
+
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel(QString("%1 of %2 channels marked bad").arg(bad.size()).arg(reports.size())));
+
+    QTableWidget *table = new QTableWidget();
+    table->setColumnCount(7);
+    table->setHorizontalHeaderLabels({
+        "Channel", "Label", "Reasons", "Deviation z", "Noise z", "Uncorrelated %", "Unpredictable %"
+    });
+    table->setRowCount(reports.size());
+
+    for (int row = 0; row < reports.size(); ++row) {
+        const BadChannels::ChannelReport &report = reports[row];
+        table->setItem(row, 0, new QTableWidgetItem(QString::number(report.channel + 1)));
+        table->setItem(row, 1, new QTableWidgetItem(m_eegData->channel(report.channel).label));
+        table->setItem(row, 2, new QTableWidgetItem(BadChannels::reasonText(report.reasons)));
+        table->setItem(row, 3, new QTableWidgetItem(QString::number(report.deviationZ, 'f', 1)));
+        table->setItem(row, 4, new QTableWidgetItem(QString::number(report.noiseZ, 'f', 1)));
+        table->setItem(row, 5, new QTableWidgetItem(QString::number(100.0 * report.uncorrelatedFraction, 'f', 1)));
+        table->setItem(row, 6, new QTableWidgetItem(QString::number(100.0 * report.unpredictableFraction, 'f', 1)));
+    }
+
+    table->resizeColumnsToContents();
+    layout->addWidget(table);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+    QPushButton *hideBtn = buttons->addButton("Hide Bad", QDialogButtonBox::ActionRole);
+    hideBtn->setEnabled(!bad.isEmpty());
+    connect(hideBtn, &QPushButton::clicked, [this, &dialog]() {
+        hideBadChannels();
+        dialog.accept();
+    });
+
+    // Splines need a position, bad channels without one stay marked
+    QVector<int> repairable;
+    for (int ch : bad) {
+        if (m_eegData->electrodeLayout().contains(m_eegData->channel(ch).label)) repairable.append(ch);
+    }
+    QPushButton *interpolateBtn = buttons->addButton("Interpolate Bad", QDialogButtonBox::ActionRole);
+    interpolateBtn->setEnabled(!repairable.isEmpty());
+    connect(interpolateBtn, &QPushButton::clicked, [this, &dialog, &repairable]() {
+        if (!SphericalSpline::interpolateChannels(*m_eegData, repairable)) {
+            QMessageBox::warning(this, "Error", "Interpolation failed, see the log for details");
+            return;
+        }
+        QVector<int> marked = m_eegData->badChannels();
+        for (int ch : repairable) marked.removeAll(ch);
+        m_eegData->setBadChannels(marked);
+        dialog.accept();
+    });
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    dialog.exec();
+}
+
+void MainWindow::detectSpikes() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        if (!m_eegData->channel(i).bad) channels.append(i);
+    }
+
+    int count = SpikeDetection::detectInto(*m_eegData, channels);
+    statusBar()->showMessage(QString("Detected %1 spikes on %2 channels").arg(count).arg(channels.size()), 5000);
+}
+
+void MainWindow::detectSeizures() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        if (!m_eegData->channel(i).bad) channels.append(i);
+    }
+
+    int count = SeizureDetection::detectInto(*m_eegData, channels);
+    statusBar()->showMessage(QString("Detected %1 possible seizures").arg(count), 5000);
+}
+
+void MainWindow::showDirectedConnectivity() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    QStringList measures = {"Granger causality", "Partial directed coherence", "Directed transfer function"};
+    bool ok = false;
+    QString measure = QInputDialog::getItem(this, "Directed Connectivity", "Measure:", measures, 0, false, &ok);
+    if (!ok) return;
+
+    // Good channels sharing the first channel's sampling rate, one window over the visible range
+    double samplingRate = m_eegData->channel(0).samplingRate;
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        const EEGChannel &channel = m_eegData->channel(i);
+        if (!channel.bad && channel.samplingRate == samplingRate) channels.append(i);
+    }
+
+    MVAR::MVARParams params;
+    params.startTime = m_chartView->currentStartTime();
+    params.window = m_chartView->currentDuration();
+    params.step = params.window;
+    params.duration = params.window;
+    MVAR::DirectedConnectivity result = MVAR::directedConnectivity(*m_eegData, channels, params);
+    if (result.isEmpty() || !result.granger.first().allFinite()) {
+        QMessageBox::warning(this, "Error", "Not enough clean data in the visible range for an MVAR fit");
+        return;
+    }
+
+    const Eigen::MatrixXd &values = measure == measures[0] ? result.granger.first()
+                                  : measure == measures[1] ? result.pdc.first() : result.dtf.first();
+    showHeatmap(QString("%1 - order %2, %3 channels (target x source)").arg(measure).arg(result.order).arg(channels.size()),
+                values, 0, channels.size() - 1, 0, channels.size() - 1, "Source channel", "Target channel");
+}
+
+void MainWindow::fitMicrostates() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    // Good channels sharing the first channel's sampling rate
+    double samplingRate = m_eegData->channel(0).samplingRate;
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        const EEGChannel &channel = m_eegData->channel(i);
+        if (!channel.bad && channel.samplingRate == samplingRate) channels.append(i);
+    }
+
+    Microstates::MicrostateParams params;
+    params.numStates = m_microstateCountSpin->value();
+    params.minSegmentDuration = 0.03;
+    Microstates::MicrostateModel model = Microstates::fit(*m_eegData, channels, params);
+    if (model.isEmpty()) {
+        QMessageBox::warning(this, "Error", "Not enough channels or GFP peaks for microstates");
+        return;
+    }
+    Microstates::Segmentation segmentation = Microstates::backfit(model, *m_eegData, params);
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Microstates");
+    dialog.resize(700, 400);
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+    layout->addWidget(new QLabel(QString("%1 channels, %2 GFP peaks, GEV %3% on peaks, %4% on the recording")
+        .arg(channels.size()).arg(model.peakCount)
+        .arg(model.gev * 100.0, 0, 'f', 1).arg(segmentation.gev * 100.0, 0, 'f', 1)));
+
+    // One row per state, then the transition probabilities to every state
+    int numStates = model.stateCount();
+    QTableWidget *table = new QTableWidget(numStates, 6 + numStates);
+    QStringList headers = {"State", "GEV (%)", "Coverage (%)", "Mean duration (ms)", "Occurrence (/s)", "Mean GFP"};
+    for (int k = 0; k < numStates; ++k) headers.append(QString("To %1").arg(QChar('A' + k)));
+    table->setHorizontalHeaderLabels(headers);
+    for (int k = 0; k < numStates; ++k) {
+        const Microstates::StateStatistics &state = segmentation.states[k];
+        table->setItem(k, 0, new QTableWidgetItem(QString(QChar('A' + k))));
+        table->setItem(k, 1, new QTableWidgetItem(QString::number(state.gev * 100.0, 'f', 1)));
+        table->setItem(k, 2, new QTableWidgetItem(QString::number(state.coverage * 100.0, 'f', 1)));
+        table->setItem(k, 3, new QTableWidgetItem(QString::number(state.meanDuration * 1000.0, 'f', 1)));
+        table->setItem(k, 4, new QTableWidgetItem(QString::number(state.occurrence, 'f', 2)));
+        table->setItem(k, 5, new QTableWidgetItem(QString::number(state.meanGfp, 'g', 4)));
+        for (int j = 0; j < numStates; ++j) {
+            table->setItem(k, 6 + j, new QTableWidgetItem(QString::number(segmentation.transitions(k, j), 'f', 2)));
+        }
+    }
+    table->resizeColumnsToContents();
+    layout->addWidget(table);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+    dialog.exec();
+}
+
+void MainWindow::detectArtifacts() {
+    if (m_eegData->isEmpty()) {
+        QMessageBox::warning(this, "Error", "No data loaded");
+        return;
+    }
+
+    QVector<int> channels;
+    for (int i = 0; i < m_eegData->channelCount(); ++i) channels.append(i);
+
+    QVector<ArtifactDetection::ChannelArtifacts> results = ArtifactDetection::detect(*m_eegData, channels);
+
+    QDialog dialog(this);
+    dialog.setWindowTitle("Artifact Detection");
+    dialog.resize(800, 500);
+
+    QVBoxLayout *layout = new QVBoxLayout(&dialog);
+
+    // One row per channel: count per artifact type and total marked time
+    QTableWidget *table = new QTableWidget();
+    QStringList headers = {"Channel", "Label"};
+    for (int t = 0; t < ArtifactDetection::ArtifactTypeCount; ++t) {
+        headers.append(ArtifactDetection::typeName(static_cast<ArtifactDetection::ArtifactType>(t)));
+    }
+    headers.append("Marked (s)");
+    table->setColumnCount(headers.size());
+    table->setHorizontalHeaderLabels(headers);
+    table->setRowCount(results.size());
+
+    for (int row = 0; row < results.size(); ++row) {
+        const ArtifactDetection::ChannelArtifacts &result = results[row];
+        table->setItem(row, 0, new QTableWidgetItem(QString::number(result.channel + 1)));
+        table->setItem(row, 1, new QTableWidgetItem(m_eegData->channel(result.channel).label));
+        for (int t = 0; t < ArtifactDetection::ArtifactTypeCount; ++t) {
+            int count = result.count(static_cast<ArtifactDetection::ArtifactType>(t));
+            table->setItem(row, 2 + t, new QTableWidgetItem(QString::number(count)));
+        }
+
+        double marked = 0.0;
+        for (int i = 0; i < result.intervals.size(); ++i) {
+            marked += result.endTime(i) - result.startTime(i);
+        }
+        table->setItem(row, headers.size() - 1, new QTableWidgetItem(QString::number(marked, 'f', 2)));
+    }
+
+    table->resizeColumnsToContents();
+    layout->addWidget(table);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Close);
+    QPushButton *rejectBtn = buttons->addButton("Reject Marked Segments", QDialogButtonBox::ActionRole);
+    rejectBtn->setToolTip("Exclude the marked time ranges from spectra and export");
+    connect(rejectBtn, &QPushButton::clicked, [this, &results, &dialog]() {
+        IntervalSet marked = ArtifactDetection::toIntervalSet(results);
+        m_eegData->setRejectedIntervals(m_eegData->rejectedIntervals().united(marked));
+        dialog.accept();
+    });
+    connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttons);
+
+    dialog.exec();
+}
@@ -12,10 +12,13 @@
 #include <QSpinBox>
 #include <QDoubleSpinBox>
 #include <QComboBox>
+#include <QCheckBox>
 #include <QLabel>
 #include <QProgressBar>
 #include "../DataModels/EEGData.h"
 #include "../Visualization/EEGChartView.h"
+#include "../Visualization/EventTableModel.h"
+#include <QTableView>
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -37,7 +40,9 @@ private slots:
     void onOffsetApply();
     void onNormalizeApply();
     void onDCRemoveApply();
+    void onBaselineApply();
     void onNotchFilterApply();
+    void onResampleApply();
     void onMontageApply();
     void onResetMontage();
 
@@ -53,6 +58,20 @@ private slots:
     void showPowerSpectrum(int channelIndex, int windowSizeIndex);
     void showBandPower(int channelIndex);
     void showSpectrogram(int channelIndex);
+    void showComodulogram(int channelIndex);
+    void showERSP(int channelIndex);
+    void showComplexityTrend(int channelIndex);
+    void showCorrelationMatrix();
+    void showChannelLags();
+    void showDirectedConnectivity();
+    void fitMicrostates();
+    void detectArtifacts();
+    void detectBadChannels();
+    void hideBadChannels();
+    void interpolateBadChannels();
+    void detectSpikes();
+    void detectSeizures();
+    void onLoadElectrodePositions();
 
 signals:
     void channelCountChanged(int newCount);
@@ -66,6 +85,10 @@ private:
     void createStatusBar();
 
     void onChannelItemChanged(QListWidgetItem *item);
+    Wavelet::DenoiseParams waveletParams() const;
+    void showHeatmap(const QString &title, const Eigen::MatrixXd &values,
+                     double xMin, double xMax, double yMin, double yMax,
+                     const QString &xLabel, const QString &yLabel);
     
 private:
     // Core data and view
@@ -79,6 +102,10 @@ private:
     QDockWidget *m_processingDock;
     QWidget *m_processingWidget;
 
+    QDockWidget *m_eventDock;
+    QTableView *m_eventTable;
+    EventTableModel *m_eventModel;
+
     QToolBar *m_panelToolBar;
     
     // Processing controls
@@ -87,9 +114,20 @@ private:
     QDoubleSpinBox *m_highCutSpin;
     QDoubleSpinBox *m_gainSpin;
     QDoubleSpinBox *m_offsetSpin;
+    QComboBox *m_baselineModeCombo;
+    QDoubleSpinBox *m_baselineWindowSpin;
+    QSpinBox *m_baselineOrderSpin;
     QComboBox *m_notchFreqCombo;
+    QComboBox *m_notchMethodCombo;
+    QComboBox *m_notchReferenceCombo;
+    QDoubleSpinBox *m_resampleRateSpin;
+    QComboBox *m_waveletCombo;
+    QComboBox *m_waveletRuleCombo;
+    QSpinBox *m_waveletLevelsSpin;
     QComboBox *m_montageCombo;
     QSpinBox *m_channelSelectSpin;
+    QCheckBox *m_seizureOnLoadCheck;
+    QSpinBox *m_microstateCountSpin;
     
     // Display controls
     QDoubleSpinBox *m_timeStartSpin;
@@ -101,11 +139,13 @@ private:
     QAction *m_actOpen;
     QAction *m_actSave;
     QAction *m_actSaveAs;
+    QAction *m_actLoadPositions;
     QAction *m_actExit;
     
     QAction *m_actShowGrid;
     QAction *m_actShowChannels;
     QAction *m_actShowProcessing; 
+    QAction *m_actShowEvents;
     QAction *m_actZoomIn;
     QAction *m_actZoomOut;
     QAction *m_actPanLeft;
@@ -0,0 +1,64 @@
+#pragma once
+#include <QThread>
+#include <QtGlobal>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+inline int threadCount() {
+    return std::max(1, QThread::idealThreadCount());
+}
+
+// Set while a thread is running parallelFor work, so nested calls stay serial
+// instead of oversubscribing the machine.
+inline bool &insideWorker() {
+    thread_local bool inside = false;
+    return inside;
+}
+
+// Calls fn(i) for every i in [begin, end). Indices are handed out one at a time
+// from a shared counter, so uneven work items balance across threads.
+template <typename Fn>
+void parallelFor(int begin, int end, Fn &&fn, int maxThreads = 0) {
+    int count = end - begin;
+    if (count <= 0) return;
+
+    int threads = maxThreads > 0 ? maxThreads : threadCount();
+    threads = std::min(threads, count);
+
+    if (threads <= 1 || insideWorker()) {
+        for (int i = begin; i < end; ++i) fn(i);
+        return;
+    }
+
+    std::atomic<int> next(begin);
+    auto worker = [&]() {
+        bool wasInside = insideWorker();
+        insideWorker() = true;
+        for (int i = next++; i < end; i = next++) fn(i);
+        insideWorker() = wasInside;
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto &thread : pool) thread.join();
+}
+
+// Splits [0, total) into blocks of blockSize and calls fn(start, length) for each
+// block in parallel.
+template <typename Fn>
+void parallelForBlocks(qint64 total, qint64 blockSize, Fn &&fn, int maxThreads = 0) {
+    if (total <= 0 || blockSize <= 0) return;
+    int blocks = static_cast<int>((total + blockSize - 1) / blockSize);
+    parallelFor(0, blocks, [&](int b) {
+        qint64 start = b * blockSize;
+        fn(start, std::min(blockSize, total - start));
+    }, maxThreads);
+}
+
+}
@@ -3,6 +3,7 @@
 #include <Eigen/Dense>
 #include <iir/Butterworth.h>
 #include <QVector>
+#include <QPair>
 #include <QDebug>
 #include <cmath>
 #include <algorithm>
@@ -10,6 +11,13 @@
 #include <vector>
 #include <complex>
 #include <memory>
+#include <map>
+#include <set>
+#include <mutex>
+#include <limits>
+#include "../DataModels/IntervalSet.h"
+#include "../DataModels/ValidityMask.h"
+#include "Parallel.h"
 
 namespace SignalProcessor {
 
@@ -123,6 +131,176 @@ inline void notchFilter(QVector<double> &data, double samplingRate, double notch
     data = y;
 }
 
+// ================== ADAPTIVE LINE-NOISE CANCELLER ==================
+
+enum LineCancellerMethod {
+    LineCancellerLMS,      // normalized LMS, cheap, slower to converge
+    LineCancellerRLS       // exponentially weighted RLS, converges in a few cycles
+};
+
+struct LineCancellerParams {
+    double lineFrequency = 50.0;        // Hz
+    int harmonics = 3;                  // fundamental and overtones below Nyquist, at most MaxHarmonics
+    LineCancellerMethod method = LineCancellerRLS;
+    double stepSize = 0.01;             // LMS, normalized step
+    double forgetting = 0.999;          // RLS, memory about 1 / (1 - forgetting) samples
+    double referenceQ = 30.0;           // reference channel, band-pass Q per harmonic
+    bool trackFrequency = true;         // synthesized reference follows mains drift
+    double maxDrift = 0.5;              // Hz, bound on the tracked offset
+};
+
+// Subtracts the line component the weights predict from a reference, one
+// in-phase and one quadrature tap per harmonic, and adapts the weights to
+// minimize what is left. Unlike the notch it only removes the part coherent
+// with the reference, so EEG power at the line frequency largely survives,
+// and it has no long ringing on transients. The reference is either a
+// synthesized sinusoid per harmonic or a channel with mains pickup,
+// band-passed around each harmonic. A synthesized reference slightly off the
+// true mains frequency shows up as steadily rotating weights; with
+// trackFrequency that rotation is fed back into the oscillator, a simple
+// frequency-locked loop, so the weights settle instead. All state is kept between process() calls,
+// so consecutive blocks of a stream give the same output as one long call.
+class LineNoiseCanceller {
+public:
+    static constexpr int MaxHarmonics = 4;
+    static constexpr int MaxTaps = 2 * MaxHarmonics;
+    using Taps = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MaxTaps, 1>;
+    using TapMatrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MaxTaps, MaxTaps>;
+
+    LineNoiseCanceller(double samplingRate, const LineCancellerParams &params = LineCancellerParams())
+        : m_params(params) {
+        m_harmonics = 0;
+        for (int h = 1; h <= std::min(params.harmonics, MaxHarmonics); ++h) {
+            if (h * params.lineFrequency < samplingRate / 2) m_harmonics = h;
+        }
+        m_omega = 2.0 * M_PI * params.lineFrequency / samplingRate;
+        m_maxOffset = 2.0 * M_PI * params.maxDrift / samplingRate;
+        m_rotation.resize(m_harmonics);
+        m_resonators.resize(m_harmonics);
+        for (int h = 0; h < m_harmonics; ++h) {
+            double w = (h + 1) * m_omega;
+
+            // Constant 0 dB peak band-pass, RBJ cookbook
+            double alpha = std::sin(w) / (2.0 * params.referenceQ);
+            Resonator &r = m_resonators[h];
+            r.b0 = alpha / (1.0 + alpha);
+            r.a1 = -2.0 * std::cos(w) / (1.0 + alpha);
+            r.a2 = (1.0 - alpha) / (1.0 + alpha);
+        }
+        reset();
+    }
+
+    int harmonicCount() const { return m_harmonics; }
+
+    void reset() {
+        int taps = 2 * m_harmonics;
+        m_weights = Taps::Zero(taps);
+        m_inverse = TapMatrix::Identity(taps, taps) * 100.0;
+        m_phasors.fill(std::complex<double>(1.0, 0.0), m_harmonics);
+        for (Resonator &r : m_resonators) r.x1 = r.x2 = r.y1 = r.y2 = 0.0;
+        setOffset(0.0);
+        m_lastAngle = 0.0;
+        m_count = 0;
+    }
+
+    // x in place; reference, when given, is the same stretch of the reference
+    // channel. Non-finite samples pass through and do not adapt the weights.
+    void process(double *x, qint64 n, const double *reference = nullptr) {
+        if (m_harmonics == 0) return;
+        int taps = 2 * m_harmonics;
+        Taps u(taps);
+        Taps gain(taps);
+        const double lambda = m_params.forgetting;
+
+        for (qint64 i = 0; i < n; ++i) {
+            referenceTaps(u, reference ? reference[i] : 0.0, reference != nullptr);
+
+            // Keep the recursion honest: P symmetric, phasors on the unit circle
+            if (++m_count % 4096 == 0) {
+                m_inverse = (0.5 * (m_inverse + m_inverse.transpose())).eval();
+                for (std::complex<double> &phasor : m_phasors) phasor /= std::abs(phasor);
+            }
+            if (!reference && m_params.trackFrequency && m_count % TrackInterval == 0) trackFrequency();
+
+            if (!std::isfinite(x[i])) continue;
+            double error = x[i] - m_weights.dot(u);
+            x[i] = error;
+
+            if (m_params.method == LineCancellerRLS) {
+                gain.noalias() = m_inverse * u;
+                double denominator = lambda + u.dot(gain);
+                gain /= denominator;
+                m_weights.noalias() += error * gain;
+                m_inverse.noalias() -= gain * (u.transpose() * m_inverse);
+                m_inverse /= lambda;
+            } else {
+                m_weights.noalias() += (m_params.stepSize * error / (1e-12 + u.squaredNorm())) * u;
+            }
+        }
+    }
+
+private:
+    static constexpr int TrackInterval = 64;     // samples between frequency updates
+
+    struct Resonator {
+        double b0 = 0.0, a1 = 0.0, a2 = 0.0;
+        double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0;
+    };
+
+    // Two taps per harmonic: cos and sin of the synthesized phase, or the
+    // band-passed reference and its previous sample
+    void referenceTaps(Taps &u, double sample, bool fromChannel) {
+        if (!fromChannel) {
+            for (int h = 0; h < m_harmonics; ++h) {
+                u[2 * h] = m_phasors[h].real();
+                u[2 * h + 1] = m_phasors[h].imag();
+                m_phasors[h] *= m_rotation[h];
+            }
+            return;
+        }
+
+        if (!std::isfinite(sample)) sample = 0.0;
+        for (int h = 0; h < m_harmonics; ++h) {
+            Resonator &r = m_resonators[h];
+            double y = r.b0 * (sample - r.x2) - r.a1 * r.y1 - r.a2 * r.y2;
+            r.x2 = r.x1;
+            r.x1 = sample;
+            u[2 * h] = y;
+            u[2 * h + 1] = r.y1;
+            r.y2 = r.y1;
+            r.y1 = y;
+        }
+    }
+
+    void setOffset(double offset) {
+        m_offset = std::max(-m_maxOffset, std::min(m_maxOffset, offset));
+        for (int h = 0; h < m_harmonics; ++h) m_rotation[h] = std::polar(1.0, (h + 1) * (m_omega + m_offset));
+    }
+
+    // Output w0 cos(phi) + w1 sin(phi) = A cos(phi - theta): a reference
+    // running slow by d makes theta fall by d per sample
+    void trackFrequency() {
+        if (m_weights.head<2>().squaredNorm() < 1e-12) return;
+        double angle = std::atan2(m_weights[1], m_weights[0]);
+        double step = std::remainder(angle - m_lastAngle, 2.0 * M_PI);
+        m_lastAngle = angle;
+        setOffset(m_offset - 0.3 * step / TrackInterval);
+    }
+
+    LineCancellerParams m_params;
+    int m_harmonics;
+    double m_omega;                               // radians per sample, fundamental
+    double m_offset;                              // tracked drift, radians per sample
+    double m_maxOffset;
+    double m_lastAngle;
+    Taps m_weights;
+    TapMatrix m_inverse;                          // RLS inverse correlation matrix
+    QVector<std::complex<double>> m_phasors;      // synthesized reference per harmonic
+    QVector<std::complex<double>> m_rotation;
+    QVector<Resonator> m_resonators;              // reference channel band-pass per harmonic
+    qint64 m_count;                               // samples processed
+};
+
 // ================== STATISTICS ==================
 
 inline double mean(const QVector<double> &data) {
@@ -151,302 +329,129 @@ inline double maxValue(const QVector<double> &data) {
     return *std::max_element(data.begin(), data.end());
 }
 
-// ================== MONTAGES ==================
-inline void applyAverageReference(QVector<QVector<double>> &allChannelData) {
-    if (allChannelData.isEmpty()) {
-        qWarning() << "Average Reference: No data";
-        return;
-    }
-    
-    int numSamples = allChannelData[0].size();
-    int numChannels = allChannelData.size();
-    
-    if (numChannels == 0 || numSamples == 0) {
-        qWarning() << "Average Reference: Invalid dimensions";
-        return;
-    }
-    
-    QVector<double> average(numSamples, 0.0);
-    
-    // Compute average at each time point
-    for (int s = 0; s < numSamples; ++s) {
-        double sum = 0.0;
-        int validChannels = 0;
-        bool hasValidData = false;
-        
-        for (int ch = 0; ch < numChannels; ++ch) {
-            double val = allChannelData[ch][s];
-            
-            if (std::isfinite(val)) {  // isfinite checks for both NaN and Inf
-                sum += val;
-                validChannels++;
-                hasValidData = true;
-            } else {
-                // Replace invalid value with 0 to prevent propagation
-                allChannelData[ch][s] = 0.0;
-            }
-        }
-        
-        if (validChannels > 0 && hasValidData) {
-            average[s] = sum / validChannels;
+// ================== MASKED KERNELS ==================
+// Invalid samples (see ValidityMask) are left out instead of poisoning the
+// result. Clean chunks run without any per-sample test, dirty ones through
+// vectorized selects. A mask whose size does not match the data is ignored.
+
+struct Moments {
+    qint64 count = 0;
+    double mean = 0.0;
+    double variance = 0.0;      // population
+    double min = 0.0;
+    double max = 0.0;
+};
+
+// Chunk moments merged pairwise (Chan et al.), so long recordings keep precision
+inline Moments moments(const double *x, qint64 n, const ValidityMask &mask) {
+    const qint64 chunkSize = ValidityMask::ChunkSize;
+    bool masked = mask.size() == n && !mask.allValid();
+    Eigen::ArrayXd valid(masked ? chunkSize : 0);
+
+    Moments total;
+    double totalM2 = 0.0;
+    for (qint64 start = 0; start < n; start += chunkSize) {
+        qint64 count = std::min(chunkSize, n - start);
+        Eigen::Map<const Eigen::ArrayXd> values(x + start, count);
+
+        qint64 c;
+        double m, m2, lo, hi;
+        if (!masked || mask.chunkValid(start / chunkSize)) {
+            c = count;
+            m = values.mean();
+            m2 = (values - m).square().sum();
+            lo = values.minCoeff();
+            hi = values.maxCoeff();
         } else {
-            average[s] = 0.0;
+            mask.weights(start, count, valid.data());
+            auto keep = valid.head(count) > 0.0;
+            c = static_cast<qint64>(valid.head(count).sum());
+            if (c == 0) continue;
+            m = keep.select(values, 0.0).sum() / c;
+            m2 = keep.select(values - m, 0.0).square().sum();
+            lo = keep.select(values, std::numeric_limits<double>::infinity()).minCoeff();
+            hi = keep.select(values, -std::numeric_limits<double>::infinity()).maxCoeff();
         }
-        
-        // Ensure average itself is valid
-        if (!std::isfinite(average[s])) {
-            average[s] = 0.0;
-        }
-    }
-    
-    // Subtract average from each channel
-    for (int ch = 0; ch < numChannels; ++ch) {
-        for (int s = 0; s < numSamples; ++s) {
-            double original = allChannelData[ch][s];
-            double result = original - average[s];
-            
-            // Check if result is valid
-            if (std::isfinite(result)) {
-                allChannelData[ch][s] = result;
-            } else {
-                qDebug() << "NaN detected in channel" << ch << "at sample" << s 
-                         << "original:" << original << "avg:" << average[s];
-                allChannelData[ch][s] = 0.0;
-            }
+
+        if (total.count == 0) {
+            total.min = lo;
+            total.max = hi;
+        } else {
+            total.min = std::min(total.min, lo);
+            total.max = std::max(total.max, hi);
         }
+        qint64 merged = total.count + c;
+        double delta = m - total.mean;
+        total.mean += delta * c / merged;
+        totalM2 += m2 + delta * delta * static_cast<double>(total.count) * c / merged;
+        total.count = merged;
     }
+    if (total.count > 0) total.variance = totalM2 / total.count;
+    return total;
 }
 
-inline int findChannelIndex(const QVector<QString> &labels, const QString &name) {
-    for (int i = 0; i < labels.size(); ++i) {
-        if (labels[i].contains(name, Qt::CaseInsensitive)) {
-            return i;
-        }
-    }
-    return -1;
+inline Moments moments(const QVector<double> &data, const ValidityMask &mask) {
+    return moments(data.constData(), data.size(), mask);
 }
 
-inline void applyBipolarMontage(QVector<QVector<double>> &allChannelData,
-                                const QVector<QString> &channelLabels) {
-    if (allChannelData.size() < 2) {
-        qWarning() << "Bipolar Montage: Need at least 2 channels, have" << allChannelData.size();
-        return;
-    }
-    
-    qDebug() << "Generating bipolar pairs from" << channelLabels.size() << "channels";
-    
-    QVector<QPair<int, int>> pairs;
-    
-    // Pair adjacent channels by numeric suffix
-    QMap<QString, QVector<int>> channelGroups;
-    
-    for (int i = 0; i < channelLabels.size(); ++i) {
-        QString label = channelLabels[i];
-        
-        // Extract base name (remove numbers)
-        QString baseName = label;
-        while (!baseName.isEmpty() && baseName.back().isDigit()) {
-            baseName.chop(1);
-        }
-        
-        channelGroups[baseName].append(i);
-    }
-    
-    // Pair channels within the same group (e.g., F3 with F4, C3 with C4)
-    for (const auto &group : channelGroups) {
-        const QVector<int> &indices = group;
-        
-        // Pair odd/even numbered channels
-        QVector<int> left, right;
-        for (int idx : indices) {
-            QString label = channelLabels[idx];
-            if (label.contains('3') || label.contains('1') || label.contains('5') || 
-                label.contains('7') || label.contains('9')) {
-                left.append(idx);
-            } else if (label.contains('4') || label.contains('2') || label.contains('6') || 
-                      label.contains('8') || label.contains('0')) {
-                right.append(idx);
-            }
-        }
-        
-        // Pair left and right channels
-        for (int i = 0; i < qMin(left.size(), right.size()); ++i) {
-            pairs.append({left[i], right[i]});
-            qDebug() << "Created bipolar pair:" << channelLabels[left[i]] 
-                     << "-" << channelLabels[right[i]];
-        }
-    }
-    
-    if (pairs.isEmpty()) {
-        qDebug() << "No pattern-based pairs found, using consecutive channels";
-        for (int i = 0; i < channelLabels.size() - 1; ++i) {
-            pairs.append({i, i+1});
-            qDebug() << "Created consecutive pair:" << channelLabels[i] 
-                     << "-" << channelLabels[i+1];
-        }
-    }
-    
-    if (pairs.isEmpty()) {
-        qWarning() << "Bipolar Montage: Could not create any pairs";
-        return;
-    }
-    
-    // Calculate bipolar channels
-    QVector<QVector<double>> bipolarData;
-    int numSamples = allChannelData[0].size();
-    
-    for (const auto &pair : pairs) {
-        int idx1 = pair.first;
-        int idx2 = pair.second;
-        
-        QVector<double> diff(numSamples, 0.0);
-        bool hasValidData = false;
-        
-        for (int j = 0; j < numSamples; ++j) {
-            double val1 = allChannelData[idx1][j];
-            double val2 = allChannelData[idx2][j];
-            
-            if (std::isfinite(val1) && std::isfinite(val2)) {
-                diff[j] = val1 - val2;
-                hasValidData = true;
-            } else {
-                diff[j] = 0.0;
-            }
-        }
-        
-        if (hasValidData) {
-            bipolarData.append(diff);
-        }
-    }
-    
-    if (!bipolarData.isEmpty()) {
-        allChannelData = bipolarData;
-        qDebug() << "Bipolar montage created" << bipolarData.size() << "channels";
-    } else {
-        qWarning() << "Bipolar Montage: No valid bipolar data generated";
-    }
+inline double mean(const QVector<double> &data, const ValidityMask &mask) {
+    return moments(data, mask).mean;
 }
 
-inline void applyLaplacianMontage(QVector<QVector<double>> &allChannelData) {
-    if (allChannelData.size() < 3) {
-        qWarning() << "Laplacian Montage: Need at least 3 channels, have" << allChannelData.size();
-        return;
-    }
-    
-    // First, clean the input data
-    for (int ch = 0; ch < allChannelData.size(); ++ch) {
-        for (int s = 0; s < allChannelData[ch].size(); ++s) {
-            if (!std::isfinite(allChannelData[ch][s])) {
-                allChannelData[ch][s] = 0.0;
-            }
-        }
-    }
-    
-    QVector<QVector<double>> laplacianData = allChannelData;
-    int numChannels = allChannelData.size();
-    int numSamples = allChannelData[0].size();
-    int nanCount = 0;
-    
-    for (int s = 0; s < numSamples; ++s) {
-        for (int ch = 0; ch < numChannels; ++ch) {
-            double neighborSum = 0.0;
-            int neighborCount = 0;
-            
-            // Check left neighbor
-            if (ch > 0) {
-                double val = allChannelData[ch-1][s];
-                if (std::isfinite(val)) {
-                    neighborSum += val;
-                    neighborCount++;
-                }
-            }
-            
-            // Check right neighbor
-            if (ch < numChannels - 1) {
-                double val = allChannelData[ch+1][s];
-                if (std::isfinite(val)) {
-                    neighborSum += val;
-                    neighborCount++;
-                }
-            }
-            
-            double currentVal = allChannelData[ch][s];
-            
-            if (neighborCount > 0 && std::isfinite(currentVal)) {
-                double neighborAvg = neighborSum / neighborCount;
-                // Ensure neighborAvg is finite
-                if (std::isfinite(neighborAvg)) {
-                    laplacianData[ch][s] = currentVal - neighborAvg;
-                } else {
-                    laplacianData[ch][s] = currentVal;
-                    nanCount++;
-                }
-            } else {
-                laplacianData[ch][s] = std::isfinite(currentVal) ? currentVal : 0.0;
-            }
-            
-            // Final safety check
-            if (!std::isfinite(laplacianData[ch][s])) {
-                laplacianData[ch][s] = 0.0;
-                nanCount++;
-            }
-        }
-    }
-    
-    allChannelData = laplacianData;
-    
-    if (nanCount > 0) {
-        qDebug() << "Laplacian montage applied with" << nanCount << "NaN corrections";
-    } else {
-        qDebug() << "Laplacian montage applied successfully";
-    }
+inline double standardDeviation(const QVector<double> &data, const ValidityMask &mask) {
+    Moments m = moments(data, mask);
+    return m.count < 2 ? 0.0 : std::sqrt(m.variance);
 }
 
-enum MontageType {
-    MontageBipolar,
-    MontageAverageReference,
-    MontageLaplacian
-};
+// Affine rescales leave invalid samples invalid, only the statistics need the mask
+inline void normalize(QVector<double> &data, const ValidityMask &mask, double minVal = 0.0, double maxVal = 1.0) {
+    Moments m = moments(data, mask);
+    double range = m.max - m.min;
+    if (m.count == 0 || range <= 0) return;
+
+    Eigen::Map<Eigen::ArrayXd> values(data.data(), data.size());
+    values = minVal + (values - m.min) * ((maxVal - minVal) / range);
+}
+
+inline void removeDC(QVector<double> &data, const ValidityMask &mask) {
+    if (data.isEmpty()) return;
+    Eigen::Map<Eigen::ArrayXd>(data.data(), data.size()) -= mean(data, mask);
+}
+
+// Invalid runs bridged by a straight line between their valid neighbours
+// (held at the ends), so a recursive filter can run across a gap
+inline void bridgeInvalid(double *x, qint64 n, const ValidityMask &mask) {
+    if (mask.size() != n || mask.allValid() || mask.invalidCount() == n) return;
+    mask.forEachInvalidRun([&](qint64 start, qint64 length) {
+        qint64 end = start + length;
+        double before = start > 0 ? x[start - 1] : x[end];
+        double after = end < n ? x[end] : before;
+        double step = (after - before) / (length + 1);
+        for (qint64 i = 0; i < length; ++i) x[start + i] = before + step * (i + 1);
+    });
+}
 
-inline void applyMontage(QVector<QVector<double>> &allChannelData, 
-                        const QVector<QString> &channelLabels,
-                        MontageType montage) {
-    if (allChannelData.isEmpty()) {
-        qWarning() << "Montage: No data";
+// Marks the masked samples invalid again after bridgeInvalid
+inline void restoreInvalid(double *x, qint64 n, const ValidityMask &mask) {
+    if (mask.size() != n) return;
+    mask.forEachInvalidRun([&](qint64 start, qint64 length) {
+        std::fill(x + start, x + start + length, std::numeric_limits<double>::quiet_NaN());
+    });
+}
+
+// Runs filter(data) with the invalid samples bridged, then restores them.
+// Clean channels go straight to the filter.
+template <typename Fn>
+void filterMasked(QVector<double> &data, const ValidityMask &mask, Fn &&filter) {
+    if (mask.size() != data.size() || mask.allValid()) {
+        filter(data);
         return;
     }
+    if (mask.invalidCount() == data.size()) return;
 
-    for (int ch = 0; ch < allChannelData.size(); ++ch) {
-        for (int s = 0; s < allChannelData[ch].size(); ++s) {
-            if (std::isnan(allChannelData[ch][s])) {
-                qDebug() << "NaN found in input - channel" << ch << "sample" << s;
-                allChannelData[ch][s] = 0.0; 
-            }
-        }
-    }
-    
-    qDebug() << "Applying montage type:" << montage;
-    
-    switch (montage) {
-        case MontageAverageReference:
-            applyAverageReference(allChannelData);
-            break;
-        case MontageBipolar:
-            applyBipolarMontage(allChannelData, channelLabels);
-            break;
-        case MontageLaplacian:
-            applyLaplacianMontage(allChannelData);
-            break;
-        default:
-            qWarning() << "Unknown montage type";
-            return;
-    }
-    
-    // Final validation
-    if (!allChannelData.isEmpty()) {
-        qDebug() << "Montage complete. Channels:" << allChannelData.size() 
-                 << "Samples:" << allChannelData[0].size();
-    }
+    bridgeInvalid(data.data(), data.size(), mask);
+    filter(data);
+    restoreInvalid(data.data(), data.size(), mask);
 }
 
 // ================== FREQUENCY ANALYSIS ==================
@@ -482,6 +487,57 @@ inline QVector<double> powerSpectrum(const QVector<double> &data, double samplin
     return spectrum;
 }
 
+// Welch PSD over the clean segments of a channel, one-sided density in unit^2/Hz.
+// Hann windows advance by segmentLength * (1 - overlap) and never straddle a
+// rejected gap. Bin i is at i * samplingRate / segmentLength.
+inline QVector<double> welchPowerSpectrum(const CleanView &view, int segmentLength, double overlap = 0.5) {
+    QVector<double> psd;
+    double samplingRate = view.samplingRate();
+    if (segmentLength < 2 || samplingRate <= 0) return psd;
+
+    int hop = std::max(1, static_cast<int>(segmentLength * (1.0 - overlap)));
+    int numBins = segmentLength / 2 + 1;
+
+    QVector<double> window(segmentLength);
+    double windowPower = 0.0;
+    for (int i = 0; i < segmentLength; ++i) {
+        window[i] = 0.5 * (1.0 - std::cos(2.0 * M_PI * i / (segmentLength - 1)));
+        windowPower += window[i] * window[i];
+    }
+
+    double *in = fftw_alloc_real(segmentLength);
+    fftw_complex *out = fftw_alloc_complex(numBins);
+    fftw_plan plan = fftw_plan_dft_r2c_1d(segmentLength, in, out, FFTW_ESTIMATE);
+
+    psd.fill(0.0, numBins);
+    int numSegments = 0;
+    for (int s = 0; s < view.segmentCount(); ++s) {
+        const double *x = view.segmentData(s);
+        for (qint64 start = 0; start + segmentLength <= view.segmentLength(s); start += hop) {
+            double segmentMean = 0.0;
+            for (int i = 0; i < segmentLength; ++i) segmentMean += x[start + i];
+            segmentMean /= segmentLength;
+            for (int i = 0; i < segmentLength; ++i) in[i] = (x[start + i] - segmentMean) * window[i];
+
+            fftw_execute(plan);
+            for (int b = 0; b < numBins; ++b) psd[b] += out[b][0] * out[b][0] + out[b][1] * out[b][1];
+            ++numSegments;
+        }
+    }
+
+    fftw_destroy_plan(plan);
+    fftw_free(in);
+    fftw_free(out);
+
+    if (numSegments == 0) return QVector<double>();
+
+    for (int b = 0; b < numBins; ++b) {
+        bool isEdge = (b == 0) || (segmentLength % 2 == 0 && b == numBins - 1);
+        psd[b] *= (isEdge ? 1.0 : 2.0) / (numSegments * windowPower * samplingRate);
+    }
+    return psd;
+}
+
 struct BandPower {
     double delta;    // 0.5-4 Hz
     double theta;    // 4-8 Hz  
@@ -518,6 +574,667 @@ inline void removeDC(QVector<double> &data) {
     for (auto &val : data) val -= mean;
 }
 
+// ================== CROSS-CORRELATION ==================
+
+// Smallest n' >= n of the form 2^a 3^b 5^c, sizes FFTW transforms fastest
+inline int fftSize(qint64 n) {
+    qint64 best = 1;
+    while (best < n) best *= 2;
+    for (qint64 p5 = 1; p5 < best; p5 *= 5) {
+        for (qint64 p35 = p5; p35 < best; p35 *= 3) {
+            qint64 size = p35;
+            while (size < n) size *= 2;
+            best = std::min(best, size);
+        }
+    }
+    return static_cast<int>(best);
+}
+
+struct LagEstimate {
+    int first = -1;              // index into the trace list
+    int second = -1;
+    int lag = 0;                 // samples, positive when second trails first
+    double refinedLag = 0.0;     // parabola through the peak and its neighbours
+    double correlation = 0.0;    // normalized, signed, at the peak
+};
+
+// Normalized cross-correlation r[k] = sum x[i] y[i + k] / (|x| |y|) of
+// equal-length signals, k in [-maxLag, maxLag], for every requested pair
+// (indices into traces). Traces are demeaned over their finite samples and
+// non-finite samples count as zero. Each trace is transformed once, padded
+// past maxLag so no lag wraps; the spectrum products of batchSize pairs go
+// back through one many-transform inverse, batches in parallel. The peak is
+// the largest |r|, or the largest r when absolutePeak is false. curves, when
+// given, receives each pair's r from -maxLag to maxLag.
+inline QVector<LagEstimate> crossCorrelationLags(const QVector<const double*> &traces, qint64 length,
+                                                 const QVector<QPair<int, int>> &pairs, int maxLag,
+                                                 bool absolutePeak = true,
+                                                 QVector<QVector<double>> *curves = nullptr,
+                                                 int batchSize = 16) {
+    QVector<LagEstimate> results;
+    if (length < 2 || maxLag < 0 || pairs.isEmpty()) return results;
+    for (const QPair<int, int> &pair : pairs) {
+        if (pair.first < 0 || pair.first >= traces.size() || pair.second < 0 || pair.second >= traces.size()) {
+            qWarning() << "Cross-correlation: Invalid pair" << pair.first << pair.second;
+            return results;
+        }
+    }
+
+    maxLag = static_cast<int>(std::min<qint64>(maxLag, length - 1));
+    int size = fftSize(length + maxLag);
+    int numBins = size / 2 + 1;
+    int numPairs = pairs.size();
+    batchSize = std::max(1, std::min(batchSize, numPairs));
+
+    // Plans on this thread; workers execute them on their own buffers
+    double *planReal = fftw_alloc_real(static_cast<size_t>(size) * batchSize);
+    fftw_complex *planComplex = fftw_alloc_complex(static_cast<size_t>(numBins) * batchSize);
+    fftw_plan forward = fftw_plan_dft_r2c_1d(size, planReal, planComplex, FFTW_ESTIMATE);
+    int dims[] = {size};
+    fftw_plan inverse = fftw_plan_many_dft_c2r(1, dims, batchSize, planComplex, nullptr, 1, numBins,
+                                               planReal, nullptr, 1, size, FFTW_ESTIMATE);
+
+    // Forward transforms of the traces some pair uses
+    std::vector<char> needed(traces.size(), 0);
+    for (const QPair<int, int> &pair : pairs) needed[pair.first] = needed[pair.second] = 1;
+    QVector<int> used;
+    for (int s = 0; s < traces.size(); ++s) {
+        if (needed[s]) used.append(s);
+    }
+
+    std::vector<Eigen::ArrayXcd> spectra(traces.size());
+    std::vector<double> norms(traces.size(), 0.0);
+    Parallel::parallelFor(0, used.size(), [&](int u) {
+        int s = used[u];
+        const double *x = traces[s];
+        double sum = 0.0;
+        qint64 count = 0;
+        for (qint64 i = 0; i < length; ++i) {
+            if (std::isfinite(x[i])) {
+                sum += x[i];
+                ++count;
+            }
+        }
+        double mean = count > 0 ? sum / count : 0.0;
+
+        double *in = fftw_alloc_real(size);
+        fftw_complex *out = fftw_alloc_complex(numBins);
+        double energy = 0.0;
+        for (qint64 i = 0; i < length; ++i) {
+            in[i] = std::isfinite(x[i]) ? x[i] - mean : 0.0;
+            energy += in[i] * in[i];
+        }
+        std::fill(in + length, in + size, 0.0);
+
+        fftw_execute_dft_r2c(forward, in, out);
+        spectra[s] = Eigen::Map<Eigen::ArrayXcd>(reinterpret_cast<std::complex<double>*>(out), numBins);
+        norms[s] = std::sqrt(energy);
+        fftw_free(in);
+        fftw_free(out);
+    });
+
+    // Raw pointers so worker threads never touch QVector's shared-data bookkeeping
+    results.resize(numPairs);
+    LagEstimate *estimates = results.data();
+    QVector<double> *curveData = nullptr;
+    if (curves) {
+        curves->resize(numPairs);
+        curveData = curves->data();
+    }
+
+    int numBatches = (numPairs + batchSize - 1) / batchSize;
+    Parallel::parallelFor(0, numBatches, [&](int b) {
+        int first = b * batchSize;
+        int count = std::min(batchSize, numPairs - first);
+        fftw_complex *in = fftw_alloc_complex(static_cast<size_t>(numBins) * batchSize);
+        double *out = fftw_alloc_real(static_cast<size_t>(size) * batchSize);
+
+        for (int k = 0; k < batchSize; ++k) {
+            Eigen::Map<Eigen::ArrayXcd> product(reinterpret_cast<std::complex<double>*>(in + k * numBins), numBins);
+            if (k < count) {
+                const QPair<int, int> &pair = pairs[first + k];
+                product = spectra[pair.first].conjugate() * spectra[pair.second];
+            } else {
+                product.setZero();
+            }
+        }
+        fftw_execute_dft_c2r(inverse, in, out);
+
+        for (int k = 0; k < count; ++k) {
+            const QPair<int, int> &pair = pairs[first + k];
+            LagEstimate &estimate = estimates[first + k];
+            estimate.first = pair.first;
+            estimate.second = pair.second;
+
+            double scale = size * norms[pair.first] * norms[pair.second];
+            const double *r = out + static_cast<qint64>(k) * size;
+            auto at = [&](int lag) { return scale > 0.0 ? r[lag >= 0 ? lag : size + lag] / scale : 0.0; };
+
+            int best = 0;
+            double bestValue = -std::numeric_limits<double>::infinity();
+            for (int lag = -maxLag; lag <= maxLag; ++lag) {
+                double value = absolutePeak ? std::abs(at(lag)) : at(lag);
+                if (value > bestValue) {
+                    bestValue = value;
+                    best = lag;
+                }
+            }
+            estimate.lag = best;
+            estimate.correlation = at(best);
+            estimate.refinedLag = best;
+            if (best > -maxLag && best < maxLag) {
+                double sign = estimate.correlation < 0.0 ? -1.0 : 1.0;
+                double before = sign * at(best - 1);
+                double peak = sign * at(best);
+                double after = sign * at(best + 1);
+                double curvature = before - 2.0 * peak + after;
+                if (curvature < 0.0) estimate.refinedLag = best + 0.5 * (before - after) / curvature;
+            }
+
+            if (curveData) {
+                QVector<double> &curve = curveData[first + k];
+                curve.resize(2 * maxLag + 1);
+                for (int lag = -maxLag; lag <= maxLag; ++lag) curve[lag + maxLag] = at(lag);
+            }
+        }
+
+        fftw_free(in);
+        fftw_free(out);
+    });
+
+    fftw_destroy_plan(forward);
+    fftw_destroy_plan(inverse);
+    fftw_free(planReal);
+    fftw_free(planComplex);
+    return results;
+}
+
+// ================== COMPLEXITY ==================
+
+struct ComplexityParams {
+    int embedding = 2;               // template length m for sample and approximate entropy
+    double tolerance = 0.2;          // match radius r, times the window's standard deviation
+    int permutationOrder = 3;        // ordinal pattern length, at most 8
+    int permutationDelay = 1;        // samples between pattern elements
+    int higuchiKMax = 10;            // largest Higuchi interval
+};
+
+// NaN where a measure is undefined, e.g. no template matches at length m + 1
+struct Complexity {
+    double sampleEntropy = std::numeric_limits<double>::quiet_NaN();
+    double approximateEntropy = std::numeric_limits<double>::quiet_NaN();
+    double permutationEntropy = std::numeric_limits<double>::quiet_NaN();    // normalized to [0, 1]
+    double higuchiDimension = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Templates x[s], ..., x[s + dims - 1] as points of a kd-tree whose nodes keep
+// their bounding boxes. A Chebyshev-ball count adds whole subtrees inside the
+// ball and skips those outside it, so only the boundary is scanned. Leaf
+// points are copied out in tree order so a scan reads contiguous memory.
+class TemplateTree {
+public:
+    TemplateTree(const double *x, QVector<qint64> starts, int dims) : m_dims(dims) {
+        if (starts.isEmpty()) return;
+        build(x, starts, 0, starts.size());
+        m_coords.resize(static_cast<size_t>(starts.size()) * dims);
+        for (int p = 0; p < starts.size(); ++p) {
+            std::copy(x + starts[p], x + starts[p] + dims, m_coords.begin() + static_cast<size_t>(p) * dims);
+        }
+    }
+
+    int size() const { return static_cast<int>(m_coords.size() / std::max(1, m_dims)); }
+
+    // Points within tol of the template at centre over all dims (inner) and
+    // over the first dims - 1 (outer), the centre itself included
+    void count(const double *centre, double tol, qint64 &inner, qint64 &outer) const {
+        inner = 0;
+        outer = 0;
+        if (!m_nodes.empty()) count(0, centre, tol, inner, outer);
+    }
+
+private:
+    static constexpr int LeafSize = 16;
+
+    struct Node {
+        int lo, hi;                  // range of points in tree order
+        int left = -1, right = -1;
+    };
+
+    int build(const double *x, QVector<qint64> &starts, int lo, int hi) {
+        int index = static_cast<int>(m_nodes.size());
+        m_nodes.push_back({lo, hi});
+        m_bounds.resize(m_bounds.size() + 2 * m_dims);
+        double *low = &m_bounds[static_cast<size_t>(index) * 2 * m_dims];
+        double *high = low + m_dims;
+        std::fill(low, high, std::numeric_limits<double>::infinity());
+        std::fill(high, high + m_dims, -std::numeric_limits<double>::infinity());
+        for (int p = lo; p < hi; ++p) {
+            const double *point = x + starts[p];
+            for (int d = 0; d < m_dims; ++d) {
+                low[d] = std::min(low[d], point[d]);
+                high[d] = std::max(high[d], point[d]);
+            }
+        }
+        if (hi - lo <= LeafSize) return index;
+
+        // Split the widest dimension at its median
+        int axis = 0;
+        for (int d = 1; d < m_dims; ++d) {
+            if (high[d] - low[d] > high[axis] - low[axis]) axis = d;
+        }
+        int mid = lo + (hi - lo) / 2;
+        std::nth_element(starts.begin() + lo, starts.begin() + mid, starts.begin() + hi,
+                         [x, axis](qint64 a, qint64 b) { return x[a + axis] < x[b + axis]; });
+        int left = build(x, starts, lo, mid);
+        int right = build(x, starts, mid, hi);
+        m_nodes[index].left = left;
+        m_nodes[index].right = right;
+        return index;
+    }
+
+    // outerCounted: an ancestor lies inside the ball over the first dims - 1,
+    // so its points are already in outer and only the last dimension is left
+    void count(int index, const double *centre, double tol, qint64 &inner, qint64 &outer,
+               bool outerCounted = false) const {
+        const Node &node = m_nodes[index];
+        const double *low = &m_bounds[static_cast<size_t>(index) * 2 * m_dims];
+        const double *high = low + m_dims;
+        int last = m_dims - 1;
+
+        if (!outerCounted) {
+            bool outerInside = true;
+            for (int d = 0; d < last; ++d) {
+                if (high[d] < centre[d] - tol || low[d] > centre[d] + tol) return;
+                if (low[d] < centre[d] - tol || high[d] > centre[d] + tol) outerInside = false;
+            }
+            if (outerInside) {
+                outer += node.hi - node.lo;
+                outerCounted = true;
+            }
+        }
+        if (outerCounted) {
+            if (high[last] < centre[last] - tol || low[last] > centre[last] + tol) return;
+            if (low[last] >= centre[last] - tol && high[last] <= centre[last] + tol) {
+                inner += node.hi - node.lo;
+                return;
+            }
+        }
+
+        if (node.left < 0) {
+            const double *point = &m_coords[static_cast<size_t>(node.lo) * m_dims];
+            // Branch-free: matches are too irregular to predict
+            for (int p = node.lo; p < node.hi; ++p, point += m_dims) {
+                bool match = true;
+                for (int d = 0; d < last; ++d) match &= std::abs(point[d] - centre[d]) <= tol;
+                match |= outerCounted;
+                outer += match && !outerCounted;
+                inner += match & (std::abs(point[last] - centre[last]) <= tol);
+            }
+            return;
+        }
+        count(node.left, centre, tol, inner, outer, outerCounted);
+        count(node.right, centre, tol, inner, outer, outerCounted);
+    }
+
+    int m_dims;
+    std::vector<Node> m_nodes;
+    std::vector<double> m_bounds;    // per node, dims lows then dims highs
+    std::vector<double> m_coords;    // points in tree order, dims each
+};
+
+// Sample entropy (Richman & Moorman) and approximate entropy (Pincus) of n
+// samples. Templates touching a non-finite sample are left out. Both come from
+// one tree of (m + 1)-templates: each count returns the matches at length
+// m + 1 and, ignoring the last element, at length m.
+inline void templateEntropies(const double *x, qint64 n, int m, double tolerance, Complexity &result) {
+    if (m < 1 || n <= m + 1) return;
+
+    double sum = 0.0;
+    double sumSq = 0.0;
+    qint64 finite = 0;
+    for (qint64 i = 0; i < n; ++i) {
+        if (!std::isfinite(x[i])) continue;
+        sum += x[i];
+        sumSq += x[i] * x[i];
+        ++finite;
+    }
+    if (finite < 2) return;
+    double mean = sum / finite;
+    double tol = tolerance * std::sqrt(std::max(0.0, (sumSq - finite * mean * mean) / (finite - 1)));
+
+    // A template is usable when its samples are finite; run tracks finite samples ending at i
+    QVector<qint64> starts;
+    starts.reserve(static_cast<int>(n - m));
+    qint64 run = 0;
+    for (qint64 i = 0; i < n; ++i) {
+        run = std::isfinite(x[i]) ? run + 1 : 0;
+        if (run > m) starts.append(i - m);
+    }
+    if (starts.size() < 2) return;
+    QVector<qint64> queries = starts;
+    TemplateTree tree(x, std::move(starts), m + 1);
+
+    // ApEn also counts the final m-template, which has no (m + 1)-extension
+    qint64 lastStart = n - m;
+    bool lastUsable = true;
+    for (int k = 0; k < m; ++k) lastUsable = lastUsable && std::isfinite(x[lastStart + k]);
+    auto matchesLast = [&](qint64 s) {
+        for (int k = 0; k < m; ++k) {
+            if (std::abs(x[s + k] - x[lastStart + k]) > tol) return false;
+        }
+        return true;
+    };
+
+    double numLong = queries.size();
+    double numShort = numLong + (lastUsable ? 1 : 0);
+    double matchesLong = 0.0;        // pairs, self-matches excluded
+    double matchesShort = 0.0;
+    double phiLong = 0.0;
+    double phiShort = 0.0;
+    for (qint64 s : queries) {
+        qint64 inner, outer;
+        tree.count(x + s, tol, inner, outer);
+        matchesLong += inner - 1;
+        matchesShort += outer - 1;
+        phiLong += std::log(inner / numLong);
+        phiShort += std::log((outer + (lastUsable && matchesLast(s) ? 1 : 0)) / numShort);
+    }
+    if (lastUsable) {
+        // The last template against the tree: only its first m elements exist,
+        // so pad the centre and read the outer count
+        std::vector<double> centre(x + lastStart, x + lastStart + m);
+        centre.push_back(0.0);
+        qint64 inner, outer;
+        tree.count(centre.data(), tol, inner, outer);
+        phiShort += std::log((outer + 1) / numShort);
+    }
+
+    if (matchesLong > 0.0 && matchesShort > 0.0) result.sampleEntropy = -std::log(matchesLong / matchesShort);
+    result.approximateEntropy = phiShort / numShort - phiLong / numLong;
+}
+
+// Shannon entropy of the ordinal patterns (Bandt & Pompe), normalized by
+// log(order!). Ties keep their time order; patterns with a non-finite sample are skipped.
+inline double permutationEntropy(const double *x, qint64 n, int order, int delay) {
+    if (order < 2 || order > 8 || delay < 1) return std::numeric_limits<double>::quiet_NaN();
+    qint64 span = static_cast<qint64>(order - 1) * delay;
+    if (n <= span) return std::numeric_limits<double>::quiet_NaN();
+
+    int factorials[9] = {1};
+    for (int k = 1; k <= order; ++k) factorials[k] = factorials[k - 1] * k;
+    std::vector<qint64> counts(factorials[order], 0);
+    qint64 total = 0;
+
+    // Lehmer code: for each element, how many later ones are smaller
+    for (qint64 i = 0; i + span < n; ++i) {
+        const double *p = x + i;
+        int code = 0;
+        bool finite = true;
+        for (int a = 0; a < order && finite; ++a) {
+            double value = p[a * delay];
+            finite = std::isfinite(value);
+            int smaller = 0;
+            for (int b = a + 1; b < order; ++b) smaller += p[b * delay] < value;
+            code += smaller * factorials[order - 1 - a];
+        }
+        if (!finite) continue;
+        ++counts[code];
+        ++total;
+    }
+    if (total == 0) return std::numeric_limits<double>::quiet_NaN();
+
+    double entropy = 0.0;
+    for (qint64 c : counts) {
+        if (c > 0) entropy -= (static_cast<double>(c) / total) * std::log(static_cast<double>(c) / total);
+    }
+    return entropy / std::log(static_cast<double>(factorials[order]));
+}
+
+// Higuchi fractal dimension: slope of log L(k) against log(1/k) for
+// k = 1..kMax. Differences touching a non-finite sample are skipped and each
+// curve length is normalized by the differences it kept.
+inline double higuchiDimension(const double *x, qint64 n, int kMax) {
+    if (kMax < 2 || n < 2 * kMax) return std::numeric_limits<double>::quiet_NaN();
+
+    QVector<double> logK, logL;
+    for (int k = 1; k <= kMax; ++k) {
+        double total = 0.0;
+        int curves = 0;
+        for (int offset = 0; offset < k; ++offset) {
+            double length = 0.0;
+            qint64 pairs = 0;
+            for (qint64 i = offset + k; i < n; i += k) {
+                double step = x[i] - x[i - k];
+                if (!std::isfinite(step)) continue;
+                length += std::abs(step);
+                ++pairs;
+            }
+            if (pairs == 0) continue;
+            // Mean step per interval scaled to the whole series, over k
+            total += length / pairs * (n - 1) / k / k;
+            ++curves;
+        }
+        if (curves == 0 || total <= 0.0) continue;
+        logK.append(std::log(1.0 / k));
+        logL.append(std::log(total / curves));
+    }
+    if (logK.size() < 2) return std::numeric_limits<double>::quiet_NaN();
+
+    double meanK = std::accumulate(logK.begin(), logK.end(), 0.0) / logK.size();
+    double meanL = std::accumulate(logL.begin(), logL.end(), 0.0) / logL.size();
+    double covariance = 0.0;
+    double variance = 0.0;
+    for (int i = 0; i < logK.size(); ++i) {
+        covariance += (logK[i] - meanK) * (logL[i] - meanL);
+        variance += (logK[i] - meanK) * (logK[i] - meanK);
+    }
+    return covariance / variance;
+}
+
+inline Complexity complexity(const double *x, qint64 n, const ComplexityParams &params = ComplexityParams()) {
+    Complexity result;
+    templateEntropies(x, n, params.embedding, params.tolerance, result);
+    result.permutationEntropy = permutationEntropy(x, n, params.permutationOrder, params.permutationDelay);
+    result.higuchiDimension = higuchiDimension(x, n, params.higuchiKMax);
+    return result;
+}
+
+// All measures over sliding windows of window samples every step samples, for
+// every trace. Tasks are (trace, window) pairs, all in parallel; entry [t][w]
+// covers samples [w * step, w * step + window) of trace t.
+inline QVector<QVector<Complexity>> complexityTrend(const QVector<const double*> &traces, qint64 length,
+                                                    qint64 window, qint64 step,
+                                                    const ComplexityParams &params = ComplexityParams()) {
+    QVector<QVector<Complexity>> results(traces.size());
+    if (window < 2 || step < 1 || length < window) return results;
+
+    int numWindows = static_cast<int>((length - window) / step + 1);
+    std::vector<Complexity*> rows(traces.size());
+    for (int t = 0; t < traces.size(); ++t) {
+        results[t].resize(numWindows);
+        rows[t] = results[t].data();
+    }
+
+    Parallel::parallelFor(0, traces.size() * numWindows, [&](int task) {
+        int t = task / numWindows;
+        int w = task % numWindows;
+        rows[t][w] = complexity(traces[t] + static_cast<qint64>(w) * step, window, params);
+    });
+    return results;
+}
+
+// ================== BASELINE CORRECTION ==================
+
+enum BaselineMode {
+    BaselineMean,          // one global offset, same as removeDC
+    BaselinePolynomial,    // piecewise polynomial fit over overlapping segments
+    BaselineMedian         // centered running median
+};
+
+struct BaselineParams {
+    BaselineMode mode = BaselinePolynomial;
+    double segmentSeconds = 10.0;     // polynomial fit length, segments overlap by half
+    int polynomialOrder = 1;          // 1 = piecewise linear
+    double medianWindowSeconds = 2.0;
+};
+
+// Least-squares polynomial on u = (i - center) / scale; coefficients low order first
+inline Eigen::VectorXd fitPolynomial(const double *x, qint64 n, double center, double scale, int order) {
+    int terms = order + 1;
+    Eigen::MatrixXd normal = Eigen::MatrixXd::Zero(terms, terms);
+    Eigen::VectorXd rhs = Eigen::VectorXd::Zero(terms);
+    std::vector<double> powers(2 * terms - 1);
+    for (qint64 i = 0; i < n; ++i) {
+        double u = (i - center) / scale;
+        powers[0] = 1.0;
+        for (size_t p = 1; p < powers.size(); ++p) powers[p] = powers[p - 1] * u;
+        for (int a = 0; a < terms; ++a) {
+            rhs[a] += powers[a] * x[i];
+            for (int b = 0; b < terms; ++b) normal(a, b) += powers[a + b];
+        }
+    }
+    return normal.ldlt().solve(rhs);
+}
+
+inline double evaluatePolynomial(const Eigen::VectorXd &coefficients, double u) {
+    double value = 0.0;
+    for (int p = coefficients.size() - 1; p >= 0; --p) value = value * u + coefficients[p];
+    return value;
+}
+
+// Fits each half-overlapping segment, then subtracts a baseline that blends
+// linearly between the fits of neighbouring segment centers, so there are
+// no steps at segment boundaries. Only the fits are stored.
+inline void detrendPolynomial(QVector<double> &data, qint64 segmentLength, int order = 1) {
+    qint64 n = data.size();
+    order = std::max(0, order);
+    segmentLength = std::max<qint64>(segmentLength, order + 2);
+    if (n < order + 2) return;
+    if (segmentLength >= n) segmentLength = n;
+
+    qint64 hop = std::max<qint64>(1, segmentLength / 2);
+    int numSegments = static_cast<int>(std::max<qint64>(1, (n - segmentLength + hop - 1) / hop + 1));
+
+    std::vector<double> centers(numSegments);
+    std::vector<double> scales(numSegments);
+    std::vector<Eigen::VectorXd> fits(numSegments);
+    double *x = data.data();
+    for (int k = 0; k < numSegments; ++k) {
+        // The last segment is aligned to the end instead of running past it
+        qint64 start = std::min(k * hop, n - segmentLength);
+        centers[k] = start + (segmentLength - 1) / 2.0;
+        scales[k] = std::max(1.0, (segmentLength - 1) / 2.0);
+        fits[k] = fitPolynomial(x + start, segmentLength, centers[k] - start, scales[k], order);
+    }
+
+    int k = 0;
+    for (qint64 i = 0; i < n; ++i) {
+        while (k + 1 < numSegments && centers[k + 1] <= i) ++k;
+        double base = evaluatePolynomial(fits[k], (i - centers[k]) / scales[k]);
+        if (k + 1 < numSegments && i > centers[k]) {
+            double t = (i - centers[k]) / (centers[k + 1] - centers[k]);
+            double next = evaluatePolynomial(fits[k + 1], (i - centers[k + 1]) / scales[k + 1]);
+            base = (1.0 - t) * base + t * next;
+        }
+        x[i] -= base;
+    }
+}
+
+// Sliding median over a window of up to w values in O(log w) per update:
+// two balanced trees hold the lower and upper halves, the median is the
+// largest of the lower half
+// Non-finite samples are skipped, so a dropout does not pull the median.
+// A window with no finite sample reports 0; its center sample is non-finite
+// then, and stays so after subtraction.
+class RunningMedian {
+public:
+    void insert(double value) {
+        if (!std::isfinite(value)) return;
+        if (m_low.empty() || value <= *m_low.rbegin()) m_low.insert(value);
+        else m_high.insert(value);
+        rebalance();
+    }
+
+    void erase(double value) {
+        if (!std::isfinite(value)) return;
+        auto it = m_low.find(value);
+        if (it != m_low.end()) {
+            m_low.erase(it);
+        } else {
+            it = m_high.find(value);
+            if (it == m_high.end()) return;
+            m_high.erase(it);
+        }
+        rebalance();
+    }
+
+    double median() const { return m_low.empty() ? 0.0 : *m_low.rbegin(); }
+    bool isEmpty() const { return m_low.empty(); }
+
+private:
+    void rebalance() {
+        if (m_low.size() > m_high.size() + 1) {
+            auto it = std::prev(m_low.end());
+            m_high.insert(*it);
+            m_low.erase(it);
+        } else if (m_high.size() > m_low.size()) {
+            auto it = m_high.begin();
+            m_low.insert(*it);
+            m_high.erase(it);
+        }
+    }
+
+    std::multiset<double> m_low;
+    std::multiset<double> m_high;
+};
+
+// Median of x[i - half, i + half] clipped to the signal, for outputs
+// [first, first + count)
+inline void runningMedian(const double *x, qint64 n, qint64 half, qint64 first, qint64 count, double *out) {
+    RunningMedian window;
+    qint64 lo = std::max<qint64>(0, first - half);
+    qint64 hi = std::min(n, first + half + 1);
+    for (qint64 j = lo; j < hi; ++j) window.insert(x[j]);
+
+    for (qint64 i = first; i < first + count; ++i) {
+        out[i - first] = window.median();
+        if (i + half + 1 < n) window.insert(x[i + half + 1]);
+        if (i - half >= 0) window.erase(x[i - half]);
+    }
+}
+
+// Subtracts the running median. Blocks are primed with their left context
+// so they run independently; results match a single sequential pass.
+inline void removeRunningMedian(QVector<double> &data, qint64 windowLength) {
+    qint64 n = data.size();
+    if (n == 0 || windowLength < 2) return;
+    qint64 half = windowLength / 2;
+
+    std::vector<double> baseline(n);
+    const double *x = data.constData();
+    Parallel::parallelForBlocks(n, 65536, [&](qint64 start, qint64 count) {
+        runningMedian(x, n, half, start, count, baseline.data() + start);
+    });
+
+    double *y = data.data();
+    for (qint64 i = 0; i < n; ++i) y[i] -= baseline[i];
+}
+
+inline void removeBaseline(QVector<double> &data, double samplingRate, const BaselineParams &params) {
+    if (data.isEmpty() || samplingRate <= 0) return;
+    switch (params.mode) {
+    case BaselineMean:
+        removeDC(data);
+        break;
+    case BaselinePolynomial:
+        detrendPolynomial(data, std::llround(params.segmentSeconds * samplingRate), params.polynomialOrder);
+        break;
+    case BaselineMedian:
+        removeRunningMedian(data, std::llround(params.medianWindowSeconds * samplingRate));
+        break;
+    }
+}
+
 inline QVector<double> extractTimeWindow(const QVector<double> &data, 
                                         double samplingRate,
                                         double startTime, double duration) {
@@ -539,4 +1256,234 @@ inline QVector<double> extractTimeWindow(const QVector<double> &data,
     return result;
 }
 
+
+// ================== RESAMPLING ==================
+
+// Anti-aliasing FIR for an up/down rational resampler, split into its
+// polyphase components. Phase r holds the taps that meet input samples
+// q - halfTaps .. q + halfTaps for outputs whose upsampled position has
+// remainder r, stored in input order so each output is one dot product.
+struct ResamplerDesign {
+    int up = 1;
+    int down = 1;
+    int halfTaps = 0;
+    int tapsPerPhase = 1;
+    std::vector<double> coefficients;   // up x tapsPerPhase
+
+    const double *phase(int r) const { return coefficients.data() + static_cast<size_t>(r) * tapsPerPhase; }
+};
+
+inline double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    double halfX = x / 2.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (halfX / k) * (halfX / k);
+        sum += term;
+        if (term < sum * 1e-16) break;
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc, cutoff at 90% of the lower Nyquist rate, ~85 dB
+// stopband. Designs are cached by ratio since the same few ratios come up
+// for every channel and file.
+inline std::shared_ptr<const ResamplerDesign> resamplerDesign(int up, int down) {
+    static std::map<std::pair<int, int>, std::shared_ptr<const ResamplerDesign>> cache;
+    static std::mutex cacheMutex;
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = cache.find({up, down});
+    if (it != cache.end()) return it->second;
+
+    const int zeroCrossings = 16;
+    const double beta = 8.6;
+    const int factor = std::max(up, down);
+    const double cutoff = 0.9 * 0.5 / factor;         // cycles per upsampled sample
+    const double halfLength = zeroCrossings * factor;  // in upsampled samples
+
+    auto design = std::make_shared<ResamplerDesign>();
+    design->up = up;
+    design->down = down;
+    design->halfTaps = static_cast<int>(std::ceil(halfLength / up));
+    design->tapsPerPhase = 2 * design->halfTaps + 1;
+    design->coefficients.assign(static_cast<size_t>(up) * design->tapsPerPhase, 0.0);
+
+    const double windowNorm = besselI0(beta);
+    for (int r = 0; r < up; ++r) {
+        double *h = design->coefficients.data() + static_cast<size_t>(r) * design->tapsPerPhase;
+        double sum = 0.0;
+        for (int i = 0; i < design->tapsPerPhase; ++i) {
+            double t = r + static_cast<double>(design->halfTaps - i) * up;
+            if (std::abs(t) > halfLength) continue;
+            double arg = M_PI * 2.0 * cutoff * t;
+            double sinc = (t == 0.0) ? 1.0 : std::sin(arg) / arg;
+            double ratio = t / halfLength;
+            double window = besselI0(beta * std::sqrt(1.0 - ratio * ratio)) / windowNorm;
+            h[i] = sinc * window;
+            sum += h[i];
+        }
+        // Unit DC gain for every phase
+        if (sum != 0.0) {
+            for (int i = 0; i < design->tapsPerPhase; ++i) h[i] /= sum;
+        }
+    }
+
+    cache[{up, down}] = design;
+    return design;
+}
+
+// Smallest up/down with toRate / fromRate == up / down, approximated by
+// continued fractions when the rates are not integers
+inline bool resampleRatio(double fromRate, double toRate, int &up, int &down, int maxFactor = 1000) {
+    if (fromRate <= 0 || toRate <= 0) return false;
+
+    double from = std::round(fromRate);
+    double to = std::round(toRate);
+    if (std::abs(from - fromRate) < 1e-9 && std::abs(to - toRate) < 1e-9) {
+        long long g = std::gcd(static_cast<long long>(from), static_cast<long long>(to));
+        if (from / g <= maxFactor && to / g <= maxFactor) {
+            up = static_cast<int>(to / g);
+            down = static_cast<int>(from / g);
+            return true;
+        }
+    }
+
+    double ratio = toRate / fromRate;
+    long long p0 = 0, q0 = 1, p1 = 1, q1 = 0;
+    double x = ratio;
+    for (int iter = 0; iter < 64; ++iter) {
+        long long a = static_cast<long long>(std::floor(x));
+        long long p2 = a * p1 + p0;
+        long long q2 = a * q1 + q0;
+        if (p2 > maxFactor || q2 > maxFactor) break;
+        p0 = p1; q0 = q1; p1 = p2; q1 = q2;
+        if (std::abs(static_cast<double>(p1) / q1 - ratio) < 1e-12 * ratio) break;
+        double frac = x - a;
+        if (frac < 1e-12) break;
+        x = 1.0 / frac;
+    }
+    if (p1 <= 0 || q1 <= 0) return false;
+    up = static_cast<int>(p1);
+    down = static_cast<int>(q1);
+    return true;
+}
+
+// Outputs [firstOutput, firstOutput + count) of the resampled signal. x holds
+// input samples offset .. offset + n - 1, anything outside counts as zero.
+inline void polyphaseFilter(const ResamplerDesign &design, const double *x, qint64 n, qint64 offset,
+                            qint64 firstOutput, qint64 count, double *out) {
+    const int taps = design.tapsPerPhase;
+    for (qint64 m = firstOutput; m < firstOutput + count; ++m) {
+        qint64 k = m * design.down;
+        qint64 q = k / design.up;
+        const double *h = design.phase(static_cast<int>(k % design.up));
+        qint64 start = q - design.halfTaps - offset;
+
+        double acc = 0.0;
+        if (start >= 0 && start + taps <= n) {
+            acc = Eigen::Map<const Eigen::VectorXd>(h, taps).dot(Eigen::Map<const Eigen::VectorXd>(x + start, taps));
+        } else {
+            int first = static_cast<int>(std::max<qint64>(0, -start));
+            int last = static_cast<int>(std::min<qint64>(taps, n - start));
+            for (int i = first; i < last; ++i) acc += h[i] * x[start + i];
+        }
+        *out++ = acc;
+    }
+}
+
+inline qint64 resampledLength(qint64 n, int up, int down) {
+    return (n * up + down - 1) / down;
+}
+
+inline QVector<double> resample(const QVector<double> &data, int up, int down) {
+    QVector<double> result;
+    if (data.isEmpty() || up <= 0 || down <= 0) return result;
+    if (up == down) return data;
+
+    auto design = resamplerDesign(up, down);
+    qint64 length = resampledLength(data.size(), up, down);
+    result.resize(static_cast<int>(length));
+
+    const double *x = data.constData();
+    double *y = result.data();
+    Parallel::parallelForBlocks(length, 65536, [&](qint64 start, qint64 count) {
+        polyphaseFilter(*design, x, data.size(), 0, start, count, y + start);
+    });
+    return result;
+}
+
+inline QVector<double> resample(const QVector<double> &data, double fromRate, double toRate) {
+    int up = 1;
+    int down = 1;
+    if (!resampleRatio(fromRate, toRate, up, down)) {
+        qWarning() << "Resample: Invalid rates" << fromRate << toRate;
+        return data;
+    }
+    return resample(data, up, down);
+}
+
+// Block-wise resampling of an unbounded stream. Output is identical to the
+// one-shot resample() once flush() has been called.
+class Resampler {
+public:
+    Resampler(int up, int down) : m_design(resamplerDesign(up, down)) {}
+
+    void reset() {
+        m_buffer.clear();
+        m_bufferStart = 0;
+        m_inputCount = 0;
+        m_nextOutput = 0;
+    }
+
+    // Appends input and returns every output that no longer depends on future samples
+    QVector<double> process(const double *input, int n) {
+        m_buffer.insert(m_buffer.end(), input, input + n);
+        m_inputCount += n;
+
+        const ResamplerDesign &d = *m_design;
+        QVector<double> out;
+        qint64 ready = m_inputCount - d.halfTaps;
+        if (ready <= 0) return out;
+        qint64 lastOutput = (ready * d.up - 1) / d.down;
+        produce(lastOutput + 1 - m_nextOutput, out);
+
+        // Drop input no future output can reach
+        qint64 keepFrom = (m_nextOutput * d.down) / d.up - d.halfTaps;
+        qint64 drop = keepFrom - m_bufferStart;
+        if (drop > 0) {
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + drop);
+            m_bufferStart += drop;
+        }
+        return out;
+    }
+
+    QVector<double> process(const QVector<double> &input) {
+        return process(input.constData(), input.size());
+    }
+
+    // Remaining outputs with the stream zero-padded past its end, then resets
+    QVector<double> flush() {
+        QVector<double> out;
+        produce(resampledLength(m_inputCount, m_design->up, m_design->down) - m_nextOutput, out);
+        reset();
+        return out;
+    }
+
+private:
+    void produce(qint64 count, QVector<double> &out) {
+        if (count <= 0) return;
+        out.resize(static_cast<int>(count));
+        polyphaseFilter(*m_design, m_buffer.data(), static_cast<qint64>(m_buffer.size()), m_bufferStart,
+                        m_nextOutput, count, out.data());
+        m_nextOutput += count;
+    }
+
+    std::shared_ptr<const ResamplerDesign> m_design;
+    std::vector<double> m_buffer;
+    qint64 m_bufferStart = 0;
+    qint64 m_inputCount = 0;
+    qint64 m_nextOutput = 0;
+};
+
 }
\ No newline at end of file
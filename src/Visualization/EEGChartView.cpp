@@ -1,4 +1,5 @@
 #include "EEGChartView.h"
+#include "../Utils/Parallel.h"
 #include <QValueAxis>
 #include <QDateTimeAxis>
 #include <QWheelEvent>
@@ -18,7 +19,8 @@ EEGChartView::EEGChartView(QWidget *parent)
       m_showGrid(true),
       m_isPanning(false),
       m_isZooming(false),
-      m_selectedChannel(-1) {
+      m_selectedChannel(-1),
+      m_waveletPreview(false) {
     
     setChart(m_chart);
     setRenderHint(QPainter::Antialiasing);
@@ -32,12 +34,15 @@ EEGChartView::EEGChartView(QWidget *parent)
 EEGChartView::~EEGChartView() {
     qDeleteAll(m_series);
     m_series.clear();
+    qDeleteAll(m_eventSeries);
+    m_eventSeries.clear();
 }
 
 void EEGChartView::setEEGData(EEGData *data) {
     m_eegData = data;
     if (data) {
         connect(data, &EEGData::dataChanged, this, &EEGChartView::updateChart);
+        connect(data, &EEGData::eventsChanged, this, &EEGChartView::updateChart);
     }
     updateChart();
 }
@@ -69,7 +74,7 @@ void EEGChartView::createChart() {
 void EEGChartView::selectAllChannels() {
     m_visibleChannels.clear();
     if (m_eegData) {
-        for (int i = 0; i < m_eegData->channelCount(); ++i) {
+        for (int i = 0; i < m_eegData->displayChannelCount(); ++i) {
             m_visibleChannels.append(i);
         }
     }
@@ -80,7 +85,7 @@ void EEGChartView::selectAllChannels() {
 void EEGChartView::selectFirstNChannels(int n) {
     m_visibleChannels.clear();
     if (m_eegData) {
-        int maxChannels = qMin(n, m_eegData->channelCount());
+        int maxChannels = qMin(n, m_eegData->displayChannelCount());
         for (int i = 0; i < maxChannels; ++i) {
             m_visibleChannels.append(i);
         }
@@ -107,6 +112,7 @@ void EEGChartView::updateChart() {
             delete series;
         }
         m_series.clear();
+        clearEventMarkers();
         return;
     }
     
@@ -118,6 +124,7 @@ void EEGChartView::updateChart() {
             delete series;
         }
         m_series.clear();
+        clearEventMarkers();
         return;
     }
     
@@ -127,6 +134,7 @@ void EEGChartView::updateChart() {
         delete series;
     }
     m_series.clear();
+    clearEventMarkers();
     
     // Get axes first
     QList<QAbstractAxis*> axesX = m_chart->axes(Qt::Horizontal);
@@ -147,39 +155,51 @@ void EEGChartView::updateChart() {
         }
     }
     
-    // Create new series for visible channels
-    int channelCount = m_eegData->channelCount();
+    // Create new series for visible channels. Only the visible window is
+    // fetched, so a display montage costs the window length, not the recording
+    int channelCount = m_eegData->displayChannelCount();
+
+    // Wavelet preview denoises the window plus a margin against edge effects
+    double margin = m_waveletPreview ? 1.0 : 0.0;
+    QVector<int> windowStarts;
+    QVector<QVector<double>> windows = m_eegData->displayWindow(m_visibleChannels, m_startTime - margin,
+                                                                m_startTime + m_duration + margin, windowStarts);
+    if (m_waveletPreview) {
+        Parallel::parallelFor(0, windows.size(), [&](int i) {
+            if (!windows[i].isEmpty()) Wavelet::denoise(windows[i], m_waveletParams);
+        });
+    }
     
     for (int i = 0; i < m_visibleChannels.size(); ++i) {
         int channelIndex = m_visibleChannels[i];
         
         // Bounds check
-        if (channelIndex < 0 || channelIndex >= m_eegData->channelCount()) {
+        if (channelIndex < 0 || channelIndex >= channelCount) {
             qWarning() << "Skipping invalid channel index:" << channelIndex;
             continue;
         }
         
-        const EEGChannel &channel = m_eegData->channel(channelIndex);
-        
         // Empty data check
-        if (channel.data.isEmpty()) {
+        if (m_eegData->displaySampleCount(channelIndex) == 0) {
             qWarning() << "Channel" << channelIndex << "has empty data";
             continue;
         }
         
+        double samplingRate = m_eegData->displaySamplingRate(channelIndex);
         QLineSeries *series = new QLineSeries();
-        series->setName(channel.label);
+        series->setName(m_eegData->displayChannelLabel(channelIndex));
 
-        bool isSelected = (channelIndex == m_selectedChannel);
+        // The selection is a recorded channel, it has no row under a montage
+        bool isSelected = !m_eegData->hasDisplayMontage() && channelIndex == m_selectedChannel;
         int penWidth = isSelected ? 3 : 1;
         QColor color = getChannelColor(i, isSelected);
         series->setPen(QPen(color, penWidth));
         
         // Add data points with bounds checking
-        int startSample = static_cast<int>(m_startTime * channel.samplingRate);
-        int endSample = static_cast<int>((m_startTime + m_duration) * channel.samplingRate);
-        startSample = qMax(0, startSample);
-        endSample = qMin(channel.data.size() - 1, endSample);
+        const QVector<double> &window = windows[i];
+        int startSample = qMax(windowStarts[i], static_cast<int>(m_startTime * samplingRate));
+        int endSample = qMin(windowStarts[i] + window.size() - 1,
+                             static_cast<int>((m_startTime + m_duration) * samplingRate));
         
         if (startSample <= endSample) {
             // Downsample for performance
@@ -187,12 +207,9 @@ void EEGChartView::updateChart() {
             double offset = i * m_offsetScale;
             
             for (int s = startSample; s <= endSample; s += step) {
-                // Extra bounds check
-                if (s >= 0 && s < channel.data.size()) {
-                    double time = s / channel.samplingRate;
-                    double value = channel.data[s] * m_verticalScale + offset;
-                    series->append(time, value);
-                }
+                double time = s / samplingRate;
+                double value = window[s - windowStarts[i]] * m_verticalScale + offset;
+                series->append(time, value);
             }
         } else {
             qWarning() << "Invalid sample range for channel" << channelIndex;
@@ -214,11 +231,55 @@ void EEGChartView::updateChart() {
         double yMin = 0;
         double yMax = m_visibleChannels.size() * m_offsetScale;
         axisY->setRange(yMin - m_offsetScale * 0.5, yMax + m_offsetScale * 0.5);
+        updateEventMarkers(axisX, axisY, yMin - m_offsetScale * 0.5, yMax + m_offsetScale * 0.5);
     }
     
     m_chart->update();
 }
 
+void EEGChartView::clearEventMarkers() {
+    for (auto series : m_eventSeries) {
+        m_chart->removeSeries(series);
+        delete series;
+    }
+    m_eventSeries.clear();
+}
+
+void EEGChartView::updateEventMarkers(QValueAxis *axisX, QValueAxis *axisY, double yMin, double yMax) {
+    const EventStore &events = m_eegData->events();
+    if (events.isEmpty()) return;
+
+    QVector<int> visible = events.inWindow(m_startTime, m_startTime + m_duration);
+    // Too many markers just hide the signal and stall the chart
+    const int maxMarkers = 200;
+    if (visible.size() > maxMarkers) visible.resize(maxMarkers);
+
+    // Vertical line at the onset and, for events with a duration, at the end.
+    // Events of one type share a colour.
+    QStringList types = events.types();
+    auto addMarker = [&](double x, const QColor &color) {
+        if (x < m_startTime || x > m_startTime + m_duration) return;
+        QLineSeries *series = new QLineSeries();
+        series->setPen(QPen(color, 1, Qt::DashLine));
+        series->append(x, yMin);
+        series->append(x, yMax);
+        m_eventSeries.append(series);
+        m_chart->addSeries(series);
+        series->attachAxis(axisX);
+        series->attachAxis(axisY);
+        for (QLegendMarker *marker : m_chart->legend()->markers(series)) {
+            marker->setVisible(false);
+        }
+    };
+
+    for (int index : visible) {
+        const EEGEvent &event = events.at(index);
+        QColor color = getChannelColor(types.indexOf(event.type) + 3, false);
+        addMarker(event.onset, color);
+        if (event.duration > 0) addMarker(event.end(), color.lighter(130));
+    }
+}
+
 void EEGChartView::setVisibleChannels(const QVector<int> &channels) {
     m_visibleChannels = channels;
     updateChart();
@@ -426,6 +487,12 @@ void EEGChartView::clearSelectedChannel() {
     updateChart();
 }
 
+void EEGChartView::setWaveletPreview(bool enabled, const Wavelet::DenoiseParams &params) {
+    m_waveletPreview = enabled;
+    m_waveletParams = params;
+    updateChart();
+}
+
 QColor EEGChartView::getChannelColor(int index, bool isSelected) const {
     if (isSelected) {
         return Qt::yellow; 
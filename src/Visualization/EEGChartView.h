@@ -5,6 +5,7 @@
 #include <QChartView>
 #include <QtCharts>
 #include "../DataModels/EEGData.h"
+#include "../Analysis/Wavelet.h"
 
 QT_CHARTS_USE_NAMESPACE
 
@@ -31,6 +32,8 @@ public:
     void setShowGrid(bool show);
     void setSelectedChannel(int channel);
     void clearSelectedChannel();
+    // Shows a wavelet-denoised copy of the visible window, the data is untouched
+    void setWaveletPreview(bool enabled, const Wavelet::DenoiseParams &params = Wavelet::DenoiseParams());
     
     double currentStartTime() const { return m_startTime; }
     double currentDuration() const { return m_duration; }
@@ -54,11 +57,14 @@ private:
     void panChart(double dx, double dy);
     QColor getChannelColor(int index, bool isSelected) const;
     void ensureVisibleChannels();
+    void updateEventMarkers(QValueAxis *axisX, QValueAxis *axisY, double yMin, double yMax);
+    void clearEventMarkers();
     
 private:
     EEGData *m_eegData;
     QChart *m_chart;
     QVector<QLineSeries*> m_series;
+    QVector<QLineSeries*> m_eventSeries;
     QVector<int> m_visibleChannels;
     
     double m_startTime;
@@ -67,6 +73,8 @@ private:
     double m_offsetScale;
     bool m_showGrid;
     int m_selectedChannel;
+    bool m_waveletPreview;
+    Wavelet::DenoiseParams m_waveletParams;
     
     QPoint m_lastMousePos;
     bool m_isPanning;
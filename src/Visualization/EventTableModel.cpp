@@ -0,0 +1,76 @@
+#include "EventTableModel.h"
+
+EventTableModel::EventTableModel(EEGData *data, QObject *parent)
+    : QAbstractTableModel(parent), m_eegData(data) {
+    connect(m_eegData, &EEGData::eventAboutToBeAdded, this, [this](int row) {
+        beginInsertRows(QModelIndex(), row, row);
+    });
+    connect(m_eegData, &EEGData::eventAdded, this, [this]() { endInsertRows(); });
+    connect(m_eegData, &EEGData::eventAboutToBeRemoved, this, [this](int row) {
+        beginRemoveRows(QModelIndex(), row, row);
+    });
+    connect(m_eegData, &EEGData::eventRemoved, this, [this]() { endRemoveRows(); });
+    connect(m_eegData, &EEGData::eventsAboutToBeReset, this, [this]() { beginResetModel(); });
+    connect(m_eegData, &EEGData::eventsReset, this, [this]() { endResetModel(); });
+
+    // Only the channel column depends on the channels
+    connect(m_eegData, &EEGData::channelCountChanged, this, &EventTableModel::onChannelsChanged);
+    connect(m_eegData, &EEGData::channelAdded, this, &EventTableModel::onChannelsChanged);
+    connect(m_eegData, &EEGData::channelRemoved, this, &EventTableModel::onChannelsChanged);
+}
+
+void EventTableModel::onChannelsChanged() {
+    if (rowCount() == 0) return;
+    emit dataChanged(index(0, ColumnChannel), index(rowCount() - 1, ColumnChannel));
+}
+
+int EventTableModel::rowCount(const QModelIndex &parent) const {
+    if (parent.isValid()) return 0;
+    return m_eegData->events().size();
+}
+
+int EventTableModel::columnCount(const QModelIndex &parent) const {
+    if (parent.isValid()) return 0;
+    return ColumnCount;
+}
+
+QVariant EventTableModel::data(const QModelIndex &index, int role) const {
+    if (!index.isValid() || index.row() >= m_eegData->events().size()) return QVariant();
+
+    const EEGEvent &event = m_eegData->events().at(index.row());
+    if (role == Qt::TextAlignmentRole && index.column() != ColumnType) {
+        return int(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    if (role != Qt::DisplayRole) return QVariant();
+
+    switch (index.column()) {
+    case ColumnOnset:
+        return QString::number(event.onset, 'f', 3);
+    case ColumnDuration:
+        return QString::number(event.duration, 'f', 3);
+    case ColumnType:
+        return event.type;
+    case ColumnChannel:
+        if (event.channel < 0 || event.channel >= m_eegData->channelCount()) return QString("All");
+        return m_eegData->channel(event.channel).label;
+    }
+    return QVariant();
+}
+
+QVariant EventTableModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (role != Qt::DisplayRole) return QVariant();
+    if (orientation == Qt::Vertical) return section + 1;
+
+    switch (section) {
+    case ColumnOnset: return QString("Onset (s)");
+    case ColumnDuration: return QString("Duration (s)");
+    case ColumnType: return QString("Type");
+    case ColumnChannel: return QString("Channel");
+    }
+    return QVariant();
+}
+
+double EventTableModel::onset(int row) const {
+    if (row < 0 || row >= m_eegData->events().size()) return 0.0;
+    return m_eegData->events().at(row).onset;
+}
@@ -0,0 +1,29 @@
+#ifndef EVENTTABLEMODEL_H
+#define EVENTTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include "../DataModels/EEGData.h"
+
+// Read-only view of the data's event store, one row per event in onset order
+class EventTableModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column { ColumnOnset, ColumnDuration, ColumnType, ColumnChannel, ColumnCount };
+
+    explicit EventTableModel(EEGData *data, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    double onset(int row) const;
+
+private:
+    void onChannelsChanged();
+
+    EEGData *m_eegData;
+};
+
+#endif
@@ -0,0 +1,139 @@
+// Checks for the rank-one common reference in DataModels/Montage. Returns
+// non-zero on failure.
+#include "../src/DataModels/Montage.h"
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+static int failures = 0;
+
+static void check(bool condition, const char *message) {
+    if (!condition) {
+        std::printf("FAIL: %s\n", message);
+        ++failures;
+    }
+}
+
+static const QVector<QString> kLabels = {"Fp1", "Fp2", "C3", "C4", "O1", "O2"};
+
+// Runs the montage over [offset, offset + count) of full-length channels
+static std::vector<std::vector<double>> applyWindow(const Montage &montage, std::vector<std::vector<double>> &channels,
+                                                    qint64 offset, qint64 count,
+                                                    const std::vector<ValidityMask> &masks = {}) {
+    QVector<const double*> inputs;
+    QVector<const ValidityMask*> maskPointers;
+    for (size_t j = 0; j < channels.size(); ++j) {
+        inputs.append(channels[j].data() + offset);
+        if (!masks.empty()) maskPointers.append(&masks[j]);
+    }
+
+    std::vector<std::vector<double>> outputs(montage.outputCount(), std::vector<double>(count));
+    QVector<double*> outputPointers;
+    for (auto &row : outputs) outputPointers.append(row.data());
+    montage.apply(inputs, count, outputPointers, QVector<int>(), maskPointers, offset);
+    return outputs;
+}
+
+static void averageOfConstantIsZero() {
+    Montage car = Montage::averageReference(kLabels);
+    check(car.outputCount() == kLabels.size() && car.hasReference(), "average reference has the wrong shape");
+
+    std::vector<std::vector<double>> channels(kLabels.size(), std::vector<double>(10000, 42.5));
+    auto outputs = applyWindow(car, channels, 0, 10000);
+    double largest = 0.0;
+    for (const auto &row : outputs) {
+        for (double v : row) largest = std::max(largest, std::abs(v));
+    }
+    check(largest < 1e-12, "CAR of a constant input is not zero");
+}
+
+// Masked samples leave the reference, which is rescaled over the rest, so a
+// constant input still references to zero; the gapped channel stays invalid
+static void maskedAverageOfConstantIsZero() {
+    const qint64 length = 3 * ValidityMask::ChunkSize;
+    std::vector<std::vector<double>> channels(kLabels.size(), std::vector<double>(length, -7.0));
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (qint64 i = 5000; i < 5100; ++i) channels[2][i] = nan;
+    channels[4][6000] = std::numeric_limits<double>::infinity();
+
+    std::vector<ValidityMask> masks;
+    for (const auto &x : channels) masks.push_back(ValidityMask::scan(x.data(), length));
+
+    // The window starts mid-chunk, so mask positions need the offset
+    const qint64 offset = 4500;
+    const qint64 count = 4000;
+    auto outputs = applyWindow(Montage::averageReference(kLabels), channels, offset, count, masks);
+
+    double largest = 0.0;
+    bool gapsKept = true;
+    for (size_t row = 0; row < outputs.size(); ++row) {
+        for (qint64 i = 0; i < count; ++i) {
+            double v = outputs[row][i];
+            if (masks[row].isValid(offset + i)) largest = std::max(largest, std::abs(v));
+            else gapsKept &= !std::isfinite(v);
+        }
+    }
+    check(largest < 1e-12, "masked CAR of a constant input is not zero");
+    check(gapsKept, "masked CAR filled an invalid sample");
+}
+
+// Each output is its input minus the mean of the valid inputs at that sample
+static void maskedAverageMatchesMean() {
+    const qint64 length = 9000;
+    std::vector<std::vector<double>> channels(kLabels.size(), std::vector<double>(length));
+    for (size_t j = 0; j < channels.size(); ++j) {
+        for (qint64 i = 0; i < length; ++i) channels[j][i] = std::sin(0.013 * i * (j + 1)) + 0.5 * j;
+    }
+    for (qint64 i = 3000; i < 3400; ++i) channels[1][i] = std::numeric_limits<double>::quiet_NaN();
+
+    std::vector<ValidityMask> masks;
+    for (const auto &x : channels) masks.push_back(ValidityMask::scan(x.data(), length));
+    auto outputs = applyWindow(Montage::averageReference(kLabels), channels, 0, length, masks);
+
+    double error = 0.0;
+    for (qint64 i = 0; i < length; ++i) {
+        double sum = 0.0;
+        int valid = 0;
+        for (const auto &x : channels) {
+            if (std::isfinite(x[i])) {
+                sum += x[i];
+                ++valid;
+            }
+        }
+        for (size_t j = 0; j < channels.size(); ++j) {
+            if (std::isfinite(channels[j][i])) error = std::max(error, std::abs(outputs[j][i] - (channels[j][i] - sum / valid)));
+        }
+    }
+    check(error < 1e-12, "masked CAR differs from the mean of the valid inputs");
+}
+
+// "X - AVG" in a definition is the same rank-one reference
+static void definitionAverageMatchesBuiltIn() {
+    Montage defined = Montage::fromDefinition("O1 - AVG\nCz' = C3 - CAR", kLabels);
+    check(defined.outputCount() == 2 && defined.hasReference(), "definition with AVG has no reference");
+
+    const qint64 length = 1000;
+    std::vector<std::vector<double>> channels(kLabels.size(), std::vector<double>(length));
+    for (size_t j = 0; j < channels.size(); ++j) {
+        for (qint64 i = 0; i < length; ++i) channels[j][i] = std::cos(0.02 * i + j) * (j + 1);
+    }
+    auto fromDefinition = applyWindow(defined, channels, 0, length);
+    auto builtIn = applyWindow(Montage::averageReference(kLabels), channels, 0, length);
+
+    double error = 0.0;
+    for (qint64 i = 0; i < length; ++i) {
+        error = std::max(error, std::abs(fromDefinition[0][i] - builtIn[4][i]));
+        error = std::max(error, std::abs(fromDefinition[1][i] - builtIn[2][i]));
+    }
+    check(error < 1e-12, "AVG in a definition differs from the average reference");
+}
+
+int main() {
+    averageOfConstantIsZero();
+    maskedAverageOfConstantIsZero();
+    maskedAverageMatchesMean();
+    definitionAverageMatchesBuiltIn();
+    if (failures == 0) std::printf("All montage checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// Checks for the polyphase resampler in Utils/SignalProcessor. Returns
+// non-zero on failure.
+#include "../src/Utils/SignalProcessor.h"
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+static int failures = 0;
+
+static void check(bool condition, const char *message) {
+    if (!condition) {
+        std::printf("FAIL: %s\n", message);
+        ++failures;
+    }
+}
+
+static QVector<double> sine(double frequency, double rate, int n) {
+    QVector<double> x(n);
+    for (int i = 0; i < n; ++i) x[i] = std::sin(2.0 * M_PI * frequency * i / rate);
+    return x;
+}
+
+// Zero crossings per second over the samples away from the padded ends
+static double crossingFrequency(const QVector<double> &x, double rate, int margin) {
+    double first = -1.0;
+    double last = -1.0;
+    int crossings = 0;
+    for (int i = margin + 1; i < x.size() - margin; ++i) {
+        if ((x[i - 1] < 0.0) == (x[i] < 0.0)) continue;
+        // Linear interpolation of the crossing time
+        double t = (i - 1 + x[i - 1] / (x[i - 1] - x[i])) / rate;
+        if (first < 0.0) first = t;
+        else ++crossings;
+        last = t;
+    }
+    return crossings > 0 ? crossings / (2.0 * (last - first)) : 0.0;
+}
+
+// A sine keeps its frequency and lines up with the sine sampled at the new rate
+static void sineKeepsItsFrequency() {
+    struct Case { double from; double to; double frequency; };
+    for (const Case &c : {Case{256.0, 100.0, 10.0}, Case{250.0, 1000.0, 37.0}, Case{500.0, 512.0, 60.0},
+                          Case{1000.0, 250.0, 12.5}}) {
+        const int n = static_cast<int>(20 * c.from);
+        QVector<double> y = SignalProcessor::resample(sine(c.frequency, c.from, n), c.from, c.to);
+        QVector<double> expected = sine(c.frequency, c.to, y.size());
+
+        check(y.size() == static_cast<int>(std::ceil(n * c.to / c.from)), "wrong resampled length");
+        int margin = static_cast<int>(c.to);
+        double error = 0.0;
+        for (int i = margin; i < y.size() - margin; ++i) error = std::max(error, std::abs(y[i] - expected[i]));
+        check(error < 1e-3, "resampled sine differs from the sine at the new rate");
+        check(std::abs(crossingFrequency(y, c.to, margin) - c.frequency) < 1e-3 * c.frequency,
+              "resampled sine changed frequency");
+    }
+}
+
+// Content above the new Nyquist rate is filtered out, not folded down
+static void aliasIsSuppressed() {
+    QVector<double> y = SignalProcessor::resample(sine(90.0, 500.0, 10000), 500.0, 100.0);
+    double largest = 0.0;
+    for (int i = 100; i < y.size() - 100; ++i) largest = std::max(largest, std::abs(y[i]));
+    check(largest < 1e-3, "tone above the new Nyquist rate leaks through");
+}
+
+// Uneven blocks through the streaming resampler give the one-shot output
+static void streamMatchesOneShot() {
+    QVector<double> x = sine(7.0, 256.0, 5000);
+    for (int i = 0; i < x.size(); ++i) x[i] += 0.3 * std::sin(0.9 * i);
+    QVector<double> whole = SignalProcessor::resample(x, 25, 64);
+
+    SignalProcessor::Resampler stream(25, 64);
+    QVector<double> pieces;
+    int blocks[] = {1, 17, 300, 64, 999, 2};
+    int at = 0;
+    for (int b = 0; at < x.size(); b = (b + 1) % 6) {
+        int n = std::min(blocks[b], x.size() - at);
+        pieces += stream.process(x.constData() + at, n);
+        at += n;
+    }
+    pieces += stream.flush();
+
+    check(pieces.size() == whole.size(), "stream and one-shot lengths differ");
+    double error = 0.0;
+    for (int i = 0; i < std::min(pieces.size(), whole.size()); ++i) error = std::max(error, std::abs(pieces[i] - whole[i]));
+    check(error < 1e-12, "stream output differs from the one-shot output");
+}
+
+static void ratiosAreReduced() {
+    int up = 0;
+    int down = 0;
+    check(SignalProcessor::resampleRatio(256.0, 100.0, up, down) && up == 25 && down == 64, "256 -> 100 Hz ratio");
+    check(SignalProcessor::resampleRatio(44100.0, 48000.0, up, down) && up == 160 && down == 147, "44.1 -> 48 kHz ratio");
+    check(!SignalProcessor::resampleRatio(0.0, 100.0, up, down), "zero rate accepted");
+}
+
+int main() {
+    sineKeepsItsFrequency();
+    aliasIsSuppressed();
+    streamMatchesOneShot();
+    ratiosAreReduced();
+    if (failures == 0) std::printf("All resampler checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+// Checks for DataModels/ValidityMask and the masked kernels in
+// Utils/SignalProcessor. Returns non-zero on failure.
+#include "../src/DataModels/ValidityMask.h"
+#include "../src/Utils/SignalProcessor.h"
+#include <cstdio>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <utility>
+
+static int failures = 0;
+
+static void check(bool condition, const char *message) {
+    if (!condition) {
+        std::printf("FAIL: %s\n", message);
+        ++failures;
+    }
+}
+
+static const double kNaN = std::numeric_limits<double>::quiet_NaN();
+static const double kInf = std::numeric_limits<double>::infinity();
+
+// Three chunks and a bit, invalid samples in the first and third only
+static QVector<double> gappedSignal() {
+    QVector<double> x(static_cast<int>(3 * ValidityMask::ChunkSize + 100));
+    for (int i = 0; i < x.size(); ++i) x[i] = std::sin(0.01 * i);
+    x[10] = kNaN;
+    x[11] = kNaN;
+    x[12] = kInf;
+    x[2 * ValidityMask::ChunkSize + 63] = -kInf;
+    x[2 * ValidityMask::ChunkSize + 64] = kNaN;
+    return x;
+}
+
+static void scanFindsEveryInvalidSample() {
+    QVector<double> x = gappedSignal();
+    ValidityMask mask = ValidityMask::scan(x);
+    const qint64 chunk = ValidityMask::ChunkSize;
+
+    check(mask.size() == x.size(), "mask size differs from the signal");
+    check(mask.invalidCount() == 5, "wrong invalid sample count");
+    check(mask.chunkCount() == 4, "wrong chunk count");
+    check(!mask.chunkValid(0) && mask.chunkValid(1) && !mask.chunkValid(2) && mask.chunkValid(3),
+          "wrong clean chunks");
+
+    bool agrees = true;
+    for (qint64 i = 0; i < x.size(); ++i) agrees &= mask.isValid(i) == std::isfinite(x[i]);
+    check(agrees, "isValid disagrees with the samples");
+
+    // Chunk-granular: clean chunks pass, any range touching a dirty one fails
+    check(mask.rangeValid(chunk, chunk), "clean chunk reported invalid");
+    check(mask.rangeValid(3 * chunk, 100), "clean tail reported invalid");
+    check(!mask.rangeValid(0, 11), "range with a NaN reported valid");
+    check(!mask.rangeValid(2 * chunk + 64, 1), "single invalid sample reported valid");
+    check(!mask.rangeValid(chunk + 10, chunk), "range reaching a dirty chunk reported valid");
+
+    std::vector<std::pair<qint64, qint64>> runs;
+    mask.forEachInvalidRun([&](qint64 start, qint64 count) { runs.emplace_back(start, count); });
+    check(runs.size() == 2, "wrong number of invalid runs");
+    if (runs.size() == 2) {
+        check(runs[0].first == 10 && runs[0].second == 3, "first run misplaced");
+        check(runs[1].first == 2 * chunk + 63 && runs[1].second == 2, "run across a word boundary misplaced");
+    }
+
+    std::vector<double> weights(20);
+    mask.weights(0, 20, weights.data());
+    bool weighted = true;
+    for (int i = 0; i < 20; ++i) weighted &= weights[i] == (i >= 10 && i <= 12 ? 0.0 : 1.0);
+    check(weighted, "weights do not follow the mask");
+
+    ValidityMask clean = ValidityMask::scan(QVector<double>(1000, 1.0));
+    check(clean.allValid() && clean.rangeValid(0, 1000), "clean signal has invalid samples");
+}
+
+static void bridgeIsLinearAcrossGaps() {
+    QVector<double> x(20);
+    for (int i = 0; i < x.size(); ++i) x[i] = 2.0 * i;
+    x[5] = kNaN;
+    x[6] = kNaN;
+    x[7] = kNaN;
+    x[0] = kNaN;
+    x[19] = kInf;
+    ValidityMask mask = ValidityMask::scan(x);
+
+    SignalProcessor::bridgeInvalid(x.data(), x.size(), mask);
+    bool finite = true;
+    for (double v : x) finite &= std::isfinite(v);
+    check(finite, "bridged signal is not finite");
+    check(std::abs(x[5] - 10.0) < 1e-12 && std::abs(x[6] - 12.0) < 1e-12 && std::abs(x[7] - 14.0) < 1e-12,
+          "interior gap is not bridged linearly");
+    check(x[0] == 2.0 && x[19] == 36.0, "edge gaps do not hold the nearest valid sample");
+
+    SignalProcessor::restoreInvalid(x.data(), x.size(), mask);
+    check(std::isnan(x[0]) && std::isnan(x[6]) && std::isnan(x[19]) && x[4] == 8.0,
+          "restore does not put the gaps back");
+}
+
+static void filterMaskedKeepsGaps() {
+    QVector<double> x = gappedSignal();
+    const QVector<double> original = x;
+    ValidityMask mask = ValidityMask::scan(x);
+
+    // A filter that leaves samples alone must not change any valid one
+    SignalProcessor::filterMasked(x, mask, [](QVector<double> &) {});
+    bool unchanged = true;
+    bool gapsKept = true;
+    for (int i = 0; i < x.size(); ++i) {
+        if (mask.isValid(i)) unchanged &= x[i] == original[i];
+        else gapsKept &= std::isnan(x[i]);
+    }
+    check(unchanged, "masked no-op filter changed valid samples");
+    check(gapsKept, "masked no-op filter filled a gap");
+
+    // The filter sees a finite signal and its output stays NaN in the gaps
+    bool sawFinite = true;
+    SignalProcessor::filterMasked(x, mask, [&](QVector<double> &data) {
+        for (double &v : data) {
+            sawFinite &= std::isfinite(v);
+            v *= 2.0;
+        }
+    });
+    check(sawFinite, "filter saw non-finite samples");
+    unchanged = true;
+    gapsKept = true;
+    for (int i = 0; i < x.size(); ++i) {
+        if (mask.isValid(i)) unchanged &= x[i] == 2.0 * original[i];
+        else gapsKept &= std::isnan(x[i]);
+    }
+    check(unchanged, "masked gain changed valid samples beyond the gain");
+    check(gapsKept, "NaN inside a chunk did not stay NaN after filtering");
+}
+
+int main() {
+    scanFindsEveryInvalidSample();
+    bridgeIsLinearAcrossGaps();
+    filterMaskedKeepsGaps();
+    if (failures == 0) std::printf("All validity mask checks passed\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+// Checks for the lifting transforms in Analysis/Wavelet. Returns non-zero on failure.
+#include "../src/Analysis/Wavelet.h"
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+static int failures = 0;
+
+static void check(bool condition, const char *message) {
+    if (!condition) {
+        std::printf("FAIL: %s\n", message);
+        ++failures;
+    }
+}
+
+// db2 has two vanishing moments, so a ramp leaves no detail except where the
+// periodic wrap joins the ends
+static void rampHasNoDb2Detail() {
+    const int n = 64;
+    std::vector<double> x(n);
+    std::vector<double> scratch(n);
+    for (int i = 0; i < n; ++i) x[i] = 0.5 * i + 3.0;
+    Wavelet::forward(x.data(), n, 1, Wavelet::WaveletDb2, scratch.data());
+
+    double largest = 0.0;
+    for (int k = n / 2 + 1; k < n; ++k) largest = std::max(largest, std::abs(x[k]));
+    check(largest < 1e-12, "db2 detail of a linear ramp is not zero");
+}
+
+static void liftingIsOrthonormal() {
+    const int n = 1024;
+    for (Wavelet::WaveletType type : {Wavelet::WaveletHaar, Wavelet::WaveletDb2}) {
+        std::vector<double> x(n);
+        std::vector<double> scratch(n);
+        for (int i = 0; i < n; ++i) x[i] = std::sin(0.37 * i) + 0.1 * ((i * 7919) % 13);
+        std::vector<double> y = x;
+
+        Wavelet::forward(y.data(), n, 4, type, scratch.data());
+        double before = 0.0;
+        double after = 0.0;
+        for (int i = 0; i < n; ++i) {
+            before += x[i] * x[i];
+            after += y[i] * y[i];
+        }
+        check(std::abs(after / before - 1.0) < 1e-12, "lifting does not preserve energy");
+
+        Wavelet::inverse(y.data(), n, 4, type, scratch.data());
+        double error = 0.0;
+        for (int i = 0; i < n; ++i) error = std::max(error, std::abs(y[i] - x[i]));
+        check(error < 1e-12, "lifting does not reconstruct the input");
+    }
+}
+
+int main() {
+    rampHasNoDb2Detail();
+    liftingIsOrthonormal();
+    if (failures == 0) std::printf("All wavelet checks passed\n");
+    return failures == 0 ? 0 : 1;
+}